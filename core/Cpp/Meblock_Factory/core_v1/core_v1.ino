@@ -1,20 +1,40 @@
 #include <Arduino.h>
+#include <atomic>
 #include <string>
 #include <type_traits>
 #include <utility>
 
-#include <BLEDevice.h>
-#include <BLEServer.h>
-#include <BLEUtils.h>
+// ===== Stack BLE =====
+// NimBLE-Arduino (lib/External_Lib/NimBLE-Arduino) khi đã cài: tốn ít RAM hơn Bluedroid nhiều, và chỉnh được link
+// theo từng kết nối (2M PHY, LL data length 251 byte, interval ngắn). -DMEBLOCK_USE_NIMBLE=0 giữ bản build
+// Bluedroid BLEDevice. Cả 2 dùng chung service, characteristic và giao thức OTA.
+#ifndef MEBLOCK_USE_NIMBLE
+  #if __has_include(<NimBLEDevice.h>)
+    #define MEBLOCK_USE_NIMBLE 1
+  #else
+    #define MEBLOCK_USE_NIMBLE 0
+  #endif
+#endif
+#if MEBLOCK_USE_NIMBLE
+  #include <NimBLEDevice.h>   // map luôn BLEDevice / BLEServer / BLECharacteristic... sang các class NimBLE
+#else
+  #include <BLEDevice.h>
+  #include <BLEServer.h>
+  #include <BLEUtils.h>
+#endif
 #include <Preferences.h>
-#include <Update.h>
 
 #include "IOT47_BLE_OTA.h"
+#include "MeblockCmd.h"
+#include "MeblockBoot.h"
+#include "MeblockSlots.h"
+#include "MeblockAssets.h"
 #include "esp_ota_ops.h"
 #include "esp_partition.h"
 #include "esp_mac.h"
+#include "esp_heap_caps.h"
 
-#if __has_include("esp_gatt_common_api.h")
+#if !MEBLOCK_USE_NIMBLE && __has_include("esp_gatt_common_api.h")
   #include "esp_gatt_common_api.h"
   #define HAVE_ESP_GATT_MTU 1
 #else
@@ -25,6 +45,40 @@
 #include "freertos/queue.h"
 #include "freertos/task.h"
 
+// ===== Chỉnh link NimBLE, yêu cầu khi kết nối (central có thể từ chối bất kỳ mục nào) =====
+#define BLE_LINK_DATA_LEN   251      // payload LL: 1 ATT write 244 byte trong 1 gói radio thay vì 10 gói
+#define BLE_LINK_ITVL_MIN   6        // 7.5 ms (đơn vị 1.25 ms); iOS từ chối < 15 ms và giữ interval riêng
+#define BLE_LINK_ITVL_MAX   12       // 15 ms
+#define BLE_LINK_TIMEOUT    400      // 4 s (đơn vị 10 ms)
+
+// ===== OTA qua kênh L2CAP CoC (chỉ NimBLE) =====
+// Cần stack NimBLE và -DCONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM=1 (nimconfig.h đi kèm để mặc định 0).
+// Bản Bluedroid chỉ có OTA qua GATT write.
+#if MEBLOCK_USE_NIMBLE && defined(CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM) && (CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM > 0)
+  #define MEBLOCK_OTA_L2CAP 1
+#else
+  #define MEBLOCK_OTA_L2CAP 0
+#endif
+#define OTA_L2CAP_PSM      0x0081   // PSM động LE (0x0080..0x00FF)
+#define OTA_L2CAP_WAIT_MS  2000     // chờ tối đa khi ring RX đầy trước khi bỏ SDU
+
+// ===== OTA qua UART (nối dây, cùng frame / ring RX / writer như BLE) =====
+// "OTA_UART[=<baud>]\n" ở 115200 -> trả "UART OK B=<baud>\r\n", sau đó cổng chuyển sang <baud>.
+// Host -> board: dòng BEGIN ("IOT47_BLE_OTA_BEGIN:...\r\n"), chờ OK, rồi gửi frame thô (dùng ;FC=1 để điều tốc).
+// Board -> host: mọi phản hồi OTA dạng [0x00][len_hi][len_lo][payload] (độ dài 16-bit big-endian).
+// Log dùng chung cổng nhưng không bao giờ chứa 0x00.
+// "OTA_UART_EXIT\n" (giữa 2 phiên) hoặc OTA_UART_IDLE_MS không có dữ liệu => thoát chế độ này.
+#define OTA_UART_BAUD      921600   // mặc định khi OTA_UART không có "=<baud>"
+#define OTA_UART_BAUD_MAX  2000000  // CP2102N / CH343 / USB native; CH340 cũng chỉ tới khoảng 2 Mbaud
+#define OTA_UART_RX_BUF    8192     // buffer RX của driver UART (đặt trước Serial.begin)
+#define OTA_UART_MIN_READ  256      // gom các lần đọc nhỏ: ít record hơn, lớn hơn trong ring RX
+#define OTA_UART_WAIT_MS   2000     // chờ tối đa khi ring RX đầy trước khi bỏ đoạn dữ liệu
+#define OTA_UART_IDLE_MS   10000    // không có byte nào trong khoảng này -> thoát chế độ UART (đang tải = mất kết nối)
+#define OTA_UART_SYNC      0x00
+#define OTA_UART_REPLY_MAX 512      // phản hồi lớn nhất gửi trong 1 lần write (= giá trị ATT lớn nhất, vừa mọi notify BLE)
+
+#define BOOT_LOG_TX_BUF    1024     // UART TX buffer: boot logs no longer block setup() at 115200
+
 Preferences prefs;
 
 // ===== Cấu hình MEBLOCK =====
@@ -33,22 +87,74 @@ static const char *KEY_NAME       = "name";
 static const char *MEBLOCK_PREFIX = "MEBLOCK-";
 
 String g_bleName;                 // tên BLE hiện tại
+static bool s_nameSavePending = false;   // tên mặc định / đã chuẩn hoá: ghi NVS sau khi quảng bá
+
+// Slot đích cho lần tải kế tiếp (SLOT=<n>[,<tên>]); 0 => phân vùng OTA kế tiếp (app1) như cũ
+static uint8_t s_slotTarget = 0;
+static char s_slotName[MEBLOCK_SLOT_NAME_MAX + 1] = "";
 BLECharacteristic *pOtaCharacteristic = nullptr;
 
-// Buffer lệnh UART (text)
-String gSerialCmdBuf;
+// Buffer lệnh UART (text, cố định)
+static MeblockLineBuf s_serialLine;
 
 // ===== OTA RX buffering (tăng tốc + tránh nghẽn callback BLE) =====
-// Lưu ý: iot47_ota_task nhận len kiểu uint8_t => tối đa 255 bytes mỗi "write".
-static const uint16_t OTA_POOL_ITEM_SIZE = 255;   // tối đa dữ liệu enqueue mỗi gói
-static const uint8_t  OTA_POOL_COUNT     = 32;    // tăng nếu muốn (tốn RAM)
-
-static uint8_t  s_otaPool[OTA_POOL_COUNT][OTA_POOL_ITEM_SIZE];
-static uint16_t s_otaLen[OTA_POOL_COUNT];
-
-static QueueHandle_t s_otaFreeQ = nullptr;
-static QueueHandle_t s_otaFillQ = nullptr;
-static volatile bool s_otaQueuesReady = false;
+// Mỗi "write" BLE tối đa 512 bytes (giá trị ATT lớn nhất, MTU 517 - 3) => 1 frame V=2 / 1 write.
+// Ring byte SPSC không khoá: producer = task BLE host (onWrite / L2CAP / disconnect), consumer = ota_worker_task.
+// Mỗi write là 1 record liền mạch [len lo][len hi][data...]; len 0 = mất kết nối, 0xFFFF = quay về đầu ring.
+// Worker được đánh thức bằng task notification và xử lý hết mọi record có sẵn mỗi lần thức.
+static const uint16_t OTA_RX_MAX_WRITE      = IOT47_OTA_FRAME_MAX;   // tối đa dữ liệu mỗi write
+#if MEBLOCK_USE_NIMBLE
+static const uint32_t OTA_RX_RING_SIZE      = 32 * 1024;             // RAM trong (NimBLE để lại nhiều heap hơn Bluedroid)
+#else
+static const uint32_t OTA_RX_RING_SIZE      = 16 * 1024;             // RAM trong
+#endif
+static const uint32_t OTA_RX_RING_SIZE_PSRAM = 128 * 1024;           // S3 có PSRAM
+static const uint32_t OTA_RX_WAIT_MS        = 100;                   // GATT: chờ ring trống trước khi FAIL:BUSY
+static const uint16_t OTA_RX_REC_HDR        = 2;
+static const uint16_t OTA_RX_REC_WRAP       = 0xFFFF;
+
+static uint8_t *s_otaRing = nullptr;
+static uint32_t s_otaRingSize = 0;
+static std::atomic<uint32_t> s_otaRingHead{0};   // chỉ producer ghi
+static std::atomic<uint32_t> s_otaRingTail{0};   // chỉ consumer ghi
+static uint32_t s_otaRingHighWater = 0;          // byte đang chờ lớn nhất
+static uint32_t s_otaRingWaits = 0;              // số lần producer phải chờ ring trống
+static TaskHandle_t s_otaWorker = nullptr;
+static volatile bool s_otaRxReady = false;
+static uint16_t s_attMtu = 23;      // ATT MTU của link GATT (khôi phục khi kênh L2CAP đóng)
+
+// Chế độ OTA UART: loopTask thay task BLE host làm producer duy nhất của ring, phản hồi ra Serial
+static volatile bool s_otaUart = false;
+static uint32_t s_otaUartLastMs = 0;             // lần đọc UART gần nhất
+static uint8_t s_uartLine[IOT47_OTA_FRAME_MAX + 1];  // dòng text (BEGIN / lệnh) trước khi bắt đầu tải
+static uint16_t s_uartLineLen = 0;
+
+// Thông lượng theo kênh truyền (cùng bộ đếm cho GATT write và SDU L2CAP), in ra khi OTA kết thúc
+struct OtaLinkStats {
+  const char *name;
+  uint32_t bytes;
+  uint32_t writes;
+  uint32_t firstMs;
+  uint32_t lastMs;
+};
+static OtaLinkStats s_linkGatt  = { "gatt", 0, 0, 0, 0 };
+static OtaLinkStats s_linkL2cap = { "l2cap", 0, 0, 0, 0 };
+static OtaLinkStats s_linkUart  = { "uart", 0, 0, 0, 0 };
+
+// Pipeline counters for STATS? (reset at BEGIN). Flash side lives in ota_flash_stats (IOT47_OTA_Writer.h).
+struct OtaPipeStats {
+  uint32_t beginMs;
+  uint32_t lastMs;                         // last process callback
+  uint32_t startCur;                       // image bytes already on flash at BEGIN (I= resume)
+  uint32_t cur;                            // image bytes written
+  uint32_t total;
+  uint32_t rxWrites;                       // records handed to the worker
+  uint32_t rxFails;                        // writes dropped: ring still full after the wait (FAIL:BUSY)
+  uint32_t rxUsMax;
+  uint32_t rxHist[IOT47_OTA_HIST_BUCKETS]; // producer time per write (GATT callback / L2CAP SDU / UART chunk), log2 us
+  uint32_t streamResets;                   // reassembler "Bad payload len"
+};
+static OtaPipeStats s_otaStats;
 
 
 // ===== Binary-safe read helper (works with both Bluedroid BLE & NimBLE wrappers) =====
@@ -62,26 +168,31 @@ struct has_getLength : std::false_type {};
 template <typename T>
 struct has_getLength<T, std::void_t<decltype(std::declval<T>().getLength())>> : std::true_type {};
 
-// Copy the most recent written value from characteristic into out[].
-// IMPORTANT: avoids Arduino String truncation on binary data.
-static size_t ble_read_value_bytes(BLECharacteristic *ch, uint8_t *out, size_t outMax) {
-  if (!ch || !out || outMax == 0) return 0;
-
-  // Arduino-ESP32 core 3.x BLE wrapper exposes binary-safe APIs:
-  //   - getData()   -> pointer to value bytes
-  //   - getLength() -> value length in bytes
-  // Using getValue() (String) will truncate when the data contains 0x00 (OTA frames do).
-  const uint8_t *data = (const uint8_t *)ch->getData();
-  size_t len = (size_t)ch->getLength();
-
-  if (!data || len == 0) return 0;
-  if (len > outMax) len = outMax;
-  memcpy(out, data, len);
-  return len;
-}
+// Giá trị vừa ghi vào characteristic, đọc dạng nhị phân (String của getValue() Arduino bị cắt ở byte 0x00).
+// NimBLE: getValue() (API công khai) trả bản sao chép dưới khoá của thư viện => host BLE ghi đè giá trị
+// giữa chừng cũng không làm hỏng frame đang đọc. Bản sao sống tới hết onWrite rồi được copy vào RX ring.
+struct BleRxValue {
+#if MEBLOCK_USE_NIMBLE
+  NimBLEAttValue value;
+  explicit BleRxValue(NimBLECharacteristic *ch) : value(ch ? ch->getValue() : NimBLEAttValue()) {}
+  const uint8_t *data() const { return value.data(); }
+  size_t length() const { return value.length(); }
+#else
+  // Arduino-ESP32 core 3.x: getData() / getLength() đọc thẳng giá trị nhị phân
+  const uint8_t *ptr = nullptr;
+  size_t len = 0;
+  explicit BleRxValue(BLECharacteristic *ch) {
+    if (ch) {
+      ptr = (const uint8_t *)ch->getData();
+      len = (size_t)ch->getLength();
+    }
+  }
+  const uint8_t *data() const { return ptr; }
+  size_t length() const { return len; }
+#endif
+};
 
 
-static bool isMeblockTextCommand(const String &cmd);
 static bool ota_enqueue_from_bytes(const uint8_t *data, uint16_t dataLen, TickType_t waitTicks);
 static void ota_worker_task(void *arg);
 
@@ -90,13 +201,167 @@ static void ota_worker_task(void *arg);
 String generateDefaultNameFromMac();
 String normalizeNameWithPrefix(const String &raw);
 void saveDeviceName(const String &name);
-bool handleMeblockCommand(const String &cmd);
+bool handleMeblockCommand(const char *line, size_t len, MeblockCmdSource src);
 void cmdBootApp1();
+static void ota_uart_enter(uint32_t baud);
 void setupBleName();
+void ota_reply_cb(const uint8_t *data, uint16_t len);
+
+// ===== Bộ đếm thông lượng link =====
+static void ota_link_count(OtaLinkStats *s, size_t n) {
+  uint32_t now = millis();
+  if (s->writes == 0) s->firstMs = now;
+  s->bytes += n;
+  s->writes++;
+  s->lastMs = now;
+}
+
+static void ota_link_reset(OtaLinkStats *s) {
+  s->bytes = 0;
+  s->writes = 0;
+}
+
+static void ota_link_report(OtaLinkStats *s) {
+  if (s->writes == 0) return;
+  uint32_t ms = s->lastMs - s->firstMs;
+  float kbps = (ms > 0) ? ((float)s->bytes / (float)ms) : 0.0f;   // byte/ms == kB/s
+  Serial.printf("[OTA] %s: %lu bytes in %lu writes, %lu ms, %.1f kB/s\n",
+                s->name,
+                (unsigned long)s->bytes,
+                (unsigned long)s->writes,
+                (unsigned long)ms,
+                kbps);
+  ota_link_reset(s);
+}
+
+// ===== Pipeline stats (STATS?) =====
+static void ota_stats_reset() {
+  memset(&s_otaStats, 0, sizeof(s_otaStats));
+  s_otaStats.beginMs = s_otaStats.lastMs = millis();
+  s_otaRingHighWater = 0;
+  s_otaRingWaits = 0;
+}
+
+// Image progress (process callback: every 20 frames, end / error callbacks)
+static void ota_stats_mark(uint32_t cur, uint32_t total) {
+  s_otaStats.cur = cur;
+  s_otaStats.total = total;
+  s_otaStats.lastMs = millis();
+}
+
+static uint32_t ota_stats_bps() {
+  uint32_t ms = s_otaStats.lastMs - s_otaStats.beginMs;
+  uint32_t n = (s_otaStats.cur > s_otaStats.startCur) ? s_otaStats.cur - s_otaStats.startCur : 0;
+  return ms ? (uint32_t)((uint64_t)n * 1000 / ms) : 0;
+}
+
+// One JSON line on Serial: {"st":..,"img":[cur,total],"ms":..,"bps":..,"rx":{..},"flash":{..}}
+static void ota_stats_print(const char *tag) {
+  const iot47_flash_stats_t &f = ota_flash_stats;
+  Serial.printf("%s{\"st\":%lu,\"img\":[%lu,%lu],\"ms\":%lu,\"bps\":%lu,"
+                "\"rx\":{\"n\":%lu,\"fail\":%lu,\"wait\":%lu,\"hw\":%lu,\"ring\":%lu,\"reset\":%lu,\"max\":%lu,\"us\":[",
+                tag, (unsigned long)ota_state, (unsigned long)s_otaStats.cur, (unsigned long)s_otaStats.total,
+                (unsigned long)(s_otaStats.lastMs - s_otaStats.beginMs), (unsigned long)ota_stats_bps(),
+                (unsigned long)s_otaStats.rxWrites, (unsigned long)s_otaStats.rxFails,
+                (unsigned long)s_otaRingWaits, (unsigned long)s_otaRingHighWater, (unsigned long)s_otaRingSize,
+                (unsigned long)s_otaStats.streamResets, (unsigned long)s_otaStats.rxUsMax);
+  for (int i = 0; i < IOT47_OTA_HIST_BUCKETS; i++)
+    Serial.printf(i ? ",%lu" : "%lu", (unsigned long)s_otaStats.rxHist[i]);
+  Serial.printf("]},\"flash\":{\"n\":%lu,\"avg\":%lu,\"max\":%lu,\"ewait\":%lu,\"us\":[",
+                (unsigned long)f.sectors, (unsigned long)(f.sectors ? f.write_us_total / f.sectors : 0),
+                (unsigned long)f.write_us_max, (unsigned long)f.erase_waits);
+  for (int i = 0; i < IOT47_OTA_HIST_BUCKETS; i++)
+    Serial.printf(i ? ",%lu" : "%lu", (unsigned long)f.write_hist[i]);
+  Serial.println("]}}");
+}
+
+static uint8_t *ota_put32(uint8_t *p, uint32_t v) {
+  p[0] = (uint8_t)(v >> 24);
+  p[1] = (uint8_t)(v >> 16);
+  p[2] = (uint8_t)(v >> 8);
+  p[3] = (uint8_t)v;
+  return p + 4;
+}
+
+static uint8_t *ota_put_hist(uint8_t *p, const uint32_t *h) {
+  for (int i = 0; i < IOT47_OTA_HIST_BUCKETS; i++) {
+    uint16_t v = (h[i] > 0xFFFF) ? 0xFFFF : (uint16_t)h[i];
+    *p++ = (uint8_t)(v >> 8);
+    *p++ = (uint8_t)v;
+  }
+  return p;
+}
+
+// Binary STATS reply on the OTA reply channel (BLE notify / UART frame), big-endian like the other notifies:
+// [0x04][ver=1][state] then u32: cur, total, ms, bps, rx writes, rx fails, ring waits, ring high-water,
+// ring size, stream resets, rx max us, flash sectors, flash avg us, flash max us, erase waits
+// then u16 x IOT47_OTA_HIST_BUCKETS: rx histogram, flash histogram (bucket i = [2^i, 2^(i+1)) us)
+static void ota_stats_reply() {
+  const iot47_flash_stats_t &f = ota_flash_stats;
+  uint8_t msg[3 + 15 * 4 + 2 * IOT47_OTA_HIST_BUCKETS * 2];
+  uint8_t *p = msg;
+  *p++ = IOT47_OTA_NTF_STATS;
+  *p++ = 1;
+  *p++ = (uint8_t)ota_state;
+  p = ota_put32(p, s_otaStats.cur);
+  p = ota_put32(p, s_otaStats.total);
+  p = ota_put32(p, s_otaStats.lastMs - s_otaStats.beginMs);
+  p = ota_put32(p, ota_stats_bps());
+  p = ota_put32(p, s_otaStats.rxWrites);
+  p = ota_put32(p, s_otaStats.rxFails);
+  p = ota_put32(p, s_otaRingWaits);
+  p = ota_put32(p, s_otaRingHighWater);
+  p = ota_put32(p, s_otaRingSize);
+  p = ota_put32(p, s_otaStats.streamResets);
+  p = ota_put32(p, s_otaStats.rxUsMax);
+  p = ota_put32(p, f.sectors);
+  p = ota_put32(p, f.sectors ? f.write_us_total / f.sectors : 0);
+  p = ota_put32(p, f.write_us_max);
+  p = ota_put32(p, f.erase_waits);
+  p = ota_put_hist(p, s_otaStats.rxHist);
+  p = ota_put_hist(p, f.write_hist);
+  ota_reply_cb(msg, (uint16_t)(p - msg));
+}
 
 // ===== OTA callbacks =====
 void ota_begin_cb(uint32_t cur, uint32_t total) {
   Serial.println("[OTA] Begin OTA...");
+  ota_link_reset(&s_linkGatt);
+  ota_link_reset(&s_linkL2cap);
+  ota_link_reset(&s_linkUart);
+  ota_stats_reset();
+  s_otaStats.startCur = s_otaStats.cur = iot47_image_written();
+  s_otaStats.total = total;
+  // Ảnh cũ trong slot sắp bị ghi đè: metadata chỉ ghi lại khi tải xong
+  if (!ota_asset) meblock_slot_clear(meblock_slot_of(ota_wr_part));
+}
+
+// Metadata slot vừa tải xong (SHA-256 chỉ có khi host gửi H=)
+static void ota_slot_record(uint32_t size) {
+  uint8_t n = meblock_slot_of(ota_wr_part);
+  if (n == 0) return;
+  MeblockSlotInfo info;
+  memset(&info, 0, sizeof(info));
+  info.size = size;
+  if (ota_wr_verified) memcpy(info.sha, ota_wr_expect, sizeof(info.sha));
+  strncpy(info.name, s_slotName, MEBLOCK_SLOT_NAME_MAX);
+  meblock_slot_set(n, &info);
+}
+
+// BEGIN có H=: ảnh đã nằm trong chính slot đích (SLOT=<n>, chưa chọn thì phân vùng mặc định của lần tải tiếp theo)
+// => boot luôn, không tải lại. Slot khác có cùng ảnh không tính: tải thường không được ngầm đổi sang slot khác
+static const esp_partition_t *ota_slot_match(const uint8_t sha[32], uint32_t size) {
+  uint8_t n = s_slotTarget ? s_slotTarget : meblock_slot_of(esp_ota_get_next_update_partition(nullptr));
+  return (n && meblock_slot_holds(n, sha, size)) ? meblock_slot_partition(n) : nullptr;
+}
+
+// BEGIN có N=<tên>: file asset vào LittleFS (spiffs / ffat) thay vì phân vùng app
+// Lần đầu trên board (phân vùng trống hẳn): format ở đây, trong OTA worker task. Fallback không có RX ring thì
+// BEGIN đang chạy trong callback BLE => không format (vài giây), dùng FILES_FORMAT.
+static int ota_asset_open(const char *name, uint32_t size, const uint8_t *sha) {
+  if (!meblock_assets_begin() && !(s_otaRxReady && meblock_assets_format(false))) return IOT47_ASSET_FAIL;
+  if (meblock_asset_holds(name, sha, size)) return IOT47_ASSET_SAME;
+  return meblock_asset_upload_open(name, size) ? IOT47_ASSET_OPEN : IOT47_ASSET_FAIL;
 }
 
 void ota_process_cb(uint32_t cur, uint32_t total) {
@@ -105,6 +370,8 @@ void ota_process_cb(uint32_t cur, uint32_t total) {
   static uint32_t lastCur = 0;
 
   uint32_t now = millis();
+  ota_stats_mark(cur, total);
+
   bool timeHit = (now - lastMs) >= 250;      // log ~4 lần/giây
   bool stepHit = (cur - lastCur) >= 8192;    // hoặc mỗi 8KB
   bool done    = (total > 0 && cur >= total);
@@ -120,13 +387,50 @@ void ota_process_cb(uint32_t cur, uint32_t total) {
   }
 }
 void ota_end_cb(uint32_t cur, uint32_t total) {
+  ota_link_report(&s_linkGatt);
+  ota_link_report(&s_linkL2cap);
+  ota_link_report(&s_linkUart);
+  ota_stats_mark(cur, total);
+  ota_stats_print("[OTA] stats: ");
+  if (ota_asset) {
+    Serial.printf("[OTA] File %s saved, ready for the next upload\n", ota_asset_name);
+    return;
+  }
+  ota_slot_record(total);
   Serial.println("[OTA] Download done, restarting to new firmware...");
 }
 
 void ota_error_cb(uint32_t cur, uint32_t total) {
+  ota_link_report(&s_linkGatt);
+  ota_link_report(&s_linkL2cap);
+  ota_link_report(&s_linkUart);
+  ota_stats_mark(cur, total);
+  ota_stats_print("[OTA] stats: ");
   Serial.println("[OTA] Download error!");
 }
 
+// Phản hồi OTA: notify trên characteristic OTA, hoặc frame [0x00][len_hi][len_lo][payload] khi ở chế độ UART
+void ota_reply_cb(const uint8_t *data, uint16_t len) {
+  if (s_otaUart) {
+    uint8_t buf[3 + OTA_UART_REPLY_MAX];
+    buf[0] = OTA_UART_SYNC;
+    buf[1] = (uint8_t)(len >> 8);
+    buf[2] = (uint8_t)len;
+    if (len <= OTA_UART_REPLY_MAX) {
+      memcpy(&buf[3], data, len);
+      Serial.write(buf, 3 + len);   // 1 lần write => không bị xen với dòng log
+    } else {
+      Serial.write(buf, 3);         // không cắt bớt; chỉ trường hợp quá cỡ này mới có thể xen với dòng log
+      Serial.write(data, len);
+    }
+    return;
+  }
+  if (pOtaCharacteristic) {
+    pOtaCharacteristic->setValue((uint8_t *)data, len);
+    pOtaCharacteristic->notify();
+  }
+}
+
 // ===== Sinh tên default theo MAC: MEBLOCK-XXYYZZ =====
 String generateDefaultNameFromMac() {
   uint8_t mac[6];
@@ -185,117 +489,289 @@ void cmdBootApp1() {
   esp_err_t err = esp_ota_set_boot_partition(app1);
   if (err == ESP_OK) {
     Serial.println("[MEBLOCK] Restarting to app1...");
-    delay(200);
-    ESP.restart();
+    meblock_restart();
   } else {
     Serial.printf("[MEBLOCK] ERROR: esp_ota_set_boot_partition failed, err=%d\n", (int)err);
   }
 }
 
 
-// Xử lý lệnh text của MEBLOCK (dùng chung BLE + UART)
-bool handleMeblockCommand(const String &cmdIn) {
-  String cmd = cmdIn;
-  cmd.trim();
+// ===== Lệnh text MEBLOCK (dùng chung BLE + UART, bảng hằng, không cấp phát heap) =====
+// Thống kê pipeline OTA: JSON trên Serial + bản nhị phân [0x04]... trên kênh trả lời OTA (BLE / OTA_UART)
+static void cmdStats(const char *arg, MeblockCmdSource src) {
+  (void)arg;
+  ota_stats_print("[MEBLOCK] STATS = ");
+  if (src == MEBLOCK_CMD_SRC_BLE || s_otaUart) ota_stats_reply();
+}
+
+// Hỏi tên hiện tại
+static void cmdNameQuery(const char *arg, MeblockCmdSource src) {
+  (void)arg;
+  (void)src;
+  Serial.print("[MEBLOCK] NAME = ");
+  Serial.println(g_bleName);
+}
+
+// Đổi tên: NAME=<suffix> hoặc NAME=MEBLOCK-XXXX (NAME= / NAME=RESET => tên mặc định theo MAC)
+static void cmdNameSet(const char *arg, MeblockCmdSource src) {
+  (void)src;
+  if (arg[0] == '\0' || strcasecmp(arg, "RESET") == 0) {
+    saveDeviceName(generateDefaultNameFromMac());
+  } else {
+    saveDeviceName(String(arg));
+  }
+
+  Serial.println("[MEBLOCK] Name changed, rebooting to apply BLE name...");
+  meblock_restart();
+}
+
+// Trả lời lệnh (SLOTS? / FILES? ...) qua kênh OTA (BLE / OTA_UART), mỗi dòng 1 lần gửi
+static void cmd_reply_line(const char *line) {
+  iot47_ota_reply(line);
+}
+
+// SLOTS?: "SLOTS <số slot> boot=<slot>" + mỗi slot "SLOT <n> <label> <size> <sha 8 byte đầu> <tên>" / "... empty"
+static void cmdSlots(const char *arg, MeblockCmdSource src) {
+  (void)arg;
+  meblock_slot_list((src == MEBLOCK_CMD_SRC_BLE || s_otaUart) ? cmd_reply_line : nullptr);
+}
 
-  // Hỏi tên hiện tại
-  if (cmd.equalsIgnoreCase("NAME?")) {
-    Serial.print("[MEBLOCK] NAME = ");
-    Serial.println(g_bleName);
-    return true;
+// SLOT=<n>[,<tên>]: các lần tải sau ghi vào slot n (SLOT=0 => mặc định app1)
+static void cmdSlotTarget(const char *arg, MeblockCmdSource src) {
+  char *name = nullptr;
+  uint8_t n = (uint8_t)strtoul(arg, &name, 10);
+  const esp_partition_t *p = meblock_slot_partition(n);
+  bool ok = (n == 0) || (p && p != esp_ota_get_running_partition());
+  if (ok) {
+    while (*name == ',' || *name == ' ') name++;
+    s_slotTarget = n;
+    strncpy(s_slotName, name, MEBLOCK_SLOT_NAME_MAX);
+    s_slotName[MEBLOCK_SLOT_NAME_MAX] = '\0';
+    iot47_writer_set_target(n ? p : nullptr);
   }
+  char line[48];
+  if (ok) snprintf(line, sizeof(line), "SLOT OK %u\r\n", (unsigned)n);
+  else snprintf(line, sizeof(line), "SLOT FAIL %u\r\n", (unsigned)n);
+  Serial.print(line);
+  if (src == MEBLOCK_CMD_SRC_BLE || s_otaUart) iot47_ota_reply(line);
+}
+
+// BOOT_SLOT=<n>: đổi chương trình = chọn slot n rồi restart
+static void cmdBootSlot(const char *arg, MeblockCmdSource src) {
+  (void)src;
+  if (!meblock_slot_select((uint8_t)strtoul(arg, nullptr, 10))) return;
+  meblock_restart();
+}
 
-  // Boot sang app1
-  if (cmd.equalsIgnoreCase("BOOT_APP1") || cmd.equalsIgnoreCase("APP1")) {
-    cmdBootApp1();
-    return true;
+static volatile bool s_assetFormatPending = false;   // FILES_FORMAT từ BLE, loop() thực hiện
+
+static void files_format_now(bool reply) {
+  char line[32];
+  snprintf(line, sizeof(line), "FILES_FORMAT %s\r\n", meblock_assets_format(true) ? "OK" : "FAIL");
+  Serial.print(line);
+  if (reply) iot47_ota_reply(line);
+}
+
+// FILES?: "FILES <số file> <phân vùng> used=<byte> total=<byte>" + mỗi file "FILE <tên> <size>"
+static void cmdFiles(const char *arg, MeblockCmdSource src) {
+  (void)arg;
+  meblock_asset_list((src == MEBLOCK_CMD_SRC_BLE || s_otaUart) ? cmd_reply_line : nullptr);
+}
+
+// FILE_SHA=<tên>: "FILE_SHA <tên> <sha256 hex> <size>" hoặc "FILE_SHA <tên> none"
+static void cmdFileSha(const char *arg, MeblockCmdSource src) {
+  meblock_asset_print_sha(arg, (src == MEBLOCK_CMD_SRC_BLE || s_otaUart) ? cmd_reply_line : nullptr);
+}
+
+// FILE_DEL=<tên>: xoá asset
+static void cmdFileDel(const char *arg, MeblockCmdSource src) {
+  char line[MEBLOCK_CMD_MAX + 24];
+  snprintf(line, sizeof(line), "FILE_DEL %s %s\r\n", meblock_asset_remove(arg) ? "OK" : "FAIL", arg);
+  Serial.print(line);
+  if (src == MEBLOCK_CMD_SRC_BLE || s_otaUart) iot47_ota_reply(line);
+}
+
+// FILES_FORMAT: xoá sạch phân vùng asset và format LittleFS (mất mọi dữ liệu trên spiffs / ffat).
+// Từ BLE: chạy ở loop() (format mất vài giây, không chặn host BLE)
+static void cmdFilesFormat(const char *arg, MeblockCmdSource src) {
+  (void)arg;
+  if (src == MEBLOCK_CMD_SRC_BLE) {
+    s_assetFormatPending = true;
+    return;
   }
+  files_format_now(s_otaUart);
+}
 
-  // Đổi tên: NAME=<suffix> hoặc NAME=MEBLOCK-XXXX
-  if (cmd.startsWith("NAME=")) {
-    String value = cmd.substring(5);
-    value.trim();
+// Timeline khởi động (Serial)
+static void cmdBootTimeline(const char *arg, MeblockCmdSource src) {
+  (void)arg;
+  (void)src;
+  meblock_boot_dump();
+}
 
-    if (value.length() == 0 || value.equalsIgnoreCase("RESET")) {
-      String defName = generateDefaultNameFromMac();
-      saveDeviceName(defName);
-    } else {
-      saveDeviceName(value);
-    }
+// Boot sang app1
+static void cmdApp1(const char *arg, MeblockCmdSource src) {
+  (void)arg;
+  (void)src;
+  cmdBootApp1();
+}
 
-    Serial.println("[MEBLOCK] Name changed, rebooting to apply BLE name...");
-    delay(200);
-    ESP.restart();
-    return true;
+// OTA_UART[=<baud>]: chuyển sang chế độ OTA binary qua UART (chỉ từ UART)
+static void cmdOtaUart(const char *arg, MeblockCmdSource src) {
+  if (src != MEBLOCK_CMD_SRC_UART || s_otaUart) {
+    Serial.println("[MEBLOCK] OTA_UART ignored (UART text mode only)");
+    return;
   }
+  ota_uart_enter(arg[0] ? (uint32_t)strtoul(arg, nullptr, 10) : OTA_UART_BAUD);
+}
+
+static const MeblockCmd kMeblockCmds[] = {
+  { "STATS?",     cmdStats },
+  { "BOOT?",      cmdBootTimeline },
+  { "SLOTS?",     cmdSlots },
+  { "SLOT=",      cmdSlotTarget },
+  { "BOOT_SLOT=", cmdBootSlot },
+  { "FILES?",     cmdFiles },
+  { "FILE_SHA=",  cmdFileSha },
+  { "FILE_DEL=",  cmdFileDel },
+  { "FILES_FORMAT", cmdFilesFormat },
+  { "NAME?",      cmdNameQuery },
+  { "NAME=",      cmdNameSet },
+  { "BOOT_APP1",  cmdApp1 },
+  { "APP1",       cmdApp1 },
+  { "OTA_UART",   cmdOtaUart },
+  { "OTA_UART=",  cmdOtaUart },
+};
 
-  return false;
+// line: đã trim, kết thúc '\0'. false => không phải lệnh MEBLOCK
+bool handleMeblockCommand(const char *line, size_t len, MeblockCmdSource src) {
+  return meblock_cmd_dispatch(kMeblockCmds, MEBLOCK_CMD_COUNT(kMeblockCmds), line, len, src);
 }
 
-// Load / init tên BLE từ NVS
+// Load / init tên BLE từ NVS (chỉ đọc; ghi lại tên nếu cần ở saveBleNameDeferred())
 void setupBleName() {
   prefs.begin(MEBLOCK_NS, false);
 
   String saved = prefs.getString(KEY_NAME, "");
   if (saved.length() == 0) {
     g_bleName = generateDefaultNameFromMac();
-    prefs.putString(KEY_NAME, g_bleName);
+    s_nameSavePending = true;
     Serial.print("[MEBLOCK] No stored name, using default from MAC: ");
     Serial.println(g_bleName);
   } else {
     g_bleName = normalizeNameWithPrefix(saved);
-    if (g_bleName != saved) {
-      prefs.putString(KEY_NAME, g_bleName);
-    }
+    s_nameSavePending = (g_bleName != saved);
     Serial.print("[MEBLOCK] Loaded stored name: ");
     Serial.println(g_bleName);
   }
 }
 
+// Ghi tên vào NVS sau khi đã quảng bá (ghi flash không nằm trên đường tới trạng thái connectable)
+void saveBleNameDeferred() {
+  if (!s_nameSavePending) return;
+  s_nameSavePending = false;
+  prefs.putString(KEY_NAME, g_bleName);
+  Serial.print("[MEBLOCK] Stored name: ");
+  Serial.println(g_bleName);
+}
+
 
 // ===== Helpers for OTA buffering =====
-static bool isMeblockTextCommand(const String &cmd) {
-  if (cmd.length() == 0) return false;
-  if (cmd.startsWith("NAME=")) return true;
-  if (cmd.equalsIgnoreCase("NAME?")) return true;
-  if (cmd.equalsIgnoreCase("BOOT_APP1")) return true;
-  if (cmd.equalsIgnoreCase("APP1")) return true;
-  return false;
+// Byte đang chờ worker trong ring
+static uint32_t ota_ring_used(uint32_t head, uint32_t tail) {
+  return (head >= tail) ? (head - tail) : (s_otaRingSize - tail + head);
 }
 
-static bool ota_enqueue_from_bytes(const uint8_t *data, uint16_t dataLen, TickType_t waitTicks) {
-  if (!s_otaQueuesReady || !s_otaFreeQ || !s_otaFillQ) return false;
-
-  uint8_t idx = 0xFF;
-  if (xQueueReceive(s_otaFreeQ, &idx, waitTicks) != pdTRUE) {
-    return false;
+// Producer: ghi 1 record liền mạch, false nếu ring không đủ chỗ (head không bao giờ đuổi kịp tail)
+static bool ota_ring_push(const uint8_t *data, uint16_t n) {
+  uint32_t need = OTA_RX_REC_HDR + n;
+  uint32_t head = s_otaRingHead.load(std::memory_order_relaxed);
+  uint32_t tail = s_otaRingTail.load(std::memory_order_acquire);
+  uint32_t at;
+  if (head >= tail) {
+    uint32_t toEnd = s_otaRingSize - head;
+    if ((toEnd > need) || (toEnd == need && tail != 0)) {
+      at = head;
+    } else if (need < tail) {
+      // không đủ chỗ tới cuối ring => đánh dấu quay về đầu (consumer tự quay nếu còn < 2 byte)
+      if (toEnd >= OTA_RX_REC_HDR) {
+        uint16_t wrap = OTA_RX_REC_WRAP;
+        memcpy(&s_otaRing[head], &wrap, OTA_RX_REC_HDR);
+      }
+      at = 0;
+    } else {
+      return false;
+    }
+  } else {
+    if (head + need >= tail) return false;
+    at = head;
   }
 
-  uint16_t n = dataLen;
-  if (n > OTA_POOL_ITEM_SIZE) n = OTA_POOL_ITEM_SIZE;
+  memcpy(&s_otaRing[at], &n, OTA_RX_REC_HDR);
+  if (n) memcpy(&s_otaRing[at + OTA_RX_REC_HDR], data, n);
+  uint32_t next = at + need;
+  if (next == s_otaRingSize) next = 0;
+  s_otaRingHead.store(next, std::memory_order_release);
 
-  memcpy(s_otaPool[idx], data, n);
-  s_otaLen[idx] = n;
-  // Ensure 0-termination for text parsing inside iot47 (safe even for binary because len is passed)
-  if (n < OTA_POOL_ITEM_SIZE) s_otaPool[idx][n] = 0;
+  uint32_t used = ota_ring_used(next, tail);
+  if (used > s_otaRingHighWater) s_otaRingHighWater = used;
+  return true;
+}
+
+// Đưa 1 write vào ring và đánh thức worker. dataLen 0 = báo mất kết nối
+static bool ota_enqueue_from_bytes(const uint8_t *data, uint16_t dataLen, TickType_t waitTicks) {
+  if (!s_otaRxReady) return false;
 
-  if (xQueueSend(s_otaFillQ, &idx, waitTicks) != pdTRUE) {
-    // trả block về free nếu gửi vào fillQ thất bại
-    xQueueSend(s_otaFreeQ, &idx, 0);
-    return false;
+  uint16_t n = dataLen;
+  if (n > OTA_RX_MAX_WRITE) n = OTA_RX_MAX_WRITE;
+
+  uint32_t us0 = micros();
+  if (!ota_ring_push(data, n)) {
+    // Ring đầy (hiếm: worker xử lý hết mọi record mỗi lần thức) => chờ worker nhả chỗ
+    s_otaRingWaits++;
+    TickType_t t0 = xTaskGetTickCount();
+    do {
+      if ((xTaskGetTickCount() - t0) >= waitTicks) {
+        s_otaStats.rxFails++;
+        return false;
+      }
+      vTaskDelay(1);
+    } while (!ota_ring_push(data, n));
   }
+  xTaskNotifyGive(s_otaWorker);
 
+  uint32_t us = micros() - us0;
+  s_otaStats.rxWrites++;
+  if (us > s_otaStats.rxUsMax) s_otaStats.rxUsMax = us;
+  iot47_hist_add(s_otaStats.rxHist, us);
   return true;
 }
 
+// FC=1: số frame frameBytes chứa vừa ring khi trống (= credit ban đầu của host).
+// Mỗi write chứa 1 phần frame tốn thêm 1 header record; chừa chỗ bỏ trống khi quay vòng
+// và record worker đang xử lý (frame được tính xong trước khi record được nhả).
+static uint16_t ota_rx_credit_frames(uint16_t frameBytes) {
+  uint16_t wmax = (ota_att_mtu > 3) ? (uint16_t)(ota_att_mtu - 3) : 20;
+  if (wmax > OTA_RX_MAX_WRITE) wmax = OTA_RX_MAX_WRITE;
+  uint32_t cost = frameBytes + OTA_RX_REC_HDR * ((frameBytes + wmax - 1) / wmax + 1);
+  uint32_t reserve = 2 * (OTA_RX_REC_HDR + OTA_RX_MAX_WRITE) + 1;
+  if (!s_otaRxReady || s_otaRingSize <= reserve + cost) return 0;
+  return (uint16_t)((s_otaRingSize - reserve) / cost);
+}
 
-// ---------------- OTA stream reassembly (handles BLE fragmentation) ----------------
-// Protocol frame (binary): [pkt_hi][pkt_lo][len_hi][len_lo][payload...]
-// Total frame length = 4 + payload_len, must be <= 255 (iot47_ota_task uses uint8_t len)
 
-static uint8_t s_rxFrame[256];      // +1 for optional terminator
-static uint16_t s_rxHave = 0;       // bytes currently in frame buffer
-static uint16_t s_rxNeed = 0;       // total bytes needed for current frame (0 => header not complete yet)
+// ---------------- OTA stream reassembly (handles BLE fragmentation) ----------------
+// Protocol frame (binary): [pkt_hi][pkt_lo][len_hi][len_lo][payload...][crc16 when C=1]
+// Total frame length = 4 + payload_len + iot47_ota_frame_trailer(), must be <= iot47_ota_max_frame()
+// (255 for legacy hosts, up to 512 when the host negotiated V=2 in the BEGIN header)
+//
+// Only the 4-byte header is copied; payload bytes go straight from the RX ring into
+// iot47_frame_data() (-> flash sector buffer), even when a frame spans several writes.
+
+static uint8_t s_rxText[IOT47_OTA_FRAME_MAX + 1];       // text control line (+1 terminator)
+static uint8_t s_rxHdr[4];
+static uint16_t s_rxHave = 0;       // header bytes received for current frame
+static uint16_t s_rxNeed = 0;       // payload (+ CRC) bytes still expected (valid once header complete)
 
 static inline bool is_printable_ascii(uint8_t c) {
   return (c >= 0x20 && c <= 0x7E);
@@ -309,25 +785,27 @@ static void ota_stream_reset() {
 static void ota_stream_feed(const uint8_t *data, uint16_t len) {
   while (len > 0) {
     // If we're not currently building a binary frame and the chunk looks like text, pass through directly
-    if (s_rxHave == 0 && s_rxNeed == 0) {
+    if (s_rxHave == 0) {
       // Typical control lines: "IOT47_BLE_OTA_BEGIN:xxxxx\r\n", "IOT47_BLE_OTA_END\r\n"
       // They start with printable ASCII, whereas binary frames usually start with 0x00 (packet high byte).
-      if (is_printable_ascii(data[0])) {
-        uint16_t n = (len > 255) ? 255 : len;
-        memcpy(s_rxFrame, data, n);
-        s_rxFrame[n] = 0; // safe terminator for text parsing
-        (void)iot47_ota_task((uint8_t *)s_rxFrame, (uint8_t)n);
+      // While downloading only frames are valid: packet numbers >= 0x2000 have a printable high byte.
+      // A new BEGIN line is still accepted (reconnect before the old session was stopped).
+      if ((ota_state != OTA_DOWNLOADDING && is_printable_ascii(data[0])) || iot47_ota_is_begin(data, len)) {
+        uint16_t n = (len > IOT47_OTA_FRAME_MAX) ? IOT47_OTA_FRAME_MAX : len;
+        memcpy(s_rxText, data, n);
+        s_rxText[n] = 0; // safe terminator for text parsing
+        (void)iot47_ota_task((uint8_t *)s_rxText, n);
         // Consume all (we assume a single text command per write)
         return;
       }
     }
 
     // Binary frame reassembly
-    if (s_rxNeed == 0) {
+    if (s_rxHave < 4) {
       // Need at least header (4 bytes)
       uint16_t needHdr = 4 - s_rxHave;
       uint16_t take = (len < needHdr) ? len : needHdr;
-      memcpy(s_rxFrame + s_rxHave, data, take);
+      memcpy(s_rxHdr + s_rxHave, data, take);
       s_rxHave += take;
       data += take;
       len  -= take;
@@ -336,28 +814,31 @@ static void ota_stream_feed(const uint8_t *data, uint16_t len) {
         continue; // still waiting for full header
       }
 
-      uint16_t payloadLen = ((uint16_t)s_rxFrame[2] << 8) | (uint16_t)s_rxFrame[3];
-      // iot47_ota_task len is uint8_t => total <= 255 => payload <= 251
-      if (payloadLen > 251) {
+      uint16_t packet     = ((uint16_t)s_rxHdr[0] << 8) | (uint16_t)s_rxHdr[1];
+      uint16_t payloadLen = ((uint16_t)s_rxHdr[2] << 8) | (uint16_t)s_rxHdr[3];
+      uint16_t trailer    = iot47_ota_frame_trailer();
+      if (payloadLen + trailer > iot47_ota_max_frame() - 4) {
         Serial.printf("[OTA] Bad payload len=%u -> drop/reset\n", (unsigned)payloadLen);
+        s_otaStats.streamResets++;
         ota_stream_reset();
         continue;
       }
-      s_rxNeed = 4 + payloadLen;
+      s_rxNeed = payloadLen + trailer;
+      iot47_frame_begin(packet, payloadLen);
+    }
+
+    // Stream payload bytes (no intermediate frame copy)
+    uint16_t take = (len < s_rxNeed) ? len : s_rxNeed;
+    if (take > 0) {
+      iot47_frame_data(data, take);
+      s_rxNeed -= take;
+      data += take;
+      len  -= take;
     }
 
-    // Copy payload bytes
-    uint16_t remain = s_rxNeed - s_rxHave;
-    uint16_t take = (len < remain) ? len : remain;
-    memcpy(s_rxFrame + s_rxHave, data, take);
-    s_rxHave += take;
-    data += take;
-    len  -= take;
-
-    if (s_rxHave == s_rxNeed) {
-      // Got full frame -> feed to OTA task
-      s_rxFrame[s_rxHave] = 0; // safe terminator (doesn't change len passed)
-      (void)iot47_ota_task((uint8_t *)s_rxFrame, (uint8_t)s_rxHave);
+    if (s_rxNeed == 0) {
+      // Got full frame -> let OTA commit it
+      (void)iot47_frame_end();
       ota_stream_reset();
     }
   }
@@ -365,61 +846,87 @@ static void ota_stream_feed(const uint8_t *data, uint16_t len) {
 
 static void ota_worker_task(void *arg) {
   (void)arg;
-  uint8_t idx = 0;
 
-  // Process OTA fragments from queue and reassemble into full frames
+  // Process every OTA write available in the ring per wakeup and reassemble into full frames
   for (;;) {
-    if (xQueueReceive(s_otaFillQ, &idx, portMAX_DELAY) == pdTRUE) {
-      uint16_t n = s_otaLen[idx];
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    uint32_t tail = s_otaRingTail.load(std::memory_order_relaxed);
+    while (tail != s_otaRingHead.load(std::memory_order_acquire)) {
+      uint16_t n = OTA_RX_REC_WRAP;
+      if (s_otaRingSize - tail >= OTA_RX_REC_HDR) memcpy(&n, &s_otaRing[tail], OTA_RX_REC_HDR);
+      if (n == OTA_RX_REC_WRAP) {
+        tail = 0;
+        continue;
+      }
+
       if (n > 0) {
-        ota_stream_feed((const uint8_t *)s_otaPool[idx], n);
+        ota_stream_feed(&s_otaRing[tail + OTA_RX_REC_HDR], n);
+      } else {
+        // Empty item = link lost: drop partial frame, stop OTA (checkpoint kept for resume)
+        ota_stream_reset();
+        if (ota_state == OTA_DOWNLOADDING) {
+          Serial.println("[OTA] BLE disconnected -> OTA stopped");
+          iot47_stop_ota();
+        }
       }
-      // return block to pool
-      xQueueSend(s_otaFreeQ, &idx, 0);
-      //taskYIELD();
-      vTaskDelay(1);
+      // trả chỗ cho producer ngay sau mỗi record
+      tail += OTA_RX_REC_HDR + n;
+      if (tail == s_otaRingSize) tail = 0;
+      s_otaRingTail.store(tail, std::memory_order_release);
     }
   }
 }
 
 
-// ===== BLE callbacks – dùng Arduino String (core ESP32 v3) =====
+// ===== BLE callbacks =====
 class MyCallbacks : public BLECharacteristicCallbacks {
+#if MEBLOCK_USE_NIMBLE
+  void onWrite(NimBLECharacteristic *pCharacteristic, NimBLEConnInfo &connInfo) override {
+    (void)connInfo;
+#else
   void onWrite(BLECharacteristic *pCharacteristic) override {
-    uint8_t rxBuf[OTA_POOL_ITEM_SIZE];
-    size_t rxLen = ble_read_value_bytes(pCharacteristic, rxBuf, sizeof(rxBuf));
-    if (rxLen == 0) return;
+#endif
+    BleRxValue rx(pCharacteristic);
+    const uint8_t *rxBuf = rx.data();
+    size_t rxLen = rx.length();
+    if (!rxBuf || rxLen == 0) return;
+    if (rxLen > OTA_RX_MAX_WRITE) rxLen = OTA_RX_MAX_WRITE;
+    ota_link_count(&s_linkGatt, rxLen);
 
     // Text commands always start with a letter (A-Z / a-z).
     bool startsWithLetter =
         ((rxBuf[0] >= 'A' && rxBuf[0] <= 'Z') || (rxBuf[0] >= 'a' && rxBuf[0] <= 'z'));
 
-    if (startsWithLetter) {
-      String cmd;
-      cmd.reserve(rxLen + 1);
-      for (size_t i = 0; i < rxLen; i++) cmd += (char)rxBuf[i];
-      cmd.trim();
+    if (startsWithLetter && rxLen <= MEBLOCK_CMD_MAX) {
+      char line[MEBLOCK_CMD_MAX + 1];
+      memcpy(line, rxBuf, rxLen);
+      size_t n = rxLen;
+      char *cmd = meblock_cmd_trim(line, &n);
 
       // Nếu là lệnh text MEBLOCK => xử lý ngay (ưu tiên)
-      if (isMeblockTextCommand(cmd)) {
+      if (handleMeblockCommand(cmd, n, MEBLOCK_CMD_SRC_BLE)) {
         Serial.print("[BLE] CMD = '");
         Serial.print(cmd);
-        Serial.println("'");
-
-        if (handleMeblockCommand(cmd)) {
-          Serial.println("[BLE] Command processed.");
-        } else {
-          Serial.println("[BLE] Unknown or invalid command (ignored).");
-        }
+        Serial.println("' processed.");
         return;
       }
       // Không phải command MEBLOCK => có thể là OTA control string (BEGIN/END/...)
       // -> rơi xuống xử lý OTA bên dưới (binary-safe)
     }
 
+    // UART OTA đang chạy => loopTask là producer duy nhất của ring
+    if (s_otaUart) {
+      Serial.println("[BLE] UART OTA active -> write ignored");
+      pOtaCharacteristic->setValue("FAIL:BUSY");
+      pOtaCharacteristic->notify();
+      return;
+    }
+
     // OTA packet / header => enqueue để tránh nghẽn callback BLE (tăng tốc + ổn định)
-    if (s_otaQueuesReady) {
-      if (!ota_enqueue_from_bytes(rxBuf, (uint16_t)rxLen, 0/*pdMS_TO_TICKS(100)*/)) {
+    // Copy thẳng từ bản sao giá trị BLE vào ring (không qua buffer tạm trên stack)
+    if (s_otaRxReady) {
+      if (!ota_enqueue_from_bytes(rxBuf, (uint16_t)rxLen, pdMS_TO_TICKS(OTA_RX_WAIT_MS))) {
         Serial.println("[OTA] RX buffer full -> FAIL:BUSY");
         if (pOtaCharacteristic) {
           pOtaCharacteristic->setValue("FAIL:BUSY");
@@ -430,8 +937,7 @@ class MyCallbacks : public BLECharacteristicCallbacks {
     }
 
     // Fallback: xử lý trực tiếp (nếu queue chưa sẵn)
-    uint8_t n = (rxLen > 255) ? 255 : (uint8_t)rxLen;
-    int otaRes = iot47_ota_task((uint8_t *)rxBuf, n);
+    int otaRes = iot47_ota_task((uint8_t *)rxBuf, (uint16_t)rxLen);
     if (otaRes != 0) {
       Serial.print("[OTA] iot47_ota_task handled packet, code=");
       Serial.println(otaRes);
@@ -444,57 +950,307 @@ class MyCallbacks : public BLECharacteristicCallbacks {
 };
 
 
+// MTU do central đàm phán => IOT47 chọn kích thước frame cho protocol V=2
+static void ble_on_mtu(uint16_t mtu) {
+  meblock_boot_mark("connect");   // lần kết nối đầu tiên (central đã đàm phán MTU)
+  s_attMtu = mtu;
+  if (!s_otaUart) iot47_ble_ota_set_mtu(mtu);
+  Serial.printf("[BLE] MTU = %u\n", (unsigned)mtu);
+}
+
+// Mất kết nối giữa chừng => báo worker dừng phiên OTA (host BEGIN lại với I= để resume)
+static void ble_on_disconnect() {
+  s_attMtu = 23;
+  if (!s_otaUart) iot47_ble_ota_set_mtu(23);
+  if (s_otaRxReady && !s_otaUart) ota_enqueue_from_bytes(nullptr, 0, pdMS_TO_TICKS(100));
+  BLEDevice::startAdvertising();
+}
+
+#if MEBLOCK_USE_NIMBLE
+class MyServerCallbacks : public NimBLEServerCallbacks {
+  // Xin link nhanh ngay khi kết nối; mọi yêu cầu đều là best effort, link vẫn chạy với thông số central (hoặc
+  // controller: ESP32 gốc không có 2M PHY) chốt lại.
+  void onConnect(NimBLEServer *pServer, NimBLEConnInfo &connInfo) override {
+    uint16_t h = connInfo.getConnHandle();
+    if (!pServer->updatePhy(h, BLE_GAP_LE_PHY_2M_MASK, BLE_GAP_LE_PHY_2M_MASK, BLE_GAP_LE_PHY_CODED_ANY)) {
+      Serial.println("[BLE] 2M PHY not available -> 1M");
+    }
+    pServer->setDataLen(h, BLE_LINK_DATA_LEN);
+    pServer->updateConnParams(h, BLE_LINK_ITVL_MIN, BLE_LINK_ITVL_MAX, 0, BLE_LINK_TIMEOUT);
+    Serial.printf("[BLE] Connected, interval %.2f ms\n", connInfo.getConnInterval() * 1.25f);
+  }
+
+  void onMTUChange(uint16_t MTU, NimBLEConnInfo &connInfo) override {
+    (void)connInfo;
+    ble_on_mtu(MTU);
+  }
+
+  void onPhyUpdate(NimBLEConnInfo &connInfo, uint8_t txPhy, uint8_t rxPhy) override {
+    (void)connInfo;
+    Serial.printf("[BLE] PHY tx=%s rx=%s\n", txPhy == BLE_GAP_LE_PHY_2M ? "2M" : "1M", rxPhy == BLE_GAP_LE_PHY_2M ? "2M" : "1M");
+  }
+
+  void onConnParamsUpdate(NimBLEConnInfo &connInfo) override {
+    Serial.printf("[BLE] Interval %.2f ms, latency %u\n", connInfo.getConnInterval() * 1.25f, (unsigned)connInfo.getConnLatency());
+  }
+
+  void onDisconnect(NimBLEServer *pServer, NimBLEConnInfo &connInfo, int reason) override {
+    (void)pServer;
+    (void)connInfo;
+    (void)reason;
+    ble_on_disconnect();
+  }
+};
+#else
+class MyServerCallbacks : public BLEServerCallbacks {
+  void onMtuChanged(BLEServer *pServer, esp_ble_gatts_cb_param_t *param) override {
+    (void)pServer;
+    ble_on_mtu(param->mtu.mtu);
+  }
+
+  void onDisconnect(BLEServer *pServer) override {
+    (void)pServer;
+    ble_on_disconnect();
+  }
+};
+#endif
+
+
+#if MEBLOCK_OTA_L2CAP
+// OTA qua L2CAP CoC: kênh mang cùng luồng byte như GATT write (dòng BEGIN là 1 SDU riêng, sau đó các frame
+// [pkt][len][payload] kích thước bất kỳ tới IOT47_OTA_FRAME_MAX), phản hồi vẫn là notify trên pOtaCharacteristic.
+// SDU đi cùng đường ring -> worker -> ghép frame -> writer.
+class OtaL2capCallbacks : public NimBLEL2CAPChannelCallbacks {
+  void onConnect(NimBLEL2CAPChannel *channel, uint16_t negotiatedMTU) override {
+    (void)channel;
+    // Link này không có header ATT: frame V=2 dùng được trọn IOT47_OTA_FRAME_MAX
+    if (!s_otaUart) iot47_ble_ota_set_mtu(IOT47_OTA_FRAME_MAX + 3);
+    ota_link_reset(&s_linkL2cap);
+    Serial.printf("[L2CAP] OTA channel open, PSM=0x%04X, MTU=%u\n", OTA_L2CAP_PSM, (unsigned)negotiatedMTU);
+  }
+
+  // Chạy trên task NimBLE host. Credit SDU chỉ trả lại cho peer sau khi hàm này return, nên chờ ring trống
+  // ở đây giữ tốc độ bên gửi bằng tốc độ ghi flash thay vì FAIL:BUSY.
+  void onRead(NimBLEL2CAPChannel *channel, std::vector<uint8_t> &data) override {
+    (void)channel;
+    const uint8_t *p = data.data();
+    size_t left = data.size();
+    if (s_otaUart) return;   // ring đang thuộc OTA UART
+    ota_link_count(&s_linkL2cap, left);
+    while (left > 0) {
+      uint16_t n = (left > OTA_RX_MAX_WRITE) ? OTA_RX_MAX_WRITE : (uint16_t)left;
+      if (!ota_enqueue_from_bytes(p, n, pdMS_TO_TICKS(OTA_L2CAP_WAIT_MS))) {
+        Serial.println("[L2CAP] RX ring stalled -> SDU dropped");
+        return;
+      }
+      p += n;
+      left -= n;
+    }
+  }
+
+  void onDisconnect(NimBLEL2CAPChannel *channel) override {
+    (void)channel;
+    if (s_otaUart) return;
+    iot47_ble_ota_set_mtu(s_attMtu);
+    if (s_otaRxReady) ota_enqueue_from_bytes(nullptr, 0, pdMS_TO_TICKS(100));   // mất kết nối
+    Serial.println("[L2CAP] OTA channel closed");
+  }
+};
+#endif
+
+
+// ===== OTA qua UART =====
+// Driver UART của Arduino chuyển byte từ RX FIFO vào ring buffer của nó trong ISR UART; loopTask chép từng loạt
+// thẳng vào ring OTA (worker -> ghép frame -> writer, như BLE).
+static void ota_uart_enter(uint32_t baud) {
+  if (!s_otaRxReady) {
+    Serial.println("[UART] OTA unavailable (RX ring not allocated)");
+    return;
+  }
+  if (ota_state == OTA_DOWNLOADDING) {
+    Serial.println("[UART] BLE OTA in progress -> OTA_UART refused");
+    return;
+  }
+  if (baud < 115200) baud = 115200;
+  if (baud > OTA_UART_BAUD_MAX) baud = OTA_UART_BAUD_MAX;
+#if ARDUINO_USB_CDC_ON_BOOT
+  baud = 0;   // USB CDC native: baud không phải tốc độ đường dây, giữ nguyên cổng
+#endif
+
+  s_otaUart = true;
+  iot47_ble_ota_set_mtu(IOT47_OTA_FRAME_MAX + 3);   // không có header ATT: frame V=2 tới IOT47_OTA_FRAME_MAX
+  ota_link_reset(&s_linkUart);
+  s_uartLineLen = 0;
+  s_otaUartLastMs = millis();
+
+  char msg[32];
+  snprintf(msg, sizeof(msg), "UART OK B=%lu\r\n", (unsigned long)baud);
+  ota_reply_cb((const uint8_t *)msg, (uint16_t)strlen(msg));
+#if !ARDUINO_USB_CDC_ON_BOOT
+  Serial.flush();   // phản hồi đi hết ở baud cũ
+  Serial.updateBaudRate(baud);
+#endif
+}
+
+static void ota_uart_exit() {
+  // Đang tải: như mất kết nối BLE (dừng phiên, giữ checkpoint để resume bằng I=)
+  if (ota_state == OTA_DOWNLOADDING) ota_enqueue_from_bytes(nullptr, 0, pdMS_TO_TICKS(100));
+  ota_link_report(&s_linkUart);
+#if !ARDUINO_USB_CDC_ON_BOOT
+  Serial.flush();
+  Serial.updateBaudRate(115200);
+#endif
+  iot47_ble_ota_set_mtu(s_attMtu);
+  s_otaUart = false;
+  Serial.println("[UART] OTA mode off");
+}
+
+static void ota_uart_poll() {
+  int avail = Serial.available();
+  uint32_t now = millis();
+  if (avail <= 0) {
+    if (now - s_otaUartLastMs >= OTA_UART_IDLE_MS) {
+      Serial.println("[UART] idle -> leaving OTA mode");
+      ota_uart_exit();
+    } else {
+      delay(1);
+    }
+    return;
+  }
+
+  if (ota_state == OTA_DOWNLOADDING) {
+    // Frame: chờ gom một loạt ngắn rồi chép vào ring thành 1 record
+    if (avail < OTA_UART_MIN_READ && (now - s_otaUartLastMs) < 2) {
+      delay(1);
+      return;
+    }
+    static uint8_t chunk[OTA_RX_MAX_WRITE];
+    size_t n = Serial.readBytes(chunk, (avail > OTA_RX_MAX_WRITE) ? OTA_RX_MAX_WRITE : (size_t)avail);
+    s_otaUartLastMs = now;
+    if (n == 0) return;
+    ota_link_count(&s_linkUart, n);
+    if (!ota_enqueue_from_bytes(chunk, (uint16_t)n, pdMS_TO_TICKS(OTA_UART_WAIT_MS))) {
+      Serial.println("[UART] RX ring stalled -> chunk dropped");
+    }
+    return;
+  }
+
+  // Giữa 2 phiên: các dòng kết thúc bằng '\n' (BEGIN, OTA_UART_EXIT, lệnh MEBLOCK)
+  s_otaUartLastMs = now;
+  while (Serial.available() > 0) {
+    int c = Serial.read();
+    if (c < 0) break;
+    if (s_uartLineLen < IOT47_OTA_FRAME_MAX) s_uartLine[s_uartLineLen++] = (uint8_t)c;
+    if (c != '\n') continue;
+
+    uint16_t n = s_uartLineLen;
+    s_uartLineLen = 0;
+    if (iot47_ota_is_begin(s_uartLine, n)) {
+      // Host chờ OK rồi mới gửi frame, nên các byte sau được đọc ở chế độ tải
+      ota_link_count(&s_linkUart, n);
+      ota_enqueue_from_bytes(s_uartLine, n, pdMS_TO_TICKS(OTA_UART_WAIT_MS));
+      return;
+    }
+
+    size_t len = n;
+    char *cmd = meblock_cmd_trim((char *)s_uartLine, &len);
+    if (strcasecmp(cmd, "OTA_UART_EXIT") == 0) {
+      ota_uart_exit();
+      return;
+    }
+    if (len > 0 && !handleMeblockCommand(cmd, len, MEBLOCK_CMD_SRC_UART)) {
+      Serial.println("[UART] Unknown command.");
+    }
+  }
+}
+
+
 // ===== SETUP & LOOP =====
 #define SERVICE_UUID "55072829-bc9e-4c53-0003-74a6d4c78751"
 
 void setup() {
+  meblock_boot_mark("setup");
+  Serial.setRxBufferSize(OTA_UART_RX_BUF);   // OTA_UART: đủ chứa ~40 ms ở 2 Mbaud
+  Serial.setTxBufferSize(BOOT_LOG_TX_BUF);   // log khởi động vào buffer driver, không chặn chờ UART
   Serial.begin(115200);
-  delay(500);
+  meblock_boot_delay(500);
   Serial.println();
   Serial.println("=== MEBLOCK FACTORY + IOT47 BLE OTA ===");
+  meblock_boot_mark("serial");
 
   // 1) Tên BLE (MEBLOCK-... hoặc từ user)
   setupBleName();
+  meblock_boot_mark("name");
 
   // 2) Init BLE
   Serial.print("[BLE] Device name: ");
   Serial.println(g_bleName);
 
+  uint32_t heapBefore = ESP.getFreeHeap();
   BLEDevice::init(g_bleName.c_str());
+  meblock_boot_mark("ble_init");
 
   // Tăng MTU (best-effort) để cải thiện throughput BLE
-#if HAVE_ESP_GATT_MTU
+#if MEBLOCK_USE_NIMBLE
+  Serial.printf("[BLE] NimBLE setMTU(517) => %s\n", NimBLEDevice::setMTU(517) ? "ok" : "failed");
+  // 2M PHY mặc định cho mọi kết nối (C3 / S3); ESP32 gốc không hỗ trợ => giữ 1M
+  if (!NimBLEDevice::setDefaultPhy(BLE_GAP_LE_PHY_1M_MASK | BLE_GAP_LE_PHY_2M_MASK,
+                                   BLE_GAP_LE_PHY_1M_MASK | BLE_GAP_LE_PHY_2M_MASK)) {
+    Serial.println("[BLE] 2M PHY not supported by this controller");
+  }
+  NimBLEDevice::setPower(9);   // dBm
+#elif HAVE_ESP_GATT_MTU
   esp_err_t mtuErr = esp_ble_gatt_set_local_mtu(517);
   Serial.printf("[BLE] set_local_mtu(517) => %d\n", (int)mtuErr);
 #else
-  Serial.println("[BLE] esp_ble_gatt_set_local_mtu not available (core NimBLE). MTU will be negotiated by central.");
+  Serial.println("[BLE] esp_ble_gatt_set_local_mtu not available. MTU will be negotiated by central.");
 #endif
-#if defined(ESP_PWR_LVL_P9)
+#if !MEBLOCK_USE_NIMBLE && defined(ESP_PWR_LVL_P9)
   // Tăng TX power để ổn định kết nối (tuỳ board / môi trường)
   BLEDevice::setPower(ESP_PWR_LVL_P9);
 #endif
+  Serial.printf("[BLE] %s stack: %lu bytes heap\n", MEBLOCK_USE_NIMBLE ? "NimBLE" : "Bluedroid",
+                (unsigned long)(heapBefore - ESP.getFreeHeap()));
 
   // Bật RX buffering cho OTA (giảm nghẽn callback BLE => tốc độ cao hơn)
-  s_otaFreeQ = xQueueCreate(OTA_POOL_COUNT, sizeof(uint8_t));
-  s_otaFillQ = xQueueCreate(OTA_POOL_COUNT, sizeof(uint8_t));
-  if (s_otaFreeQ && s_otaFillQ) {
-    for (uint8_t i = 0; i < OTA_POOL_COUNT; i++) {
-      uint8_t idx = i;
-      xQueueSend(s_otaFreeQ, &idx, 0);
+  // Ring RX: PSRAM nếu có (S3 N16R8...), không thì RAM trong
+  const char *ringMem = "internal";
+  if (psramFound()) {
+    s_otaRing = (uint8_t *)heap_caps_malloc(OTA_RX_RING_SIZE_PSRAM, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (s_otaRing) {
+      s_otaRingSize = OTA_RX_RING_SIZE_PSRAM;
+      ringMem = "psram";
     }
-    s_otaQueuesReady = true;
-    BaseType_t core = (portNUM_PROCESSORS > 1) ? 1 : 0;
-    xTaskCreatePinnedToCore(ota_worker_task, "ota_worker", 8192, nullptr, 2, nullptr, core);
-
-    Serial.printf("[OTA] RX buffering ON: pool=%u, item=%u\n", OTA_POOL_COUNT, OTA_POOL_ITEM_SIZE);
+  }
+  if (!s_otaRing) {
+    s_otaRing = (uint8_t *)malloc(OTA_RX_RING_SIZE);
+    if (s_otaRing) s_otaRingSize = OTA_RX_RING_SIZE;
+  }
+  BaseType_t core = (portNUM_PROCESSORS > 1) ? 1 : 0;
+  if (s_otaRing && xTaskCreatePinnedToCore(ota_worker_task, "ota_worker", 8192, nullptr, 2, &s_otaWorker, core) == pdPASS) {
+    s_otaRxReady = true;
+    Serial.printf("[OTA] RX buffering ON: ring=%lu bytes (%s), max write=%u\n",
+                  (unsigned long)s_otaRingSize, ringMem, OTA_RX_MAX_WRITE);
   } else {
-    Serial.println("[OTA] RX buffering OFF (queue alloc failed)");
+    Serial.println("[OTA] RX buffering OFF (ring alloc failed)");
   }
+  meblock_boot_mark("ota_ring");
 
   BLEServer *pServer = BLEDevice::createServer();
+  pServer->setCallbacks(new MyServerCallbacks());
   BLEService *pService = pServer->createService(SERVICE_UUID);
 
   // 3) Characteristic OTA + command
+#if MEBLOCK_USE_NIMBLE
+  pOtaCharacteristic = pService->createCharacteristic(
+      SERVICE_UUID,
+      NIMBLE_PROPERTY::READ      |
+      NIMBLE_PROPERTY::WRITE     |
+      NIMBLE_PROPERTY::WRITE_NR  |
+      NIMBLE_PROPERTY::NOTIFY    |
+      NIMBLE_PROPERTY::INDICATE
+  );
+#else
   pOtaCharacteristic = pService->createCharacteristic(
       SERVICE_UUID,
       BLECharacteristic::PROPERTY_READ      |
@@ -503,6 +1259,7 @@ void setup() {
       BLECharacteristic::PROPERTY_NOTIFY    |
       BLECharacteristic::PROPERTY_INDICATE
   );
+#endif
 
   pOtaCharacteristic->setCallbacks(new MyCallbacks());
   pOtaCharacteristic->setValue("MEBLOCK FACTORY READY");
@@ -513,42 +1270,77 @@ void setup() {
   iot47_ble_ota_set_proces_callback(ota_process_cb);
   iot47_ble_ota_set_end_callback(ota_end_cb);
   iot47_ble_ota_set_error_callback(ota_error_cb);
+  iot47_ble_ota_set_credit_callback(ota_rx_credit_frames);
+  iot47_ble_ota_set_reply_callback(ota_reply_cb);
+  iot47_ble_ota_set_match_callback(ota_slot_match);
+  iot47_ble_ota_set_asset_callbacks(ota_asset_open, meblock_asset_upload_write, meblock_asset_upload_close);
   iot47_stop_ota();  // đảm bảo state = OTA_BEGIN khi khởi động
 
   pService->start();
+  meblock_boot_mark("gatt");
+
+#if MEBLOCK_OTA_L2CAP
+  // GATT vẫn dùng được để dự phòng; host hỗ trợ CoC thì mở PSM OTA_L2CAP_PSM
+  if (NimBLEDevice::createL2CAPServer()->createService(OTA_L2CAP_PSM, OTA_RX_MAX_WRITE, new OtaL2capCallbacks())) {
+    Serial.printf("[L2CAP] OTA service on PSM 0x%04X\n", OTA_L2CAP_PSM);
+  } else {
+    Serial.println("[L2CAP] OTA service registration failed (GATT only)");
+  }
+#endif
 
   BLEAdvertising *pAdvertising = BLEDevice::getAdvertising();
   pAdvertising->addServiceUUID(SERVICE_UUID);
+#if MEBLOCK_USE_NIMBLE
+  pAdvertising->enableScanResponse(true);
+  pAdvertising->setName(g_bleName.c_str());   // NimBLE không tự thêm tên vào gói quảng bá
+  pAdvertising->setPreferredParams(BLE_LINK_ITVL_MIN, BLE_LINK_ITVL_MAX);
+#else
   pAdvertising->setScanResponse(true);
   pAdvertising->setMinPreferred(0x06);
   pAdvertising->setMaxPreferred(0x0C);
+#endif
 
   BLEDevice::startAdvertising();
+  meblock_boot_mark("adv");
 
   Serial.println("[BLE] Advertising started.");
+
+  // 4) Init không gấp: sau khi thiết bị đã connectable
+  saveBleNameDeferred();
+  meblock_boot_mark("deferred");
+  Serial.printf("[BOOT] advertising after %lu us (BOOT? = timeline)\n", (unsigned long)meblock_boot_us("adv"));
 }
 
+static bool s_loopMarked = false;   // mốc "loop" chỉ ghi ở vòng loop() đầu tiên
+
 void loop() {
-  // Xử lý lệnh UART (text, kết thúc '\n')
-  while (Serial.available() > 0) {
-    char c = (char)Serial.read();
-    if (c == '\n') {
-      String cmd = gSerialCmdBuf;
-      gSerialCmdBuf = "";
-      cmd.trim();
-
-      if (cmd.length() > 0) {
-        Serial.print("[UART] CMD = '");
-        Serial.print(cmd);
-        Serial.println("'");
+  if (!s_loopMarked) {
+    s_loopMarked = true;
+    meblock_boot_mark("loop");
+  }
+  if (s_otaUart) {
+    ota_uart_poll();
+    return;
+  }
 
-        if (!handleMeblockCommand(cmd)) {
-          Serial.println("[UART] Unknown command.");
-        }
-      }
-    } else if (c != '\r') {
-      gSerialCmdBuf += c;
+  if (s_assetFormatPending) {
+    s_assetFormatPending = false;
+    files_format_now(true);
+  }
+
+  // Xử lý lệnh UART (text, kết thúc '\n' / '\r')
+  while (Serial.available() > 0) {
+    size_t n = 0;
+    const char *cmd = meblock_line_feed(&s_serialLine, (char)Serial.read(), &n);
+    if (!cmd) continue;
+
+    Serial.print("[UART] CMD = '");
+    Serial.print(cmd);
+    Serial.println("'");
+    if (!handleMeblockCommand(cmd, n, MEBLOCK_CMD_SRC_UART)) {
+      Serial.println("[UART] Unknown command.");
     }
+    if (s_otaUart) return;   // OTA_UART: các byte tiếp theo do ota_uart_poll() đọc
   }
 
   delay(10);
@@ -1,32 +1,27 @@
 #ifndef __IOT47_BLE_OTA__
 #define __IOT47_BLE_OTA__
 
-#include <Update.h>
+#include "IOT47_OTA_Writer.h"
+#include "IOT47_OTA_Lzss.h"
+#include "IOT47_OTA_Delta.h"
+#include "IOT47_OTA_Resume.h"
 int UpdateRun()
 {
     Serial.println("Start update");
-    if (Update.end())
+    if (iot47_writer_end())
     {
         Serial.println("OTA finished!");
-        if (Update.isFinished())
-        {
-            Serial.println("Restart device!");
-            delay(2000);
-            ESP.restart();
+        Serial.println("Restart device!");
+        delay(2000);
+        ESP.restart();
 
-            // Cho compiler yên tâm, coi như OTA thành công
-            return 1;
-        }
-        else
-        {
-            Serial.println("OTA not finished");
-            return 0;   // OTA không hoàn tất
-        }
+        // Cho compiler yên tâm, coi như OTA thành công
+        return 1;
     }
     else
     {
-        Serial.println("Error occured #:" + String(Update.getError()));
-        return 0;       // lỗi Update.end()
+        Serial.println("Error occured #:" + String((int)ota_wr_err));
+        return 0;       // lỗi ghi / ảnh không hợp lệ
     }
 }
 
@@ -35,16 +30,147 @@ int UpdateRun()
 #define OTA_BEGIN        0
 #define OTA_DOWNLOADDING 1
 #define OTA_DOWNLOADDONE 2
-uint32_t ota_fw_size,ota_fw_counter;
+
+// ===== Sliding-window mode (đàm phán qua header BEGIN) =====
+// Host gửi "IOT47_BLE_OTA_BEGIN:<size>;W=<n>\r\n" => thiết bị trả "OK W=<n>\r\n" (n đã được giới hạn).
+// Thiếu ";W=" => chế độ cũ: gói sai thứ tự => "Fail" (giữ nguyên cho client cũ).
+// Trong chế độ window, gói tới sớm (trong cửa sổ) được giữ lại, gói trùng bị bỏ qua,
+// và thiết bị notify bitmap ACK: [0x01][base_hi][base_lo][bitmap W/8 byte]
+//   base   = số gói kế tiếp đang chờ (mọi gói < base đã ghi xong)
+//   bit i  = (bitmap[i/8] >> (i%8)) & 1  <=> gói base+i đã nhận (bit 0 luôn = 0)
+// Host chỉ gửi lại các gói có bit 0 nằm dưới bit 1 cao nhất, hoặc gói base nếu hết timeout.
+#ifndef IOT47_OTA_WINDOW_MAX
+#define IOT47_OTA_WINDOW_MAX   32     // số gói tối đa giữ lại (bội số của 8)
+#endif
+// ===== Frame theo MTU (protocol V=2) =====
+// Header BEGIN có ";V=2" => thiết bị nhận frame tới F byte (F = MTU - 3, kẹp trong [255..512])
+// và trả "F=<F>" trong OK. Không có V=2 => frame tối đa 255 byte như cũ.
+#define IOT47_OTA_FRAME_LEGACY 255    // frame tối đa của giao thức cũ (len uint8_t)
+#ifndef IOT47_OTA_FRAME_MAX
+#define IOT47_OTA_FRAME_MAX    512    // giá trị ATT tối đa (MTU 517 - 3, giới hạn 512 của GATT)
+#endif
+#define IOT47_OTA_HDR_SIZE     4      // [pkt_hi][pkt_lo][len_hi][len_lo]
+#ifndef IOT47_OTA_ACK_MIN_MS
+#define IOT47_OTA_ACK_MIN_MS   10     // khoảng cách tối thiểu giữa 2 ACK "bất thường" (gap/trùng)
+#endif
+#define IOT47_OTA_NTF_ACK      0x01
+#define IOT47_OTA_NTF_NACK     0x02
+#define IOT47_OTA_NTF_CREDIT   0x03
+#define IOT47_OTA_NTF_STATS    0x04   // thống kê pipeline (ứng dụng tự gửi, vd core factory: STATS?)
+
+// ===== Kiểm tra toàn vẹn (H= / C=1) =====
+// ";H=<sha256 64 hex>" : SHA-256 của ảnh firmware (sau giải nén / áp patch). Thiết bị băm trên task
+//   riêng trong lúc ghi flash (IOT47_OTA_Hash.h); sai => "FAIL:HASH\r\n", không đổi phân vùng boot.
+// ";C=1" : mỗi frame có thêm 2 byte CRC16-CCITT (0x1021, init 0xFFFF, big-endian) sau payload,
+//   tính trên header 4 byte + payload: [pkt_hi][pkt_lo][len_hi][len_lo][payload][crc_hi][crc_lo]
+//   (len vẫn là độ dài payload). Frame sai CRC bị bỏ và thiết bị notify NACK ngay:
+//   [0x02][pkt_hi][pkt_lo] (pkt lấy từ header, có thể sai nếu chính header hỏng) => host gửi lại.
+#define IOT47_OTA_CRC_SIZE     2
+
+// ===== Điều khiển luồng bằng credit (FC=1) =====
+// ";FC=1" => thiết bị trả "FC=<n>" trong OK: host được gửi n frame đầu tiên (tính cả frame gửi lại).
+// Mỗi khi xử lý xong thêm khoảng n/4 frame, thiết bị notify hạn mức mới: [0x03][lim_hi][lim_lo]
+//   lim = số frame đã xử lý + n (16-bit, quay vòng) => host chỉ gửi frame thứ k (đếm từ 0 sau OK) khi k < lim.
+// n = số frame vừa buffer RX của thiết bị (callback iot47_ble_ota_set_credit_callback), nên tốc độ gửi
+// tự khớp với tốc độ ghi flash. Thiếu callback => không có "FC=" trong OK (host giữ cách gửi cũ).
+#ifndef IOT47_OTA_CREDIT_MAX
+#define IOT47_OTA_CREDIT_MAX   0x4000
+#endif
+
+// ===== Ảnh nén (Z=1) =====
+// "IOT47_BLE_OTA_BEGIN:<size nén>;Z=1;U=<size gốc>[;ZW=11][;ZL=5]\r\n" => "OK Z=1\r\n"
+// Payload các frame là stream LZSS (xem IOT47_OTA_Lzss.h), được giải nén trước khi ghi flash.
+// Đếm gói / ACK / kết thúc theo byte nén; callback tiến trình báo byte đã giải nén.
+#ifndef IOT47_OTA_LZSS_W_DEFAULT
+#define IOT47_OTA_LZSS_W_DEFAULT 11
+#endif
+#ifndef IOT47_OTA_LZSS_L_DEFAULT
+#define IOT47_OTA_LZSS_L_DEFAULT 5
+#endif
+
+// ===== Delta (D=) =====
+// "IOT47_BLE_OTA_BEGIN:<size patch>;D=<size ảnh mới>\r\n" => "OK D=1\r\n"
+// Payload là patch (IOT47_OTA_Delta.h) áp lên ảnh app đang nằm trong phân vùng đích.
+// Kết hợp được với Z=1 (khi đó U= là kích thước patch sau giải nén).
+// Ảnh cũ không khớp SHA-256 trong patch => "FAIL:BASE\r\n" (host gửi lại bản đầy đủ).
+
+// ===== Bỏ qua ảnh đã có (H= + match callback) =====
+// Nếu ứng dụng báo một phân vùng đã chứa ảnh có cùng SHA-256 / size (iot47_ble_ota_set_match_callback),
+// BEGIN trả "OK SKIP\r\n" thay vì OK: không nhận frame nào, thiết bị chọn phân vùng đó để boot và restart.
+
+// ===== File asset (N=) =====
+// "IOT47_BLE_OTA_BEGIN:<size>;N=<tên file>[;W=..][;V=2][;Z=1;U=..][;H=..][;C=1][;FC=1]\r\n"
+// Cùng frame / window / credit / CRC / giải nén như firmware, nhưng byte ảnh được giao cho asset callback
+// (iot47_ble_ota_set_asset_callbacks, vd file LittleFS trên phân vùng spiffs) thay vì ghi phân vùng app.
+// OK có " N=1" (thiết bị cũ không có => coi BEGIN là firmware: host phải ngắt thay vì gửi frame).
+// Xong => "FILE DONE\r\n": không đổi phân vùng boot, không restart, host gửi tiếp BEGIN cho file kế tiếp.
+// H= khớp file đang có (cùng tên, size, SHA-256) => "OK SKIP\r\n", không nhận frame nào, không restart.
+// Không kết hợp với D= / I=. Thiếu callback => "Fail\r\n".
+#ifndef IOT47_OTA_NAME_MAX
+#define IOT47_OTA_NAME_MAX     31
+#endif
+#define IOT47_ASSET_FAIL       0      // asset open callback: không mở được (tên sai / hết chỗ)
+#define IOT47_ASSET_OPEN       1      // đã mở file tạm, chờ dữ liệu
+#define IOT47_ASSET_SAME       2      // file đang có đúng nội dung này => bỏ qua
+
+// ===== Resume (I=) =====
+// "IOT47_BLE_OTA_BEGIN:<size>;I=<mã ảnh>\r\n" => "OK R=<offset>\r\n"
+// Thiết bị checkpoint offset đã ghi + CRC32 vào NVS (IOT47_OTA_Resume.h). Nếu BEGIN lại cùng
+// mã ảnh và cùng size, vùng đã ghi còn đúng CRC => tiếp tục từ R (host gửi từ byte R, gói
+// đánh số lại từ 0). R=0 => làm lại từ đầu. Chỉ áp dụng cho ảnh thô (không Z=1 / D=).
+// Gửi BEGIN khi phiên cũ còn dang dở (chưa kịp báo mất kết nối) sẽ dừng phiên cũ trước.
+
+uint32_t ota_fw_size,ota_fw_counter;           // byte trên đường truyền (nén nếu Z=1)
+uint32_t ota_img_size;                          // byte ảnh firmware ghi xuống flash
+bool ota_compressed = false;
+iot47_lzss_t ota_lzss;
+bool ota_delta = false;
+iot47_delta_t ota_delta_st;
+bool ota_asset = false;                         // N=: phiên hiện tại ghi file asset
+char ota_asset_name[IOT47_OTA_NAME_MAX + 1];
+bool ota_frame_crc = false;                     // C=1
+uint32_t ota_crc_errors = 0;
+uint32_t ota_resume_id = 0;                     // 0 => phiên không checkpoint
+uint32_t ota_ckpt_off = 0;                      // offset của checkpoint gần nhất
 uint32_t ota_download_paket;
 uint32_t ota_state;
 uint32_t ota_tranfer_mode;
 int couter_process = 0;
 typedef void (*ota_callback_t)(uint32_t curen, uint32_t totol);
+typedef uint16_t (*ota_credit_callback_t)(uint16_t frame_bytes);   // số frame frame_bytes vừa buffer RX
+typedef void (*ota_reply_callback_t)(const uint8_t *data, uint16_t len);
+typedef const esp_partition_t *(*ota_match_callback_t)(const uint8_t sha[32], uint32_t size);
+typedef int (*ota_asset_open_callback_t)(const char *name, uint32_t size, const uint8_t *sha);  // sha = 0 khi không có H=
+typedef iot47_file_sink_t ota_asset_write_callback_t;
+typedef bool (*ota_asset_close_callback_t)(bool ok);   // ok = false => bỏ file dở dang
 ota_callback_t begin_callback;
 ota_callback_t proces_callback;
 ota_callback_t end_callback;
 ota_callback_t error_callback;
+ota_credit_callback_t credit_callback;
+ota_reply_callback_t reply_callback;
+ota_match_callback_t match_callback;
+ota_asset_open_callback_t asset_open_callback;
+ota_asset_write_callback_t asset_write_callback;
+ota_asset_close_callback_t asset_close_callback;
+
+uint16_t ota_att_mtu = 23;                     // MTU đã đàm phán (cập nhật qua iot47_ble_ota_set_mtu)
+uint16_t ota_frame_max = IOT47_OTA_FRAME_LEGACY; // frame tối đa của phiên hiện tại
+
+// window state (chỉ cấp phát khi host yêu cầu W=)
+uint16_t ota_window = 0;                       // 0 => chế độ cũ
+uint16_t ota_slot_size = 0;                    // = ota_frame_max - header
+uint8_t *ota_win_buf = 0;                      // ota_window * ota_slot_size
+uint8_t *ota_frame_buf = 0;                    // C=1: giữ payload đúng thứ tự tới khi CRC đúng
+uint16_t ota_win_len[IOT47_OTA_WINDOW_MAX];
+uint8_t  ota_win_have[IOT47_OTA_WINDOW_MAX / 8];
+uint16_t ota_win_since_ack = 0;
+uint32_t ota_win_last_ack_ms = 0;
+
+// credit state (FC=1)
+uint16_t ota_credit = 0;                       // 0 => không dùng credit
+uint16_t ota_credit_frames = 0;                // frame đã xử lý từ BEGIN (16-bit)
+uint16_t ota_credit_limit = 0;                 // hạn mức đã notify gần nhất
 
 BLECharacteristic *OTA_BLECharacteristic;
 void iot47_ble_ota_begin(BLECharacteristic *c)
@@ -68,36 +194,681 @@ void iot47_ble_ota_set_error_callback(ota_callback_t c)
 {
   error_callback = c;
 }
+// Bật FC=1: c(frame_bytes) trả về số frame chứa vừa buffer RX khi trống
+void iot47_ble_ota_set_credit_callback(ota_credit_callback_t c)
+{
+  credit_callback = c;
+}
+
+// Gửi trả lời (OK / ACK / NACK / credit / FAIL...) qua đường khác notify (vd UART). 0 => notify như cũ
+void iot47_ble_ota_set_reply_callback(ota_reply_callback_t c)
+{
+  reply_callback = c;
+}
+
+// BEGIN có H=: c(sha, size) trả về phân vùng đã chứa đúng ảnh đó (vd slot chương trình) => không tải lại
+void iot47_ble_ota_set_match_callback(ota_match_callback_t c)
+{
+  match_callback = c;
+}
+
+// BEGIN có N=: open(tên, size, sha) mở file (IOT47_ASSET_*), write nhận từng sector, close(ok) chốt / bỏ file
+void iot47_ble_ota_set_asset_callbacks(ota_asset_open_callback_t open, ota_asset_write_callback_t write,
+                                       ota_asset_close_callback_t close)
+{
+  asset_open_callback = open;
+  asset_write_callback = write;
+  asset_close_callback = close;
+}
+
+// Trả lời host: notify trên characteristic OTA, hoặc qua reply_callback nếu có
+void iot47_ota_reply(const uint8_t *data, uint16_t len)
+{
+  if(reply_callback != 0)
+  {
+    reply_callback(data, len);
+    return;
+  }
+  OTA_BLECharacteristic->setValue((uint8_t *)data, len);
+  OTA_BLECharacteristic->notify();
+}
+void iot47_ota_reply(const char *s)
+{
+  iot47_ota_reply((const uint8_t *)s, (uint16_t)strlen(s));
+}
+
+// Gọi khi central đổi MTU (onMtuChanged) để V=2 chọn được kích thước frame
+void iot47_ble_ota_set_mtu(uint16_t mtu)
+{
+  ota_att_mtu = mtu;
+}
+
+// Frame lớn nhất (header + payload) chấp nhận trong phiên hiện tại
+uint16_t iot47_ota_max_frame()
+{
+  return ota_frame_max;
+}
+
+void iot47_window_free()
+{
+  if(ota_win_buf != 0)free(ota_win_buf);
+  if(ota_frame_buf != 0)free(ota_frame_buf);
+  ota_win_buf = 0;
+  ota_frame_buf = 0;
+  ota_window = 0;
+}
+
+// Số byte theo sau payload của mỗi frame (CRC16 khi C=1)
+uint16_t iot47_ota_frame_trailer()
+{
+  return ota_frame_crc ? IOT47_OTA_CRC_SIZE : 0;
+}
+
+// CRC16-CCITT (poly 0x1021), crc = 0xFFFF cho lần đầu
+static inline uint16_t iot47_crc16(uint16_t crc, const uint8_t *data, uint16_t len)
+{
+  while(len--)
+  {
+    crc ^= (uint16_t)(*data++) << 8;
+    for(int k = 0; k < 8; k++)crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+  }
+  return crc;
+}
+
+// Lưu offset đã ghi chắc chắn xuống flash của phiên hiện tại
+void iot47_ckpt_now()
+{
+  if((ota_resume_id == 0) || (ota_wr_flushed <= ota_ckpt_off))return;
+  iot47_ckpt_t c = { ota_resume_id, ota_fw_size, ota_wr_flushed, ota_wr_crc };
+  iot47_ckpt_save(&c);
+  ota_ckpt_off = ota_wr_flushed;
+}
+
+// Kết thúc phiên file asset: close(ok) chốt file (ok = false => xoá file dở dang)
+bool iot47_asset_close(bool ok)
+{
+  if(!ota_asset)return ok;
+  ota_asset = false;
+  bool closed = (asset_close_callback != 0) && asset_close_callback(ok);
+  return ok && closed;
+}
 
 void iot47_stop_ota()
 {
+  if(ota_state == OTA_DOWNLOADDING)
+  {
+    iot47_ckpt_now();
+    iot47_writer_abort();
+  }
+  iot47_asset_close(false);
+  ota_resume_id = 0;
+  ota_frame_crc = false;
+  ota_credit = 0;
   ota_state = OTA_BEGIN;
+  iot47_window_free();
+  iot47_lzss_free(&ota_lzss);
+  ota_compressed = false;
+  ota_delta = false;
+}
+
+// Số byte ảnh (đã giải nén) đã vào writer
+uint32_t iot47_image_written()
+{
+  return ota_wr_flushed + ota_wr_fill;
+}
+
+// Stream sau giải nén -> (áp patch) -> writer
+bool iot47_image_write(const uint8_t *data, uint32_t len)
+{
+  if(ota_delta)return iot47_delta_feed(&ota_delta_st, data, len);
+  return iot47_writer_write(data, len);
+}
+
+// Payload theo đúng thứ tự -> (giải nén) -> (áp patch) -> writer
+bool iot47_stream_write(const uint8_t *data, uint32_t len)
+{
+  if(ota_compressed)return iot47_lzss_feed(&ota_lzss, data, len);
+  return iot47_image_write(data, len);
+}
+
+static inline bool iot47_win_test(uint16_t i) { return (ota_win_have[i >> 3] >> (i & 7)) & 1; }
+static inline void iot47_win_set(uint16_t i)  { ota_win_have[i >> 3] |= (uint8_t)(1 << (i & 7)); }
+static inline void iot47_win_clr(uint16_t i)  { ota_win_have[i >> 3] &= (uint8_t)~(1 << (i & 7)); }
+
+// Notify bitmap ACK (chỉ dùng trong chế độ window)
+void iot47_send_ack()
+{
+  uint8_t msg[3 + IOT47_OTA_WINDOW_MAX / 8];
+  uint16_t base = (uint16_t)ota_download_paket;
+  uint16_t nbytes = ota_window / 8;
+  msg[0] = IOT47_OTA_NTF_ACK;
+  msg[1] = (uint8_t)(base >> 8);
+  msg[2] = (uint8_t)base;
+  memset(&msg[3], 0, nbytes);
+  for(uint16_t i = 1; i < ota_window; i++)
+  {
+    uint16_t slot = (uint16_t)((ota_download_paket + i) % ota_window);
+    if(iot47_win_test(slot))msg[3 + (i >> 3)] |= (uint8_t)(1 << (i & 7));
+  }
+  iot47_ota_reply(msg, 3 + nbytes);
+  ota_win_since_ack = 0;
+  ota_win_last_ack_ms = millis();
+}
+
+// Thêm 1 frame đã xử lý; notify hạn mức mới khi đã nhả được ~1/4 credit
+void iot47_credit_frame()
+{
+  if(ota_credit == 0)return;
+  ota_credit_frames++;
+  uint16_t lim = (uint16_t)(ota_credit_frames + ota_credit);
+  uint16_t step = (ota_credit >= 4) ? (uint16_t)(ota_credit / 4) : 1;
+  if((uint16_t)(lim - ota_credit_limit) < step)return;
+  uint8_t msg[3] = { IOT47_OTA_NTF_CREDIT, (uint8_t)(lim >> 8), (uint8_t)lim };
+  iot47_ota_reply(msg, 3);
+  ota_credit_limit = lim;
+}
+
+// ===== Frame API (stream payload thẳng từ buffer RX vào flash writer, không copy cả frame) =====
+// iot47_frame_begin(packet, size) -> iot47_frame_data(...) (1 hoặc nhiều lần) -> iot47_frame_end()
+#define IOT47_FRAME_SKIP   0    // bỏ: trùng / ngoài cửa sổ / sai thứ tự (chế độ cũ)
+#define IOT47_FRAME_WRITE  1    // đúng thứ tự: ghi thẳng vào writer
+#define IOT47_FRAME_HOLD   2    // tới sớm: copy vào slot của window
+
+uint8_t  ota_frame_mode = IOT47_FRAME_SKIP;
+uint16_t ota_frame_size = 0;
+uint16_t ota_frame_fill = 0;
+uint16_t ota_frame_slot = 0;
+bool     ota_frame_irregular = false;
+bool     ota_frame_seq_err = false;      // C=1, chế độ cũ: sai thứ tự, chỉ báo "Fail" nếu CRC đúng
+uint16_t ota_frame_packet = 0;
+uint16_t ota_frame_crc_acc = 0xFFFF;
+uint16_t ota_frame_crc_rx = 0;
+uint8_t  ota_frame_crc_got = 0;
+
+// File asset đã ghi đủ (và khớp H=): chốt file, về lại OTA_BEGIN để nhận file kế tiếp
+int iot47_asset_done()
+{
+  iot47_writer_print_stats();
+  iot47_writer_release();
+  bool ok = (asset_close_callback != 0) && asset_close_callback(true);
+  if(ok)
+  {
+    Serial.printf("[OTA] file %s saved (%lu bytes)\n", ota_asset_name, (unsigned long)iot47_image_written());
+    iot47_ota_reply("FILE DONE\r\n");
+    if(end_callback!=0)end_callback(iot47_image_written(),ota_img_size);   // ota_asset còn true trong callback
+  }
+  ota_asset = false;
+  iot47_stop_ota();
+  if(ok)return 3;
+  iot47_ota_reply("FAIL:FLASH\r\n");
+  if(error_callback!=0)error_callback(iot47_image_written(),ota_img_size);
+  return 2;
 }
-int iot47_ota_task(uint8_t *rxValue, uint8_t len)
+
+// Payload của gói kế tiếp đã vào writer. Trả về 3 nếu đã đủ firmware (OTA xong)
+int iot47_payload_done(uint16_t size)
 {
+  ota_download_paket++;
+  ota_fw_counter+=size;
+  couter_process++;
+  if((ota_resume_id != 0) && (ota_wr_flushed >= ota_ckpt_off + IOT47_OTA_CKPT_BYTES))iot47_ckpt_now();
+  if(couter_process==20)
+  {
+    couter_process=0;
+    if(proces_callback!=0)proces_callback(iot47_image_written(),ota_img_size);
+  }
+  if(ota_fw_counter == ota_fw_size)
+  {
+    if(ota_compressed && !iot47_lzss_done(&ota_lzss))
+    {
+      Serial.printf("[OTA] decompressed %lu / %lu bytes -> size mismatch\n",
+                    (unsigned long)ota_lzss.out_done, (unsigned long)ota_img_size);
+      iot47_ota_reply("FAIL:SIZE\r\n");
+      if(error_callback!=0)error_callback(iot47_image_written(),ota_img_size);
+      iot47_stop_ota();
+      return 2;
+    }
+    if(ota_delta && !iot47_delta_done(&ota_delta_st))
+    {
+      Serial.printf("[OTA] patched %lu / %lu bytes -> size mismatch\n",
+                    (unsigned long)ota_delta_st.out_done, (unsigned long)ota_img_size);
+      iot47_ota_reply("FAIL:SIZE\r\n");
+      if(error_callback!=0)error_callback(iot47_image_written(),ota_img_size);
+      iot47_stop_ota();
+      return 2;
+    }
+    if(!iot47_writer_finish())
+    {
+      Serial.printf("[OTA] image check failed, err=%d\n", (int)ota_wr_err);
+      if(ota_wr_err == ESP_ERR_INVALID_CRC)iot47_ota_reply("FAIL:HASH\r\n");
+      else iot47_ota_reply("FAIL:FLASH\r\n");
+      if(error_callback!=0)error_callback(iot47_image_written(),ota_img_size);
+      if(ota_resume_id != 0)iot47_ckpt_clear();   // ảnh trên flash sai => không resume từ đây
+      ota_resume_id = 0;
+      iot47_stop_ota();
+      return 2;
+    }
+    if(ota_asset)return iot47_asset_done();
+    iot47_lzss_free(&ota_lzss);
+    ota_delta = false;
+    if(ota_resume_id != 0)iot47_ckpt_clear();
+    ota_resume_id = 0;
+    iot47_ota_reply("OTA DONE\r\n");
+    ota_state = OTA_DOWNLOADDONE;
+    iot47_window_free();
+    if(end_callback!=0)end_callback(iot47_image_written(),ota_img_size);
+    if(!UpdateRun())
+    {
+      if(error_callback!=0)error_callback(iot47_image_written(),ota_img_size);
+    }
+    return 3;
+  }
+  return 2;
+}
+
+int iot47_frame_begin(uint16_t packet, uint16_t size)
+{
+  ota_frame_mode = IOT47_FRAME_SKIP;
+  ota_frame_size = size;
+  ota_frame_fill = 0;
+  ota_frame_irregular = false;
+  ota_frame_seq_err = false;
+  ota_frame_packet = packet;
+  ota_frame_crc_got = 0;
+  ota_frame_crc_rx = 0;
+  if(ota_frame_crc)
+  {
+    uint8_t hdr[IOT47_OTA_HDR_SIZE] = { (uint8_t)(packet >> 8), (uint8_t)packet, (uint8_t)(size >> 8), (uint8_t)size };
+    ota_frame_crc_acc = iot47_crc16(0xFFFF, hdr, IOT47_OTA_HDR_SIZE);
+  }
+  if(ota_state != OTA_DOWNLOADDING)return ota_frame_mode;
+
+  uint16_t d = (uint16_t)(packet - (uint16_t)ota_download_paket);
+  if(ota_window == 0)
+  {
+    if(d == 0)ota_frame_mode = IOT47_FRAME_WRITE;
+    else if(ota_frame_crc)ota_frame_seq_err = true;   // chờ CRC: header hỏng thì NACK thay vì "Fail"
+    else
+    {
+      Serial.println("Lỗi khi ota");
+      iot47_ota_reply("Fail\r\n");
+      if(error_callback!=0)error_callback(ota_fw_counter,ota_fw_size);
+    }
+    return ota_frame_mode;
+  }
+
+  if(d == 0)ota_frame_mode = IOT47_FRAME_WRITE;
+  else if(d < ota_window && size <= ota_slot_size)
+  {
+    ota_frame_slot = (uint16_t)((ota_download_paket + d) % ota_window);
+    if(!iot47_win_test(ota_frame_slot))ota_frame_mode = IOT47_FRAME_HOLD;
+    ota_frame_irregular = true;   // có lỗ trống trước gói này
+  }
+  else
+  {
+    ota_frame_irregular = true;   // gói trùng (đã ghi) hoặc vượt quá cửa sổ => bỏ
+  }
+  return ota_frame_mode;
+}
+
+// Nhận payload (và CRC16 khi C=1) của frame hiện tại, theo từng mẩu bất kỳ
+void iot47_frame_data(const uint8_t *data, uint16_t n)
+{
+  uint16_t take = n;
+  if((uint32_t)ota_frame_fill + take > ota_frame_size)take = (uint16_t)(ota_frame_size - ota_frame_fill);
+  if(ota_frame_crc)
+  {
+    ota_frame_crc_acc = iot47_crc16(ota_frame_crc_acc, data, take);
+    for(uint16_t i = take; (i < n) && (ota_frame_crc_got < IOT47_OTA_CRC_SIZE); i++, ota_frame_crc_got++)
+      ota_frame_crc_rx = (uint16_t)((ota_frame_crc_rx << 8) | data[i]);
+  }
+  if(ota_frame_mode == IOT47_FRAME_WRITE)
+  {
+    if(ota_frame_crc)
+    {
+      if(ota_frame_size <= ota_slot_size)memcpy(&ota_frame_buf[ota_frame_fill], data, take);   // ghi khi CRC đúng
+    }
+    else iot47_stream_write(data, take);
+  }
+  else if(ota_frame_mode == IOT47_FRAME_HOLD)
+  {
+    memcpy(&ota_win_buf[ota_frame_slot * ota_slot_size + ota_frame_fill], data, take);
+  }
+  ota_frame_fill += take;
+}
+
+// Notify NACK cho frame sai CRC
+void iot47_send_nack(uint16_t packet)
+{
+  uint8_t msg[3] = { IOT47_OTA_NTF_NACK, (uint8_t)(packet >> 8), (uint8_t)packet };
+  iot47_ota_reply(msg, 3);
+}
+
+int iot47_frame_end()
+{
+  int r = 2;
+  if(ota_state != OTA_DOWNLOADDING)return 0;
+
+  if(ota_wr_err != ESP_OK)
+  {
+    Serial.printf("[OTA] flash write error %d\n", (int)ota_wr_err);
+    iot47_ota_reply("FAIL:FLASH\r\n");
+    if(error_callback!=0)error_callback(ota_fw_counter,ota_fw_size);
+    iot47_stop_ota();
+    return 2;
+  }
+  if(ota_delta && (ota_delta_st.error != IOT47_DELTA_OK))
+  {
+    Serial.printf("[OTA] delta: %s\n", iot47_delta_strerror(ota_delta_st.error));
+    if(ota_delta_st.error == IOT47_DELTA_ERR_BASE)iot47_ota_reply("FAIL:BASE\r\n");
+    else iot47_ota_reply("FAIL:PATCH\r\n");
+    if(error_callback!=0)error_callback(ota_fw_counter,ota_fw_size);
+    iot47_stop_ota();
+    return 2;
+  }
+
+  if(ota_frame_crc && ((ota_frame_crc_got < IOT47_OTA_CRC_SIZE) || (ota_frame_crc_rx != ota_frame_crc_acc) ||
+                        (ota_frame_fill < ota_frame_size) || (ota_frame_size > ota_slot_size)))
+  {
+    ota_crc_errors++;
+    iot47_send_nack(ota_frame_packet);
+    ota_frame_mode = IOT47_FRAME_SKIP;
+    ota_frame_irregular = true;
+  }
+  else if(ota_frame_seq_err)
+  {
+    Serial.println("Lỗi khi ota");
+    iot47_ota_reply("Fail\r\n");
+    if(error_callback!=0)error_callback(ota_fw_counter,ota_fw_size);
+  }
+
+  if(ota_frame_mode == IOT47_FRAME_WRITE)
+  {
+    if(ota_frame_crc)iot47_stream_write(ota_frame_buf, ota_frame_size);
+    r = iot47_payload_done(ota_frame_size);
+    // xả các gói đã giữ sẵn ngay sau base
+    while((r != 3) && (ota_window > 0))
+    {
+      uint16_t slot = (uint16_t)(ota_download_paket % ota_window);
+      if(!iot47_win_test(slot))break;
+      iot47_win_clr(slot);
+      iot47_stream_write(&ota_win_buf[slot * ota_slot_size], ota_win_len[slot]);
+      r = iot47_payload_done(ota_win_len[slot]);
+    }
+    if(r == 3)return 3;
+  }
+  else if(ota_frame_mode == IOT47_FRAME_HOLD)
+  {
+    ota_win_len[ota_frame_slot] = ota_frame_size;
+    iot47_win_set(ota_frame_slot);
+  }
+
+  if(ota_window > 0)
+  {
+    ota_win_since_ack++;
+    if((ota_win_since_ack >= ota_window / 2) ||
+       (ota_frame_irregular && (millis() - ota_win_last_ack_ms) >= IOT47_OTA_ACK_MIN_MS))
+    {
+      iot47_send_ack();
+    }
+  }
+  iot47_credit_frame();
+  return r;
+}
+
+// Đọc tuỳ chọn ";KEY=<số>" trong header BEGIN (vd ";W=32"). Không có => trả về def
+uint32_t iot47_header_option(const char *header, const char *key, uint32_t def)
+{
+  const char *p = strchr(header, ';');
+  size_t klen = strlen(key);
+  while(p != 0)
+  {
+    p++;
+    if((strncmp(p, key, klen) == 0) && (p[klen] == '='))return (uint32_t)strtoul(p + klen + 1, 0, 10);
+    p = strchr(p, ';');
+  }
+  return def;
+}
+
+// Giá trị text của option key (tới ';' / '\r' / '\n') vào out. false nếu không có, rỗng hoặc dài hơn max - 1
+bool iot47_header_text(const char *header, const char *key, char *out, size_t max)
+{
+  const char *p = strchr(header, ';');
+  size_t klen = strlen(key);
+  while(p != 0)
+  {
+    p++;
+    if((strncmp(p, key, klen) == 0) && (p[klen] == '='))
+    {
+      p += klen + 1;
+      size_t n = strcspn(p, ";\r\n");
+      if((n == 0) || (n >= max))return false;
+      memcpy(out, p, n);
+      out[n] = 0;
+      return true;
+    }
+    p = strchr(p, ';');
+  }
+  return false;
+}
+
+// Dòng text BEGIN (để nhận ra BEGIN mới khi phiên cũ còn dang dở)
+bool iot47_ota_is_begin(const uint8_t *data, uint16_t len)
+{
+  return (len > 20) && (memcmp(data, "IOT47_BLE_OTA_BEGIN:", 20) == 0);
+}
+
+// Ảnh đã nằm sẵn trên phân vùng p: boot thẳng phân vùng đó thay vì tải lại
+int iot47_ota_skip(const esp_partition_t *p)
+{
+  ota_wr_err = esp_ota_set_boot_partition(p);
+  if(ota_wr_err != ESP_OK)
+  {
+    Serial.printf("[OTA] skip: cannot boot %s, err=%d\n", p->label, (int)ota_wr_err);
+    iot47_ota_reply("FAIL:FLASH\r\n");
+    return 2;
+  }
+  Serial.printf("[OTA] image already in %s -> skip download\n", p->label);
+  iot47_ota_reply("OK SKIP\r\n");
+  Serial.println("Restart device!");
+  delay(2000);
+  ESP.restart();
+  return 3;
+}
+
+int iot47_ota_task(uint8_t *rxValue, uint16_t len)
+{
+  if((ota_state == OTA_DOWNLOADDING) && iot47_ota_is_begin(rxValue, len))
+  {
+    Serial.println("[OTA] new BEGIN while downloading -> stop previous session");
+    iot47_stop_ota();
+  }
   if(ota_state == OTA_BEGIN)
   {
-    if (len > 20 && len < 40)  //IOT47_BLE_OTA_BEGIN:1234567\r\n
+    if (len > 20 && len < 200)  //IOT47_BLE_OTA_BEGIN:1234567[;W=32][;V=2][;Z=1;U=2345678][;D=2345678][;I=123][;H=<64 hex>][;C=1][;FC=1][;N=<tên>]\r\n
     {
       if((rxValue[0] == 'I') && (rxValue[1] == 'O') && (rxValue[2] == 'T') && (rxValue[3] == '4') && (rxValue[4] == '7'))
       {
-        uint8_t *header = (uint8_t *)malloc(len); 
+        uint8_t *header = (uint8_t *)malloc(len + 1); 
         for (int i = 0; i < len; i++)header[i] = rxValue[i];
+        header[len] = 0;
         uint8_t *ota_cmd = (uint8_t *)strstr((const char *)header,(const char *)"IOT47_BLE_OTA_BEGIN:"); //find header
         if(ota_cmd != 0)
         {
           ota_fw_size=0;
           for(int i=0;i<20;i++)
           {
-            if((ota_cmd[20 + i] == '\r') || (ota_cmd[20 + i] == '\n'))
+            if((ota_cmd[20 + i] == '\r') || (ota_cmd[20 + i] == '\n') || (ota_cmd[20 + i] == ';'))
             {
+              uint32_t win = iot47_header_option((const char *)ota_cmd, "W", 0);
+              uint32_t ver = iot47_header_option((const char *)ota_cmd, "V", 1);
+              ota_frame_max = IOT47_OTA_FRAME_LEGACY;
+              if(ver >= 2)
+              {
+                uint16_t f = (ota_att_mtu > 3) ? (uint16_t)(ota_att_mtu - 3) : 0;
+                if(f < IOT47_OTA_FRAME_LEGACY)f = IOT47_OTA_FRAME_LEGACY;   // frame lớn hơn MTU vẫn được ghép lại
+                if(f > IOT47_OTA_FRAME_MAX)f = IOT47_OTA_FRAME_MAX;
+                ota_frame_max = f;
+              }
+              ota_slot_size = (uint16_t)(ota_frame_max - IOT47_OTA_HDR_SIZE);
+
+              iot47_lzss_free(&ota_lzss);
+              ota_compressed = (iot47_header_option((const char *)ota_cmd, "Z", 0) != 0);
+              uint32_t delta_size = iot47_header_option((const char *)ota_cmd, "D", 0);
+              ota_delta = (delta_size != 0);
+              uint32_t stream_size = ota_fw_size;          // byte sau giải nén (ảnh hoặc patch)
+              if(ota_compressed)
+              {
+                stream_size = iot47_header_option((const char *)ota_cmd, "U", 0);
+                uint8_t zw = (uint8_t)iot47_header_option((const char *)ota_cmd, "ZW", IOT47_OTA_LZSS_W_DEFAULT);
+                uint8_t zl = (uint8_t)iot47_header_option((const char *)ota_cmd, "ZL", IOT47_OTA_LZSS_L_DEFAULT);
+                if(!iot47_lzss_init(&ota_lzss, zw, zl, stream_size, iot47_image_write))
+                {
+                  Serial.println("[OTA] bad compression params / no RAM");
+                  iot47_lzss_free(&ota_lzss);
+                  ota_compressed = false;
+                  ota_delta = false;
+                  iot47_ota_reply("Fail\r\n");
+                  free(header);
+                  return 1;
+                }
+              }
+              ota_img_size = ota_delta ? delta_size : stream_size;
+
+              // H=: SHA-256 cả ảnh (băm song song với ghi flash, hoặc bỏ qua nếu đã có ảnh này)
+              uint8_t expect[32];
+              const char *h = strstr((const char *)ota_cmd, ";H=");
+              bool have_hash = (h != 0) && iot47_sha256_from_hex(h + 3, expect);
+              ota_asset = iot47_header_text((const char *)ota_cmd, "N", ota_asset_name, sizeof(ota_asset_name));
+              if(ota_asset)
+              {
+                int r = ((asset_open_callback == 0) || (asset_write_callback == 0) || ota_delta) ? IOT47_ASSET_FAIL :
+                        asset_open_callback(ota_asset_name, ota_img_size, have_hash ? expect : 0);
+                if(r != IOT47_ASSET_OPEN)
+                {
+                  ota_asset = false;
+                  iot47_lzss_free(&ota_lzss);
+                  ota_compressed = false;
+                  ota_delta = false;
+                  free(header);
+                  if(r == IOT47_ASSET_SAME)
+                  {
+                    Serial.printf("[OTA] file %s unchanged -> skip download\n", ota_asset_name);
+                    iot47_ota_reply("OK SKIP\r\n");
+                    return 3;
+                  }
+                  Serial.printf("[OTA] cannot open file %s\n", ota_asset_name);
+                  iot47_ota_reply("Fail\r\n");
+                  return 1;
+                }
+              }
+              const esp_partition_t *same = (have_hash && !ota_asset && (match_callback != 0)) ? match_callback(expect, ota_img_size) : 0;
+              if(same != 0)
+              {
+                iot47_lzss_free(&ota_lzss);
+                ota_compressed = false;
+                ota_delta = false;
+                free(header);
+                return iot47_ota_skip(same);
+              }
+              iot47_window_free();
+              ota_frame_crc = (iot47_header_option((const char *)ota_cmd, "C", 0) != 0);
+              ota_crc_errors = 0;
+              if(ota_frame_crc)
+              {
+                ota_slot_size = (uint16_t)(ota_slot_size - IOT47_OTA_CRC_SIZE);
+                ota_frame_buf = (uint8_t *)malloc(ota_slot_size);
+                if(ota_frame_buf == 0)ota_frame_crc = false;   // thiếu RAM => không dùng CRC (OK không có C=1)
+              }
+              if(win > 0)
+              {
+                if(win > IOT47_OTA_WINDOW_MAX)win = IOT47_OTA_WINDOW_MAX;
+                win = (win + 7) & ~7u;
+                ota_win_buf = (uint8_t *)malloc(win * ota_slot_size);
+                if(ota_win_buf != 0)ota_window = (uint16_t)win;   // thiếu RAM => lùi về chế độ cũ
+              }
+              memset(ota_win_have, 0, sizeof(ota_win_have));
+              ota_win_since_ack = 0;
+              ota_win_last_ack_ms = millis();
+
+              ota_credit = 0;
+              if((iot47_header_option((const char *)ota_cmd, "FC", 0) != 0) && (credit_callback != 0))
+              {
+                uint16_t c = credit_callback(ota_frame_max);
+                ota_credit = (c > IOT47_OTA_CREDIT_MAX) ? IOT47_OTA_CREDIT_MAX : c;
+              }
+              ota_credit_frames = 0;
+              ota_credit_limit = ota_credit;
+
+              bool wr_ok = ota_asset ? iot47_writer_begin_sink(asset_write_callback) : iot47_writer_begin(ota_img_size);
+              if(wr_ok && ota_delta)
+              {
+                wr_ok = iot47_writer_keep_old();
+                if(!wr_ok)iot47_writer_abort();
+                iot47_delta_init(&ota_delta_st, ota_img_size, iot47_writer_read_old, iot47_writer_write);
+              }
+
+              // Resume: chỉ ảnh thô, checkpoint cùng mã ảnh + size và vùng đã ghi còn đúng CRC
+              ota_resume_id = (ota_compressed || ota_delta || ota_asset) ? 0 : iot47_header_option((const char *)ota_cmd, "I", 0);
+              ota_ckpt_off = 0;
+              if(wr_ok && (ota_resume_id != 0))
+              {
+                iot47_ckpt_t c;
+                uint32_t crc = 0;
+                if(iot47_ckpt_load(&c) && (c.id == ota_resume_id) && (c.size == ota_fw_size) && (c.off < ota_fw_size) &&
+                   iot47_writer_crc_flash(c.off, &crc) && (crc == c.crc))
+                {
+                  iot47_writer_resume(c.off, c.crc);
+                  ota_ckpt_off = c.off;
+                  Serial.printf("[OTA] resume at %lu / %lu\n", (unsigned long)c.off, (unsigned long)ota_fw_size);
+                }
+                else iot47_ckpt_clear();
+              }
+
+              bool hashed = false;
+              if(wr_ok && have_hash)
+              {
+                hashed = iot47_writer_set_hash(expect);
+                wr_ok = hashed;
+                if(!wr_ok)iot47_writer_abort();
+              }
+              // FC=1: erase trước phần còn lại của phân vùng trong lúc host bắt đầu gửi
+              if(wr_ok && (ota_credit > 0))iot47_writer_erase_ahead(ota_img_size);
+              if(!wr_ok)
+              {
+                Serial.printf("[OTA] writer begin failed, err=%d\n", (int)ota_wr_err);
+                iot47_window_free();
+                iot47_lzss_free(&ota_lzss);
+                ota_compressed = false;
+                ota_delta = false;
+                ota_resume_id = 0;
+                iot47_asset_close(false);
+                iot47_ota_reply("Fail\r\n");
+                free(header);
+                return 1;
+              }
               ota_state = OTA_DOWNLOADDING;
-              ota_fw_counter = 0;
+              ota_fw_counter = ota_ckpt_off;
               ota_download_paket = 0;
-              OTA_BLECharacteristic->setValue("OK\r\n");
-              OTA_BLECharacteristic->notify();
-              if(begin_callback!=0)begin_callback(ota_fw_counter,ota_fw_size); 
-              Update.begin(ota_fw_size);
+              if((ota_window > 0) || (ver >= 2) || ota_compressed || ota_delta || (ota_resume_id != 0) || hashed || ota_frame_crc ||
+                 (ota_credit > 0) || ota_asset)
+              {
+                char ok[64];
+                int n = snprintf(ok, sizeof(ok), "OK");
+                if(ota_window > 0)n += snprintf(ok + n, sizeof(ok) - n, " W=%u", (unsigned)ota_window);
+                if(ver >= 2)n += snprintf(ok + n, sizeof(ok) - n, " F=%u", (unsigned)ota_frame_max);
+                if(ota_compressed)n += snprintf(ok + n, sizeof(ok) - n, " Z=1");
+                if(ota_delta)n += snprintf(ok + n, sizeof(ok) - n, " D=1");
+                if(ota_resume_id != 0)n += snprintf(ok + n, sizeof(ok) - n, " R=%lu", (unsigned long)ota_ckpt_off);
+                if(hashed)n += snprintf(ok + n, sizeof(ok) - n, " H=1");
+                if(ota_frame_crc)n += snprintf(ok + n, sizeof(ok) - n, " C=1");
+                if(ota_credit > 0)n += snprintf(ok + n, sizeof(ok) - n, " FC=%u", (unsigned)ota_credit);
+                if(ota_asset)n += snprintf(ok + n, sizeof(ok) - n, " N=1");
+                snprintf(ok + n, sizeof(ok) - n, "\r\n");
+                iot47_ota_reply(ok);
+              }
+              else iot47_ota_reply("OK\r\n");
+              if(begin_callback!=0)begin_callback(0,ota_img_size); 
               free(header);    
               return 1;
             }
@@ -112,37 +883,13 @@ int iot47_ota_task(uint8_t *rxValue, uint8_t len)
   else if(ota_state == OTA_DOWNLOADDING)
   {
     // [0][1] = số thứ tự gói tin     |      [2][3] = size payload   |       [4]...[n] play load
+    if(len < IOT47_OTA_HDR_SIZE)return 2;   // frame cụt: chưa đủ header, không đọc rxValue
     uint16_t packet = ((uint16_t)rxValue[0]<<8) | (uint16_t)rxValue[1];
-    if(packet == ota_download_paket)
-    {
-      ota_download_paket++;
-      uint16_t size = ((uint16_t)rxValue[2]<<8) | (uint16_t)rxValue[3];
-      Update.write((uint8_t *)&(rxValue[4]),size);
-      ota_fw_counter+=size;
-      couter_process++;
-      if(couter_process==20)
-      {
-        couter_process=0;
-        if(proces_callback!=0)proces_callback(ota_fw_counter,ota_fw_size);
-      }
-      if(ota_fw_counter == ota_fw_size)
-      {
-        OTA_BLECharacteristic->setValue("OTA DONE\r\n");
-        OTA_BLECharacteristic->notify();
-        ota_state = OTA_DOWNLOADDONE;
-        if(end_callback!=0)end_callback(ota_fw_counter,ota_fw_size);
-        UpdateRun();
-        return 3;
-      }
-    }
-    else
-    {
-      Serial.println("Lỗi khi ota");
-      OTA_BLECharacteristic->setValue("Fail\r\n");
-      OTA_BLECharacteristic->notify();
-      if(error_callback!=0)error_callback(ota_fw_counter,ota_fw_size);
-    }
-    return 2;
+    uint16_t size = ((uint16_t)rxValue[2]<<8) | (uint16_t)rxValue[3];
+    if(size + iot47_ota_frame_trailer() > len - IOT47_OTA_HDR_SIZE)return 2;   // frame cụt
+    iot47_frame_begin(packet, size);
+    iot47_frame_data(&rxValue[IOT47_OTA_HDR_SIZE], (uint16_t)(size + iot47_ota_frame_trailer()));
+    return iot47_frame_end();
   }
   return 0;
 }
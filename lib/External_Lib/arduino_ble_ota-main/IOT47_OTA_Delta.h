@@ -0,0 +1,293 @@
+#ifndef __IOT47_OTA_DELTA__
+#define __IOT47_OTA_DELTA__
+
+// ===== Delta OTA: áp patch lên ảnh app đang có trong phân vùng đích (tại chỗ) =====
+// Patch (little-endian):
+//   header 76 byte : "MBD1" | base_size u32 | new_size u32 | base_sha256[32] | new_sha256[32]
+//   op 0x01 COPY   : <varint src> <varint len>                 new[i] = old[src + i]
+//   op 0x02 ADD    : <varint src> <varint len> <len byte diff> new[i] = old[src + i] + diff[i]
+//   op 0x03 LIT    : <varint len> <len byte>                   new[i] = byte
+//   varint = LEB128 không dấu
+// Ảnh cũ được đọc từ chính phân vùng đang ghi: writer chỉ erase/ghi sector k khi đã đủ 4KB
+// ảnh mới và giữ lại nội dung cũ của sector vừa ghi đè, nên byte mới ở vị trí p chỉ được
+// đọc byte cũ nằm ở sector >= sector(p) - 1. Tool tạo patch (tools/Cpp/meblock_ota_tools)
+// đảm bảo điều này; hàm read trả false nếu vi phạm.
+// Trước khi ra byte đầu tiên, SHA-256 của ảnh cũ [0, base_size) phải khớp base_sha256.
+// Không phụ thuộc Arduino => dùng chung cho firmware và tool trên máy tính.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "IOT47_OTA_Lzss.h"      // iot47_sink_t
+#include "IOT47_OTA_Sha256.h"
+
+#define IOT47_DELTA_MAGIC      "MBD1"
+#define IOT47_DELTA_HDR_SIZE   76
+#define IOT47_DELTA_OP_COPY    0x01
+#define IOT47_DELTA_OP_ADD     0x02
+#define IOT47_DELTA_OP_LIT     0x03
+#ifndef IOT47_DELTA_CHUNK
+#define IOT47_DELTA_CHUNK      256
+#endif
+#define IOT47_DELTA_SECTOR     4096
+
+// Đọc len byte ảnh cũ tại offset (tính từ đầu phân vùng)
+typedef bool (*iot47_read_t)(uint32_t offset, uint8_t *dst, uint32_t len);
+
+enum {
+  IOT47_DELTA_OK = 0,
+  IOT47_DELTA_ERR_FORMAT,     // magic / op / độ dài sai
+  IOT47_DELTA_ERR_BASE,       // ảnh cũ không khớp (size / SHA-256)
+  IOT47_DELTA_ERR_RANGE,      // op đọc ngoài ảnh cũ
+  IOT47_DELTA_ERR_READ,       // đọc flash lỗi
+  IOT47_DELTA_ERR_SINK,       // writer báo lỗi
+};
+
+enum {
+  IOT47_DELTA_HDR = 0,
+  IOT47_DELTA_OP,
+  IOT47_DELTA_ARG,
+  IOT47_DELTA_ADD_DATA,
+  IOT47_DELTA_LIT_DATA,
+  IOT47_DELTA_DONE,
+};
+
+typedef struct {
+  uint8_t  state;
+  uint8_t  error;
+  uint8_t  op;
+  uint8_t  argi, nargs;
+  uint8_t  vshift;
+  uint32_t vacc;
+  uint32_t arg[2];
+  uint32_t src, len;         // op đang chạy: vị trí đọc ảnh cũ / số byte còn lại
+  uint8_t  hdr[IOT47_DELTA_HDR_SIZE];
+  uint8_t  hdr_fill;
+  uint32_t base_size;
+  uint32_t new_size;
+  uint32_t expect_size;      // 0 => không kiểm tra
+  uint32_t out_done;
+  uint8_t  old[IOT47_DELTA_CHUNK];
+  uint16_t old_fill, old_pos;
+  uint8_t  out[IOT47_DELTA_CHUNK];
+  uint16_t out_fill;
+  iot47_read_t read;
+  iot47_sink_t sink;
+} iot47_delta_t;
+
+static inline uint32_t iot47_delta_u32(const uint8_t *p)
+{
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// expect_size = kích thước ảnh mới host khai báo ở BEGIN (0 => lấy theo header patch)
+static inline void iot47_delta_init(iot47_delta_t *d, uint32_t expect_size, iot47_read_t read, iot47_sink_t sink)
+{
+  memset(d, 0, sizeof(*d));
+  d->expect_size = expect_size;
+  d->read = read;
+  d->sink = sink;
+  d->state = IOT47_DELTA_HDR;
+}
+
+static inline bool iot47_delta_fail(iot47_delta_t *d, uint8_t err)
+{
+  if(d->error == IOT47_DELTA_OK)d->error = err;
+  return false;
+}
+
+static inline bool iot47_delta_flush(iot47_delta_t *d)
+{
+  if(d->out_fill == 0)return true;
+  if(!d->sink(d->out, d->out_fill))return iot47_delta_fail(d, IOT47_DELTA_ERR_SINK);
+  d->out_fill = 0;
+  return true;
+}
+
+static inline bool iot47_delta_emit(iot47_delta_t *d, uint8_t b)
+{
+  d->out[d->out_fill++] = b;
+  d->out_done++;
+  if(d->out_fill == IOT47_DELTA_CHUNK)return iot47_delta_flush(d);
+  return true;
+}
+
+// SHA-256 ảnh cũ phải khớp header trước khi ghi đè bất kỳ sector nào
+static inline bool iot47_delta_check_base(iot47_delta_t *d)
+{
+  iot47_sha256_t h;
+  uint8_t digest[32];
+  uint32_t step = IOT47_DELTA_SECTOR;
+  uint8_t *buf = (uint8_t *)malloc(step);
+  if(buf == 0)
+  {
+    buf = d->old;                // thiếu RAM => đọc từng mẩu nhỏ
+    step = IOT47_DELTA_CHUNK;
+  }
+  iot47_sha256_init(&h);
+  bool ok = true;
+  for(uint32_t off = 0; ok && (off < d->base_size); off += step)
+  {
+    uint32_t n = d->base_size - off;
+    if(n > step)n = step;
+    ok = d->read(off, buf, n);
+    if(ok)iot47_sha256_update(&h, buf, n);
+  }
+  iot47_sha256_final(&h, digest);
+  if(buf != d->old)free(buf);
+  if(!ok)return iot47_delta_fail(d, IOT47_DELTA_ERR_READ);
+  if(memcmp(digest, &d->hdr[12], 32) != 0)return iot47_delta_fail(d, IOT47_DELTA_ERR_BASE);
+  return true;
+}
+
+static inline bool iot47_delta_header(iot47_delta_t *d)
+{
+  if(memcmp(d->hdr, IOT47_DELTA_MAGIC, 4) != 0)return iot47_delta_fail(d, IOT47_DELTA_ERR_FORMAT);
+  d->base_size = iot47_delta_u32(&d->hdr[4]);
+  d->new_size = iot47_delta_u32(&d->hdr[8]);
+  if((d->new_size == 0) || ((d->expect_size != 0) && (d->new_size != d->expect_size)))
+    return iot47_delta_fail(d, IOT47_DELTA_ERR_FORMAT);
+  if(!iot47_delta_check_base(d))return false;
+  d->state = IOT47_DELTA_OP;
+  return true;
+}
+
+// Đã đủ tham số của op: kiểm tra phạm vi rồi chạy (COPY chạy luôn, ADD/LIT chờ dữ liệu)
+static inline bool iot47_delta_start_op(iot47_delta_t *d)
+{
+  if(d->op == IOT47_DELTA_OP_LIT)
+  {
+    d->src = 0;
+    d->len = d->arg[0];
+  }
+  else
+  {
+    d->src = d->arg[0];
+    d->len = d->arg[1];
+    if((d->src > d->base_size) || (d->len > d->base_size - d->src))return iot47_delta_fail(d, IOT47_DELTA_ERR_RANGE);
+  }
+  if(d->len > d->new_size - d->out_done)return iot47_delta_fail(d, IOT47_DELTA_ERR_FORMAT);
+
+  if(d->op == IOT47_DELTA_OP_COPY)
+  {
+    while(d->len > 0)
+    {
+      uint32_t n = IOT47_DELTA_CHUNK - d->out_fill;
+      if(n > d->len)n = d->len;
+      if(!d->read(d->src, &d->out[d->out_fill], n))return iot47_delta_fail(d, IOT47_DELTA_ERR_READ);
+      d->out_fill = (uint16_t)(d->out_fill + n);
+      d->out_done += n;
+      d->src += n;
+      d->len -= n;
+      if((d->out_fill == IOT47_DELTA_CHUNK) && !iot47_delta_flush(d))return false;
+    }
+    d->state = IOT47_DELTA_OP;
+  }
+  else
+  {
+    d->old_fill = 0;
+    d->old_pos = 0;
+    d->state = (d->op == IOT47_DELTA_OP_ADD) ? IOT47_DELTA_ADD_DATA : IOT47_DELTA_LIT_DATA;
+    if(d->len == 0)d->state = IOT47_DELTA_OP;
+  }
+  if((d->state == IOT47_DELTA_OP) && (d->out_done == d->new_size))
+  {
+    d->state = IOT47_DELTA_DONE;
+    return iot47_delta_flush(d);
+  }
+  return true;
+}
+
+// Đưa thêm dữ liệu patch vào (mẩu bất kỳ). Trả false nếu lỗi (xem d->error)
+static inline bool iot47_delta_feed(iot47_delta_t *d, const uint8_t *data, uint32_t len)
+{
+  if(d->error != IOT47_DELTA_OK)return false;
+  uint32_t i = 0;
+  while((i < len) && (d->state != IOT47_DELTA_DONE))
+  {
+    switch(d->state)
+    {
+      case IOT47_DELTA_HDR:
+      {
+        uint32_t take = IOT47_DELTA_HDR_SIZE - d->hdr_fill;
+        if(take > len - i)take = len - i;
+        memcpy(&d->hdr[d->hdr_fill], &data[i], take);
+        d->hdr_fill = (uint8_t)(d->hdr_fill + take);
+        i += take;
+        if((d->hdr_fill == IOT47_DELTA_HDR_SIZE) && !iot47_delta_header(d))return false;
+        break;
+      }
+      case IOT47_DELTA_OP:
+        d->op = data[i++];
+        if((d->op < IOT47_DELTA_OP_COPY) || (d->op > IOT47_DELTA_OP_LIT))return iot47_delta_fail(d, IOT47_DELTA_ERR_FORMAT);
+        d->nargs = (d->op == IOT47_DELTA_OP_LIT) ? 1 : 2;
+        d->argi = 0;
+        d->vacc = 0;
+        d->vshift = 0;
+        d->state = IOT47_DELTA_ARG;
+        break;
+      case IOT47_DELTA_ARG:
+      {
+        uint8_t b = data[i++];
+        if(d->vshift > 28)return iot47_delta_fail(d, IOT47_DELTA_ERR_FORMAT);
+        d->vacc |= (uint32_t)(b & 0x7F) << d->vshift;
+        d->vshift = (uint8_t)(d->vshift + 7);
+        if(b & 0x80)break;
+        d->arg[d->argi++] = d->vacc;
+        d->vacc = 0;
+        d->vshift = 0;
+        if((d->argi == d->nargs) && !iot47_delta_start_op(d))return false;
+        break;
+      }
+      case IOT47_DELTA_ADD_DATA:
+        if(d->old_pos == d->old_fill)
+        {
+          uint32_t n = d->len;
+          if(n > IOT47_DELTA_CHUNK)n = IOT47_DELTA_CHUNK;
+          if(!d->read(d->src, d->old, n))return iot47_delta_fail(d, IOT47_DELTA_ERR_READ);
+          d->src += n;
+          d->old_fill = (uint16_t)n;
+          d->old_pos = 0;
+        }
+        if(!iot47_delta_emit(d, (uint8_t)(d->old[d->old_pos++] + data[i++])))return false;
+        if(--d->len == 0)d->state = IOT47_DELTA_OP;
+        break;
+      case IOT47_DELTA_LIT_DATA:
+      {
+        uint32_t take = d->len;
+        if(take > len - i)take = len - i;
+        for(uint32_t k = 0; k < take; k++)
+        {
+          if(!iot47_delta_emit(d, data[i + k]))return false;
+        }
+        i += take;
+        d->len -= take;
+        if(d->len == 0)d->state = IOT47_DELTA_OP;
+        break;
+      }
+    }
+    if((d->state == IOT47_DELTA_OP) && (d->out_done == d->new_size))d->state = IOT47_DELTA_DONE;
+  }
+  return iot47_delta_flush(d);
+}
+
+static inline bool iot47_delta_done(const iot47_delta_t *d)
+{
+  return d->state == IOT47_DELTA_DONE;
+}
+
+static inline const char *iot47_delta_strerror(uint8_t err)
+{
+  switch(err)
+  {
+    case IOT47_DELTA_OK:         return "ok";
+    case IOT47_DELTA_ERR_FORMAT: return "bad patch";
+    case IOT47_DELTA_ERR_BASE:   return "base image mismatch";
+    case IOT47_DELTA_ERR_RANGE:  return "copy out of base image";
+    case IOT47_DELTA_ERR_READ:   return "flash read error";
+    case IOT47_DELTA_ERR_SINK:   return "write error";
+  }
+  return "?";
+}
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef __IOT47_OTA_ERASE__
+#define __IOT47_OTA_ERASE__
+
+// ===== Erase trước phân vùng OTA trên task riêng (chạy song song với truyền dữ liệu) =====
+// Erase là thao tác flash chậm nhất (~30-50 ms / sector 4KB). Ngay sau BEGIN, task erase xoá dần
+// phân vùng đích từ con trỏ ghi tới cuối ảnh; writer chỉ phải chờ khi đuổi kịp task erase.
+// Trong lúc chờ radio, flash rảnh => phần lớn thời gian erase không còn nằm trên đường ghi.
+// Task erase chỉ đi trước con trỏ ghi tối đa 2 bước erase: erase liền một mạch cả phân vùng sẽ giữ
+// khoá flash và làm writer chờ ngay ở các sector đầu.
+// Writer dùng bước erase = block 64KB (esp_partition_erase_range dùng block erase khi thẳng hàng:
+// ~150 ms thay vì 16 x ~30-50 ms), nên tổng thời gian erase giảm hẳn chứ không chỉ dời sang task khác.
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_partition.h"
+
+#ifndef IOT47_OTA_ERASE_CORE
+#define IOT47_OTA_ERASE_CORE 0
+#endif
+#ifndef IOT47_OTA_ERASE_BLOCK
+#define IOT47_OTA_ERASE_BLOCK 65536
+#endif
+
+typedef struct {
+  uint32_t from;
+  uint32_t to;
+  uint32_t step;
+} iot47_erase_job_t;
+
+QueueHandle_t ota_erase_q = 0;            // job erase (1 job / phiên)
+SemaphoreHandle_t ota_erase_sem = 0;      // task erase báo tiến độ / đã dừng
+SemaphoreHandle_t ota_erase_go = 0;       // writer báo con trỏ ghi đã tiến
+const esp_partition_t *ota_erase_part = 0;
+volatile uint32_t ota_erase_done = 0;     // phân vùng đã erase tới offset này
+volatile uint32_t ota_erase_limit = 0;    // không erase quá offset này (con trỏ ghi + ota_erase_ahead)
+uint32_t ota_erase_ahead = 0;
+volatile bool ota_erase_busy = false;     // job đang chạy
+volatile bool ota_erase_cancel = false;
+
+static void iot47_erase_task(void *arg)
+{
+  (void)arg;
+  iot47_erase_job_t job;
+  for(;;)
+  {
+    if(xQueueReceive(ota_erase_q, &job, portMAX_DELAY) != pdTRUE)continue;
+    for(uint32_t off = job.from, n = 0; (off < job.to) && !ota_erase_cancel; off += n)
+    {
+      n = job.step - (off % job.step);   // resume: về lại biên block
+      if(n > job.to - off)n = job.to - off;
+      while((off + n > ota_erase_limit) && !ota_erase_cancel)xSemaphoreTake(ota_erase_go, pdMS_TO_TICKS(10));
+      if(ota_erase_cancel)break;
+      if(esp_partition_erase_range(ota_erase_part, off, n) != ESP_OK)break;   // writer tự erase lại và báo lỗi
+      ota_erase_done = off + n;
+      xSemaphoreGive(ota_erase_sem);
+    }
+    ota_erase_busy = false;
+    xSemaphoreGive(ota_erase_sem);
+  }
+}
+
+// Bắt đầu erase [from, to) của part theo từng bước step (from, to chẵn sector)
+bool iot47_erase_start(const esp_partition_t *part, uint32_t from, uint32_t to, uint32_t step)
+{
+  if(ota_erase_q == 0)
+  {
+    ota_erase_q = xQueueCreate(1, sizeof(iot47_erase_job_t));
+    ota_erase_sem = xSemaphoreCreateBinary();
+    ota_erase_go = xSemaphoreCreateBinary();
+    if((ota_erase_q == 0) || (ota_erase_sem == 0) || (ota_erase_go == 0))return false;
+    xTaskCreatePinnedToCore(iot47_erase_task, "ota_erase", 2048, 0, 1, 0, IOT47_OTA_ERASE_CORE);
+  }
+  xSemaphoreTake(ota_erase_sem, 0);
+  xSemaphoreTake(ota_erase_go, 0);
+  ota_erase_part = part;
+  ota_erase_done = from;
+  ota_erase_ahead = 2 * step;
+  ota_erase_limit = from + ota_erase_ahead;
+  ota_erase_cancel = false;
+  ota_erase_busy = true;
+  iot47_erase_job_t job = { from, to, step };
+  xQueueSend(ota_erase_q, &job, portMAX_DELAY);
+  return true;
+}
+
+// Con trỏ ghi đã tới wr => cho task erase đi tiếp
+void iot47_erase_advance(uint32_t wr)
+{
+  ota_erase_limit = wr + ota_erase_ahead;
+  xSemaphoreGive(ota_erase_go);
+}
+
+// Chờ tới khi [.., end) đã erase. false => task erase đã dừng trước end (writer tự erase)
+bool iot47_erase_wait(uint32_t end)
+{
+  if(ota_erase_limit < end)iot47_erase_advance(end);
+  while(ota_erase_done < end)
+  {
+    if(!ota_erase_busy)return ota_erase_done >= end;
+    xSemaphoreTake(ota_erase_sem, pdMS_TO_TICKS(10));
+  }
+  return true;
+}
+
+// Dừng job hiện tại (tối đa 1 bước erase) trước khi bỏ phân vùng
+void iot47_erase_stop()
+{
+  ota_erase_cancel = true;
+  xSemaphoreGive(ota_erase_go);
+  while(ota_erase_busy)xSemaphoreTake(ota_erase_sem, pdMS_TO_TICKS(10));
+}
+
+#endif
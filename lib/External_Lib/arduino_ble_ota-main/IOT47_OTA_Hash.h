@@ -0,0 +1,116 @@
+#ifndef __IOT47_OTA_HASH__
+#define __IOT47_OTA_HASH__
+
+// ===== SHA-256 ảnh OTA trên task riêng (chạy song song với ghi flash) =====
+// Writer giao từng sector vừa ghi cho task hash qua queue rồi chuyển sang buffer sector còn lại;
+// buffer chỉ được dùng lại khi task hash trả về (2 buffer xoay vòng).
+// Ghi flash 1 sector mất hàng chục ms, băm 4KB chỉ vài chục us => kiểm tra gần như không tốn
+// thêm thời gian, và lúc kết thúc chỉ còn chờ sector cuối.
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_partition.h"
+#include "esp_timer.h"
+#include "IOT47_OTA_Sha256.h"
+
+#define IOT47_HASH_FLASH 0xFF      // job đọc lại từ flash (phần đã ghi trước khi resume)
+
+#ifndef IOT47_OTA_HASH_CORE
+#define IOT47_OTA_HASH_CORE 0
+#endif
+
+typedef struct {
+  uint8_t  idx;                    // buffer sector của writer, hoặc IOT47_HASH_FLASH
+  uint32_t off;                    // job flash: offset trong phân vùng
+  uint32_t len;
+} iot47_hash_job_t;
+
+QueueHandle_t ota_hash_q = 0;      // job chờ băm
+QueueHandle_t ota_hash_free_q = 0; // buffer sector đã băm xong (writer lấy lại để ghi tiếp)
+iot47_sha256_t ota_hash_ctx;
+uint8_t *ota_hash_bufs[2] = { 0, 0 };
+const esp_partition_t *ota_hash_part = 0;
+uint32_t ota_hash_us = 0;          // tổng thời gian băm (báo cáo)
+
+static void iot47_hash_task(void *arg)
+{
+  (void)arg;
+  iot47_hash_job_t job;
+  for(;;)
+  {
+    if(xQueueReceive(ota_hash_q, &job, portMAX_DELAY) != pdTRUE)continue;
+    int64_t t0 = esp_timer_get_time();
+    if(job.idx == IOT47_HASH_FLASH)
+    {
+      uint8_t chunk[256];
+      for(uint32_t o = 0; o < job.len; o += sizeof(chunk))
+      {
+        uint32_t n = job.len - o;
+        if(n > sizeof(chunk))n = sizeof(chunk);
+        esp_partition_read(ota_hash_part, job.off + o, chunk, n);
+        iot47_sha256_update(&ota_hash_ctx, chunk, n);
+      }
+    }
+    else
+    {
+      iot47_sha256_update(&ota_hash_ctx, ota_hash_bufs[job.idx], job.len);
+      xQueueSend(ota_hash_free_q, &job.idx, portMAX_DELAY);
+    }
+    ota_hash_us += (uint32_t)(esp_timer_get_time() - t0);
+  }
+}
+
+// Bắt đầu băm ảnh mới. bufs = 2 buffer sector của writer (đều đang rảnh)
+bool iot47_hash_start(const esp_partition_t *part, uint8_t *buf0, uint8_t *buf1)
+{
+  if(ota_hash_q == 0)
+  {
+    ota_hash_q = xQueueCreate(4, sizeof(iot47_hash_job_t));
+    ota_hash_free_q = xQueueCreate(2, sizeof(uint8_t));
+    if((ota_hash_q == 0) || (ota_hash_free_q == 0))return false;
+    xTaskCreatePinnedToCore(iot47_hash_task, "ota_hash", 4096, 0, 1, 0, IOT47_OTA_HASH_CORE);
+  }
+  xQueueReset(ota_hash_q);
+  xQueueReset(ota_hash_free_q);
+  ota_hash_part = part;
+  ota_hash_bufs[0] = buf0;
+  ota_hash_bufs[1] = buf1;
+  ota_hash_us = 0;
+  iot47_sha256_init(&ota_hash_ctx);
+  uint8_t idx = 1;                 // buffer 0 đang được writer dùng, buffer 1 rảnh
+  xQueueSend(ota_hash_free_q, &idx, 0);
+  return true;
+}
+
+// Băm lại [off, off + len) đang có trên flash (resume)
+void iot47_hash_flash(uint32_t off, uint32_t len)
+{
+  iot47_hash_job_t job = { IOT47_HASH_FLASH, off, len };
+  if(len > 0)xQueueSend(ota_hash_q, &job, portMAX_DELAY);
+}
+
+// Giao buffer idx (len byte) cho task hash, trả về buffer rảnh kế tiếp để writer ghi tiếp
+uint8_t iot47_hash_push(uint8_t idx, uint32_t len)
+{
+  iot47_hash_job_t job = { idx, 0, len };
+  xQueueSend(ota_hash_q, &job, portMAX_DELAY);
+  uint8_t next = 0;
+  xQueueReceive(ota_hash_free_q, &next, portMAX_DELAY);
+  return next;
+}
+
+// Chờ task hash trả buffer còn lại (queue FIFO => mọi job trước đó đã xong)
+void iot47_hash_drain()
+{
+  uint8_t other = 0;
+  xQueueReceive(ota_hash_free_q, &other, portMAX_DELAY);
+}
+
+void iot47_hash_finish(uint8_t out[32])
+{
+  iot47_hash_drain();
+  iot47_sha256_final(&ota_hash_ctx, out);
+}
+
+#endif
@@ -0,0 +1,152 @@
+#ifndef __IOT47_OTA_LZSS__
+#define __IOT47_OTA_LZSS__
+
+// ===== Giải nén LZSS dạng stream (bitstream tương thích heatshrink) =====
+// Bit đọc từ MSB -> LSB của từng byte:
+//   1 + 8 bit            : literal
+//   0 + W bit + L bit    : back-reference, offset = index + 1, độ dài = count + 1
+// RAM cố định = 2^W byte cửa sổ (W=11 => 2KB). Dữ liệu vào theo từng mẩu bất kỳ (không cần
+// trọn frame), dữ liệu ra được đẩy vào sink theo khối nhỏ. Dừng đúng khi đủ out_total byte
+// (bỏ qua bit đệm cuối stream).
+// Không phụ thuộc Arduino => dùng chung cho firmware và tool/simulator trên máy tính.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IOT47_LZSS_W_MIN  4
+#define IOT47_LZSS_W_MAX  14
+#define IOT47_LZSS_L_MIN  3
+#ifndef IOT47_LZSS_OUT_CHUNK
+#define IOT47_LZSS_OUT_CHUNK 128
+#endif
+
+typedef bool (*iot47_sink_t)(const uint8_t *data, uint32_t len);
+
+enum {
+  IOT47_LZSS_TAG = 0,
+  IOT47_LZSS_LIT,
+  IOT47_LZSS_IDX,
+  IOT47_LZSS_CNT,
+  IOT47_LZSS_DONE,
+};
+
+typedef struct {
+  uint8_t  *win;
+  uint16_t mask;
+  uint16_t head;
+  uint8_t  wbits, lbits;
+  uint8_t  state;
+  uint8_t  need;            // số bit cần cho trường đang đọc
+  uint8_t  got;
+  uint16_t acc;
+  uint16_t index;
+  uint32_t out_total;
+  uint32_t out_done;
+  uint8_t  out[IOT47_LZSS_OUT_CHUNK];
+  uint16_t out_fill;
+  iot47_sink_t sink;
+  bool     error;           // sink lỗi / tham số sai
+} iot47_lzss_t;
+
+static inline bool iot47_lzss_flush(iot47_lzss_t *z)
+{
+  if(z->out_fill == 0)return true;
+  if(!z->sink(z->out, z->out_fill))z->error = true;
+  z->out_fill = 0;
+  return !z->error;
+}
+
+static inline void iot47_lzss_emit(iot47_lzss_t *z, uint8_t b)
+{
+  z->win[z->head & z->mask] = b;
+  z->head++;
+  z->out[z->out_fill++] = b;
+  if(z->out_fill == IOT47_LZSS_OUT_CHUNK)iot47_lzss_flush(z);
+  if(++z->out_done == z->out_total)z->state = IOT47_LZSS_DONE;
+}
+
+static inline void iot47_lzss_free(iot47_lzss_t *z)
+{
+  if(z->win != 0)free(z->win);
+  z->win = 0;
+}
+
+// wbits/lbits phải khớp với lúc nén. out_total = kích thước sau giải nén
+static inline bool iot47_lzss_init(iot47_lzss_t *z, uint8_t wbits, uint8_t lbits, uint32_t out_total, iot47_sink_t sink)
+{
+  memset(z, 0, sizeof(*z));
+  if((wbits < IOT47_LZSS_W_MIN) || (wbits > IOT47_LZSS_W_MAX) || (lbits < IOT47_LZSS_L_MIN) || (lbits >= wbits) || (sink == 0))
+  {
+    z->error = true;
+    return false;
+  }
+  z->win = (uint8_t *)calloc(1, (size_t)1 << wbits);   // heatshrink: cửa sổ ban đầu toàn 0
+  if(z->win == 0)
+  {
+    z->error = true;
+    return false;
+  }
+  z->mask = (uint16_t)((1u << wbits) - 1);
+  z->wbits = wbits;
+  z->lbits = lbits;
+  z->out_total = out_total;
+  z->sink = sink;
+  z->state = (out_total > 0) ? IOT47_LZSS_TAG : IOT47_LZSS_DONE;
+  return true;
+}
+
+// Đưa thêm dữ liệu nén vào. Trả false nếu sink báo lỗi
+static inline bool iot47_lzss_feed(iot47_lzss_t *z, const uint8_t *data, uint32_t len)
+{
+  if(z->error)return false;
+  for(uint32_t i = 0; (i < len) && (z->state != IOT47_LZSS_DONE); i++)
+  {
+    uint8_t in = data[i];
+    for(int8_t b = 7; (b >= 0) && (z->state != IOT47_LZSS_DONE); b--)
+    {
+      uint8_t bit = (in >> b) & 1;
+      if(z->state == IOT47_LZSS_TAG)
+      {
+        z->state = bit ? IOT47_LZSS_LIT : IOT47_LZSS_IDX;
+        z->need = bit ? 8 : z->wbits;
+        z->got = 0;
+        z->acc = 0;
+        continue;
+      }
+      z->acc = (uint16_t)((z->acc << 1) | bit);
+      if(++z->got < z->need)continue;
+
+      if(z->state == IOT47_LZSS_LIT)
+      {
+        z->state = IOT47_LZSS_TAG;
+        iot47_lzss_emit(z, (uint8_t)z->acc);
+      }
+      else if(z->state == IOT47_LZSS_IDX)
+      {
+        z->index = (uint16_t)(z->acc + 1);
+        z->state = IOT47_LZSS_CNT;
+        z->need = z->lbits;
+        z->got = 0;
+        z->acc = 0;
+      }
+      else
+      {
+        uint16_t count = (uint16_t)(z->acc + 1);
+        z->state = IOT47_LZSS_TAG;
+        while((count-- > 0) && (z->state != IOT47_LZSS_DONE))
+        {
+          iot47_lzss_emit(z, z->win[(uint16_t)(z->head - z->index) & z->mask]);
+        }
+      }
+    }
+  }
+  return iot47_lzss_flush(z);
+}
+
+static inline bool iot47_lzss_done(const iot47_lzss_t *z)
+{
+  return z->state == IOT47_LZSS_DONE;
+}
+
+#endif
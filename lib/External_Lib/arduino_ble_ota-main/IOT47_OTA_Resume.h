@@ -0,0 +1,56 @@
+#ifndef __IOT47_OTA_RESUME__
+#define __IOT47_OTA_RESUME__
+
+// ===== Checkpoint để tiếp tục OTA sau khi mất kết nối =====
+// Lưu trong NVS (Preferences, namespace "iot47ota"):
+//   id   : mã ảnh do host đặt (I= trong header BEGIN)
+//   size : kích thước ảnh
+//   off  : số byte đã ghi chắc chắn xuống flash (chẵn sector)
+//   crc  : CRC32 của [0, off) trong phân vùng đích
+// Ghi lại mỗi IOT47_OTA_CKPT_BYTES và khi phiên bị dừng giữa chừng; xoá khi OTA xong.
+
+#include <Preferences.h>
+
+#ifndef IOT47_OTA_CKPT_BYTES
+#define IOT47_OTA_CKPT_BYTES (64 * 1024)   // ~20 lần ghi NVS cho ảnh 1.2MB
+#endif
+
+typedef struct {
+  uint32_t id;
+  uint32_t size;
+  uint32_t off;
+  uint32_t crc;
+} iot47_ckpt_t;
+
+bool iot47_ckpt_load(iot47_ckpt_t *c)
+{
+  Preferences p;
+  if(!p.begin("iot47ota", true))return false;
+  c->id = p.getUInt("id", 0);
+  c->size = p.getUInt("size", 0);
+  c->off = p.getUInt("off", 0);
+  c->crc = p.getUInt("crc", 0);
+  p.end();
+  return (c->id != 0) && (c->off > 0);
+}
+
+void iot47_ckpt_save(const iot47_ckpt_t *c)
+{
+  Preferences p;
+  if(!p.begin("iot47ota", false))return;
+  p.putUInt("id", c->id);
+  p.putUInt("size", c->size);
+  p.putUInt("off", c->off);
+  p.putUInt("crc", c->crc);
+  p.end();
+}
+
+void iot47_ckpt_clear()
+{
+  Preferences p;
+  if(!p.begin("iot47ota", false))return;
+  p.clear();
+  p.end();
+}
+
+#endif
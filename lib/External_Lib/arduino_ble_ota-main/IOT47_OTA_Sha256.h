@@ -0,0 +1,161 @@
+#ifndef __IOT47_OTA_SHA256__
+#define __IOT47_OTA_SHA256__
+
+// ===== SHA-256 dạng stream =====
+// Trên ESP32 dùng mbedtls (có tăng tốc phần cứng); trên máy tính (tool / simulator) dùng bản C thuần.
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(ESP_PLATFORM) && __has_include("mbedtls/sha256.h")
+  #include "mbedtls/sha256.h"
+  #define IOT47_SHA256_MBEDTLS 1
+#else
+  #define IOT47_SHA256_MBEDTLS 0
+#endif
+
+#if IOT47_SHA256_MBEDTLS
+
+typedef struct { mbedtls_sha256_context ctx; } iot47_sha256_t;
+
+static inline void iot47_sha256_init(iot47_sha256_t *h)
+{
+  mbedtls_sha256_init(&h->ctx);
+  mbedtls_sha256_starts(&h->ctx, 0);
+}
+static inline void iot47_sha256_update(iot47_sha256_t *h, const uint8_t *data, size_t len)
+{
+  mbedtls_sha256_update(&h->ctx, data, len);
+}
+static inline void iot47_sha256_final(iot47_sha256_t *h, uint8_t out[32])
+{
+  mbedtls_sha256_finish(&h->ctx, out);
+  mbedtls_sha256_free(&h->ctx);
+}
+
+#else
+
+typedef struct {
+  uint32_t state[8];
+  uint64_t bytes;
+  uint8_t  buf[64];
+  uint8_t  fill;
+} iot47_sha256_t;
+
+static const uint32_t IOT47_SHA256_K[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define IOT47_ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static inline void iot47_sha256_block(iot47_sha256_t *h, const uint8_t *p)
+{
+  uint32_t w[64];
+  for(int i = 0; i < 16; i++)
+    w[i] = ((uint32_t)p[4 * i] << 24) | ((uint32_t)p[4 * i + 1] << 16) | ((uint32_t)p[4 * i + 2] << 8) | p[4 * i + 3];
+  for(int i = 16; i < 64; i++)
+  {
+    uint32_t s0 = IOT47_ROR32(w[i - 15], 7) ^ IOT47_ROR32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    uint32_t s1 = IOT47_ROR32(w[i - 2], 17) ^ IOT47_ROR32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+  uint32_t a = h->state[0], b = h->state[1], c = h->state[2], d = h->state[3];
+  uint32_t e = h->state[4], f = h->state[5], g = h->state[6], k = h->state[7];
+  for(int i = 0; i < 64; i++)
+  {
+    uint32_t S1 = IOT47_ROR32(e, 6) ^ IOT47_ROR32(e, 11) ^ IOT47_ROR32(e, 25);
+    uint32_t ch = (e & f) ^ (~e & g);
+    uint32_t t1 = k + S1 + ch + IOT47_SHA256_K[i] + w[i];
+    uint32_t S0 = IOT47_ROR32(a, 2) ^ IOT47_ROR32(a, 13) ^ IOT47_ROR32(a, 22);
+    uint32_t mj = (a & b) ^ (a & c) ^ (b & c);
+    uint32_t t2 = S0 + mj;
+    k = g; g = f; f = e; e = d + t1;
+    d = c; c = b; b = a; a = t1 + t2;
+  }
+  h->state[0] += a; h->state[1] += b; h->state[2] += c; h->state[3] += d;
+  h->state[4] += e; h->state[5] += f; h->state[6] += g; h->state[7] += k;
+}
+
+static inline void iot47_sha256_init(iot47_sha256_t *h)
+{
+  static const uint32_t iv[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+  };
+  memcpy(h->state, iv, sizeof(iv));
+  h->bytes = 0;
+  h->fill = 0;
+}
+
+static inline void iot47_sha256_update(iot47_sha256_t *h, const uint8_t *data, size_t len)
+{
+  h->bytes += len;
+  if(h->fill)
+  {
+    size_t take = 64 - h->fill;
+    if(take > len)take = len;
+    memcpy(h->buf + h->fill, data, take);
+    h->fill = (uint8_t)(h->fill + take);
+    data += take;
+    len -= take;
+    if(h->fill < 64)return;
+    iot47_sha256_block(h, h->buf);
+    h->fill = 0;
+  }
+  while(len >= 64)
+  {
+    iot47_sha256_block(h, data);
+    data += 64;
+    len -= 64;
+  }
+  memcpy(h->buf, data, len);
+  h->fill = (uint8_t)len;
+}
+
+static inline void iot47_sha256_final(iot47_sha256_t *h, uint8_t out[32])
+{
+  uint64_t bits = h->bytes * 8;
+  uint8_t pad = 0x80;
+  iot47_sha256_update(h, &pad, 1);
+  pad = 0;
+  while(h->fill != 56)iot47_sha256_update(h, &pad, 1);
+  uint8_t len[8];
+  for(int i = 0; i < 8; i++)len[i] = (uint8_t)(bits >> (56 - 8 * i));
+  iot47_sha256_update(h, len, 8);
+  for(int i = 0; i < 8; i++)
+  {
+    out[4 * i]     = (uint8_t)(h->state[i] >> 24);
+    out[4 * i + 1] = (uint8_t)(h->state[i] >> 16);
+    out[4 * i + 2] = (uint8_t)(h->state[i] >> 8);
+    out[4 * i + 3] = (uint8_t)(h->state[i]);
+  }
+}
+
+#undef IOT47_ROR32
+
+#endif
+
+// Đổi chuỗi hex 64 ký tự -> 32 byte. Trả false nếu sai định dạng
+static inline bool iot47_sha256_from_hex(const char *hex, uint8_t out[32])
+{
+  for(int i = 0; i < 64; i++)
+  {
+    char c = hex[i];
+    uint8_t v;
+    if(c >= '0' && c <= '9')v = (uint8_t)(c - '0');
+    else if(c >= 'a' && c <= 'f')v = (uint8_t)(c - 'a' + 10);
+    else if(c >= 'A' && c <= 'F')v = (uint8_t)(c - 'A' + 10);
+    else return false;
+    if(i & 1)out[i >> 1] = (uint8_t)(out[i >> 1] | v);
+    else out[i >> 1] = (uint8_t)(v << 4);
+  }
+  return true;
+}
+
+#endif
@@ -0,0 +1,377 @@
+#ifndef __IOT47_OTA_WRITER__
+#define __IOT47_OTA_WRITER__
+
+// ===== Flash writer: gom payload thành sector 4KB rồi ghi 1 lần =====
+// Payload của từng frame (~251..508 byte) được copy vào buffer sector; mỗi khi đủ 4KB
+// mới erase + ghi sector đó một lần (esp_partition_erase_range / esp_partition_write).
+// Ghi theo offset (không qua esp_ota_write) để tiếp tục được phiên OTA dở dang; ảnh được
+// kiểm tra khi esp_ota_set_boot_partition().
+// Thời gian mỗi lần ghi sector được đo để báo cáo (flash là nút cổ chai khi BLE nhanh).
+// Khi host theo credit (FC=1), phân vùng được erase trước theo block 64KB trên task erase
+// (IOT47_OTA_Erase.h) nên flush thường chỉ còn esp_partition_write.
+// File asset (BEGIN có N=): sector gom xong được giao cho sink của ứng dụng (vd ghi file LittleFS)
+// thay vì ghi phân vùng; CRC32 / SHA-256 / thống kê giữ nguyên.
+
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_timer.h"
+#include "IOT47_OTA_Hash.h"
+#include "IOT47_OTA_Erase.h"
+#if __has_include("esp_rom_crc.h")
+  #include "esp_rom_crc.h"
+  #define IOT47_CRC32_ROM 1
+#else
+  #define IOT47_CRC32_ROM 0
+#endif
+
+#ifndef IOT47_OTA_SECTOR_SIZE
+#define IOT47_OTA_SECTOR_SIZE 4096
+#endif
+#ifndef IOT47_OTA_PRE_ERASE
+#define IOT47_OTA_PRE_ERASE 1         // 0 => erase từng sector lúc ghi như cũ
+#endif
+
+#ifndef IOT47_OTA_HIST_BUCKETS
+#define IOT47_OTA_HIST_BUCKETS 16     // bucket cuối: >= 32 ms
+#endif
+
+// Histogram log2: bucket i đếm giá trị trong [2^i, 2^(i+1)) us (bucket 0: 0-1 us, bucket cuối gom phần còn lại)
+static inline void iot47_hist_add(uint32_t *hist, uint32_t us)
+{
+  uint32_t b = 0;
+  while((us > 1) && (b < IOT47_OTA_HIST_BUCKETS - 1))
+  {
+    us >>= 1;
+    b++;
+  }
+  hist[b]++;
+}
+
+typedef struct {
+  uint32_t sectors;          // số lần ghi (1 sector / lần, trừ phần đuôi)
+  uint32_t write_us_total;
+  uint32_t write_us_min;
+  uint32_t write_us_max;
+  uint32_t write_hist[IOT47_OTA_HIST_BUCKETS];   // thời gian erase + ghi mỗi sector (log2 us)
+  uint32_t erase_checks;     // số lần flush khi có task erase
+  uint32_t erase_ahead_min;  // erase-ahead: khoảng task erase đi trước con trỏ ghi lúc flush (byte)
+  uint64_t erase_ahead_sum;
+  uint32_t erase_waits;      // số lần writer phải chờ task erase
+  uint32_t erase_wait_us;
+} iot47_flash_stats_t;
+
+// Đích ghi thay cho phân vùng: ghi tiếp len byte tại offset (offset tăng dần, liên tục)
+typedef bool (*iot47_file_sink_t)(uint32_t offset, const uint8_t *data, uint32_t len);
+
+const esp_partition_t *ota_wr_part = 0;
+iot47_file_sink_t ota_wr_sink = 0;       // != 0 => phiên ghi vào sink (ota_wr_part = 0)
+const esp_partition_t *ota_wr_target = 0; // phân vùng đích do ứng dụng chọn (0 => phân vùng OTA kế tiếp)
+uint8_t *ota_wr_buf = 0;                 // buffer sector đang gom (= ota_wr_bufs[ota_wr_idx])
+uint8_t *ota_wr_bufs[2] = { 0, 0 };      // IOT47_OTA_SECTOR_SIZE byte, buffer thứ 2 chỉ có khi băm SHA-256
+uint8_t ota_wr_idx = 0;
+bool ota_wr_hashing = false;             // H= : băm ảnh trên task hash
+uint8_t ota_wr_expect[32];
+bool ota_wr_verified = false;            // ảnh vừa ghi khớp SHA-256 ota_wr_expect
+uint32_t ota_wr_fill = 0;                // số byte đang chờ trong buffer sector
+uint32_t ota_wr_flushed = 0;             // số byte đã ghi xuống flash
+uint32_t ota_wr_crc = 0;                 // CRC32 của [0, ota_wr_flushed) (checkpoint resume)
+esp_err_t ota_wr_err = ESP_OK;
+iot47_flash_stats_t ota_flash_stats;
+uint8_t *ota_wr_old = 0;                 // delta: nội dung cũ của sector vừa ghi đè (0 => không giữ)
+bool ota_wr_pre_erase = false;           // task erase đang erase trước con trỏ ghi
+
+// CRC32 (IEEE, như zlib). crc = 0 cho lần đầu, truyền tiếp kết quả cho các mẩu sau
+static inline uint32_t iot47_crc32(uint32_t crc, const uint8_t *data, uint32_t len)
+{
+#if IOT47_CRC32_ROM
+  return esp_rom_crc32_le(crc, data, len);
+#else
+  crc = ~crc;
+  while(len--)
+  {
+    crc ^= *data++;
+    for(int k = 0; k < 8; k++)crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+  }
+  return ~crc;
+#endif
+}
+
+void iot47_writer_release()
+{
+  if(ota_wr_pre_erase)iot47_erase_stop();  // task erase không còn động tới phân vùng
+  ota_wr_pre_erase = false;
+  if(ota_wr_hashing)iot47_hash_drain();  // task hash không còn đọc buffer
+  ota_wr_hashing = false;
+  for(int i = 0; i < 2; i++)
+  {
+    if(ota_wr_bufs[i] != 0)free(ota_wr_bufs[i]);
+    ota_wr_bufs[i] = 0;
+  }
+  if(ota_wr_old != 0)free(ota_wr_old);
+  ota_wr_buf = 0;
+  ota_wr_old = 0;
+  ota_wr_part = 0;
+  ota_wr_sink = 0;
+}
+
+// Ghi các phiên sau vào part thay vì phân vùng OTA kế tiếp (0 => trở lại mặc định)
+void iot47_writer_set_target(const esp_partition_t *part)
+{
+  ota_wr_target = part;
+}
+
+static void iot47_writer_reset()
+{
+  iot47_writer_release();
+  memset(&ota_flash_stats, 0, sizeof(ota_flash_stats));
+  ota_wr_fill = 0;
+  ota_wr_flushed = 0;
+  ota_wr_crc = 0;
+  ota_wr_verified = false;
+  ota_hash_us = 0;
+  ota_wr_idx = 0;
+}
+
+static bool iot47_writer_alloc()
+{
+  ota_wr_buf = ota_wr_bufs[0] = (uint8_t *)malloc(IOT47_OTA_SECTOR_SIZE);
+  if(ota_wr_buf == 0)
+  {
+    ota_wr_err = ESP_ERR_NO_MEM;
+    ota_wr_part = 0;
+    ota_wr_sink = 0;
+    return false;
+  }
+  ota_wr_err = ESP_OK;
+  return true;
+}
+
+// Mở phân vùng đích (mặc định phân vùng OTA kế tiếp = app1) cho ảnh size byte
+bool iot47_writer_begin(uint32_t size)
+{
+  iot47_writer_reset();
+  ota_wr_part = (ota_wr_target != 0) ? ota_wr_target : esp_ota_get_next_update_partition(0);
+  if((ota_wr_part == 0) || (size == 0) || (size > ota_wr_part->size))
+  {
+    ota_wr_err = ESP_ERR_INVALID_SIZE;
+    ota_wr_part = 0;
+    return false;
+  }
+  // Không erase cả vùng ở BEGIN: erase từng sector khi ghi tới
+  return iot47_writer_alloc();
+}
+
+// Mở phiên ghi vào sink (file asset): không phân vùng, không erase, không resume / delta
+bool iot47_writer_begin_sink(iot47_file_sink_t sink)
+{
+  iot47_writer_reset();
+  if(sink == 0)
+  {
+    ota_wr_err = ESP_ERR_INVALID_ARG;
+    return false;
+  }
+  ota_wr_sink = sink;
+  return iot47_writer_alloc();
+}
+
+// Tiếp tục phiên cũ: [0, offset) đã nằm trên flash với CRC32 = crc (offset chẵn sector)
+void iot47_writer_resume(uint32_t offset, uint32_t crc)
+{
+  ota_wr_flushed = offset;
+  ota_wr_crc = crc;
+}
+
+// Băm SHA-256 ảnh trong lúc ghi, so với expect khi kết thúc (gọi sau begin / resume)
+bool iot47_writer_set_hash(const uint8_t expect[32])
+{
+  if((ota_wr_buf == 0) || ota_wr_hashing)return false;
+  if(ota_wr_bufs[1] == 0)ota_wr_bufs[1] = (uint8_t *)malloc(IOT47_OTA_SECTOR_SIZE);
+  if(ota_wr_bufs[1] == 0)return false;
+  if(!iot47_hash_start(ota_wr_part, ota_wr_bufs[0], ota_wr_bufs[1]))return false;
+  memcpy(ota_wr_expect, expect, 32);
+  ota_wr_hashing = true;
+  iot47_hash_flash(0, ota_wr_flushed);   // phần đã ghi từ phiên trước (resume)
+  return true;
+}
+
+// CRC32 của len byte đầu phân vùng đích (kiểm tra checkpoint trước khi resume)
+bool iot47_writer_crc_flash(uint32_t len, uint32_t *crc)
+{
+  if((ota_wr_part == 0) || (ota_wr_buf == 0))return false;
+  uint32_t c = 0;
+  for(uint32_t off = 0; off < len; off += IOT47_OTA_SECTOR_SIZE)
+  {
+    uint32_t n = len - off;
+    if(n > IOT47_OTA_SECTOR_SIZE)n = IOT47_OTA_SECTOR_SIZE;
+    if(esp_partition_read(ota_wr_part, off, ota_wr_buf, n) != ESP_OK)return false;
+    c = iot47_crc32(c, ota_wr_buf, n);
+  }
+  *crc = c;
+  return true;
+}
+
+// Erase trước [ota_wr_flushed, size) theo block 64KB trên task erase (gọi sau begin / resume).
+// Không dùng cho delta: ảnh cũ nằm ngay trong phân vùng đích.
+// 1 block erase giữ khoá flash ~150 ms, lâu hơn thời gian ring RX chờ trước FAIL:BUSY => chỉ dùng khi
+// host tự điều tốc (FC=1); host cũ gửi dồn vẫn erase từng sector lúc ghi.
+bool iot47_writer_erase_ahead(uint32_t size)
+{
+  if(!IOT47_OTA_PRE_ERASE || (ota_wr_part == 0) || (ota_wr_old != 0) || ota_wr_pre_erase)return false;
+  uint32_t end = (size + IOT47_OTA_SECTOR_SIZE - 1) / IOT47_OTA_SECTOR_SIZE * IOT47_OTA_SECTOR_SIZE;
+  if(end > ota_wr_part->size)end = ota_wr_part->size;
+  if(ota_wr_flushed >= end)return false;
+  ota_wr_pre_erase = iot47_erase_start(ota_wr_part, ota_wr_flushed, end, IOT47_OTA_ERASE_BLOCK);
+  return ota_wr_pre_erase;
+}
+
+// Delta OTA: giữ lại nội dung cũ của sector trước khi ghi đè (gọi sau iot47_writer_begin)
+bool iot47_writer_keep_old()
+{
+  if(ota_wr_old == 0)ota_wr_old = (uint8_t *)malloc(IOT47_OTA_SECTOR_SIZE);
+  return ota_wr_old != 0;
+}
+
+// Đọc ảnh cũ trong phân vùng đang ghi: phần chưa ghi đè đọc từ flash, sector vừa ghi đè đọc
+// từ bản giữ lại. Sector cũ hơn đã mất => false
+bool iot47_writer_read_old(uint32_t offset, uint8_t *dst, uint32_t len)
+{
+  if(ota_wr_part == 0)return false;
+  if(offset < ota_wr_flushed)
+  {
+    if((ota_wr_old == 0) || (offset + IOT47_OTA_SECTOR_SIZE < ota_wr_flushed))return false;
+    uint32_t n = ota_wr_flushed - offset;
+    if(n > len)n = len;
+    memcpy(dst, &ota_wr_old[offset + IOT47_OTA_SECTOR_SIZE - ota_wr_flushed], n);
+    offset += n;
+    dst += n;
+    len -= n;
+  }
+  if(len == 0)return true;
+  return esp_partition_read(ota_wr_part, offset, dst, len) == ESP_OK;
+}
+
+static bool iot47_writer_flush()
+{
+  if(ota_wr_fill == 0)return true;
+  if(ota_wr_old != 0)esp_partition_read(ota_wr_part, ota_wr_flushed, ota_wr_old, ota_wr_fill);
+  bool erased = false;
+  if(ota_wr_pre_erase)
+  {
+    uint32_t done = ota_erase_done;
+    uint32_t ahead = (done > ota_wr_flushed) ? done - ota_wr_flushed : 0;
+    if((ota_flash_stats.erase_checks++ == 0) || (ahead < ota_flash_stats.erase_ahead_min))
+      ota_flash_stats.erase_ahead_min = ahead;
+    ota_flash_stats.erase_ahead_sum += ahead;
+    if(ahead < IOT47_OTA_SECTOR_SIZE)
+    {
+      int64_t w0 = esp_timer_get_time();
+      ota_flash_stats.erase_waits++;
+      erased = iot47_erase_wait(ota_wr_flushed + IOT47_OTA_SECTOR_SIZE);
+      ota_flash_stats.erase_wait_us += (uint32_t)(esp_timer_get_time() - w0);
+    }
+    else erased = true;
+  }
+  int64_t t0 = esp_timer_get_time();
+  if(ota_wr_sink != 0)ota_wr_err = ota_wr_sink(ota_wr_flushed, ota_wr_buf, ota_wr_fill) ? ESP_OK : ESP_FAIL;
+  else
+  {
+    ota_wr_err = erased ? ESP_OK : esp_partition_erase_range(ota_wr_part, ota_wr_flushed, IOT47_OTA_SECTOR_SIZE);
+    if(ota_wr_err == ESP_OK)ota_wr_err = esp_partition_write(ota_wr_part, ota_wr_flushed, ota_wr_buf, ota_wr_fill);
+  }
+  uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+  if(ota_wr_err != ESP_OK)return false;
+
+  ota_flash_stats.sectors++;
+  ota_flash_stats.write_us_total += us;
+  if((ota_flash_stats.write_us_min == 0) || (us < ota_flash_stats.write_us_min))ota_flash_stats.write_us_min = us;
+  if(us > ota_flash_stats.write_us_max)ota_flash_stats.write_us_max = us;
+  iot47_hist_add(ota_flash_stats.write_hist, us);
+
+  ota_wr_crc = iot47_crc32(ota_wr_crc, ota_wr_buf, ota_wr_fill);
+  ota_wr_flushed += ota_wr_fill;
+  if(ota_wr_pre_erase)iot47_erase_advance(ota_wr_flushed);
+  if(ota_wr_hashing)
+  {
+    // task hash băm sector này trong lúc ta gom sector kế tiếp vào buffer còn lại
+    ota_wr_idx = iot47_hash_push(ota_wr_idx, ota_wr_fill);
+    ota_wr_buf = ota_wr_bufs[ota_wr_idx];
+  }
+  ota_wr_fill = 0;
+  return true;
+}
+
+// Thêm payload vào buffer sector, ghi xuống flash mỗi khi đủ 1 sector
+bool iot47_writer_write(const uint8_t *data, uint32_t len)
+{
+  if((ota_wr_buf == 0) || (ota_wr_err != ESP_OK))return false;
+  while(len > 0)
+  {
+    uint32_t take = IOT47_OTA_SECTOR_SIZE - ota_wr_fill;
+    if(take > len)take = len;
+    memcpy(&ota_wr_buf[ota_wr_fill], data, take);
+    ota_wr_fill += take;
+    data += take;
+    len -= take;
+    if((ota_wr_fill == IOT47_OTA_SECTOR_SIZE) && !iot47_writer_flush())return false;
+  }
+  return true;
+}
+
+void iot47_writer_print_stats()
+{
+  uint32_t avg = ota_flash_stats.sectors ? ota_flash_stats.write_us_total / ota_flash_stats.sectors : 0;
+  Serial.printf("[OTA] flash: %lu sectors, write avg %lu us, min %lu us, max %lu us\n",
+                (unsigned long)ota_flash_stats.sectors,
+                (unsigned long)avg,
+                (unsigned long)ota_flash_stats.write_us_min,
+                (unsigned long)ota_flash_stats.write_us_max);
+  if(ota_flash_stats.erase_checks > 0)
+    Serial.printf("[OTA] erase-ahead: avg %lu B, min %lu B, writer waited %lu x (%lu us)\n",
+                  (unsigned long)(ota_flash_stats.erase_ahead_sum / ota_flash_stats.erase_checks),
+                  (unsigned long)ota_flash_stats.erase_ahead_min,
+                  (unsigned long)ota_flash_stats.erase_waits,
+                  (unsigned long)ota_flash_stats.erase_wait_us);
+  if(ota_hash_us > 0)Serial.printf("[OTA] sha256: %lu us on hash task\n", (unsigned long)ota_hash_us);
+}
+
+// Ghi phần đuôi và (nếu có H=) so SHA-256. Sai => ota_wr_err = ESP_ERR_INVALID_CRC
+bool iot47_writer_finish()
+{
+  if(ota_wr_buf == 0)return false;
+  if(!iot47_writer_flush())return false;
+  if(ota_wr_hashing)
+  {
+    uint8_t digest[32];
+    iot47_hash_finish(digest);
+    ota_wr_hashing = false;
+    if(memcmp(digest, ota_wr_expect, 32) != 0)
+    {
+      ota_wr_err = ESP_ERR_INVALID_CRC;
+      return false;
+    }
+    ota_wr_verified = true;
+  }
+  return true;
+}
+
+// Chọn phân vùng boot mới (IDF kiểm tra ảnh trước khi chọn)
+bool iot47_writer_end()
+{
+  if(!iot47_writer_finish())
+  {
+    iot47_writer_release();
+    return false;
+  }
+  iot47_writer_print_stats();
+  ota_wr_err = esp_ota_set_boot_partition(ota_wr_part);
+  iot47_writer_release();
+  return ota_wr_err == ESP_OK;
+}
+
+// Bỏ phiên ghi: dữ liệu đã ghi vẫn nằm trên flash (để resume), boot partition không đổi
+void iot47_writer_abort()
+{
+  iot47_writer_release();
+}
+
+#endif
@@ -0,0 +1,243 @@
+// MeblockAssets.cpp
+#include "MeblockAssets.h"
+#include <LittleFS.h>
+#include "esp_partition.h"
+#include "mbedtls/sha256.h"
+
+static const char *ASSET_LABELS[] = { "spiffs", "ffat" };   // phân vùng data theo thứ tự ưu tiên
+static const char *ASSET_TMP = "/.upload";                  // file đang nhận (tên asset không bắt đầu bằng '.')
+static const uint32_t ASSET_RESERVE = 2 * 4096;             // LittleFS cần vài block trống cho metadata
+
+static bool s_mounted = false;
+static const char *s_label = nullptr;
+static File s_upload;
+static char s_uploadName[MEBLOCK_ASSET_NAME_MAX + 1];
+static uint32_t s_uploadDone = 0;
+
+static void assetPath(const char *name, char path[MEBLOCK_ASSET_NAME_MAX + 2]) {
+  snprintf(path, MEBLOCK_ASSET_NAME_MAX + 2, "/%s", name);
+}
+
+static const esp_partition_t *assetPartition(const char **label) {
+  for (const char *l : ASSET_LABELS) {
+    const esp_partition_t *p = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, l);
+    if (p) {
+      *label = l;
+      return p;
+    }
+  }
+  return nullptr;
+}
+
+// Toàn bộ phân vùng đã xoá (0xFF): chưa có filesystem nào (kể cả FAT có wear-levelling ghi ở cuối phân vùng)
+static bool partitionErased(const esp_partition_t *p) {
+  uint32_t buf[256];
+  for (uint32_t off = 0; off + sizeof(buf) <= p->size; off += sizeof(buf)) {
+    if (esp_partition_read(p, off, buf, sizeof(buf)) != ESP_OK) return false;
+    for (uint32_t w : buf) {
+      if (w != 0xFFFFFFFFu) return false;
+    }
+  }
+  return true;
+}
+
+bool meblock_assets_begin() {
+  if (s_mounted) return true;
+  const char *label = nullptr;
+  if (!assetPartition(&label)) return false;
+  // Không bao giờ format ở đây: phân vùng có thể đang chứa dữ liệu khác (vd FAT trên "ffat")
+  if (!LittleFS.begin(false, MEBLOCK_ASSET_BASE, 4, label)) {
+    Serial.printf("[ASSET] no LittleFS on %s (FILES_FORMAT to format)\n", label);
+    return false;
+  }
+  s_mounted = true;
+  s_label = label;
+  return true;
+}
+
+bool meblock_assets_format(bool force) {
+  if (s_upload) return false;   // đang nhận file
+  const char *label = nullptr;
+  const esp_partition_t *p = assetPartition(&label);
+  if (!p) return false;
+  if (!force && !partitionErased(p)) {
+    Serial.printf("[ASSET] %s is not empty, not formatting\n", label);
+    return false;
+  }
+  Serial.printf("[ASSET] formatting %s (%lu KB)...\n", label, (unsigned long)(p->size / 1024));
+  if (s_mounted) {
+    LittleFS.end();
+    s_mounted = false;
+  }
+  // begin(true) format khi không mount được; đã có LittleFS => format() xoá hết
+  bool ok = LittleFS.begin(true, MEBLOCK_ASSET_BASE, 4, label);
+  if (ok && force) ok = LittleFS.format();
+  if (!ok) {
+    Serial.printf("[ASSET] format failed on %s\n", label);
+    return false;
+  }
+  s_mounted = true;
+  s_label = label;
+  return true;
+}
+
+fs::FS &meblock_assets_fs() {
+  meblock_assets_begin();
+  return LittleFS;
+}
+
+bool meblock_asset_name_valid(const char *name) {
+  size_t n = name ? strlen(name) : 0;
+  if (n == 0 || n > MEBLOCK_ASSET_NAME_MAX || name[0] == '.') return false;
+  for (size_t i = 0; i < n; i++) {
+    char c = name[i];
+    bool ok = (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '.' || c == '_' ||
+              c == '-';
+    if (!ok) return false;
+  }
+  return true;
+}
+
+File meblock_asset_open(const char *name) {
+  if (!meblock_asset_name_valid(name) || !meblock_assets_begin()) return File();
+  char path[MEBLOCK_ASSET_NAME_MAX + 2];
+  assetPath(name, path);
+  if (!LittleFS.exists(path)) return File();
+  return LittleFS.open(path, "r");
+}
+
+bool meblock_asset_exists(const char *name) {
+  if (!meblock_asset_name_valid(name) || !meblock_assets_begin()) return false;
+  char path[MEBLOCK_ASSET_NAME_MAX + 2];
+  assetPath(name, path);
+  return LittleFS.exists(path);
+}
+
+bool meblock_asset_remove(const char *name) {
+  if (!meblock_asset_exists(name)) return false;
+  char path[MEBLOCK_ASSET_NAME_MAX + 2];
+  assetPath(name, path);
+  return LittleFS.remove(path);
+}
+
+bool meblock_asset_sha(const char *name, uint8_t sha[32], uint32_t *size) {
+  File f = meblock_asset_open(name);
+  if (!f) return false;
+  mbedtls_sha256_context ctx;
+  mbedtls_sha256_init(&ctx);
+  mbedtls_sha256_starts(&ctx, 0);
+  uint8_t buf[512];   // lệnh BLE chạy trên task host: stack nhỏ
+  uint32_t total = 0;
+  for (;;) {
+    int n = f.read(buf, sizeof(buf));
+    if (n <= 0) break;
+    mbedtls_sha256_update(&ctx, buf, (size_t)n);
+    total += (uint32_t)n;
+  }
+  mbedtls_sha256_finish(&ctx, sha);
+  mbedtls_sha256_free(&ctx);
+  bool ok = total == (uint32_t)f.size();
+  f.close();
+  if (size) *size = total;
+  return ok;
+}
+
+bool meblock_asset_holds(const char *name, const uint8_t *sha, uint32_t size) {
+  if (!sha) return false;
+  File f = meblock_asset_open(name);
+  if (!f) return false;
+  bool sameSize = (uint32_t)f.size() == size;   // so size trước: không phải băm cả file khi đã khác
+  f.close();
+  uint8_t have[32];
+  uint32_t n = 0;
+  return sameSize && meblock_asset_sha(name, have, &n) && n == size && memcmp(have, sha, 32) == 0;
+}
+
+void meblock_asset_list(void (*out)(const char *line)) {
+  char line[96];
+  if (!meblock_assets_begin()) {
+    snprintf(line, sizeof(line), "FILES none\r\n");
+    Serial.print(line);
+    if (out) out(line);
+    return;
+  }
+
+  uint16_t count = 0;
+  File root = LittleFS.open("/");
+  for (File f = root.openNextFile(); f; f = root.openNextFile()) {
+    if (!f.isDirectory() && f.name()[0] != '.') count++;
+  }
+  root.close();
+  snprintf(line, sizeof(line), "FILES %u %s used=%lu total=%lu\r\n", (unsigned)count, s_label,
+           (unsigned long)LittleFS.usedBytes(), (unsigned long)LittleFS.totalBytes());
+  Serial.print(line);
+  if (out) out(line);
+
+  root = LittleFS.open("/");
+  for (File f = root.openNextFile(); f; f = root.openNextFile()) {
+    if (f.isDirectory() || f.name()[0] == '.') continue;
+    snprintf(line, sizeof(line), "FILE %s %lu\r\n", f.name(), (unsigned long)f.size());
+    Serial.print(line);
+    if (out) out(line);
+  }
+  root.close();
+}
+
+void meblock_asset_print_sha(const char *name, void (*out)(const char *line)) {
+  uint8_t sha[32];
+  uint32_t size = 0;
+  char line[MEBLOCK_ASSET_NAME_MAX + 96];
+  if (meblock_asset_sha(name, sha, &size)) {
+    int n = snprintf(line, sizeof(line), "FILE_SHA %s ", name);
+    for (int i = 0; i < 32; i++) n += snprintf(line + n, sizeof(line) - n, "%02x", sha[i]);
+    snprintf(line + n, sizeof(line) - n, " %lu\r\n", (unsigned long)size);
+  } else {
+    snprintf(line, sizeof(line), "FILE_SHA %.*s none\r\n", MEBLOCK_ASSET_NAME_MAX, name);
+  }
+  Serial.print(line);
+  if (out) out(line);
+}
+
+bool meblock_asset_upload_open(const char *name, uint32_t size) {
+  if (s_upload) s_upload.close();
+  if (!meblock_asset_name_valid(name) || !meblock_assets_begin()) return false;
+
+  // Chỗ trống tính cả file cũ cùng tên (chỉ bị thay khi nhận xong)
+  size_t total = LittleFS.totalBytes();
+  size_t used = LittleFS.usedBytes();
+  if (used + size + ASSET_RESERVE > total) {
+    Serial.printf("[ASSET] %s: %lu bytes, only %lu free\n", name, (unsigned long)size,
+                  (unsigned long)(total > used ? total - used : 0));
+    return false;
+  }
+  s_upload = LittleFS.open(ASSET_TMP, "w");
+  if (!s_upload) return false;
+  strncpy(s_uploadName, name, MEBLOCK_ASSET_NAME_MAX);
+  s_uploadName[MEBLOCK_ASSET_NAME_MAX] = '\0';
+  s_uploadDone = 0;
+  return true;
+}
+
+bool meblock_asset_upload_write(uint32_t offset, const uint8_t *data, uint32_t len) {
+  if (!s_upload || offset != s_uploadDone) return false;
+  if (s_upload.write(data, len) != len) return false;
+  s_uploadDone += len;
+  return true;
+}
+
+bool meblock_asset_upload_close(bool ok) {
+  if (!s_upload) return false;
+  s_upload.close();
+  if (!ok) {
+    LittleFS.remove(ASSET_TMP);
+    return true;
+  }
+  char path[MEBLOCK_ASSET_NAME_MAX + 2];
+  assetPath(s_uploadName, path);
+  // LittleFS rename thay file cũ nguyên tử: mất điện giữa chừng vẫn còn nguyên 1 bản (cũ hoặc mới)
+  if (!LittleFS.rename(ASSET_TMP, path)) {
+    LittleFS.remove(ASSET_TMP);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,63 @@
+// MeblockAssets.h
+#pragma once
+#include <Arduino.h>
+#include <FS.h>
+
+// File asset (âm thanh, bitmap cho Oled, cấu hình...) trên LittleFS, ở phân vùng data "spiffs" (board 4MB)
+// hoặc "ffat" (board 16MB). Tải lên 1 lần qua pipeline OTA của core factory (BEGIN có ;N=<tên>, xem
+// IOT47_BLE_OTA.h), chương trình chỉ đọc => asset không còn nằm trong ảnh app, mỗi lần OTA nhỏ hơn.
+// Tên file phẳng (không thư mục): 1..MEBLOCK_ASSET_NAME_MAX ký tự A-Z a-z 0-9 . _ -, không bắt đầu bằng '.'.
+// Filesystem mount khi dùng lần đầu, không làm chậm boot. Mount không bao giờ tự format: phân vùng chưa có LittleFS
+// chỉ được format khi người dùng yêu cầu (FILES_FORMAT) hoặc khi đã kiểm tra là trống hẳn (meblock_assets_format).
+
+#ifndef MEBLOCK_ASSET_BASE
+#define MEBLOCK_ASSET_BASE "/assets"   // mount point VFS (fopen("/assets/<tên>") cũng đọc được)
+#endif
+#define MEBLOCK_ASSET_NAME_MAX 31
+
+/// Mount LittleFS (không format). false nếu bảng phân vùng không có spiffs / ffat hoặc phân vùng chưa có LittleFS
+bool meblock_assets_begin();
+
+/// Format phân vùng asset thành LittleFS rồi mount. force = false: chỉ format khi cả phân vùng đang trống (toàn 0xFF),
+/// force = true: xoá mọi dữ liệu đang có. Mất vài giây: không gọi từ callback BLE. false nếu không format
+bool meblock_assets_format(bool force);
+
+/// Filesystem asset (đã mount), vd để truyền cho thư viện đọc file
+fs::FS &meblock_assets_fs();
+
+/// Tên hợp lệ cho 1 asset
+bool meblock_asset_name_valid(const char *name);
+
+/// Mở asset để đọc. File rỗng (false) nếu không có
+File meblock_asset_open(const char *name);
+
+/// Asset có tồn tại
+bool meblock_asset_exists(const char *name);
+
+/// Xoá asset
+bool meblock_asset_remove(const char *name);
+
+/// SHA-256 và size của asset. false nếu không có
+bool meblock_asset_sha(const char *name, uint8_t sha[32], uint32_t *size);
+
+/// Asset name đang có đúng size byte với SHA-256 sha (sha = nullptr => false)
+bool meblock_asset_holds(const char *name, const uint8_t *sha, uint32_t size);
+
+/// In danh sách asset ra Serial; out != nullptr => gửi thêm từng dòng qua out (vd trả lời BLE)
+void meblock_asset_list(void (*out)(const char *line));
+
+/// In "FILE_SHA <tên> <sha 64 hex> <size>" (hoặc "... none") ra Serial và out
+void meblock_asset_print_sha(const char *name, void (*out)(const char *line));
+
+// ===== Tải lên (core factory, asset callback của IOT47) =====
+// Dữ liệu ghi vào file tạm; chỉ khi close(true) file tạm mới thay file cũ cùng tên => mất kết nối giữa chừng
+// không làm hỏng asset đang có.
+
+/// Bắt đầu nhận asset name, size byte. false nếu tên sai / không đủ chỗ
+bool meblock_asset_upload_open(const char *name, uint32_t size);
+
+/// Ghi tiếp len byte (offset = số byte đã ghi)
+bool meblock_asset_upload_write(uint32_t offset, const uint8_t *data, uint32_t len);
+
+/// ok = true: thay file cũ bằng file vừa nhận; false: bỏ file tạm
+bool meblock_asset_upload_close(bool ok);
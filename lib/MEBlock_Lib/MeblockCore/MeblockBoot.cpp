@@ -0,0 +1,72 @@
+// MeblockBoot.cpp
+#include "MeblockBoot.h"
+#include <atomic>
+#include "esp_timer.h"
+
+struct MeblockBootMark {
+  std::atomic<const char *> stage;   // ghi (release) sau us: đọc được stage (acquire) là us đã đúng
+  uint32_t us;
+};
+
+static MeblockBootMark s_marks[MEBLOCK_BOOT_MARKS];
+static std::atomic<uint32_t> s_markCount{0};
+
+static const MeblockBootMark *findMark(const char *stage, uint32_t n) {
+  for (uint32_t i = 0; i < n; i++) {
+    const char *s = s_marks[i].stage.load(std::memory_order_acquire);   // nullptr: slot đang được ghi
+    if (s && (s == stage || strcmp(s, stage) == 0)) return &s_marks[i];
+  }
+  return nullptr;
+}
+
+void meblock_boot_mark(const char *stage) {
+  uint32_t us = (uint32_t)esp_timer_get_time();
+  uint32_t n = s_markCount.load();
+  if (n >= MEBLOCK_BOOT_MARKS || findMark(stage, n)) return;
+
+  // Giữ chỗ rồi mới ghi: BLE host task và loop() có thể ghi cùng lúc
+  uint32_t i = s_markCount.fetch_add(1);
+  if (i >= MEBLOCK_BOOT_MARKS) {
+    s_markCount.store(MEBLOCK_BOOT_MARKS);
+    return;
+  }
+  s_marks[i].us = us;
+  s_marks[i].stage.store(stage, std::memory_order_release);
+}
+
+uint32_t meblock_boot_us(const char *stage) {
+  uint32_t n = s_markCount.load();
+  if (n > MEBLOCK_BOOT_MARKS) n = MEBLOCK_BOOT_MARKS;
+  const MeblockBootMark *m = findMark(stage, n);
+  return m ? m->us : 0;
+}
+
+void meblock_boot_dump() {
+  uint32_t n = s_markCount.load();
+  if (n > MEBLOCK_BOOT_MARKS) n = MEBLOCK_BOOT_MARKS;
+  Serial.printf("[BOOT] timeline (%s boot, us since app start):\n", MEBLOCK_FAST_BOOT ? "fast" : "normal");
+  uint32_t prev = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    const char *stage = s_marks[i].stage.load(std::memory_order_acquire);
+    if (!stage) continue;   // đang được ghi
+    Serial.printf("[BOOT] %9lu  +%8lu  %s\n", (unsigned long)s_marks[i].us,
+                  (unsigned long)(s_marks[i].us - prev), stage);
+    prev = s_marks[i].us;
+  }
+}
+
+void meblock_boot_delay(uint32_t ms) {
+#if MEBLOCK_FAST_BOOT
+  (void)ms;
+#else
+  delay(ms);
+#endif
+}
+
+void meblock_restart() {
+  Serial.flush();   // chờ TX gửi hết thay vì delay cố định
+#if !MEBLOCK_FAST_BOOT
+  delay(200);
+#endif
+  ESP.restart();
+}
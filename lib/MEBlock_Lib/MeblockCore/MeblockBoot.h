@@ -0,0 +1,31 @@
+// MeblockBoot.h
+#pragma once
+#include <Arduino.h>
+
+// Timeline khởi động: mỗi mốc lưu thời điểm (us, esp_timer: tính từ lúc app chạy, không gồm bootloader).
+// Ghi mốc chỉ tốn vài chục ns (không in gì); in toàn bộ bằng meblock_boot_dump() hoặc lệnh UART "BOOT?".
+
+#ifndef MEBLOCK_BOOT_MARKS
+#define MEBLOCK_BOOT_MARKS 16     // số mốc tối đa, mốc thừa bị bỏ
+#endif
+
+// Fast boot: bỏ các delay() cố định lúc khởi động / trước restart (chỉ chờ Serial gửi xong).
+// Đặt -DMEBLOCK_FAST_BOOT=0 để giữ các khoảng chờ cũ (vd. cần đọc log sớm qua USB CDC).
+#ifndef MEBLOCK_FAST_BOOT
+#define MEBLOCK_FAST_BOOT 1
+#endif
+
+/// Ghi 1 mốc. stage phải là chuỗi hằng; mỗi stage chỉ ghi lần đầu. Gọi được từ mọi task.
+void meblock_boot_mark(const char *stage);
+
+/// Thời điểm (us) của mốc stage, 0 nếu chưa có
+uint32_t meblock_boot_us(const char *stage);
+
+/// In timeline: thời điểm từng mốc + khoảng cách tới mốc trước
+void meblock_boot_dump();
+
+/// delay(ms) khởi động, bỏ qua khi MEBLOCK_FAST_BOOT
+void meblock_boot_delay(uint32_t ms);
+
+/// Restart sau khi Serial gửi hết log (không chờ cố định 200 ms khi MEBLOCK_FAST_BOOT)
+[[noreturn]] void meblock_restart();
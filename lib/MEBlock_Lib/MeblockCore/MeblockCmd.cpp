@@ -0,0 +1,86 @@
+// MeblockCmd.cpp
+#include "MeblockCmd.h"
+
+static inline bool isSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static inline char upper(char c) {
+  return (c >= 'a' && c <= 'z') ? (char)(c - 'a' + 'A') : c;
+}
+
+// So sánh không phân biệt hoa thường n byte đầu
+static bool equalsNoCase(const char *a, const char *b, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    if (upper(a[i]) != upper(b[i])) return false;
+  }
+  return true;
+}
+
+char *meblock_cmd_trim(char *s, size_t *len) {
+  size_t n = *len;
+  while (n > 0 && isSpace(*s)) {
+    s++;
+    n--;
+  }
+  for (;;) {
+    while (n > 0 && isSpace(s[n - 1])) n--;
+    // Tool gửi literal "\n" hoặc "\r" (2 ký tự '\' và 'n') ở cuối → cắt bỏ
+    if (n >= 2 && s[n - 2] == '\\' && (s[n - 1] == 'n' || s[n - 1] == 'r')) {
+      n -= 2;
+      continue;
+    }
+    break;
+  }
+  s[n] = '\0';
+  *len = n;
+  return s;
+}
+
+const char *meblock_line_feed(MeblockLineBuf *lb, char c, size_t *outLen) {
+  if (c != '\n' && c != '\r') {
+    if (lb->len < MEBLOCK_CMD_MAX) {
+      lb->buf[lb->len++] = c;
+    } else {
+      lb->overflow = true;   // quá dài: bỏ cả dòng khi gặp cuối dòng
+    }
+    return nullptr;
+  }
+
+  bool overflow = lb->overflow;
+  size_t n = lb->len;
+  lb->len = 0;
+  lb->overflow = false;
+  if (overflow || n == 0) return nullptr;
+
+  const char *line = meblock_cmd_trim(lb->buf, &n);
+  if (n == 0) return nullptr;
+  *outLen = n;
+  return line;
+}
+
+const MeblockCmd *meblock_cmd_find(const MeblockCmd *table, size_t count, const char *line, size_t len,
+                                   const char **arg) {
+  for (size_t i = 0; i < count; i++) {
+    const char *name = table[i].name;
+    size_t n = strlen(name);
+    bool prefix = (n > 0 && name[n - 1] == '=');
+    if (prefix ? (len < n) : (len != n)) continue;
+    if (!equalsNoCase(line, name, n)) continue;
+
+    const char *a = line + n;
+    while (isSpace(*a)) a++;
+    *arg = a;
+    return &table[i];
+  }
+  return nullptr;
+}
+
+bool meblock_cmd_dispatch(const MeblockCmd *table, size_t count, const char *line, size_t len,
+                          MeblockCmdSource src) {
+  const char *arg = nullptr;
+  const MeblockCmd *cmd = meblock_cmd_find(table, count, line, len, &arg);
+  if (!cmd) return false;
+  cmd->fn(arg, src);
+  return true;
+}
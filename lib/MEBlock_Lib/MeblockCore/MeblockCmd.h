@@ -0,0 +1,53 @@
+// MeblockCmd.h
+#pragma once
+#include <Arduino.h>
+
+// Bộ xử lý lệnh text dùng chung (UART, BLE, MeblockCore): buffer cố định, không cấp phát heap.
+// Mỗi firmware khai báo bảng lệnh hằng (nằm trong flash), ví dụ:
+//   static const MeblockCmd kCmds[] = {
+//     { "NAME?", cmdNameQuery },   // khớp nguyên dòng (không phân biệt hoa thường)
+//     { "NAME=", cmdNameSet },     // tên kết thúc bằng '=' => khớp tiền tố, arg = phần sau '='
+//   };
+//   meblock_cmd_dispatch(kCmds, MEBLOCK_CMD_COUNT(kCmds), line, len, MEBLOCK_CMD_SRC_UART);
+
+#ifndef MEBLOCK_CMD_MAX
+#define MEBLOCK_CMD_MAX 64      // độ dài tối đa 1 dòng lệnh (không tính '\0')
+#endif
+
+#define MEBLOCK_CMD_COUNT(table) (sizeof(table) / sizeof((table)[0]))
+
+/// Lệnh đến từ đâu (để handler chọn kênh trả lời)
+enum MeblockCmdSource : uint8_t {
+  MEBLOCK_CMD_SRC_UART = 0,
+  MEBLOCK_CMD_SRC_BLE  = 1,
+};
+
+/// arg: phần sau '=' (đã trim) với lệnh tiền tố, "" với lệnh khớp nguyên dòng
+typedef void (*meblock_cmd_fn_t)(const char *arg, MeblockCmdSource src);
+
+struct MeblockCmd {
+  const char *name;
+  meblock_cmd_fn_t fn;
+};
+
+/// Gom từng byte thành dòng ('\n' hoặc '\r' kết thúc). Dòng dài quá MEBLOCK_CMD_MAX bị bỏ cả dòng.
+struct MeblockLineBuf {
+  char buf[MEBLOCK_CMD_MAX + 1];
+  uint8_t len;
+  bool overflow;
+};
+
+/// Thêm 1 byte. Trả về dòng đã trim (kết thúc '\0', nằm trong lb->buf) khi gặp cuối dòng, nullptr nếu chưa đủ
+/// hoặc dòng rỗng. *outLen = độ dài dòng. Con trỏ hợp lệ tới lần gọi kế tiếp.
+const char *meblock_line_feed(MeblockLineBuf *lb, char c, size_t *outLen);
+
+/// Trim khoảng trắng 2 đầu tại chỗ (và "\n" / "\r" dạng chữ do một số tool gửi). Trả về đầu chuỗi mới.
+char *meblock_cmd_trim(char *s, size_t *len);
+
+/// Tìm lệnh khớp với line (đã trim, len byte). *arg trỏ vào line (phần sau '='). nullptr nếu không khớp.
+const MeblockCmd *meblock_cmd_find(const MeblockCmd *table, size_t count, const char *line, size_t len,
+                                   const char **arg);
+
+/// Tìm và chạy. line phải kết thúc '\0' (arg trỏ vào line). false nếu không có lệnh khớp.
+bool meblock_cmd_dispatch(const MeblockCmd *table, size_t count, const char *line, size_t len,
+                          MeblockCmdSource src);
@@ -1,5 +1,9 @@
 // MeblockCore.cpp
 #include "MeblockCore.h"
+#include "MeblockCmd.h"
+#include "MeblockBoot.h"
+#include "MeblockSlots.h"
+#include "MeblockAssets.h"
 #include <Preferences.h>
 
 extern "C" {
@@ -8,18 +12,37 @@ extern "C" {
   #include "esp_partition.h"
   #include "esp_err.h"
 }
+#include "esp_attr.h"
+#include <stddef.h>
 
 // ===== DRD (Double Reset Detector) =====
+// Trạng thái DRD nằm trong RTC no-init: giữ qua reset mềm / WDT / thường cả nút EN, không ghi flash khi boot.
+// Bản ghi RTC sai magic / CRC (cúp nguồn, RTC bị xoá) => dự phòng cờ NVS, ghi từ loop() (ngoài đường khởi động).
+// Giới hạn: mỗi lần cấp nguồn (cold boot) RTC luôn sai, nên vẫn mở NVS đọc trong setup(), commit DRD_MAGIC ở
+// loop() đầu và commit xoá sau DRD_TIMEOUT. Bỏ dự phòng này thì cúp nguồn 2 lần liên tiếp không còn về factory.
 static Preferences prefs;
 
 static const uint32_t DRD_MAGIC   = 0xDEADBEEF;
 static const uint32_t DRD_TIMEOUT = 8000;   // ms
 
+static const uint32_t DRD_RTC_ARMED = 1 << 0;   // đang trong cửa sổ chờ reset lần 2
+static const uint32_t DRD_RTC_NVS   = 1 << 1;   // cờ NVS đang bật (phải xoá khi hết cửa sổ)
+
+struct DrdRtcState {
+  uint32_t magic;
+  uint32_t flags;
+  uint32_t crc;
+};
+static RTC_NOINIT_ATTR DrdRtcState drdRtc;
+
 static unsigned long drdStartTime = 0;
 static bool drdArmed              = false;
+static bool drdNvsArmPending      = false;   // bật cờ NVS ở lần loop() đầu
+static bool drdNvsClearPending    = false;   // xoá cờ NVS ở lần loop() đầu (reset mềm giữa cửa sổ)
+static bool bootReported          = false;
 
-// Buffer lệnh UART
-static String uartCmdBuf;
+// Buffer lệnh UART (cố định, không cấp phát heap)
+static MeblockLineBuf uartLine;
 
 // ================== CORE INTERNAL FUNCTIONS ==================
 
@@ -49,108 +72,193 @@ static void resetToFactory() {
   }
 
   Serial.println("[MEBLOCK_CORE][FACTORY] Đã set boot về FACTORY (app0). Restart...");
-  delay(200);
-  esp_restart();
+  meblock_restart();
+}
+
+// CRC32 (IEEE) của magic + flags
+static uint32_t drdRtcCrc(const DrdRtcState &st) {
+  const uint8_t *p = (const uint8_t *)&st;
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < offsetof(DrdRtcState, crc); i++) {
+    crc ^= p[i];
+    for (int k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+  }
+  return ~crc;
+}
+
+static bool drdRtcValid() {
+  return drdRtc.magic == DRD_MAGIC && drdRtc.crc == drdRtcCrc(drdRtc);
+}
+
+static void drdRtcWrite(uint32_t flags) {
+  drdRtc.magic = DRD_MAGIC;
+  drdRtc.flags = flags;
+  drdRtc.crc   = drdRtcCrc(drdRtc);
+}
+
+static void drdNvsWrite(uint32_t flag) {
+  prefs.begin("drd", false);
+  prefs.putUInt("flag", flag);
+  prefs.end();
 }
 
-// Khởi động DRD – gọi 1 lần trong setup()
+// Khởi động DRD – gọi 1 lần trong setup(). Chỉ đọc / ghi RTC, trừ khi RTC không còn giữ trạng thái
 static void setupDoubleResetDetector() {
   esp_reset_reason_t reason = esp_reset_reason();
-  Serial.printf("[MEBLOCK_CORE][DRD] Reset reason = %d\n", (int)reason);
+  bool rtcValid = drdRtcValid();
+  uint32_t flags = rtcValid ? drdRtc.flags : 0;
+  Serial.printf("[MEBLOCK_CORE][DRD] Reset reason = %d, RTC state %s\n", (int)reason, rtcValid ? "valid" : "lost");
 
   // Chỉ dùng DRD cho POWERON / EXT reset (ấn nút reset, cúp nguồn)
   if (reason != ESP_RST_POWERON && reason != ESP_RST_EXT) {
-    prefs.begin("drd", false);
-    prefs.putUInt("flag", 0);   // clear flag nếu còn từ trước
-    prefs.end();
-
-    Serial.println("[MEBLOCK_CORE][DRD] Not POWERON/EXT → skip DRD & clear flag.");
+    drdNvsClearPending = (flags & DRD_RTC_NVS) != 0;
+    drdRtcWrite(flags & DRD_RTC_NVS);   // đóng cửa sổ, cờ NVS (nếu có) xoá ở loop()
+    Serial.println("[MEBLOCK_CORE][DRD] Not POWERON/EXT → skip DRD.");
     return;
   }
 
-  prefs.begin("drd", false);
-  uint32_t flag = prefs.getUInt("flag", 0);
-
-  if (flag == DRD_MAGIC) {
-    Serial.println("[MEBLOCK_CORE][DRD] Double reset detected → resetToFactory()");
-    prefs.putUInt("flag", 0);   // clear flag
+  bool doubleReset = (flags & DRD_RTC_ARMED) != 0;
+  if (!rtcValid) {
+    // RTC không giữ được qua lần reset này (luôn xảy ra khi cấp nguồn) => chỉ còn cờ NVS (đọc, không ghi)
+    prefs.begin("drd", true);
+    doubleReset = prefs.getUInt("flag", 0) == DRD_MAGIC;
     prefs.end();
+    if (doubleReset) flags |= DRD_RTC_NVS;
+  }
 
+  if (doubleReset) {
+    Serial.println("[MEBLOCK_CORE][DRD] Double reset detected → resetToFactory()");
+    drdRtcWrite(0);
+    if (flags & DRD_RTC_NVS) drdNvsWrite(0);   // clear flag
     resetToFactory();
     return;
   }
 
   Serial.println("[MEBLOCK_CORE][DRD] First reset, arm window for second reset...");
-  prefs.putUInt("flag", DRD_MAGIC);
-  prefs.end();
+  if (rtcValid) {
+    drdRtcWrite(DRD_RTC_ARMED | (flags & DRD_RTC_NVS));
+  } else {
+    drdRtcWrite(DRD_RTC_ARMED | DRD_RTC_NVS);
+    drdNvsArmPending = true;
+  }
 
   drdStartTime = millis();
   drdArmed     = true;
 }
 
-// Gọi trong loop() để hết timeout thì hủy cờ DRD
+// Gọi trong loop(): ghi cờ NVS đã hoãn, hết timeout thì hủy cờ DRD
 static void handleDoubleResetDetector() {
+  if (drdNvsArmPending) {
+    drdNvsArmPending = false;
+    if (drdArmed) drdNvsWrite(DRD_MAGIC);
+  }
+  if (drdNvsClearPending) {
+    drdNvsClearPending = false;
+    drdNvsWrite(0);
+    drdRtcWrite(drdRtc.flags & ~DRD_RTC_NVS);
+  }
   if (!drdArmed) return;
 
   if (millis() - drdStartTime > DRD_TIMEOUT) {
-    prefs.begin("drd", false);
-    prefs.putUInt("flag", 0);   // clear flag
-    prefs.end();
+    if (drdRtc.flags & DRD_RTC_NVS) drdNvsWrite(0);   // clear flag
+    drdRtcWrite(0);
 
     drdArmed = false;
     Serial.println("[MEBLOCK_CORE][DRD] Timeout, no double reset → normal run.");
   }
 }
 
-// Nhận lệnh qua UART: RESET_FACTORY / FACTORY
+// ===== Lệnh UART =====
+static void cmdBootTimeline(const char *arg, MeblockCmdSource src) {
+  (void)arg;
+  (void)src;
+  meblock_boot_dump();
+}
+
+static void cmdSlots(const char *arg, MeblockCmdSource src) {
+  (void)arg;
+  (void)src;
+  meblock_slot_list(nullptr);
+}
+
+// Đổi sang chương trình trong slot khác ngay từ firmware người dùng
+static void cmdBootSlot(const char *arg, MeblockCmdSource src) {
+  (void)src;
+  if (meblock_slot_select((uint8_t)strtoul(arg, nullptr, 10))) meblock_restart();
+}
+
+// File asset (tải lên qua core factory, BEGIN có N=<tên>)
+static void cmdFiles(const char *arg, MeblockCmdSource src) {
+  (void)arg;
+  (void)src;
+  meblock_asset_list(nullptr);
+}
+
+static void cmdFileSha(const char *arg, MeblockCmdSource src) {
+  (void)src;
+  meblock_asset_print_sha(arg, nullptr);
+}
+
+// Xoá sạch phân vùng asset, format LittleFS
+static void cmdFilesFormat(const char *arg, MeblockCmdSource src) {
+  (void)arg;
+  (void)src;
+  Serial.printf("FILES_FORMAT %s\r\n", meblock_assets_format(true) ? "OK" : "FAIL");
+}
+
+static void cmdResetFactory(const char *arg, MeblockCmdSource src) {
+  (void)arg;
+  (void)src;
+  Serial.println("[MEBLOCK_CORE][UART] Nhận lệnh RESET_FACTORY → resetToFactory()");
+  resetToFactory();
+}
+
+static const MeblockCmd kCoreCmds[] = {
+  { "RESET_FACTORY", cmdResetFactory },
+  { "FACTORY",       cmdResetFactory },
+  { "BOOT?",         cmdBootTimeline },
+  { "SLOTS?",        cmdSlots },
+  { "BOOT_SLOT=",    cmdBootSlot },
+  { "FILES?",        cmdFiles },
+  { "FILE_SHA=",     cmdFileSha },
+  { "FILES_FORMAT",  cmdFilesFormat },
+};
+
+// Nhận lệnh qua UART: RESET_FACTORY / FACTORY / BOOT? / SLOTS? / BOOT_SLOT=<n> / FILES? / FILE_SHA=<tên> / FILES_FORMAT
 static void checkUartCommand() {
   while (Serial.available() > 0) {
-    char c = (char)Serial.read();
-
-    if (c == '\r' || c == '\n') {
-      uartCmdBuf.trim();
-
-      // Nếu tool gửi literal "\n" hoặc "\r" (2 ký tự '\' và 'n') ở cuối → cắt bỏ
-      if (uartCmdBuf.endsWith("\\n") || uartCmdBuf.endsWith("\\r")) {
-        uartCmdBuf.remove(uartCmdBuf.length() - 2);
-        uartCmdBuf.trim();
-      }
-
-      if (uartCmdBuf.length() > 0) {
-        Serial.print("[MEBLOCK_CORE][UART] CMD = '");
-        Serial.print(uartCmdBuf);
-        Serial.println("'");
-
-        if (uartCmdBuf.equalsIgnoreCase("RESET_FACTORY") ||
-            uartCmdBuf.equalsIgnoreCase("FACTORY")) {
-          Serial.println("[MEBLOCK_CORE][UART] Nhận lệnh RESET_FACTORY → resetToFactory()");
-          resetToFactory();
-        }
-      }
-
-      uartCmdBuf = "";
-    } else {
-      if (uartCmdBuf.length() < 64) {
-        uartCmdBuf += c;
-      } else {
-        // Quá dài thì reset buffer cho an toàn
-        uartCmdBuf = "";
-      }
-    }
+    size_t n = 0;
+    const char *line = meblock_line_feed(&uartLine, (char)Serial.read(), &n);
+    if (!line) continue;
+
+    Serial.print("[MEBLOCK_CORE][UART] CMD = '");
+    Serial.print(line);
+    Serial.println("'");
+    meblock_cmd_dispatch(kCoreCmds, MEBLOCK_CMD_COUNT(kCoreCmds), line, n, MEBLOCK_CMD_SRC_UART);
   }
 }
 
 // ================== PUBLIC API ==================
 
 void meblock_core_setup(uint32_t serialBaud) {
+  meblock_boot_mark("core_setup");
   Serial.begin(serialBaud);
-  delay(200);
+  meblock_boot_delay(200);
   Serial.println("\n[MEBLOCK_CORE] Init...");
 
   setupDoubleResetDetector();
+  meblock_boot_mark("drd");
 }
 
 void meblock_core_loop() {
+  if (!bootReported) {
+    // Thời gian từ lúc app khởi động tới loop() đầu tiên; chi tiết từng bước: lệnh BOOT?
+    bootReported = true;
+    meblock_boot_mark("loop");
+    Serial.printf("[MEBLOCK_CORE] boot → loop(): %lu us, DRD %lu us (BOOT? = timeline)\n",
+                  (unsigned long)meblock_boot_us("loop"),
+                  (unsigned long)(meblock_boot_us("drd") - meblock_boot_us("core_setup")));
+  }
   handleDoubleResetDetector();
   checkUartCommand();
 }
@@ -3,9 +3,12 @@
 #include <Arduino.h>
 
 /// Khởi tạo core: Serial + Double Reset Detector (DRD)
+/// Trạng thái DRD giữ trong RTC memory: reset mềm / WDT / nút EN (RTC còn) không mở / ghi NVS.
+/// Cúp nguồn (cold boot, RTC mất): vẫn đọc cờ NVS trong setup(), ghi cờ ở loop() đầu và xoá sau 8 s (2 lần commit).
 /// Mặc định dùng baud 115200, có thể đổi nếu cần.
 void meblock_core_setup(uint32_t serialBaud = 115200);
 
-/// Hàm loop của core: xử lý DRD + lệnh UART RESET_FACTORY
-/// Gọi mỗi vòng loop() trước khi chạy code Blockly.
+/// Hàm loop của core: xử lý DRD + lệnh UART RESET_FACTORY, BOOT? (timeline khởi động, xem MeblockBoot.h),
+/// SLOTS? / BOOT_SLOT=<n> (đổi chương trình, xem MeblockSlots.h), FILES? / FILE_SHA=<tên> (asset, xem MeblockAssets.h)
+/// Gọi mỗi vòng loop() trước khi chạy code Blockly. Lần gọi đầu in thời gian boot → loop().
 void meblock_core_loop();
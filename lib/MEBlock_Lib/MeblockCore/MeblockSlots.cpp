@@ -0,0 +1,127 @@
+// MeblockSlots.cpp
+#include "MeblockSlots.h"
+#include <Preferences.h>
+#include "esp_ota_ops.h"
+
+static const char *SLOTS_NS = "slots";
+static const uint8_t APP_MAGIC = 0xE9;   // byte đầu ảnh app ESP32
+
+static Preferences slotPrefs;
+
+// "s0".."s255": cần 5 byte
+static void slotKey(uint8_t n, char key[5]) {
+  snprintf(key, 5, "s%u", (unsigned)n);
+}
+
+static bool shaKnown(const uint8_t sha[32]) {
+  for (int i = 0; i < 32; i++) {
+    if (sha[i]) return true;
+  }
+  return false;
+}
+
+const esp_partition_t *meblock_slot_partition(uint8_t n) {
+  if (n < 1 || n > MEBLOCK_SLOT_MAX) return nullptr;
+  return esp_partition_find_first(ESP_PARTITION_TYPE_APP,
+                                  (esp_partition_subtype_t)(ESP_PARTITION_SUBTYPE_APP_OTA_0 + n), nullptr);
+}
+
+uint8_t meblock_slot_of(const esp_partition_t *p) {
+  if (!p || p->type != ESP_PARTITION_TYPE_APP) return 0;
+  int n = (int)p->subtype - (int)ESP_PARTITION_SUBTYPE_APP_OTA_0;
+  return (n >= 1 && n <= MEBLOCK_SLOT_MAX) ? (uint8_t)n : 0;
+}
+
+uint8_t meblock_slot_count() {
+  uint8_t n = 0;
+  while (n < MEBLOCK_SLOT_MAX && meblock_slot_partition(n + 1)) n++;
+  return n;
+}
+
+bool meblock_slot_get(uint8_t n, MeblockSlotInfo *out) {
+  char key[5];
+  slotKey(n, key);
+  slotPrefs.begin(SLOTS_NS, true);
+  bool ok = slotPrefs.getBytes(key, out, sizeof(*out)) == sizeof(*out);
+  slotPrefs.end();
+  if (ok) out->name[MEBLOCK_SLOT_NAME_MAX] = '\0';
+  return ok && out->size > 0;
+}
+
+bool meblock_slot_set(uint8_t n, const MeblockSlotInfo *info) {
+  if (!meblock_slot_partition(n)) return false;
+  char key[5];
+  slotKey(n, key);
+  slotPrefs.begin(SLOTS_NS, false);
+  bool ok = slotPrefs.putBytes(key, info, sizeof(*info)) == sizeof(*info);
+  slotPrefs.end();
+  return ok;
+}
+
+void meblock_slot_clear(uint8_t n) {
+  char key[5];
+  slotKey(n, key);
+  slotPrefs.begin(SLOTS_NS, false);
+  if (slotPrefs.isKey(key)) slotPrefs.remove(key);
+  slotPrefs.end();
+}
+
+bool meblock_slot_holds(uint8_t n, const uint8_t sha[32], uint32_t size) {
+  MeblockSlotInfo info;
+  if (!shaKnown(sha) || !meblock_slot_get(n, &info)) return false;
+  if (info.size != size || memcmp(info.sha, sha, 32) != 0) return false;
+
+  const esp_partition_t *p = meblock_slot_partition(n);
+  uint8_t magic = 0;
+  if (!p || size > p->size) return false;
+  return esp_partition_read(p, 0, &magic, 1) == ESP_OK && magic == APP_MAGIC;   // không bị ghi đè ngoài OTA
+}
+
+uint8_t meblock_slot_find(const uint8_t sha[32], uint32_t size) {
+  uint8_t count = meblock_slot_count();
+  for (uint8_t n = 1; n <= count; n++) {
+    if (meblock_slot_holds(n, sha, size)) return n;
+  }
+  return 0;
+}
+
+bool meblock_slot_select(uint8_t n) {
+  const esp_partition_t *p = meblock_slot_partition(n);
+  if (!p) {
+    Serial.printf("[SLOT] slot %u not found\n", (unsigned)n);
+    return false;
+  }
+  esp_err_t err = esp_ota_set_boot_partition(p);
+  if (err != ESP_OK) {
+    Serial.printf("[SLOT] slot %u (%s): no valid app, err=%d\n", (unsigned)n, p->label, (int)err);
+    return false;
+  }
+  Serial.printf("[SLOT] boot slot %u (%s)\n", (unsigned)n, p->label);
+  return true;
+}
+
+void meblock_slot_list(void (*out)(const char *line)) {
+  const esp_partition_t *boot = esp_ota_get_boot_partition();
+  uint8_t count = meblock_slot_count();
+  char line[96];
+  snprintf(line, sizeof(line), "SLOTS %u boot=%u\r\n", (unsigned)count, (unsigned)meblock_slot_of(boot));
+  Serial.print(line);
+  if (out) out(line);
+
+  for (uint8_t n = 1; n <= count; n++) {
+    const esp_partition_t *p = meblock_slot_partition(n);
+    MeblockSlotInfo info;
+    if (meblock_slot_get(n, &info)) {
+      char sha[17] = "-";
+      if (shaKnown(info.sha)) {
+        for (int i = 0; i < 8; i++) snprintf(sha + 2 * i, 3, "%02x", info.sha[i]);
+      }
+      snprintf(line, sizeof(line), "SLOT %u %s %lu %s %s\r\n", (unsigned)n, p->label,
+                     (unsigned long)info.size, sha, info.name[0] ? info.name : "-");
+    } else {
+      snprintf(line, sizeof(line), "SLOT %u %s empty\r\n", (unsigned)n, p->label);
+    }
+    Serial.print(line);
+    if (out) out(line);
+  }
+}
@@ -0,0 +1,51 @@
+// MeblockSlots.h
+#pragma once
+#include <Arduino.h>
+#include "esp_partition.h"
+
+// Slot chương trình: slot n = phân vùng app OTA_n (n >= 1), OTA_0 (app0) là core factory.
+// Board 4MB: 1 slot (app1). Board 16MB nạp bảng tuỳ chọn partitions_16MB_slots.csv: 3 slot (app1..app3);
+// bảng 16MB mặc định chỉ có 1 slot.
+// Metadata mỗi slot (tên, SHA-256, size ảnh) nằm trong NVS namespace "slots", key "s<n>".
+// Đổi chương trình = chọn phân vùng boot + restart, không phải nạp lại cả ảnh.
+
+#ifndef MEBLOCK_SLOT_MAX
+#define MEBLOCK_SLOT_MAX 15             // OTA_1..OTA_15
+#endif
+#define MEBLOCK_SLOT_NAME_MAX 23
+
+struct MeblockSlotInfo {
+  uint32_t size;                        // byte ảnh, 0 = slot trống / đang ghi dở
+  uint8_t sha[32];                      // SHA-256 ảnh, toàn 0 = không rõ (tải lên không có H=)
+  char name[MEBLOCK_SLOT_NAME_MAX + 1];
+};
+
+/// Phân vùng của slot n, nullptr nếu bảng phân vùng không có
+const esp_partition_t *meblock_slot_partition(uint8_t n);
+
+/// Slot của phân vùng p, 0 nếu p không phải slot (app0 / data)
+uint8_t meblock_slot_of(const esp_partition_t *p);
+
+/// Số slot liên tiếp từ slot 1 có trên bảng phân vùng
+uint8_t meblock_slot_count();
+
+/// Đọc metadata slot n. false nếu chưa có
+bool meblock_slot_get(uint8_t n, MeblockSlotInfo *out);
+
+/// Ghi metadata slot n (sau khi tải ảnh xong)
+bool meblock_slot_set(uint8_t n, const MeblockSlotInfo *info);
+
+/// Xoá metadata slot n (trước khi ghi đè ảnh)
+void meblock_slot_clear(uint8_t n);
+
+/// Slot n đang chứa ảnh sha + size (metadata khớp và ảnh còn trên flash)
+bool meblock_slot_holds(uint8_t n, const uint8_t sha[32], uint32_t size);
+
+/// Slot đầu tiên đang chứa ảnh sha + size, 0 nếu không có
+uint8_t meblock_slot_find(const uint8_t sha[32], uint32_t size);
+
+/// Chọn slot n cho lần boot sau (IDF kiểm tra ảnh). false nếu không có slot / ảnh hỏng
+bool meblock_slot_select(uint8_t n);
+
+/// In danh sách slot ra Serial; out != nullptr => gửi thêm từng dòng qua out (vd trả lời BLE)
+void meblock_slot_list(void (*out)(const char *line));
@@ -9,9 +9,13 @@
 #include <Preferences.h>
 #include <Wire.h>
 #include <math.h>
+#include <atomic>
 #include <MadgwickAHRS.h>
 #include <Adafruit_BMP280.h>
 #include <MPU9250_WE.h>
+#include "MeblockDrone.h"
+#include "MeblockFilter.h"
+#include "MeblockDynNotch.h"
 
 // ===================== MeblockDrone runtime configuration =====================
 static uint8_t g_pinMA = 5;
@@ -20,11 +24,13 @@ static uint8_t g_pinMC = 1;
 static uint8_t g_pinMD = 7;
 static uint8_t g_i2cSDA = 8;
 static uint8_t g_i2cSCL = 9;
+static int8_t  g_imuIntPin = MEBLOCK_DRONE_PIN_IMU_INT;
 static const char* g_apSsid = "MEBlock Drone V1";
 static const char* g_apPass = "12345678";
 // ===============================================================================
 
 #define MPU9250_ADDR 0x68
+#define BMP280_ADDR  0x76
 
 // *************************************************************  Parameters & Variables  ************************************************************* //
 
@@ -39,16 +45,19 @@ Preferences preferences;
 Madgwick MadgwickFilter;
 
 // Timer 
-unsigned long lastInnerTime = 0;
-unsigned long lastOuterTime = 0;
-unsigned long lastBaroTime  = 0;
 unsigned long lastDNSTime = 0;
 
-const float innerHz = 400.0;    // Inner loop rate (Madgwick + inner PID)
+// Rates derive from the MPU9250 FIFO sample clock (1 kHz with DLPF on), so every divider is an integer
+const float innerHz = 1000.0;   // Inner loop rate (gyro filter + inner PID): every FIFO sample
+const float estHz   = 500.0;    // Attitude estimator rate (Madgwick + altitude): 2-sample average
 const float outerHz = 100.0;    // Outer loop rate (angle PID / altitude)
 const float baroHz  = 25.0;     // Barometer update rate
+const uint8_t estDiv   = (uint8_t)(innerHz / estHz);     // estimator every N samples
+const uint8_t outerDiv = (uint8_t)(innerHz / outerHz);   // outer loop every N samples
+const uint8_t baroDiv  = (uint8_t)(innerHz / baroHz);    // barometer read kicked every N samples
 
 const float innerDt = 1.0 / innerHz;
+const float estDt   = 1.0 / estHz;
 const float outerDt = 1.0 / outerHz;
 const float baroDt  = 1.0 / baroHz;
 
@@ -58,7 +67,7 @@ float currentRoll = 0 ,currentPitch = 0 ,currentYaw = 0;
 float yaw_setpoint = 0.0; // deg
 float yaw_rate_target = 0;
 float yaw_ref = 0.0f;
-float baroAltitude = 0;
+volatile float baroAltitude = 0;   // latest barometer altitude (baro task)
 float currentAltitude = 0;
 float altitude_setpoint = 0.0; // meter
 float altitude_rate_target = 0.0;
@@ -145,38 +154,21 @@ float accZ_filtered  = 0;
 float magX_filtered  = 0;
 float magY_filtered  = 0;
 float magZ_filtered  = 0;
-float alt_filtered  = 0;
-
-// EMA filter
-float emaGyroX = 0;
-float emaGyroY = 0;
-float emaGyroZ = 0;
-float emaAccX = 0;
-float emaAccY = 0;
-float emaAccZ = 0;
-float emaMagX = 0;
-float emaMagY = 0;
-float emaMagZ = 0;
-float emaAlt = 0;
-float emaVZ = 0;
-
-float alphaGyro = 0.8f; 
+
+float alphaGyro = 0.55f; // at 1 kHz: same cutoff as 0.8 at 500 Hz
 float alphaAcc  = 0.7f;  
 float alphaMag  = 0.9f; 
-float alphaAlt  = 0.5f;
 float alphaVZ  = 0.6f; 
 
-// Median filter 
-float gyroX_buf[9] = {0}, gyroY_buf[9] = {0}, gyroZ_buf[9] = {0};
-float accX_buf[9]  = {0}, accY_buf[9]  = {0}, accZ_buf[9]  = {0};
-float magX_buf[3]  = {0}, magY_buf[3]  = {0}, magZ_buf[3]  = {0};
-float alt_buf[7]  = {0};
-float vz_buf[5]  = {0};
-size_t gyroX_idx = 0, gyroY_idx = 0, gyroZ_idx = 0;
-size_t accX_idx  = 0, accY_idx  = 0, accZ_idx  = 0;
-size_t magX_idx  = 0, magY_idx  = 0, magZ_idx  = 0;
-size_t alt_idx  = 0;
-size_t vz_idx  = 0;
+// Gyro: dynamic notch bank (tracks motor vibration peaks) + EMA, no median (lag)
+MeblockBiquad gyroNotch[3][MEBLOCK_DYN_NOTCH_PEAKS];
+float gyroNotchHz[3][MEBLOCK_DYN_NOTCH_PEAKS] = {};
+float emaGyro[3] = {};
+
+// Median + EMA filter banks (window, axes)
+MeblockMedianEma<9, 3> accFilter;
+MeblockMedianEma<3, 3> magFilter;
+MeblockMedianEma<5, 1> vzFilter;
 
 // State
 bool swlPressed = false;
@@ -187,6 +179,8 @@ bool headlessMode = false;
 bool OnFlying = false;
 bool initial_altitude = false;
 bool initial_yaw = false;
+// Set by drone_loop on arm, consumed by the flight task: setpoints / limits are only written by the flight task
+std::atomic<bool> armSetupPending{false};
 volatile bool calibrateAccelGyroRequested = false;
 volatile bool calibrateMagRequested = false;
 bool AccelGyroisCalibrating = false;
@@ -218,6 +212,14 @@ typedef struct JoyData {
 
 JoyData incomingJoystickData;
 uint8_t lastWebCommand = 255;
+portMUX_TYPE joyMux = portMUX_INITIALIZER_UNLOCKED;   // ESP-NOW callback (WiFi task) vs flight task
+
+// Flight task
+enum MotorState : uint8_t { MOTOR_STOP, MOTOR_IDLE, MOTOR_FLY };
+volatile MotorState motorState = MOTOR_STOP;   // set by drone_loop, applied by the flight task every cycle
+TaskHandle_t flightTaskHandle = nullptr;
+TaskHandle_t baroTaskHandle = nullptr;
+SemaphoreHandle_t imuLock = nullptr;           // held by calibration: flight task skips cycles meanwhile
 
 
 // *************************************************************  HTML  ************************************************************* //
@@ -1100,7 +1102,9 @@ void stopWebServer() {
 
 void readJoystickData(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len) {
   if (len == sizeof(incomingJoystickData)) {
+    portENTER_CRITICAL(&joyMux);
     memcpy(&incomingJoystickData, data, sizeof(incomingJoystickData));
+    portEXIT_CRITICAL(&joyMux);
   } else {
     Serial.printf("Received invalid data size: %d bytes\n", len);
   }
@@ -1130,42 +1134,6 @@ float angleError(float target, float current) {
     return error;
 }
 
-// ---------------- Median Filter ----------------
-// NOTE: Tránh dùng function template trong .ino vì Arduino build system có thể tự sinh prototype lỗi.
-static float medianFilterN(float input, float *buffer, size_t N, size_t &index) {
-  if (N == 0) return input;
-  buffer[index] = input;
-  index = (index + 1) % N;
-
-  // N trong sketch này nhỏ (<=9). Dùng mảng temp cố định để tránh VLA / template.
-  const size_t MEDIAN_MAX = 9;
-  float temp[MEDIAN_MAX];
-  if (N > MEDIAN_MAX) N = MEDIAN_MAX;
-  for (size_t i = 0; i < N; i++) temp[i] = buffer[i];
-
-  // sort (bubble-ish) cho N nhỏ
-  for (size_t i = 0; i + 1 < N; i++) {
-    for (size_t j = i + 1; j < N; j++) {
-      if (temp[j] < temp[i]) {
-        float t = temp[i];
-        temp[i] = temp[j];
-        temp[j] = t;
-      }
-    }
-  }
-  return temp[N / 2];
-}
-
-// Giữ nguyên cách gọi: medianFilter(x, gyroX_buf, gyroX_idx);
-#define medianFilter(input, buf, idx) \
-  medianFilterN((input), (buf), (sizeof(buf) / sizeof((buf)[0])), (idx))
-
-// ---------------- EMA Filter ----------------
-float emaFilter(float input, float &emaPrev, float alpha) {
-  emaPrev = alpha * input + (1.0f - alpha) * emaPrev;
-  return emaPrev;
-}
-
 static inline float expoCurve(float x, float expo) {
   // expo: 0..1, keeps sign, compresses near center
   // y = (1-e)*x + e*x^3
@@ -1173,60 +1141,287 @@ static inline float expoCurve(float x, float expo) {
 }
 
 // ====== Complementary filter =====
-void Complementary_Alt_Vz(float accZ, float altitudeBaro, float dt) {
+// Prediction: every estimator step
+void Complementary_Alt_Predict(float accZ, float dt) {
     // integrate acceleration
     velocityZ += accZ * dt;
     altitude += velocityZ * dt;
+}
+
+// Correction: once per barometer sample, at the sample's own timestamp. alpha / beta are per estimator step:
+// a sample covering k steps blends with alpha^k, the same as k steps against a held value.
+void Complementary_Alt_Vz(float altitudeBaro, uint32_t t_us) {
+    static uint32_t previousBaroTime = 0;
+    static bool haveBaro = false;
+    if (!haveBaro) {
+      previousBaro = altitudeBaro;
+      previousBaroTime = t_us;
+      haveBaro = true;
+      return;
+    }
+    float dtBaro = (uint32_t)(t_us - previousBaroTime) * 1e-6f;
+    if (dtBaro <= 0) return;
+    float k = dtBaro / estDt;
+    float a = powf(alpha, k);
+    float b = powf(beta, k);
 
     // complementary filter สำหรับ altitude
-    altitude = alpha * altitude + (1 - alpha) * altitudeBaro;
+    altitude = a * altitude + (1 - a) * altitudeBaro;
 
     // complementary filter สำหรับ velocityZ
-    float baroVz = (altitudeBaro - previousBaro) / dt;
-    velocityZ = beta * velocityZ + (1 - beta) * baroVz;
+    float baroVz = (altitudeBaro - previousBaro) / dtBaro;
+    velocityZ = b * velocityZ + (1 - b) * baroVz;
 
     previousBaro = altitudeBaro;
+    previousBaroTime = t_us;
+}
+
+// ***** Barometer service *****
+// BMP280 runs in normal mode (setupSensors). A low-priority task on the non-control core reads pressure +
+// temperature in one 6-byte burst at baroHz, compensates with the datasheet 32-bit integer formulas, converts to
+// altitude in single precision and pushes a timestamped sample into an SPSC ring. The flight task only pops.
+// The BMP280 shares Wire with the IMU FIFO read, so the flight task kicks the read right after a FIFO drain:
+// the ~200 us transaction (400 kHz) lands in the ~1 ms gap before the next drain. If the baro task starts late,
+// the next FIFO read waits for at most that one transaction, once per baroDiv samples, and the FIFO absorbs it.
+#define BARO_RING_SIZE 8     // power of 2
+
+struct BaroSample {
+  uint32_t t_us;             // read time (micros)
+  float pressure;            // Pa
+  float alt_m;
+};
+
+struct BaroCalib {
+  uint16_t T1; int16_t T2, T3;
+  uint16_t P1; int16_t P2, P3, P4, P5, P6, P7, P8, P9;
+};
+
+static BaroCalib baroCalib;
+static BaroSample baroRing[BARO_RING_SIZE];
+static std::atomic<uint32_t> baroHead{0};   // chỉ baro task ghi
+static std::atomic<uint32_t> baroTail{0};   // chỉ flight task ghi
+uint32_t baroErrors = 0;
+
+static bool baroReadRegs(uint8_t reg, uint8_t *buf, uint8_t len) {
+  Wire.beginTransmission(BMP280_ADDR);
+  Wire.write(reg);
+  if (Wire.endTransmission(false) != 0) return false;
+  if (Wire.requestFrom((uint8_t)BMP280_ADDR, len) != len) return false;
+  for (uint8_t i = 0; i < len; i++) buf[i] = Wire.read();
+  return true;
+}
+
+bool baroBegin() {
+  uint8_t c[24];
+  if (!baroReadRegs(0x88, c, sizeof(c))) return false;   // dig_T1..dig_P9, little-endian
+  uint16_t w[12];
+  for (int i = 0; i < 12; i++) w[i] = (uint16_t)(c[2 * i] | (c[2 * i + 1] << 8));
+  baroCalib.T1 = w[0];  baroCalib.T2 = (int16_t)w[1];  baroCalib.T3 = (int16_t)w[2];
+  baroCalib.P1 = w[3];  baroCalib.P2 = (int16_t)w[4];  baroCalib.P3 = (int16_t)w[5];
+  baroCalib.P4 = (int16_t)w[6];  baroCalib.P5 = (int16_t)w[7];  baroCalib.P6 = (int16_t)w[8];
+  baroCalib.P7 = (int16_t)w[9];  baroCalib.P8 = (int16_t)w[10]; baroCalib.P9 = (int16_t)w[11];
+  return true;
+}
+
+// BMP280 datasheet 8.2: 32-bit integer compensation, 1 Pa resolution (no 64-bit math)
+static uint32_t baroCompensate(int32_t adc_T, int32_t adc_P) {
+  const BaroCalib &k = baroCalib;
+  int32_t var1 = ((((adc_T >> 3) - ((int32_t)k.T1 << 1))) * ((int32_t)k.T2)) >> 11;
+  int32_t var2 = (((((adc_T >> 4) - ((int32_t)k.T1)) * ((adc_T >> 4) - ((int32_t)k.T1))) >> 12) * ((int32_t)k.T3)) >> 14;
+  int32_t t_fine = var1 + var2;
+
+  var1 = (t_fine >> 1) - (int32_t)64000;
+  var2 = (((var1 >> 2) * (var1 >> 2)) >> 11) * ((int32_t)k.P6);
+  var2 = var2 + ((var1 * ((int32_t)k.P5)) << 1);
+  var2 = (var2 >> 2) + (((int32_t)k.P4) << 16);
+  var1 = (((k.P3 * (((var1 >> 2) * (var1 >> 2)) >> 13)) >> 3) + ((((int32_t)k.P2) * var1) >> 1)) >> 18;
+  var1 = ((32768 + var1) * ((int32_t)k.P1)) >> 15;
+  if (var1 == 0) return 0;
+  uint32_t p = (((uint32_t)(((int32_t)1048576) - adc_P) - (var2 >> 12))) * 3125;
+  if (p < 0x80000000) p = (p << 1) / ((uint32_t)var1);
+  else p = (p / (uint32_t)var1) * 2;
+  var1 = (((int32_t)k.P9) * ((int32_t)(((p >> 3) * (p >> 3)) >> 13))) >> 12;
+  var2 = (((int32_t)(p >> 2)) * ((int32_t)k.P8)) >> 13;
+  return (uint32_t)((int32_t)p + ((var1 + var2 + k.P7) >> 4));
+}
+
+static bool baroRead(BaroSample &out) {
+  uint8_t d[6];
+  if (!baroReadRegs(0xF7, d, sizeof(d))) return false;   // press_msb..temp_xlsb: one consistent conversion
+  out.t_us = micros();
+  int32_t adc_P = ((int32_t)d[0] << 12) | ((int32_t)d[1] << 4) | (d[2] >> 4);
+  int32_t adc_T = ((int32_t)d[3] << 12) | ((int32_t)d[4] << 4) | (d[5] >> 4);
+  if (adc_P == 0x80000) return false;                    // conversion skipped / not ready yet
+  uint32_t pa = baroCompensate(adc_T, adc_P);
+  if (pa == 0) return false;
+  out.pressure = (float)pa;
+  out.alt_m = 44330.0f * (1.0f - powf(out.pressure / 101325.0f, 0.1903f));
+  return true;
+}
+
+bool baroPop(BaroSample &out) {
+  uint32_t tail = baroTail.load(std::memory_order_relaxed);
+  if (tail == baroHead.load(std::memory_order_acquire)) return false;
+  out = baroRing[tail & (BARO_RING_SIZE - 1)];
+  baroTail.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+static void baroTask(void *arg) {
+  (void)arg;
+  const TickType_t period = pdMS_TO_TICKS(1000 / (int)baroHz);
+
+  for (;;) {
+    // Kicked by the flight task after a FIFO drain. No kick (calibrating, IMU stalled): read anyway, the IMU is idle
+    ulTaskNotifyTake(pdTRUE, period * 2);
+    BaroSample b;
+    if (!baroRead(b)) {
+      baroErrors++;
+      continue;
+    }
+    baroAltitude = b.alt_m;
+
+    uint32_t head = baroHead.load(std::memory_order_relaxed);
+    if (head - baroTail.load(std::memory_order_acquire) >= BARO_RING_SIZE) continue;   // flight task stalled: drop newest
+    baroRing[head & (BARO_RING_SIZE - 1)] = b;
+    baroHead.store(head + 1, std::memory_order_release);
+  }
+}
+
+// ***** IMU FIFO acquisition *****
+// Accel + gyro go through the MPU9250 FIFO (12 bytes per sample: accel XYZ then gyro XYZ, big-endian) and are
+// drained with one burst read per wake-up, so no sample is lost when the task runs late. Each sample gets a
+// timestamp back-dated from the read time by its position in the FIFO.
+#define IMU_FIFO_FRAME     12
+#define IMU_FIFO_SIZE      512
+#define IMU_FIFO_BURST     10      // samples per I2C read: 120 bytes fits the 128-byte Wire buffer
+#define IMU_FIFO_MAX_BATCH 32
+
+struct ImuSample {
+  uint32_t t_us;                   // sample time (micros)
+  float ax, ay, az;                // g
+  float gx, gy, gz;                // deg/s
+};
+
+const float accScale = 4.0f / 32768.0f;     // MPU9250_ACC_RANGE_4G
+const float gyrScale = 500.0f / 32768.0f;   // MPU9250_GYRO_RANGE_500
+uint32_t imuFifoOverflows = 0;
+
+static bool imuReadRegs(uint8_t reg, uint8_t *buf, uint8_t len) {
+  Wire.beginTransmission(MPU9250_ADDR);
+  Wire.write(reg);
+  if (Wire.endTransmission(false) != 0) return false;
+  if (Wire.requestFrom((uint8_t)MPU9250_ADDR, len) != len) return false;
+  for (uint8_t i = 0; i < len; i++) buf[i] = Wire.read();
+  return true;
 }
 
-void updateSensorsAndMadgwick(float dt) {
-  xyzFloat gValue = myMPU9250.getGValues();
-  xyzFloat gyr    = myMPU9250.getGyrValues();
+static inline float imuWord(const uint8_t *p) {
+  return (float)(int16_t)((p[0] << 8) | p[1]);
+}
+
+void imuFifoStart() {
+  myMPU9250.enableFifo(false);
+  myMPU9250.setFifoMode(MPU9250_CONTINUOUS);
+  myMPU9250.enableFifo(true);
+  myMPU9250.resetFifo();
+  myMPU9250.startFifo(MPU9250_FIFO_ACC_GYR);
+}
+
+// Drain up to max samples (oldest first). Returns the number read; 0 if the FIFO is empty or had to be reset.
+uint8_t imuFifoRead(ImuSample *out, uint8_t max) {
+  uint8_t cnt[2];
+  if (!imuReadRegs(0x72, cnt, 2)) return 0;                 // FIFO_COUNT_H/L
+  uint32_t tRead = micros();
+  uint16_t bytes = ((cnt[0] & 0x1F) << 8) | cnt[1];
+
+  // Overflowed (task stalled, e.g. during calibration) or lost frame alignment: start over
+  if (bytes >= IMU_FIFO_SIZE - IMU_FIFO_FRAME || bytes % IMU_FIFO_FRAME) {
+    myMPU9250.resetFifo();
+    imuFifoOverflows++;
+    return 0;
+  }
+
+  uint16_t pending = bytes / IMU_FIFO_FRAME;
+  uint8_t n = pending < max ? pending : max;
+  // Offsets are raw counts at +-2 g / +-250 deg/s (autoOffsets)
+  xyzFloat aOff = myMPU9250.getAccOffsets();
+  xyzFloat gOff = myMPU9250.getGyrOffsets();
+  const uint32_t periodUs = (uint32_t)(1000000.0f / innerHz);
+
+  uint8_t done = 0;
+  while (done < n) {
+    uint8_t chunk = (n - done) < IMU_FIFO_BURST ? (n - done) : IMU_FIFO_BURST;
+    uint8_t raw[IMU_FIFO_BURST * IMU_FIFO_FRAME];
+    if (!imuReadRegs(0x74, raw, chunk * IMU_FIFO_FRAME)) break;   // FIFO_R_W
+    for (uint8_t i = 0; i < chunk; i++) {
+      const uint8_t *f = raw + i * IMU_FIFO_FRAME;
+      ImuSample &sm = out[done + i];
+      sm.t_us = tRead - (pending - 1 - (done + i)) * periodUs;
+      sm.ax = imuWord(f + 0) * accScale - aOff.x / 16384.0f;
+      sm.ay = imuWord(f + 2) * accScale - aOff.y / 16384.0f;
+      sm.az = imuWord(f + 4) * accScale - aOff.z / 16384.0f;
+      sm.gx = imuWord(f + 6) * gyrScale - gOff.x * 250.0f / 32768.0f;
+      sm.gy = imuWord(f + 8) * gyrScale - gOff.y * 250.0f / 32768.0f;
+      sm.gz = imuWord(f + 10) * gyrScale - gOff.z * 250.0f / 32768.0f;
+    }
+    done += chunk;
+  }
+  return done;
+}
+
+// Rate path: every sample, feeds the inner PID. Raw gyro goes to the FFT analyzer before the notches.
+void updateRateGyro(const ImuSample &s) {
+  meblock_dyn_notch_push(s.gx, s.gy, s.gz);
+
+  const float in[3] = { s.gx, s.gy, s.gz };
+  for (uint8_t a = 0; a < 3; a++) {
+    float v = in[a];
+    for (uint8_t k = 0; k < MEBLOCK_DYN_NOTCH_PEAKS; k++) v = gyroNotch[a][k].apply(v);
+    emaGyro[a] = alphaGyro * v + (1.0f - alphaGyro) * emaGyro[a];
+  }
+  gyroX_filtered = emaGyro[0];
+  gyroY_filtered = emaGyro[1];
+  gyroZ_filtered = emaGyro[2];
+}
+
+// Follow the peaks found by the FFT task (outer loop rate). Notches fade in / out over MEBLOCK_NOTCH_RAMP_MS:
+// no peak => fade to passthrough at the last frequency, new peak => fade in (no step in the filtered gyro).
+void updateGyroNotches() {
+  for (uint8_t a = 0; a < 3; a++) {
+    for (uint8_t k = 0; k < MEBLOCK_DYN_NOTCH_PEAKS; k++) {
+      float hz = meblock_dyn_notch_peak(a, k);
+      if (hz <= 0.0f) {
+        if (gyroNotchHz[a][k] > 0.0f) gyroNotch[a][k].setPassthrough();
+        gyroNotchHz[a][k] = 0.0f;
+      } else if (fabsf(hz - gyroNotchHz[a][k]) > 0.5f) {
+        gyroNotch[a][k].setNotch(hz, innerHz, MEBLOCK_DYN_NOTCH_Q);
+        gyroNotchHz[a][k] = hz;
+      }
+    }
+  }
+}
+
+// Magnetometer (AK8963, 100 Hz): read at outer loop rate
+void updateMag() {
   xyzFloat magValue = myMPU9250.getMagValues();
+  const float in[3] = { magValue.x - mx_bias, magValue.y - my_bias, magValue.z - mz_bias };
+  float out[3];
+  magFilter.update(in, out, alphaMag);
+  magX_filtered = out[0];
+  magY_filtered = out[1];
+  magZ_filtered = out[2];
+}
 
-  // Read sensor
-  float accX = gValue.x;
-  float accY = gValue.y;
-  float accZ = gValue.z;
-  float gyroX = gyr.x;
-  float gyroY = gyr.y;
-  float gyroZ = gyr.z;
-  float magX = magValue.x - mx_bias;
-  float magY = magValue.y - my_bias;
-  float magZ = magValue.z - mz_bias; 
-
-  // ----------- Median filter -------------
-  float gyroX_med = medianFilter(gyroX, gyroX_buf, gyroX_idx);
-  float gyroY_med = medianFilter(gyroY, gyroY_buf, gyroY_idx);
-  float gyroZ_med = medianFilter(gyroZ, gyroZ_buf, gyroZ_idx);
-  float accX_med  = medianFilter(accX,  accX_buf,  accX_idx);
-  float accY_med  = medianFilter(accY,  accY_buf,  accY_idx);
-  float accZ_med  = medianFilter(accZ,  accZ_buf,  accZ_idx);
-  float magX_med  = medianFilter(magX,  magX_buf,  magX_idx);
-  float magY_med  = medianFilter(magY,  magY_buf,  magY_idx);
-  float magZ_med  = medianFilter(magZ,  magZ_buf,  magZ_idx);
-  float alt_med  = medianFilter(baroAltitude,  alt_buf,  alt_idx);
-
-  // ----------- EMA filter ------------------
-  gyroX_filtered = emaFilter(gyroX_med, emaGyroX, alphaGyro); 
-  gyroY_filtered = emaFilter(gyroY_med, emaGyroY, alphaGyro);
-  gyroZ_filtered = emaFilter(gyroZ_med, emaGyroZ, alphaGyro);
-  accX_filtered  = emaFilter(accX_med,  emaAccX,  alphaAcc);
-  accY_filtered  = emaFilter(accY_med,  emaAccY,  alphaAcc);
-  accZ_filtered  = emaFilter(accZ_med,  emaAccZ,  alphaAcc);
-  magX_filtered  = emaFilter(magX_med,  emaMagX,  alphaMag);
-  magY_filtered  = emaFilter(magY_med,  emaMagY,  alphaMag);
-  magZ_filtered  = emaFilter(magZ_med,  emaMagZ,  alphaMag);
-  alt_filtered  = emaFilter(alt_med,  emaAlt,  alphaAlt);
+// Estimator path: accel decimated (box average over estDiv samples) + filtered gyro
+void updateSensorsAndMadgwick(float accX, float accY, float accZ, float dt) {
+  // ----------- Median + EMA filter -------------
+  const float in[3] = { accX, accY, accZ };
+  float out[3];
+  accFilter.update(in, out, alphaAcc);
+  accX_filtered = out[0];
+  accY_filtered = out[1];
+  accZ_filtered = out[2];
 
   MadgwickFilter.updateIMU(gyroX_filtered, gyroY_filtered, gyroZ_filtered,
                              accX_filtered, accY_filtered, accZ_filtered);
@@ -1253,18 +1448,26 @@ void updateSensorsAndMadgwick(float dt) {
   // vertical acceleration
   float accZ_true = accZ_world - g;
 
-  Complementary_Alt_Vz(accZ_true, baroAltitude, innerDt);
+  Complementary_Alt_Predict(accZ_true, dt);
+
+  // Raw baro samples: the complementary filter is the low-pass (a median / EMA in front only adds lag)
+  BaroSample baro;
+  while (baroPop(baro)) Complementary_Alt_Vz(baro.alt_m, baro.t_us);
   
   currentAltitude = altitude;
-  velocityZ  = medianFilter(velocityZ,  vz_buf,  vz_idx);
-  velocityZ  = emaFilter(velocityZ,  emaVZ,  alphaVZ);
+  velocityZ  = vzFilter.update(velocityZ, alphaVZ);
 }
 
 void updateParameters(float dt) {
+  JoyData joy;
+  portENTER_CRITICAL(&joyMux);
+  joy = incomingJoystickData;
+  portEXIT_CRITICAL(&joyMux);
+
   // === Mapping input giống file .ino mẫu ===
-  targetRoll  = constrain(incomingJoystickData.XR + trimRoll, -30, 30); // deg
-  targetPitch = constrain(incomingJoystickData.YR + trimPitch, -30, 30); // deg
-  targetYaw   = constrain(incomingJoystickData.XL + trimYaw, -90, 90); // deg/s
+  targetRoll  = constrain(joy.XR + trimRoll, -30, 30); // deg
+  targetPitch = constrain(joy.YR + trimPitch, -30, 30); // deg
+  targetYaw   = constrain(joy.XL + trimYaw, -90, 90); // deg/s
 
   // --- Headless Mode transform ---
   if (headlessMode == true) {
@@ -1293,7 +1496,7 @@ void updateParameters(float dt) {
   yaw_rate_target = targetYaw;
   yaw_setpoint += yaw_rate_target * dt;
 
-  float rawAltitudeRate = constrain(incomingJoystickData.YL * 0.01f, -5.0f, 5.0f); // m/s
+  float rawAltitudeRate = constrain(joy.YL * 0.01f, -5.0f, 5.0f); // m/s
 
   // Slew-rate limit: 
   static float limitedAltitudeRate = 0;  
@@ -1437,33 +1640,118 @@ void driveMotors() {
   }
 }
 
+// Arm request from drone_loop: take the altitude / yaw references on the flight task, so updateParameters()
+// never clamps against half-written limits
+static void armSetup() {
+  altitude_baseline = baroAltitude;   // latest sample from the baro task, no blocking read
+  altitude_setpoint = altitude_baseline + 1;
+  max_altitude = altitude_baseline + range_altitude;
+  min_altitude = altitude_baseline - range_altitude;
+
+  yaw_ref = currentYaw;
+  yaw_setpoint = currentYaw;
+}
+
+// =================== Flight task ===================
+// One cycle per wake-up: every FIFO sample goes through the rate filter, the estimator and outer loop run on
+// sample counts, then the inner PID runs once on the newest gyro with dt = samples consumed (sensor clock).
 void FlightController() {
-  unsigned long now = micros();
+  static uint8_t estCount = 0;
+  static uint8_t outerCount = 0;
+  static uint8_t baroCount = 0;
+  static float accSumX = 0, accSumY = 0, accSumZ = 0;
+  static ImuSample samples[IMU_FIFO_MAX_BATCH];
+
+  if (armSetupPending.exchange(false, std::memory_order_acquire)) armSetup();
+
+  uint8_t n = imuFifoRead(samples, IMU_FIFO_MAX_BATCH);
+  if (n == 0) return;
+
+  // Wire is free until the next drain: let the baro task read the BMP280 now
+  baroCount += n;
+  if (baroCount >= baroDiv) {
+    baroCount = 0;
+    if (baroTaskHandle) xTaskNotifyGive(baroTaskHandle);
+  }
+
+  for (uint8_t i = 0; i < n; i++) {
+    const ImuSample &sm = samples[i];
+    updateRateGyro(sm);
+    accSumX += sm.ax;
+    accSumY += sm.ay;
+    accSumZ += sm.az;
+
+    // -------- Estimator: 500 Hz --------
+    if (++estCount >= estDiv) {
+      estCount = 0;
+      updateSensorsAndMadgwick(accSumX / estDiv, accSumY / estDiv, accSumZ / estDiv, estDt);
+      accSumX = accSumY = accSumZ = 0;
+    }
 
-  // -------- Inner loop: 400 Hz --------
-  if (now - lastInnerTime >= 1000000UL / innerHz) {
-    lastInnerTime += 1000000UL / innerHz;   // ใช้ period คงที่
-    updateSensorsAndMadgwick(innerDt);      // innerDt คงที่ = 1/400
-    innerPID(innerDt);
+    // -------- Outer loop: 100 Hz --------
+    if (++outerCount >= outerDiv) {
+      outerCount = 0;
+      updateMag();
+      updateGyroNotches();
+      updateParameters(outerDt);
+      outerPID(outerDt);
+    }
   }
 
-  // -------- Outer loop: 100 Hz --------
-  if (now - lastOuterTime >= 1000000UL / outerHz) {
-    lastOuterTime += 1000000UL / outerHz;
-    outerPID(outerDt);
+  // -------- Inner loop: 1 kHz --------
+  innerPID(n * innerDt);
+
+  switch (motorState) {
+    case MOTOR_FLY:  driveMotors(); break;
+    case MOTOR_IDLE: Arm(); break;
+    default:         Disarm(); break;
   }
+}
+
+static void IRAM_ATTR imuDataReadyISR() {
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(flightTaskHandle, &woken);
+  if (woken) portYIELD_FROM_ISR();
+}
+
+static void flightTask(void *arg) {
+  (void)arg;
+  const TickType_t period = pdMS_TO_TICKS(1000 / (int)innerHz) > 0 ? pdMS_TO_TICKS(1000 / (int)innerHz) : 1;
+  TickType_t lastWake = xTaskGetTickCount();
 
-  // -------- Barometer: 50 Hz --------
-  if (now - lastBaroTime >= 1000000UL / baroHz) {
-    lastBaroTime += 1000000UL / baroHz;
-    baroAltitude = bmp.readAltitude(1013.25);
+  for (;;) {
+    if (g_imuIntPin >= 0) {
+      // Released by data-ready. No pulse for a few periods (loose INT wire): run anyway so motors never hold a stale command
+      ulTaskNotifyTake(pdTRUE, period * 3);
+    } else {
+      vTaskDelayUntil(&lastWake, period);
+    }
+
+    if (xSemaphoreTake(imuLock, 0) != pdTRUE) continue;   // calibrating: MPU belongs to drone_loop
+    FlightController();
+    xSemaphoreGive(imuLock);
+  }
+}
+
+static void startFlightTask() {
+  if (!baroBegin()) Serial.println("BMP280 calibration read failed");
+  xTaskCreatePinnedToCore(baroTask, "drone_baro", 3072, nullptr, 2, &baroTaskHandle, MEBLOCK_DRONE_BARO_CORE);
+  if (!meblock_dyn_notch_begin(innerHz, MEBLOCK_DRONE_FFT_CORE, 1)) Serial.println("Gyro notch: out of memory");
+
+  imuLock = xSemaphoreCreateMutex();
+  xTaskCreatePinnedToCore(flightTask, "drone_fc", MEBLOCK_DRONE_FLIGHT_STACK, nullptr, MEBLOCK_DRONE_FLIGHT_PRIO,
+                          &flightTaskHandle, MEBLOCK_DRONE_FLIGHT_CORE);
+
+  if (g_imuIntPin >= 0) {
+    pinMode(g_imuIntPin, INPUT);
+    attachInterrupt(g_imuIntPin, imuDataReadyISR, RISING);
   }
 }
 
 void setupSensors() {
   myMPU9250.enableGyrDLPF();
-  myMPU9250.setGyrDLPF(MPU9250_DLPF_2);
-  myMPU9250.setSampleRateDivider(0);
+  myMPU9250.setGyrDLPF(MPU9250_DLPF_1);    // 184 Hz: bandwidth for the 1 kHz rate loop
+  myMPU9250.setSampleRateDivider((uint8_t)(1000.0f / innerHz) - 1);
   myMPU9250.setGyrRange(MPU9250_GYRO_RANGE_500);
   myMPU9250.setAccRange(MPU9250_ACC_RANGE_4G);
   myMPU9250.enableAccDLPF(true);
@@ -1476,7 +1764,14 @@ void setupSensors() {
                 Adafruit_BMP280::FILTER_X8,    // IIR filter
                 Adafruit_BMP280::STANDBY_MS_1); // standby (ignore ใน FORCED)
 
-  MadgwickFilter.begin(innerHz);
+  MadgwickFilter.begin(estHz);
+
+  if (g_imuIntPin >= 0) {
+    myMPU9250.setIntPinPolarity(MPU9250_ACT_HIGH);
+    myMPU9250.enableIntLatch(false);                 // 50 us pulse per sample
+    myMPU9250.enableInterrupt(MPU9250_DATA_READY);
+  }
+  imuFifoStart();
 }
 
 
@@ -1526,6 +1821,7 @@ static void drone_setup(){
   setupESPNow();
   loadConfig();
   loadCalibration();
+  startFlightTask();
 
   incomingJoystickData.webCommand = 1;
   webServerRunning = false;
@@ -1554,6 +1850,7 @@ static void drone_loop(){
 
 // ---------------------- SENSOR CALIBRATION ----------------------
   if (calibrateAccelGyroRequested) { 
+    xSemaphoreTake(imuLock, portMAX_DELAY);
     AccelGyroisCalibrating = true;
     AccelGyrocalibrationDone = false;
     Serial.println("[Calibrate] Starting Accel & Gyro...");
@@ -1565,10 +1862,12 @@ static void drone_loop(){
     AccelGyroisCalibrating = false;
     AccelGyrocalibrationDone = true;
     calibrateAccelGyroRequested = false;
+    xSemaphoreGive(imuLock);
     Serial.println("[Calibrate] Accel & Gyro complete.");
   }
 
   if (calibrateMagRequested) {
+    xSemaphoreTake(imuLock, portMAX_DELAY);
     MagisCalibrating = true;
     MagcalibrationDone = false;
     Serial.println("[Calibrate] Starting Magnetometer...");
@@ -1580,6 +1879,7 @@ static void drone_loop(){
     MagisCalibrating = false;
     MagcalibrationDone = true;
     calibrateMagRequested = false;
+    xSemaphoreGive(imuLock);
     Serial.println("[Calibrate] Magnetometer complete.");
   }
 
@@ -1642,30 +1942,22 @@ static void drone_loop(){
     OnFlying = true;
   }
 
-  // ---------------------- FLIGHT CONTROL ----------------------
-  updateParameters(innerDt);
-  FlightController();
-
+  // ---------------------- MOTOR STATE (applied by flight task) ----------------------
   if (!incomingJoystickData.webCommand && !webServerRunning) {
     if (Armed && !OnFlying) {
       if (!initial_altitude && !initial_yaw) {
-        altitude_baseline = bmp.readAltitude(1013.25);
-        altitude_setpoint = altitude_baseline + 1;
-        max_altitude = altitude_baseline + range_altitude;
-        min_altitude = altitude_baseline - range_altitude;
+        // Altitude / yaw references are taken by the flight task (armSetup) before its next updateParameters()
+        armSetupPending.store(true, std::memory_order_release);
         initial_altitude = true;
-
-        yaw_ref = currentYaw;
-        yaw_setpoint = currentYaw;
         initial_yaw = true;
       }
-      Arm(); 
+      motorState = MOTOR_IDLE;
     }
     else if (Armed && OnFlying) {
-      driveMotors();
+      motorState = MOTOR_FLY;
     }
     else {
-      Disarm();
+      motorState = MOTOR_STOP;
     }
   }
   else {
@@ -1673,18 +1965,17 @@ static void drone_loop(){
     OnFlying = false;
     initial_altitude = false;
     initial_yaw = false;
-    Disarm();
+    motorState = MOTOR_STOP;
   }
 }
 
 
-#include "MeblockDrone.h"
-
 void MeblockDrone::begin(const MeblockDroneConfig& cfg){
   // SoftAP config
   g_apSsid = cfg.apSsid ? cfg.apSsid : g_apSsid;
   g_apPass = cfg.apPass ? cfg.apPass : g_apPass;
   apIP     = cfg.apIP;
+  g_imuIntPin = cfg.imuIntPin;
 
   // Run original setup
   drone_setup();
@@ -2,11 +2,41 @@
 #include <Arduino.h>
 #include <WiFi.h>
 
-// Chỉ dùng để cấu hình SoftAP Web Tuning (giống logic trong file .ino mẫu)
+// Vòng điều khiển bay chạy trong task FreeRTOS ưu tiên cao, ghim 1 core, đánh thức bởi ngắt data-ready trên
+// chân INT (hoặc mỗi tick nếu không nối INT). Mỗi lần thức: đọc burst FIFO MPU9250 (1 kHz, không mất mẫu),
+// PID rate 1 kHz, Madgwick 500 Hz, PID góc / độ cao 100 Hz. Gyro qua bank notch bám đỉnh rung động cơ
+// (FFT ở core còn lại, xem MeblockDynNotch.h) + EMA.
+// update_and_fly() trong loop() chỉ còn web, ESP-NOW, nút bấm, hiệu chuẩn, barometer: chậm bao nhiêu cũng
+// không làm trễ / lệch nhịp vòng điều khiển.
+#ifndef MEBLOCK_DRONE_PIN_IMU_INT
+#define MEBLOCK_DRONE_PIN_IMU_INT -1          // GPIO nối chân INT của MPU9250, -1 = không nối (thức mỗi tick 1 ms)
+#endif
+#ifndef MEBLOCK_DRONE_FLIGHT_CORE
+#if portNUM_PROCESSORS > 1
+#define MEBLOCK_DRONE_FLIGHT_CORE 1           // WiFi / ESP-NOW / lwIP nằm ở core 0
+#else
+#define MEBLOCK_DRONE_FLIGHT_CORE 0
+#endif
+#endif
+#ifndef MEBLOCK_DRONE_FFT_CORE
+#define MEBLOCK_DRONE_FFT_CORE (portNUM_PROCESSORS > 1 ? 1 - MEBLOCK_DRONE_FLIGHT_CORE : 0)   // FFT gyro: core không điều khiển
+#endif
+#ifndef MEBLOCK_DRONE_BARO_CORE
+#define MEBLOCK_DRONE_BARO_CORE (portNUM_PROCESSORS > 1 ? 1 - MEBLOCK_DRONE_FLIGHT_CORE : 0)  // task BMP280: core không điều khiển
+#endif
+#ifndef MEBLOCK_DRONE_FLIGHT_PRIO
+#define MEBLOCK_DRONE_FLIGHT_PRIO (configMAX_PRIORITIES - 3)   // trên loopTask / AsyncTCP, dưới task WiFi
+#endif
+#ifndef MEBLOCK_DRONE_FLIGHT_STACK
+#define MEBLOCK_DRONE_FLIGHT_STACK 4096
+#endif
+
+// Cấu hình SoftAP Web Tuning (giống logic trong file .ino mẫu) và chân ngắt IMU
 struct MeblockDroneConfig {
   const char* apSsid = "MEBlock Drone V1";
   const char* apPass = "12345678";
   IPAddress   apIP   = IPAddress(192, 168, 4, 1);
+  int8_t      imuIntPin = MEBLOCK_DRONE_PIN_IMU_INT;
 };
 
 class MeblockDrone {
@@ -0,0 +1,237 @@
+// MeblockDynNotch.cpp
+#include "MeblockDynNotch.h"
+#include <atomic>
+#include <math.h>
+
+#if __has_include(<esp_dsp.h>)
+#include <esp_dsp.h>
+#define DYN_NOTCH_ESP_DSP 1
+#else
+#define DYN_NOTCH_ESP_DSP 0
+#endif
+
+#define FFT_N     MEBLOCK_DYN_NOTCH_FFT_SIZE
+#define RING_N    (2 * FFT_N)            // producer còn 1 cửa sổ dư trước khi ghi đè mẫu đang phân tích
+#define PEAKS     MEBLOCK_DYN_NOTCH_PEAKS
+
+static_assert((FFT_N & (FFT_N - 1)) == 0, "FFT size must be a power of 2");
+
+static float s_ring[3][RING_N];
+static std::atomic<uint32_t> s_head{0};          // chỉ producer ghi
+static std::atomic<float> s_peakHz[3][PEAKS];
+
+static float s_sampleHz = 1000.0f;
+static float *s_window = nullptr;               // Hann, FFT_N
+static float *s_fft = nullptr;                  // complex xen kẽ re, im: 2 * FFT_N
+static float *s_power = nullptr;                // FFT_N / 2
+#if !DYN_NOTCH_ESP_DSP
+static float *s_twiddle = nullptr;              // cos, -sin xen kẽ: FFT_N / 2 cặp
+#endif
+
+void meblock_dyn_notch_push(float gx, float gy, float gz) {
+  uint32_t h = s_head.load(std::memory_order_relaxed);
+  uint32_t i = h & (RING_N - 1);
+  s_ring[0][i] = gx;
+  s_ring[1][i] = gy;
+  s_ring[2][i] = gz;
+  s_head.store(h + 1, std::memory_order_release);
+}
+
+float meblock_dyn_notch_peak(uint8_t axis, uint8_t k) {
+  if (axis >= 3 || k >= PEAKS) return 0.0f;
+  return s_peakHz[axis][k].load(std::memory_order_relaxed);
+}
+
+#if !DYN_NOTCH_ESP_DSP
+// Radix-2 DIT tại chỗ trên mảng complex xen kẽ (cùng bố cục với dsps_fft2r_fc32)
+static void fftRadix2(float *x, int n) {
+  for (int i = 1, j = 0; i < n; i++) {
+    int bit = n >> 1;
+    for (; j & bit; bit >>= 1) j ^= bit;
+    j |= bit;
+    if (i < j) {
+      float tr = x[2 * i], ti = x[2 * i + 1];
+      x[2 * i] = x[2 * j];
+      x[2 * i + 1] = x[2 * j + 1];
+      x[2 * j] = tr;
+      x[2 * j + 1] = ti;
+    }
+  }
+  for (int len = 2; len <= n; len <<= 1) {
+    int half = len >> 1;
+    int step = n / len;
+    for (int i = 0; i < n; i += len) {
+      for (int k = 0; k < half; k++) {
+        float wr = s_twiddle[2 * k * step], wi = s_twiddle[2 * k * step + 1];
+        float *a = &x[2 * (i + k)];
+        float *b = &x[2 * (i + k + half)];
+        float tr = b[0] * wr - b[1] * wi;
+        float ti = b[0] * wi + b[1] * wr;
+        b[0] = a[0] - tr;
+        b[1] = a[1] - ti;
+        a[0] += tr;
+        a[1] += ti;
+      }
+    }
+  }
+}
+#endif
+
+static void dynNotchTask(void *arg) {
+  (void)arg;
+  // Nửa cửa sổ mới mỗi lần (cửa sổ chồng 50%)
+  const TickType_t hop = pdMS_TO_TICKS((uint32_t)(1000.0f * (FFT_N / 2) / s_sampleHz)) > 0
+                             ? pdMS_TO_TICKS((uint32_t)(1000.0f * (FFT_N / 2) / s_sampleHz))
+                             : 1;
+  TickType_t lastWake = xTaskGetTickCount();
+  for (;;) {
+    vTaskDelayUntil(&lastWake, hop);
+    meblock_dyn_notch_analyze();
+  }
+}
+
+bool meblock_dyn_notch_begin(float sampleHz, int core, UBaseType_t prio) {
+  s_sampleHz = sampleHz;
+  for (int a = 0; a < 3; a++)
+    for (int k = 0; k < PEAKS; k++) s_peakHz[a][k].store(0.0f);
+
+  s_window = (float *)malloc(FFT_N * sizeof(float));
+  s_fft = (float *)malloc(2 * FFT_N * sizeof(float));
+  s_power = (float *)malloc(FFT_N / 2 * sizeof(float));
+  if (!s_window || !s_fft || !s_power) return false;
+
+#if DYN_NOTCH_ESP_DSP
+  if (dsps_fft2r_init_fc32(NULL, FFT_N) != ESP_OK) return false;
+  dsps_wind_hann_f32(s_window, FFT_N);
+#else
+  s_twiddle = (float *)malloc(FFT_N * sizeof(float));
+  if (!s_twiddle) return false;
+  for (int k = 0; k < FFT_N / 2; k++) {
+    s_twiddle[2 * k] = cosf(2.0f * (float)M_PI * k / FFT_N);
+    s_twiddle[2 * k + 1] = -sinf(2.0f * (float)M_PI * k / FFT_N);
+  }
+  for (int i = 0; i < FFT_N; i++) s_window[i] = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * i / (FFT_N - 1));
+#endif
+
+  if (core >= 0) {
+    return xTaskCreatePinnedToCore(dynNotchTask, "drone_notch", 3072, nullptr, prio, nullptr, core) == pdPASS;
+  }
+  return true;
+}
+
+// Tìm tối đa PEAKS đỉnh trong [minBin, maxBin], nội suy parabol, tăng dần theo tần số
+static uint8_t findPeaks(const float *p, int minBin, int maxBin, float out[PEAKS]) {
+  float mean = 0;
+  for (int b = minBin; b <= maxBin; b++) mean += p[b];
+  mean /= (float)(maxBin - minBin + 1);
+
+  int picked[PEAKS];
+  uint8_t n = 0;
+  for (; n < PEAKS; n++) {
+    int best = -1;
+    for (int b = minBin; b <= maxBin; b++) {
+      if (p[b] < p[b - 1] || p[b] < p[b + 1]) continue;   // chỉ cực đại địa phương
+      bool near = false;
+      for (uint8_t j = 0; j < n; j++) near |= abs(b - picked[j]) <= 2;
+      if (near) continue;
+      if (best < 0 || p[b] > p[best]) best = b;
+    }
+    if (best < 0 || p[best] < MEBLOCK_DYN_NOTCH_SNR * mean) break;
+    picked[n] = best;
+  }
+
+  for (uint8_t j = 0; j < n; j++) {
+    int b = picked[j];
+    float l = p[b - 1], c = p[b], r = p[b + 1];
+    float den = l - 2.0f * c + r;
+    float delta = den != 0.0f ? 0.5f * (l - r) / den : 0.0f;
+    out[j] = (b + delta) * s_sampleHz / FFT_N;
+  }
+  // sắp tăng dần: đỉnh mới vào slot trống theo thứ tự tần số
+  for (uint8_t i = 1; i < n; i++)
+    for (uint8_t j = i; j > 0 && out[j] < out[j - 1]; j--) {
+      float t = out[j];
+      out[j] = out[j - 1];
+      out[j - 1] = t;
+    }
+  return n;
+}
+
+// Ghép đỉnh mới với đỉnh cũ gần nhất (cặp gần nhất trước, trong maxJump Hz) rồi mới làm mượt: 1 đỉnh mất đi
+// thì slot của đỉnh còn lại không bị kéo về giữa 2 đỉnh. Slot không ghép được => 0, đỉnh mới vào slot trống.
+static void trackPeaks(std::atomic<float> slot[PEAKS], const float *found, uint8_t n, float maxJump) {
+  float prev[PEAKS], out[PEAKS] = {};
+  bool used[PEAKS] = {};
+  for (uint8_t k = 0; k < PEAKS; k++) prev[k] = slot[k].load(std::memory_order_relaxed);
+
+  for (;;) {
+    int bk = -1, bj = -1;
+    float best = maxJump;
+    for (uint8_t k = 0; k < PEAKS; k++) {
+      if (prev[k] <= 0.0f || out[k] > 0.0f) continue;
+      for (uint8_t j = 0; j < n; j++) {
+        float d = fabsf(found[j] - prev[k]);
+        if (!used[j] && d <= best) {
+          best = d;
+          bk = k;
+          bj = j;
+        }
+      }
+    }
+    if (bk < 0) break;
+    out[bk] = prev[bk] + 0.5f * (found[bj] - prev[bk]);   // làm mượt giữa 2 cửa sổ
+    used[bj] = true;
+  }
+
+  for (uint8_t j = 0, k = 0; j < n; j++) {
+    if (used[j]) continue;
+    while (k < PEAKS && out[k] > 0.0f) k++;
+    if (k == PEAKS) break;
+    out[k] = found[j];   // đỉnh mới / nhảy xa: lấy luôn, không trộn với đỉnh khác
+  }
+  for (uint8_t k = 0; k < PEAKS; k++) slot[k].store(out[k], std::memory_order_relaxed);
+}
+
+bool meblock_dyn_notch_analyze() {
+  if (!s_fft) return false;
+  uint32_t head = s_head.load(std::memory_order_acquire);
+  if (head < FFT_N) return false;
+  uint32_t start = head - FFT_N;
+
+  // Bin 1 và N/2 - 1 làm hàng xóm cho nội suy => dải tìm đỉnh [2, N/2 - 2]
+  int minBin = (int)(MEBLOCK_DYN_NOTCH_MIN_HZ * FFT_N / s_sampleHz);
+  int maxBin = (int)(MEBLOCK_DYN_NOTCH_MAX_HZ * FFT_N / s_sampleHz);
+  if (minBin < 2) minBin = 2;
+  if (maxBin > FFT_N / 2 - 2) maxBin = FFT_N / 2 - 2;
+  if (maxBin <= minBin) return false;
+
+  for (int a = 0; a < 3; a++) {
+    float samples[FFT_N];
+    float mean = 0;
+    for (int i = 0; i < FFT_N; i++) {
+      samples[i] = s_ring[a][(start + i) & (RING_N - 1)];
+      mean += samples[i];
+    }
+    mean /= FFT_N;
+    for (int i = 0; i < FFT_N; i++) samples[i] -= mean;   // bỏ DC (bias / chuyển động chậm)
+
+#if DYN_NOTCH_ESP_DSP
+    dsps_mul_f32(samples, s_window, s_fft, FFT_N, 1, 1, 2);   // re = x * w, bước 2 => xen kẽ
+    for (int i = 0; i < FFT_N; i++) s_fft[2 * i + 1] = 0.0f;
+    dsps_fft2r_fc32(s_fft, FFT_N);
+    dsps_bit_rev_fc32(s_fft, FFT_N);
+#else
+    for (int i = 0; i < FFT_N; i++) {
+      s_fft[2 * i] = samples[i] * s_window[i];
+      s_fft[2 * i + 1] = 0.0f;
+    }
+    fftRadix2(s_fft, FFT_N);
+#endif
+    for (int b = 0; b < FFT_N / 2; b++) s_power[b] = s_fft[2 * b] * s_fft[2 * b] + s_fft[2 * b + 1] * s_fft[2 * b + 1];
+
+    float found[PEAKS];
+    uint8_t n = findPeaks(s_power, minBin, maxBin, found);
+    trackPeaks(s_peakHz[a], found, n, MEBLOCK_DYN_NOTCH_TRACK_BINS * s_sampleHz / FFT_N);
+  }
+  return true;
+}
@@ -0,0 +1,45 @@
+// MeblockDynNotch.h
+#pragma once
+#include <Arduino.h>
+
+// Dynamic notch cho gyro: tìm đỉnh rung động cơ bằng FFT có cửa sổ Hann trên gyro thô, rồi cho bank notch biquad
+// (MeblockBiquad) bám theo. Flight task chỉ đẩy mẫu vào ring (meblock_dyn_notch_push, vài ns) và đọc tần số đỉnh.
+// FFT chạy trong task ưu tiên thấp ở core không điều khiển, mỗi nửa cửa sổ 1 lần.
+// Có esp-dsp (esp_dsp.h): FFT / nhân cửa sổ dùng hàm esp-dsp (lệnh SIMD trên ESP32-S3, tối ưu asm trên ESP32);
+// không có: FFT radix-2 C thuần.
+
+#ifndef MEBLOCK_DYN_NOTCH_FFT_SIZE
+#define MEBLOCK_DYN_NOTCH_FFT_SIZE 128     // lũy thừa 2. Ở 1 kHz: bin 7.8 Hz, cửa sổ 128 ms
+#endif
+#ifndef MEBLOCK_DYN_NOTCH_PEAKS
+#define MEBLOCK_DYN_NOTCH_PEAKS 2          // số đỉnh (số notch) mỗi trục
+#endif
+#ifndef MEBLOCK_DYN_NOTCH_MIN_HZ
+#define MEBLOCK_DYN_NOTCH_MIN_HZ 60.0f     // dưới đây là chuyển động thật của drone, không notch
+#endif
+#ifndef MEBLOCK_DYN_NOTCH_MAX_HZ
+#define MEBLOCK_DYN_NOTCH_MAX_HZ 450.0f
+#endif
+#ifndef MEBLOCK_DYN_NOTCH_Q
+#define MEBLOCK_DYN_NOTCH_Q 3.0f
+#endif
+#ifndef MEBLOCK_DYN_NOTCH_SNR
+#define MEBLOCK_DYN_NOTCH_SNR 6.0f         // công suất đỉnh / trung bình dải: thấp hơn => không phải rung, bỏ notch
+#endif
+#ifndef MEBLOCK_DYN_NOTCH_TRACK_BINS
+#define MEBLOCK_DYN_NOTCH_TRACK_BINS 3.0f  // đỉnh mới cách đỉnh cũ tối đa bấy nhiêu bin => cùng 1 đỉnh, làm mượt
+#endif
+
+/// Cấp bộ nhớ, chuẩn bị FFT; core >= 0 => tạo task phân tích ghim core đó, ưu tiên prio.
+/// core < 0: không tạo task, gọi meblock_dyn_notch_analyze() tự quản. false nếu hết RAM
+bool meblock_dyn_notch_begin(float sampleHz, int core, UBaseType_t prio);
+
+/// Mẫu gyro thô (deg/s, trước notch) x/y/z. Chỉ 1 producer (flight task)
+void meblock_dyn_notch_push(float gx, float gy, float gz);
+
+/// Phân tích cửa sổ mới nhất, cập nhật tần số đỉnh. false nếu chưa đủ mẫu
+bool meblock_dyn_notch_analyze();
+
+/// Tần số đỉnh thứ k của trục axis (Hz), 0 = không có đỉnh rung đáng kể.
+/// Slot k giữ cùng 1 đỉnh giữa các lần phân tích (không sắp theo tần số): đỉnh khác mất đi thì slot này không đổi.
+float meblock_dyn_notch_peak(uint8_t axis, uint8_t k);
@@ -0,0 +1,141 @@
+// MeblockFilter.h
+#pragma once
+#include <stdint.h>
+#include <math.h>
+
+// Bộ lọc median trượt + EMA cho nhiều trục (x/y/z) dùng chung 1 cửa sổ thời gian.
+// Mỗi trục giữ 2 mảng: cửa sổ theo thời gian (ring) và cùng các giá trị đó đã sắp xếp. Mỗi mẫu mới:
+// tìm nhị phân giá trị bị đẩy ra và chỗ chèn giá trị mới (O(log N) phép so sánh), chỉ dịch đoạn giữa 2 vị trí
+// đó (cửa sổ <= 9 nên vòng lặp ngắn nhanh hơn memmove); median = phần tử giữa. Không sắp xếp lại cả cửa sổ mỗi tick như medianFilterN() cũ.
+// Trạng thái dạng struct-of-arrays (mảng theo trục), EMA tính luôn trong cùng vòng lặp.
+// Kết quả giống hệt median + emaFilter() cũ: cửa sổ khởi tạo toàn 0, EMA cùng công thức.
+//
+//   MeblockMedianEma<9, 3> gyro;          // cửa sổ 9, 3 trục
+//   float in[3] = { gx, gy, gz }, out[3];
+//   gyro.update(in, out, 0.55f);           // out = EMA(median(in))
+
+/// N: độ dài cửa sổ (lẻ), AXES: số tín hiệu cùng nhịp
+template <uint8_t N, uint8_t AXES>
+struct MeblockMedianEma {
+  static_assert(N % 2 == 1, "median window must be odd");
+
+  float window[AXES][N];   // theo thời gian, window[a][head] = mẫu cũ nhất
+  float sorted[AXES][N];   // cùng các giá trị, tăng dần
+  float ema[AXES];
+  uint8_t head;
+
+  MeblockMedianEma() { reset(); }
+
+  /// Cửa sổ và EMA về v (mặc định 0, như buffer {0} cũ)
+  void reset(float v = 0.0f) {
+    for (uint8_t a = 0; a < AXES; a++) {
+      for (uint8_t i = 0; i < N; i++) window[a][i] = sorted[a][i] = v;
+      ema[a] = v;
+    }
+    head = 0;
+  }
+
+  /// Thêm 1 mẫu cho mọi trục. med (có thể nullptr) = median từng trục, out = EMA(median) với hệ số alpha.
+  /// Mẫu NaN / vô cực (lỗi đọc cảm biến) được thay bằng mẫu trước đó của trục, không vào cửa sổ.
+  void update(const float *in, float *out, float alpha, float *med = nullptr) {
+    uint8_t last = head ? head - 1 : N - 1;
+    for (uint8_t a = 0; a < AXES; a++) {
+      float x = in[a];
+      if (!isfinite(x)) x = window[a][last];
+      float old = window[a][head];
+      window[a][head] = x;
+      float m = slide(sorted[a], old, x);
+      if (med) med[a] = m;
+      ema[a] = alpha * m + (1.0f - alpha) * ema[a];
+      out[a] = ema[a];
+    }
+    if (++head == N) head = 0;
+  }
+
+  /// Bản 1 trục: trả về EMA(median(x))
+  float update(float x, float alpha) {
+    float out;
+    update(&x, &out, alpha);
+    return out;
+  }
+
+private:
+  // Vị trí đầu tiên có s[i] >= v
+  static uint8_t lowerBound(const float *s, uint8_t lo, uint8_t hi, float v) {
+    while (lo < hi) {
+      uint8_t mid = (uint8_t)((lo + hi) >> 1);
+      if (s[mid] < v) lo = mid + 1;
+      else hi = mid;
+    }
+    return lo;
+  }
+
+  // Thay 1 bản của old bằng x, giữ thứ tự tăng dần; trả về median. Mọi giá trị hữu hạn => old luôn có trong s
+  static float slide(float *s, float old, float x) {
+    uint8_t i = lowerBound(s, 0, N, old);
+    if (x > s[i]) {
+      uint8_t j = lowerBound(s, i + 1, N, x);   // x vào trước j, mọi phần tử (i, j) lùi 1
+      for (; i + 1 < j; i++) s[i] = s[i + 1];
+      s[i] = x;
+    } else {
+      uint8_t j = lowerBound(s, 0, i, x);       // x vào j, mọi phần tử [j, i) tiến 1
+      for (; i > j; i--) s[i] = s[i - 1];
+      s[i] = x;
+    }
+    return s[N / 2];
+  }
+};
+
+#ifndef MEBLOCK_NOTCH_RAMP_MS
+#define MEBLOCK_NOTCH_RAMP_MS 20   // thời gian bật / tắt dần notch
+#endif
+
+/// Notch biquad (direct form II transposed) có độ sâu bật / tắt dần: out = x + depth * (notch(x) - x).
+/// Mặc định tắt (trả về x). setNotch bật dần depth 0 -> 1, setPassthrough tắt dần về 0 (giữ tần số cũ khi tắt),
+/// depth đổi tuyến tính trong MEBLOCK_NOTCH_RAMP_MS => bật / tắt khi đang bay không gây giật.
+/// Bật lại từ trạng thái tắt: trạng thái được nạp theo mẫu đầu (xác lập với tín hiệu DC, không nhảy từ 0).
+/// Dời tần số khi đang bật (setNotch) giữ nguyên trạng thái.
+struct MeblockBiquad {
+  float b0 = 1.0f, b1 = 0.0f, b2 = 0.0f, a1 = 0.0f, a2 = 0.0f;
+  float z1 = 0.0f, z2 = 0.0f;
+  float depth = 0.0f, depthTarget = 0.0f, depthStep = 1.0f;
+  bool running = false;
+
+  /// Notch (RBJ cookbook) tại hz, tần số lấy mẫu sampleHz, độ hẹp q (lớn = hẹp)
+  void setNotch(float hz, float sampleHz, float q) {
+    float w0 = 2.0f * (float)M_PI * hz / sampleHz;
+    float cw = cosf(w0);
+    float alpha = sinf(w0) / (2.0f * q);
+    float inv = 1.0f / (1.0f + alpha);
+    b0 = inv;
+    b1 = -2.0f * cw * inv;
+    b2 = inv;
+    a1 = b1;
+    a2 = (1.0f - alpha) * inv;
+    float ramp = sampleHz * (MEBLOCK_NOTCH_RAMP_MS / 1000.0f);
+    depthStep = ramp > 1.0f ? 1.0f / ramp : 1.0f;
+    depthTarget = 1.0f;
+  }
+
+  /// Tắt dần notch (về passthrough)
+  void setPassthrough() { depthTarget = 0.0f; }
+
+  float apply(float x) {
+    if (!running) {
+      if (depthTarget == 0.0f) return x;
+      z1 = (1.0f - b0) * x;   // trạng thái xác lập với đầu vào hằng x (notch có độ lợi DC = 1)
+      z2 = (b2 - a2) * x;
+      running = true;
+    }
+    float y = b0 * x + z1;
+    z1 = b1 * x - a1 * y + z2;
+    z2 = b2 * x - a2 * y;
+    if (depth < depthTarget) depth = fminf(depth + depthStep, depthTarget);
+    else if (depth > depthTarget) depth = fmaxf(depth - depthStep, depthTarget);
+    if (depth == 0.0f && depthTarget == 0.0f) {
+      running = false;
+      return x;
+    }
+    return x + depth * (y - x);
+  }
+};
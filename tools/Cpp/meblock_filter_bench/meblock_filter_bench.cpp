@@ -0,0 +1,215 @@
+// meblock_filter_bench.cpp
+// Benchmark trên máy tính: bộ lọc median + EMA của MeblockDrone, cách cũ (medianFilterN: copy + sắp xếp cả cửa sổ
+// mỗi tick) so với MeblockMedianEma (MeblockFilter.h). Mỗi tick lọc 11 tín hiệu (bộ tín hiệu lúc thay bộ lọc):
+// gyro 3 x 9, accel 3 x 9, mag 3 x 3, độ cao 7, vận tốc Z 5. Kiểm tra 2 cách cho kết quả giống hệt từng bit.
+// Thêm: mẫu NaN / vô cực bị thay bằng mẫu trước (so với cách cũ trên chuỗi đã thay), mảng sắp xếp không lệch cửa sổ.
+//
+//   meblock_filter_bench [-n <số tick>] [-s <seed>]
+//
+// Exit code 0 khi kết quả khớp => dùng được trong CI. Chu kỳ CPU (rdtsc) chỉ in trên x86.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC 1
+#else
+#define BENCH_HAVE_TSC 0
+#endif
+
+#include "MeblockFilter.h"
+
+// ===== Cách cũ (nguyên văn từ MeblockDrone.cpp trước khi thay) =====
+static float medianFilterN(float input, float *buffer, size_t N, size_t &index) {
+  if (N == 0) return input;
+  buffer[index] = input;
+  index = (index + 1) % N;
+
+  // N trong sketch này nhỏ (<=9). Dùng mảng temp cố định để tránh VLA / template.
+  const size_t MEDIAN_MAX = 9;
+  float temp[MEDIAN_MAX];
+  if (N > MEDIAN_MAX) N = MEDIAN_MAX;
+  for (size_t i = 0; i < N; i++) temp[i] = buffer[i];
+
+  // sort (bubble-ish) cho N nhỏ
+  for (size_t i = 0; i + 1 < N; i++) {
+    for (size_t j = i + 1; j < N; j++) {
+      if (temp[j] < temp[i]) {
+        float t = temp[i];
+        temp[i] = temp[j];
+        temp[j] = t;
+      }
+    }
+  }
+  return temp[N / 2];
+}
+#define medianFilter(input, buf, idx) \
+  medianFilterN((input), (buf), (sizeof(buf) / sizeof((buf)[0])), (idx))
+
+float emaFilter(float input, float &emaPrev, float alpha) {
+  emaPrev = alpha * input + (1.0f - alpha) * emaPrev;
+  return emaPrev;
+}
+
+static const float kAlphaGyro = 0.55f, kAlphaAcc = 0.7f, kAlphaMag = 0.9f, kAlphaAlt = 0.5f, kAlphaVZ = 0.6f;
+static const int kSignals = 11;
+
+struct OldBank {
+  float gyro_buf[3][9] = {}, acc_buf[3][9] = {}, mag_buf[3][3] = {}, alt_buf[7] = {}, vz_buf[5] = {};
+  size_t gyro_idx[3] = {}, acc_idx[3] = {}, mag_idx[3] = {}, alt_idx = 0, vz_idx = 0;
+  float ema[kSignals] = {};
+
+  void tick(const float *in, float *out) {
+    for (int a = 0; a < 3; a++) {
+      out[a]     = emaFilter(medianFilter(in[a],     gyro_buf[a], gyro_idx[a]), ema[a],     kAlphaGyro);
+      out[3 + a] = emaFilter(medianFilter(in[3 + a], acc_buf[a],  acc_idx[a]),  ema[3 + a], kAlphaAcc);
+      out[6 + a] = emaFilter(medianFilter(in[6 + a], mag_buf[a],  mag_idx[a]),  ema[6 + a], kAlphaMag);
+    }
+    out[9]  = emaFilter(medianFilter(in[9],  alt_buf, alt_idx), ema[9],  kAlphaAlt);
+    out[10] = emaFilter(medianFilter(in[10], vz_buf,  vz_idx),  ema[10], kAlphaVZ);
+  }
+};
+
+struct NewBank {
+  MeblockMedianEma<9, 3> gyro, acc;
+  MeblockMedianEma<3, 3> mag;
+  MeblockMedianEma<7, 1> alt;
+  MeblockMedianEma<5, 1> vz;
+
+  void tick(const float *in, float *out) {
+    gyro.update(in, out, kAlphaGyro);
+    acc.update(in + 3, out + 3, kAlphaAcc);
+    mag.update(in + 6, out + 6, kAlphaMag);
+    out[9]  = alt.update(in[9], kAlphaAlt);
+    out[10] = vz.update(in[10], kAlphaVZ);
+  }
+};
+
+static inline uint64_t tsc() {
+#if BENCH_HAVE_TSC
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+struct Result {
+  double nsPerTick;
+  double cyclesPerTick;
+  float checksum;
+};
+
+template <class Bank>
+static Result run(const float *input, float *output, uint32_t ticks) {
+  Bank *bank = new Bank();
+  auto t0 = std::chrono::steady_clock::now();
+  uint64_t c0 = tsc();
+  float sum = 0;
+  for (uint32_t t = 0; t < ticks; t++) {
+    bank->tick(input + (size_t)t * kSignals, output + (size_t)t * kSignals);
+    sum += output[(size_t)t * kSignals];
+  }
+  uint64_t c1 = tsc();
+  auto t1 = std::chrono::steady_clock::now();
+  delete bank;
+  Result r;
+  r.nsPerTick = std::chrono::duration<double, std::nano>(t1 - t0).count() / ticks;
+  r.cyclesPerTick = (double)(c1 - c0) / ticks;
+  r.checksum = sum;
+  return r;
+}
+
+// Chuỗi có NaN / ±vô cực: MeblockMedianEma phải cho kết quả như cách cũ trên chuỗi đã thay mẫu lỗi bằng mẫu trước,
+// và sorted luôn đúng là window đã sắp xếp. Trả về số tick sai
+static size_t checkNonFinite(std::mt19937 &rng, uint32_t ticks) {
+  std::normal_distribution<float> noise(0.0f, 1.0f);
+  std::uniform_int_distribution<int> bad(0, 19);
+  const float kBad[3] = { NAN, INFINITY, -INFINITY };
+  MeblockMedianEma<9, 1> f;
+  float buf[9] = { 0 }, emaOld = 0.0f, prev = 0.0f;
+  size_t idx = 0, wrong = 0;
+  for (uint32_t t = 0; t < ticks; t++) {
+    float x = 20.0f * noise(rng);
+    int b = bad(rng);
+    if (b < 3) x = kBad[b];
+    else prev = x;
+    float out = f.update(x, kAlphaGyro);
+    float ref = emaFilter(medianFilter(prev, buf, idx), emaOld, kAlphaGyro);
+
+    float w[9];
+    memcpy(w, f.window[0], sizeof(w));
+    std::sort(w, w + 9);
+    if (memcmp(&out, &ref, sizeof(float)) != 0 || memcmp(w, f.sorted[0], sizeof(w)) != 0) {
+      if (!wrong) fprintf(stderr, "non-finite input: mismatch at tick %u: %.9g != %.9g\n", t, out, ref);
+      wrong++;
+    }
+  }
+  return wrong;
+}
+
+int main(int argc, char **argv) {
+  uint32_t ticks = 1000000;
+  uint32_t seed = 1;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) ticks = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    else if (!strcmp(argv[i], "-s") && i + 1 < argc) seed = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    else {
+      fprintf(stderr, "usage: %s [-n ticks] [-s seed]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (ticks == 0) ticks = 1;
+
+  // Tín hiệu giống cảm biến: nhiễu + trôi chậm + thỉnh thoảng gai (thứ median phải chặn)
+  std::mt19937 rng(seed);
+  std::normal_distribution<float> noise(0.0f, 1.0f);
+  std::uniform_int_distribution<int> spike(0, 199);
+  static const float scale[kSignals] = { 20, 20, 20, 0.05f, 0.05f, 0.05f, 2, 2, 2, 0.3f, 0.2f };
+  static const float base[kSignals] = { 0, 0, 0, 0, 0, 1, 20, -5, 40, 35, 0 };
+  float *input = new float[(size_t)ticks * kSignals];
+  for (uint32_t t = 0; t < ticks; t++) {
+    for (int k = 0; k < kSignals; k++) {
+      float v = base[k] + scale[k] * (noise(rng) + 2.0f * sinf(t * 0.001f * (k + 1)));
+      if (spike(rng) == 0) v += scale[k] * 50.0f;
+      input[(size_t)t * kSignals + k] = v;
+    }
+  }
+
+  float *outOld = new float[(size_t)ticks * kSignals];
+  float *outNew = new float[(size_t)ticks * kSignals];
+  Result rOld = run<OldBank>(input, outOld, ticks);
+  Result rNew = run<NewBank>(input, outNew, ticks);
+
+  size_t mismatch = 0;
+  for (size_t i = 0; i < (size_t)ticks * kSignals; i++) {
+    if (memcmp(&outOld[i], &outNew[i], sizeof(float)) != 0) {
+      if (!mismatch) fprintf(stderr, "mismatch at tick %zu signal %zu: %.9g != %.9g\n", i / kSignals, i % kSignals,
+                             outOld[i], outNew[i]);
+      mismatch++;
+    }
+  }
+
+  printf("ticks %u, %d signals/tick (gyro 3x9, acc 3x9, mag 3x3, alt 7, vz 5)\n", ticks, kSignals);
+  printf("%-22s %8.1f ns/tick", "medianFilterN (old)", rOld.nsPerTick);
+  if (BENCH_HAVE_TSC) printf("  %8.1f cycles/tick", rOld.cyclesPerTick);
+  printf("\n%-22s %8.1f ns/tick", "MeblockMedianEma", rNew.nsPerTick);
+  if (BENCH_HAVE_TSC) printf("  %8.1f cycles/tick", rNew.cyclesPerTick);
+  printf("\nspeedup x%.2f, outputs %s\n", rOld.nsPerTick / rNew.nsPerTick,
+         mismatch ? "DIFFER" : "bit-identical");
+  size_t nonFinite = checkNonFinite(rng, 100000);
+  printf("NaN / inf samples: %s\n", nonFinite ? "WRONG" : "replaced by the previous sample, sorted window intact");
+  (void)rOld.checksum;
+  (void)rNew.checksum;
+
+  delete[] input;
+  delete[] outOld;
+  delete[] outNew;
+  return (mismatch || nonFinite) ? 1 : 0;
+}
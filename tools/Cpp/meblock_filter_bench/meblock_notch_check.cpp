@@ -0,0 +1,181 @@
+// meblock_notch_check.cpp
+// Kiểm tra trên máy tính cho notch động của MeblockDrone (MeblockDynNotch + MeblockBiquad), cùng cách flight task
+// dùng: đẩy gyro thô 1 kHz, phân tích mỗi nửa cửa sổ FFT, notch bám tần số đỉnh (như updateGyroNotches()).
+//   - trục X: chuyển động chậm 3 Hz + rung 237.3 Hz + nhiễu  => tìm thấy 237 Hz, sai số <= 1 bin
+//   - trục Y: 2 tone 150 Hz + 310 Hz + nhiễu                  => 2 đỉnh riêng, mỗi đỉnh sai số <= 1 bin
+//   - trục Z: chỉ nhiễu                                        => không có đỉnh (0)
+//   - notch bám đỉnh trục X giảm tone 237.3 Hz ít nhất 20 dB
+//   - sau đó trục Y mất tone 150 Hz: slot của 310 Hz giữ nguyên, không có đỉnh "trộn" nằm giữa 150 và 310 Hz
+//   - bật / tắt notch liên tục và nhảy tần số notch khi đang bay 200 deg/s: lệch khỏi 200 deg/s không vượt biên độ
+//     tone (+ sai số nhỏ), tức bật / tắt / nhảy không gây giật
+//
+//   meblock_notch_check [-s <seed>]
+//
+// Exit code 0 khi mọi kiểm tra đạt => dùng được trong CI.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <random>
+
+#include "MeblockDynNotch.h"
+#include "MeblockFilter.h"
+
+static const float kSampleHz = 1000.0f;
+static const float kBinHz = kSampleHz / MEBLOCK_DYN_NOTCH_FFT_SIZE;
+static const int kSamples = 2000;
+static const int kSettle = 1500;   // đo suy giảm sau khi notch đã bám và bật hết
+static const float kMinAttenDb = 20.0f;
+
+static const float kRate = 200.0f;          // deg/s, vận tốc góc khi bật / tắt notch
+static const float kToggleTone = 25.0f;     // deg/s
+static const float kToggleMargin = 1.0f;    // deg/s
+
+static int s_failed = 0;
+
+static void check(bool ok, const char *what) {
+  printf("%-4s %s\n", ok ? "OK" : "FAIL", what);
+  if (!ok) s_failed++;
+}
+
+// Có đỉnh nào của trục axis nằm trong +-1 bin quanh hz không
+// Bật / tắt notch mỗi 150 mẫu, khi bật thì nhảy tần số 225 <-> 250 Hz mỗi 50 mẫu (như updateGyroNotches() khi đỉnh
+// xuất hiện / mất / dời). Gyro = 200 deg/s + tone 25 deg/s ở 237.3 Hz. Trả về độ lệch lớn nhất khỏi 200 deg/s,
+// meanOn = độ lệch trung bình khi notch đã bật hết (notch vẫn phải có tác dụng)
+static float toggleDeviation(float *meanOn) {
+  const float w = 2.0f * (float)M_PI / kSampleHz;
+  MeblockBiquad notch;
+  bool on = false, high = false;
+  float worst = 0.0f;
+  double sumOn = 0;
+  int nOn = 0;
+  for (int t = 0; t < 4000; t++) {
+    if (t % 150 == 0) {
+      on = !on;
+      if (on) notch.setNotch(237.3f, kSampleHz, MEBLOCK_DYN_NOTCH_Q);
+      else notch.setPassthrough();
+    } else if (on && t % 50 == 0) {
+      high = !high;
+      notch.setNotch(high ? 250.0f : 225.0f, kSampleHz, MEBLOCK_DYN_NOTCH_Q);
+    }
+    float y = notch.apply(kRate + kToggleTone * sinf(w * 237.3f * t));
+    float dev = fabsf(y - kRate);
+    if (dev > worst) worst = dev;
+    if (on && t % 150 >= 2 * MEBLOCK_NOTCH_RAMP_MS) {
+      sumOn += dev;
+      nOn++;
+    }
+  }
+  *meanOn = (float)(sumOn / nOn);
+  return worst;
+}
+
+static bool hasPeakNear(uint8_t axis, float hz) {
+  for (uint8_t k = 0; k < MEBLOCK_DYN_NOTCH_PEAKS; k++) {
+    float p = meblock_dyn_notch_peak(axis, k);
+    if (p > 0.0f && fabsf(p - hz) <= kBinHz) return true;
+  }
+  return false;
+}
+
+int main(int argc, char **argv) {
+  uint32_t seed = 1;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-s") && i + 1 < argc) seed = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    else {
+      fprintf(stderr, "usage: %s [-s seed]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  if (!meblock_dyn_notch_begin(kSampleHz, -1, 0)) {
+    fprintf(stderr, "meblock_dyn_notch_begin failed\n");
+    return 1;
+  }
+
+  std::mt19937 rng(seed);
+  std::normal_distribution<float> noise(0.0f, 3.0f);
+  const float w = 2.0f * (float)M_PI / kSampleHz;
+  MeblockBiquad notch[MEBLOCK_DYN_NOTCH_PEAKS];
+  float notchHz[MEBLOCK_DYN_NOTCH_PEAKS] = {};
+  double inPower = 0, outPower = 0;
+
+  for (int t = 0; t < kSamples; t++) {
+    float tone = 25.0f * sinf(w * 237.3f * t);
+    float gx = 40.0f * sinf(w * 3.0f * t) + tone + noise(rng);
+    float gy = 10.0f * sinf(w * 150.0f * t) + 8.0f * sinf(w * 310.0f * t) + noise(rng);
+    float gz = noise(rng);
+    meblock_dyn_notch_push(gx, gy, gz);
+
+    // Như dynNotchTask (mỗi nửa cửa sổ) + updateGyroNotches() cho trục X
+    if (t % (MEBLOCK_DYN_NOTCH_FFT_SIZE / 2) == MEBLOCK_DYN_NOTCH_FFT_SIZE / 2 - 1) {
+      meblock_dyn_notch_analyze();
+      for (uint8_t k = 0; k < MEBLOCK_DYN_NOTCH_PEAKS; k++) {
+        float hz = meblock_dyn_notch_peak(0, k);
+        if (hz <= 0.0f) {
+          if (notchHz[k] > 0.0f) notch[k].setPassthrough();
+          notchHz[k] = 0.0f;
+        } else if (fabsf(hz - notchHz[k]) > 0.5f) {
+          notch[k].setNotch(hz, kSampleHz, MEBLOCK_DYN_NOTCH_Q);
+          notchHz[k] = hz;
+        }
+      }
+    }
+
+    float y = tone;
+    for (uint8_t k = 0; k < MEBLOCK_DYN_NOTCH_PEAKS; k++) y = notch[k].apply(y);
+    if (t >= kSettle) {
+      inPower += (double)tone * tone;
+      outPower += (double)y * y;
+    }
+  }
+
+  for (uint8_t a = 0; a < 3; a++) {
+    printf("axis %c peaks:", "XYZ"[a]);
+    for (uint8_t k = 0; k < MEBLOCK_DYN_NOTCH_PEAKS; k++) printf(" %6.1f Hz", meblock_dyn_notch_peak(a, k));
+    printf("\n");
+  }
+  float attenDb = (float)(10.0 * log10((outPower + 1e-20) / inPower));
+  printf("notch at 237.3 Hz: %.1f dB (bin %.2f Hz)\n", attenDb, kBinHz);
+
+  check(hasPeakNear(0, 237.3f), "X: 237 Hz tone found within 1 bin");
+  check(hasPeakNear(1, 150.0f) && hasPeakNear(1, 310.0f), "Y: 150 Hz / 310 Hz resolved as two peaks");
+  bool quiet = true;
+  for (uint8_t k = 0; k < MEBLOCK_DYN_NOTCH_PEAKS; k++) quiet = quiet && meblock_dyn_notch_peak(2, k) == 0.0f;
+  check(quiet, "Z: noise only => no peak");
+  check(attenDb <= -kMinAttenDb, "notch attenuates the tone by >= 20 dB");
+
+  // Trục Y: tắt tone 150 Hz, giữ 310 Hz. Slot bám 310 Hz không đổi, không slot nào bị kéo vào giữa 2 đỉnh
+  int slot310 = -1;
+  for (uint8_t k = 0; k < MEBLOCK_DYN_NOTCH_PEAKS; k++)
+    if (fabsf(meblock_dyn_notch_peak(1, k) - 310.0f) <= kBinHz) slot310 = k;
+  bool kept = slot310 >= 0, noBlend = true;
+  float worst = 0.0f;
+  for (int t = kSamples; t < 2 * kSamples; t++) {
+    meblock_dyn_notch_push(noise(rng), 8.0f * sinf(w * 310.0f * t) + noise(rng), noise(rng));
+    if (t % (MEBLOCK_DYN_NOTCH_FFT_SIZE / 2) != MEBLOCK_DYN_NOTCH_FFT_SIZE / 2 - 1) continue;
+    meblock_dyn_notch_analyze();
+    if (slot310 >= 0) kept = kept && fabsf(meblock_dyn_notch_peak(1, slot310) - 310.0f) <= kBinHz;
+    for (uint8_t k = 0; k < MEBLOCK_DYN_NOTCH_PEAKS; k++) {
+      float p = meblock_dyn_notch_peak(1, k);
+      if (p > 150.0f + 2 * kBinHz && p < 310.0f - 2 * kBinHz) {
+        noBlend = false;
+        worst = p;
+      }
+    }
+  }
+  if (!noBlend) printf("axis Y after 150 Hz dropped: blended peak %.1f Hz\n", worst);
+  check(kept, "Y: 150 Hz drops out => the 310 Hz slot stays on 310 Hz");
+  check(noBlend, "Y: no peak blended between 150 Hz and 310 Hz");
+
+  float meanOn = 0.0f;
+  float worst2 = toggleDeviation(&meanOn);
+  printf("notch toggle / retune at %.0f deg/s: max deviation %.2f deg/s (tone %.0f), mean when on %.2f deg/s\n", kRate,
+         worst2, kToggleTone, meanOn);
+  check(worst2 <= kToggleTone + kToggleMargin, "notch toggle / retune: deviation stays within the tone amplitude");
+  check(meanOn < 0.5f * (2.0f / (float)M_PI) * kToggleTone, "notch toggle / retune: notch still attenuates when on");
+
+  return s_failed ? 1 : 0;
+}
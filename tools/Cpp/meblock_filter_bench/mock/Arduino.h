@@ -0,0 +1,23 @@
+// Arduino.h (host mock) – chỉ đủ để MeblockDynNotch.cpp build trên máy tính với core < 0 (không tạo task)
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <math.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void (*TaskFunction_t)(void *);
+typedef void *TaskHandle_t;
+
+#define pdPASS 1
+#define pdFAIL 0
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+static inline TickType_t xTaskGetTickCount() { return 0; }
+static inline void vTaskDelayUntil(TickType_t *, TickType_t) {}
+static inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t, const char *, uint32_t, void *, UBaseType_t,
+                                                 TaskHandle_t *, BaseType_t) {
+  return pdFAIL;
+}
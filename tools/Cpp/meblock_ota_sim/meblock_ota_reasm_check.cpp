@@ -0,0 +1,235 @@
+// meblock_ota_reasm_check.cpp
+// Kiểm tra trên máy tính bộ ghép frame OTA của core factory (ota_stream_feed trong core_v1.ino) với frame V=2
+// 512 byte, gọi thẳng ota_stream_feed (không qua BLE / ring RX) để biết chính xác từng write chứa byte nào:
+//   - cắt frame qua nhiều write: 1 byte / write, cắt trong header (sau byte 1 và 3), cắt giữa payload, byte cuối riêng
+//   - ghép nhiều frame vào 1 write, write dài cố định / ngẫu nhiên vắt qua ranh giới frame
+//   - sau mỗi write: số gói đã nhận, số byte header đã có và số byte payload còn chờ đúng với vị trí trong luồng
+//   - header có len quá lớn (gửi cụt làm 2 write) => "Bad payload len", streamResets + 1, không ghi gì
+//   - iot47_ota_task() với frame ngắn hơn header / ngắn hơn len => bị từ chối, không ghi gì
+//   - cuối phiên: "OTA DONE" + restart, app1 đúng ảnh, không có "Fail" / "FAIL"
+// Chạy 2 lần: không CRC và C=1 (trailer CRC16 cũng bị cắt qua write).
+//
+//   meblock_ota_reasm_check [-s <seed>] [-V]
+//
+// Exit code 0 khi mọi kiểm tra đạt => dùng được trong CI.
+
+#include "core_v1.ino"
+#include "mock_host.h"
+
+#include <algorithm>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const uint32_t kFrames = 70;          // 70 frame: mỗi kiểu cắt được dùng ít nhất 2 lần
+static const uint32_t kSegFrames = 4;        // số frame liên tiếp dùng chung 1 kiểu cắt
+static const uint32_t kBadAfter = 6;         // chèn header sai sau frame này
+
+enum CutKind { CUT_FRAME, CUT_BYTE, CUT_HEADER, CUT_PAYLOAD, CUT_COALESCE, CUT_FIXED, CUT_RANDOM, CUT_KINDS };
+static const char *const kCutNames[CUT_KINDS] = { "frame", "byte", "header", "payload", "coalesce", "fixed", "random" };
+
+static int s_failed = 0;
+static std::mutex s_ntfMu;
+static std::vector<std::string> s_ntf;
+
+static void check(bool ok, const char *what) {
+  printf("%-4s %s\n", ok ? "OK" : "FAIL", what);
+  if (!ok) s_failed++;
+}
+
+static uint16_t crc16(uint16_t crc, const uint8_t *d, size_t n) {
+  while (n--) {
+    crc ^= (uint16_t)(*d++) << 8;
+    for (int k = 0; k < 8; k++) crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+  }
+  return crc;
+}
+
+static bool hasNotify(const char *prefix) {
+  std::lock_guard<std::mutex> lk(s_ntfMu);
+  for (const std::string &m : s_ntf)
+    if (m.compare(0, strlen(prefix), prefix) == 0) return true;
+  return false;
+}
+
+// Luồng byte của cả phiên + vị trí đầu mỗi frame (start[kFrames] = cuối luồng)
+struct Stream {
+  std::vector<uint8_t> bytes;
+  std::vector<size_t> start;
+};
+
+static Stream buildStream(const std::vector<uint8_t> &img, uint16_t payload, bool crc) {
+  Stream s;
+  for (uint32_t k = 0, off = 0; off < img.size(); k++, off += payload) {
+    uint32_t pl = std::min<uint32_t>(payload, (uint32_t)img.size() - off);
+    s.start.push_back(s.bytes.size());
+    uint8_t hdr[4] = { (uint8_t)(k >> 8), (uint8_t)k, (uint8_t)(pl >> 8), (uint8_t)pl };
+    s.bytes.insert(s.bytes.end(), hdr, hdr + 4);
+    s.bytes.insert(s.bytes.end(), img.begin() + off, img.begin() + off + pl);
+    if (crc) {
+      uint16_t c = crc16(0xFFFF, &s.bytes[s.start.back()], 4 + pl);
+      s.bytes.push_back((uint8_t)(c >> 8));
+      s.bytes.push_back((uint8_t)c);
+    }
+  }
+  s.start.push_back(s.bytes.size());
+  return s;
+}
+
+// Các điểm cắt write: mỗi nhóm kSegFrames frame dùng 1 kiểu, nhóm luôn kết thúc đúng ranh giới frame
+static std::vector<size_t> buildCuts(const Stream &s, std::mt19937 &rng) {
+  std::vector<size_t> cuts;
+  uint32_t n = (uint32_t)s.start.size() - 1;
+  for (uint32_t seg = 0; seg * kSegFrames < n; seg++) {
+    uint32_t f0 = seg * kSegFrames, f1 = std::min(n, f0 + kSegFrames);
+    CutKind kind = (CutKind)(seg % CUT_KINDS);
+    size_t a = s.start[f0], b = s.start[f1];
+    if (kind == CUT_FIXED || kind == CUT_RANDOM) {
+      for (size_t p = a;;) {
+        p += (kind == CUT_FIXED) ? 700 : 1 + rng() % 1200;
+        if (p >= b) break;
+        cuts.push_back(p);
+      }
+    }
+    for (uint32_t k = f0; k < f1; k++) {
+      size_t st = s.start[k], en = s.start[k + 1];
+      if (kind == CUT_BYTE) {
+        for (size_t p = st + 1; p < en; p++) cuts.push_back(p);
+      } else if (kind == CUT_HEADER) {
+        cuts.push_back(st + 1);
+        cuts.push_back(st + 3);
+      } else if (kind == CUT_PAYLOAD) {
+        cuts.push_back(st + 4 + (en - st - 4) / 2);
+        cuts.push_back(en - 1);
+      }
+      if (kind == CUT_COALESCE ? (k - f0) % 3 == 2 : kind != CUT_FIXED && kind != CUT_RANDOM) cuts.push_back(en);
+    }
+    cuts.push_back(b);
+  }
+  std::sort(cuts.begin(), cuts.end());
+  cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
+  return cuts;
+}
+
+static void feed(const uint8_t *d, size_t n) {
+  ota_stream_feed(d, (uint16_t)n);
+}
+
+// Trạng thái bộ ghép phải khớp vị trí pos trong luồng (pos chưa hết phiên)
+static bool stateMatches(const Stream &s, size_t pos, std::string &why) {
+  uint32_t done = (uint32_t)(std::upper_bound(s.start.begin(), s.start.end(), pos) - s.start.begin()) - 1;
+  size_t off = pos - s.start[done];
+  size_t len = s.start[done + 1] - s.start[done];
+  uint16_t wantHave = (uint16_t)std::min<size_t>(off, 4);
+  uint16_t wantNeed = (off >= 4) ? (uint16_t)(len - off) : 0;
+  if (ota_download_paket == done && s_rxHave == wantHave && s_rxNeed == wantNeed) return true;
+  char buf[160];
+  snprintf(buf, sizeof(buf), "pos %zu: frame %lu/%lu, have %u/%u, need %u/%u", pos, (unsigned long)ota_download_paket,
+           (unsigned long)done, (unsigned)s_rxHave, (unsigned)wantHave, (unsigned)s_rxNeed, (unsigned)wantNeed);
+  why = buf;
+  return false;
+}
+
+static void runSession(bool crc, uint32_t seed) {
+  printf("--- V=2%s ---\n", crc ? ";C=1" : "");
+  const uint16_t payload = (uint16_t)(IOT47_OTA_FRAME_MAX - IOT47_OTA_HDR_SIZE - (crc ? IOT47_OTA_CRC_SIZE : 0));
+  std::mt19937 rng(seed);
+  std::vector<uint8_t> img(kFrames * payload - 200);   // frame cuối ngắn hơn
+  for (auto &b : img) b = (uint8_t)rng();
+  img[0] = 0xE9;                                        // magic ảnh app ESP32
+  Stream s = buildStream(img, payload, crc);
+  std::vector<size_t> cuts = buildCuts(s, rng);
+  uint32_t n = (uint32_t)s.start.size() - 1;
+
+  {
+    std::lock_guard<std::mutex> lk(s_ntfMu);
+    s_ntf.clear();
+  }
+  std::string hdr = "IOT47_BLE_OTA_BEGIN:" + std::to_string(img.size()) + ";V=2" + (crc ? ";C=1" : "") + "\r\n";
+  feed((const uint8_t *)hdr.data(), hdr.size());
+  check(ota_state == OTA_DOWNLOADDING && hasNotify("OK") && iot47_ota_max_frame() == IOT47_OTA_FRAME_MAX,
+        "BEGIN V=2 accepted with 512-byte frames");
+
+  uint32_t resets0 = s_otaStats.streamResets;
+  std::string why;
+  bool boundaries = true, badLen = false, shortTask = false;
+  uint32_t writes = 0;
+  size_t pos = 0;
+  for (size_t cut : cuts) {
+    if (pos == s.start[kBadAfter]) {
+      // Header len 512 (+ trailer) > frame tối đa - 4, đến cụt làm 2 write: chờ đủ 4 byte rồi mới loại
+      uint8_t bad[4] = { (uint8_t)(kBadAfter >> 8), (uint8_t)kBadAfter, 0x02, 0x00 };
+      feed(bad, 2);
+      badLen = s_rxHave == 2 && s_otaStats.streamResets == resets0;
+      feed(bad + 2, 2);
+      badLen = badLen && s_rxHave == 0 && s_rxNeed == 0 && s_otaStats.streamResets == resets0 + 1 &&
+               ota_download_paket == kBadAfter;
+
+      // Đường 1 frame / 1 write: frame cụt bị từ chối trước khi đọc header / payload
+      uint32_t written = iot47_image_written();
+      uint8_t part[8];
+      memcpy(part, &s.bytes[pos], sizeof(part));
+      shortTask = iot47_ota_task(part, 3) == 2 && iot47_ota_task(part, sizeof(part)) == 2 &&
+                  ota_download_paket == kBadAfter && iot47_image_written() == written;
+    }
+    writes++;
+    if (cut == s.bytes.size()) {
+      // Write cuối: frame cuối => OTA DONE => UpdateRun() => ESP.restart() treo luồng gọi (như worker trên board)
+      const uint8_t *d = &s.bytes[pos];
+      size_t len = cut - pos;
+      std::thread([d, len] { feed(d, len); }).detach();
+      break;
+    }
+    feed(&s.bytes[pos], cut - pos);
+    pos = cut;
+    if (pos < s.bytes.size() && boundaries && !stateMatches(s, pos, why)) {
+      printf("     %s (cut kind %s)\n", why.c_str(), kCutNames[(std::upper_bound(s.start.begin(), s.start.end(), pos) -
+                                                                s.start.begin() - 1) / kSegFrames % CUT_KINDS]);
+      boundaries = false;
+    }
+  }
+  printf("     %lu frames, %lu B in %lu writes\n", (unsigned long)n, (unsigned long)s.bytes.size(), (unsigned long)writes);
+
+  check(boundaries, "frame boundaries: packet / header / payload state right after every write");
+  check(badLen, "truncated bad-len header: waits for 4 bytes, then drop/reset (streamResets + 1)");
+  check(shortTask, "iot47_ota_task: frame shorter than header / than its len is rejected, nothing written");
+  check(s_otaStats.streamResets == resets0 + 1, "no other stream reset");
+
+  uint32_t t0 = millis();
+  while (!mock_restarted() && millis() - t0 < 5000) delay(1);
+  check(hasNotify("OTA DONE") && !hasNotify("Fail") && !hasNotify("FAIL") && mock_restarted(),
+        "OTA DONE and restart, no Fail / FAIL reply");
+  check(mock_flash_dump("app1", img.size()) == img, "app1 matches the image");
+
+  // Như sau khi khởi động lại: bộ ghép và OTA về trạng thái đầu cho phiên sau
+  ota_stream_reset();
+  iot47_stop_ota();
+  mock_clear_restart();
+}
+
+int main(int argc, char **argv) {
+  uint32_t seed = 1;
+  bool verbose = false;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-s") && i + 1 < argc) seed = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    else if (!strcmp(argv[i], "-V")) verbose = true;
+    else {
+      fprintf(stderr, "usage: %s [-s seed] [-V]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (!verbose) Serial.setOutput(fopen("/dev/null", "w"));
+
+  setup();
+  pOtaCharacteristic->hostOnNotify = [](const uint8_t *d, size_t l) {
+    std::lock_guard<std::mutex> lk(s_ntfMu);
+    s_ntf.emplace_back((const char *)d, l);
+  };
+  iot47_ble_ota_set_mtu(517);
+
+  runSession(false, seed);
+  runSession(true, seed + 1);
+  return s_failed ? 1 : 0;
+}
@@ -0,0 +1,785 @@
+// meblock_ota_sim.cpp
+// Giả lập đường OTA BLE của core factory trên Linux (không cần board):
+//   host (central) -> BLECharacteristic::onWrite -> ring RX + notify -> ota_worker_task -> ota_stream_feed
+//   -> iot47_ota_task / frame API -> writer -> flash giả lập (mock_flash.cpp)
+// core_v1.ino và IOT47_*.h được biên dịch nguyên văn; chỉ BLE / FreeRTOS / flash / NVS là mock.
+// Dùng để benchmark và kiểm tra hồi quy khi đổi protocol hoặc buffering.
+//
+//   meblock_ota_sim [tuỳ chọn] <image.bin | @size>
+// Xem usage() / README.md.
+
+#include "core_v1.ino"
+#include "mock_host.h"
+#include "IOT47_OTA_Sha256.h"
+#include <LittleFS.h>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+static void usage() {
+  fprintf(stderr,
+          "Usage: meblock_ota_sim [options] <image.bin | @size>\n"
+          "  link\n"
+          "    -m <mtu>        ATT MTU (default 247), GATT write <= mtu-3\n"
+          "    -g <us>         gap after each write (default 1500)\n"
+          "    -t <trace>      replay write sizes / gaps from file: lines \"<gap_us> <len>\" (cyclic)\n"
+          "    -P              pack frames back to back (writes cut across frame boundaries)\n"
+#if MEBLOCK_OTA_L2CAP
+          "    -L              send over the L2CAP CoC channel instead of GATT writes\n"
+#endif
+          "    -U <baud>       send over UART (OTA_UART=<baud>, wire time = 10 bits/byte) instead of BLE\n"
+          "  protocol\n"
+          "    -v <1|2>        frame version (default 2)\n"
+          "    -w <n>          window W= (default 16, 0 = legacy stop-and-go)\n"
+          "    -C              per-frame CRC16 (C=1)\n"
+          "    -H              whole-image SHA-256 (H=)\n"
+          "    -F              credit flow control (FC=1): send only while holding credits\n"
+          "    -x <opts>       extra BEGIN options, e.g. \";Z=1;U=962464\"\n"
+          "  faults (per frame, in permille)\n"
+          "    -d <pm>         drop   -r <pm> reorder (swap with next)   -e <pm> flip one payload bit\n"
+          "    -R <pct>        disconnect at pct%% and resume with I= (new BEGIN)\n"
+          "  device\n"
+          "    -f <erase_us>,<write_us_per_kb>[,<block_erase_us>]  flash timing (default 0,0;\n"
+          "                    ESP32 ~ 30000,2500,150000; block = 64KB erase)\n"
+          "    -S <n>          16MB slot layout (app1..app3), upload into slot n (SLOT=<n>)\n"
+          "    -K              slot already holds the image (needs -H): expect \"OK SKIP\" and no frames\n"
+          "    -k <n>          another slot n already holds the image (needs -H, 16MB layout): the upload must\n"
+          "                    still go to the target slot, no \"OK SKIP\"\n"
+          "    -A <name>       upload the image as file asset <name> (N=) into LittleFS instead of an app;\n"
+          "                    with -K the file is already there\n"
+          "    -b <base.bin>   preload the target app (delta OTA base image)\n"
+          "    -E <expect.bin> expected target app contents (default = image)\n"
+          "    -o <out.bin>    save the target app after the run\n"
+          "    -s <seed>  -T <timeout_ms>  -V (device log on stdout)\n"
+          "Exit code 0 when the target app (app1, or slot n) matches the expected image and was selected for boot\n"
+          "(-A: the file matches and the boot partition is unchanged).\n");
+}
+
+// ===== Tuỳ chọn =====
+struct SimOptions {
+  uint16_t mtu = 247;
+  uint32_t gapUs = 1500;
+  const char *trace = nullptr;
+  bool pack = false;
+  bool l2cap = false;
+  uint32_t uartBaud = 0;     // > 0 => UART OTA
+  int ver = 2;
+  int window = 16;
+  bool crc = false;
+  bool hash = false;
+  bool credit = false;
+  std::string extra;
+  int dropPm = 0;
+  int reorderPm = 0;
+  int corruptPm = 0;
+  int resumePct = 0;
+  uint32_t eraseUs = 0;
+  uint32_t writeUsPerKB = 0;
+  uint32_t blockEraseUs = 0;
+  int slot = 0;              // > 0 => bảng 16MB, SLOT=<n>
+  bool slotHolds = false;
+  int otherSlot = 0;         // -k: slot khác đã có ảnh này (tải thường vẫn phải tải vào slot đích)
+  const char *asset = nullptr; // -A: tên file asset
+  const char *base = nullptr;
+  const char *expect = nullptr;
+  const char *out = nullptr;
+  uint32_t seed = 1;
+  uint32_t timeoutMs = 120000;
+  bool verbose = false;
+};
+
+// ===== Thống kê phía host =====
+struct SimStats {
+  uint32_t writes = 0;
+  uint64_t linkBytes = 0;
+  uint32_t frames = 0;
+  uint32_t resent = 0;
+  uint32_t drops = 0;
+  uint32_t reorders = 0;
+  uint32_t corrupted = 0;
+  uint32_t acks = 0;
+  uint32_t nacks = 0;
+  uint32_t fails = 0;        // "Fail" (sai thứ tự, chế độ cũ)
+  uint32_t busy = 0;         // "FAIL:BUSY" (ring RX đầy)
+  uint32_t credits = 0;      // notify credit (FC=1)
+  uint32_t stalls = 0;       // số lần host phải chờ (hết window / hết credit)
+  uint32_t stallMs = 0;
+  uint32_t sessions = 0;
+};
+
+static SimOptions g_opt;
+static SimStats g_st;
+static std::mt19937 g_rng;
+
+static bool readFile(const char *path, std::vector<uint8_t> &out) {
+  FILE *f = fopen(path, "rb");
+  if (!f) return false;
+  uint8_t buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out.insert(out.end(), buf, buf + n);
+  fclose(f);
+  return true;
+}
+
+static bool chance(int permille) {
+  return permille > 0 && (int)(g_rng() % 1000) < permille;
+}
+
+// ===== Notify từ thiết bị (chạy trên luồng worker) =====
+static std::mutex g_ntfMu;
+static std::deque<std::vector<uint8_t>> g_ntf;
+
+static bool popNotify(std::vector<uint8_t> &m) {
+  std::lock_guard<std::mutex> lk(g_ntfMu);
+  if (g_ntf.empty()) return false;
+  m = std::move(g_ntf.front());
+  g_ntf.pop_front();
+  return true;
+}
+
+static bool isText(const std::vector<uint8_t> &m, const char *prefix) {
+  size_t n = strlen(prefix);
+  return m.size() >= n && memcmp(m.data(), prefix, n) == 0;
+}
+
+// ===== Link: cắt stream thành write GATT / SDU L2CAP =====
+struct TraceStep {
+  uint32_t gapUs;
+  uint16_t len;
+};
+static std::vector<TraceStep> g_trace;
+static size_t g_traceAt = 0;
+static std::vector<uint8_t> g_pending;   // byte chờ gửi (chế độ -P)
+
+static bool loadTrace(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (!f) return false;
+  char line[128];
+  while (fgets(line, sizeof(line), f)) {
+    if (line[0] == '#') continue;
+    unsigned long gap = 0, len = 0;
+    if (sscanf(line, "%lu %lu", &gap, &len) == 2 && len > 0) g_trace.push_back({ (uint32_t)gap, (uint16_t)len });
+  }
+  fclose(f);
+  return !g_trace.empty();
+}
+
+// ===== UART: trả lời từ thiết bị là frame [0x00][len_hi][len_lo][payload] (len 16-bit big-endian) lẫn trong log =====
+static void uartTxHook(const uint8_t *d, size_t n) {
+  static int state = 0;      // 0 = chờ 0x00, 1 = chờ len_hi, 2 = chờ len_lo, 3 = payload
+  static std::vector<uint8_t> msg;
+  static size_t need = 0;
+  for (size_t i = 0; i < n; i++) {
+    uint8_t c = d[i];
+    if (state == 0) {
+      if (c == 0x00) state = 1;
+    } else if (state == 1) {
+      need = (size_t)c << 8;
+      state = 2;
+    } else if (state == 2) {
+      need |= c;
+      msg.clear();
+      state = need ? 3 : 0;
+    } else {
+      msg.push_back(c);
+      if (msg.size() == need) {
+        std::lock_guard<std::mutex> lk(g_ntfMu);
+        g_ntf.push_back(msg);
+        state = 0;
+      }
+    }
+  }
+}
+
+static uint16_t linkMaxWrite() {
+  if (g_opt.uartBaud) return OTA_RX_MAX_WRITE;
+#if MEBLOCK_OTA_L2CAP
+  if (g_opt.l2cap) return OTA_RX_MAX_WRITE;
+#endif
+  // ATT: giá trị 1 attribute tối đa 512 byte, kể cả khi MTU 517 cho phép 514
+  return (uint16_t)((g_opt.mtu - 3 > IOT47_OTA_FRAME_MAX) ? IOT47_OTA_FRAME_MAX : g_opt.mtu - 3);
+}
+
+static void linkWrite(const uint8_t *data, size_t len) {
+  if (g_opt.uartBaud) {
+    Serial.injectRx(data, len);
+    delayMicroseconds((uint32_t)((uint64_t)len * 10 * 1000000 / g_opt.uartBaud));   // thời gian trên dây
+  } else
+#if MEBLOCK_OTA_L2CAP
+  if (g_opt.l2cap) {
+    NimBLEDevice::getL2CAPServer()->services.at(0)->hostSend(data, len);
+  } else
+#endif
+  {
+    pOtaCharacteristic->hostWrite(data, len);
+  }
+  g_st.writes++;
+  g_st.linkBytes += len;
+}
+
+// Gửi data thành các write kích thước theo trace (hoặc MTU), mỗi write cách nhau gap
+static void linkSend(const uint8_t *data, size_t len) {
+  while (len > 0) {
+    size_t cut = linkMaxWrite();
+    uint32_t gap = g_opt.uartBaud ? 0 : g_opt.gapUs;
+    if (!g_trace.empty()) {
+      const TraceStep &s = g_trace[g_traceAt++ % g_trace.size()];
+      if (s.len < cut) cut = s.len;
+      gap = s.gapUs;
+    }
+    if (cut > len) cut = len;
+    linkWrite(data, cut);
+    data += cut;
+    len -= cut;
+    if (gap) delayMicroseconds(gap);
+  }
+}
+
+// -P: chỉ gửi các write đầy; phần dư gửi khi host rảnh (linkFlush)
+static void linkQueue(const std::vector<uint8_t> &frame) {
+  if (!g_opt.pack) {
+    linkSend(frame.data(), frame.size());
+    return;
+  }
+  g_pending.insert(g_pending.end(), frame.begin(), frame.end());
+  size_t full = g_pending.size() - g_pending.size() % linkMaxWrite();
+  if (!g_trace.empty()) full = g_pending.size() > 2 * linkMaxWrite() ? g_pending.size() - linkMaxWrite() : 0;
+  if (full == 0) return;
+  linkSend(g_pending.data(), full);
+  g_pending.erase(g_pending.begin(), g_pending.begin() + full);
+}
+
+static void linkFlush() {
+  if (g_pending.empty()) return;
+  linkSend(g_pending.data(), g_pending.size());
+  g_pending.clear();
+}
+
+static void linkText(const char *s) {
+  linkFlush();
+  linkWrite((const uint8_t *)s, strlen(s));
+  delay(5);
+}
+
+// ===== Phiên OTA phía host =====
+static uint16_t crc16(uint16_t crc, const uint8_t *d, size_t n) {
+  while (n--) {
+    crc ^= (uint16_t)(*d++) << 8;
+    for (int k = 0; k < 8; k++) crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+  }
+  return crc;
+}
+
+struct Session {
+  const std::vector<uint8_t> *img;
+  uint32_t start = 0;        // R= (resume)
+  uint16_t payload = 251;    // byte payload / frame
+  uint32_t frames = 0;
+  std::vector<uint8_t> held; // frame giữ lại để đảo thứ tự
+  bool haveHeld = false;
+  bool fc = false;           // FC=1 đã được chấp nhận
+  uint32_t sent = 0;         // frame đã đưa ra link (tính cả gửi lại, không tính frame bị drop)
+  uint32_t limit = 0;        // hạn mức credit: chỉ gửi khi sent < limit
+};
+
+static bool hasCredit(const Session &s) {
+  return !s.fc || s.sent < s.limit;
+}
+
+static std::vector<uint8_t> buildFrame(const Session &s, uint32_t k) {
+  uint32_t off = s.start + k * s.payload;
+  uint32_t pl = (uint32_t)s.img->size() - off;
+  if (pl > s.payload) pl = s.payload;
+  std::vector<uint8_t> f = { (uint8_t)(k >> 8), (uint8_t)k, (uint8_t)(pl >> 8), (uint8_t)pl };
+  f.insert(f.end(), s.img->begin() + off, s.img->begin() + off + pl);
+  if (g_opt.crc) {
+    uint16_t c = crc16(0xFFFF, f.data(), f.size());
+    f.push_back((uint8_t)(c >> 8));
+    f.push_back((uint8_t)c);
+  }
+  return f;
+}
+
+// Gửi frame k (fresh = lần đầu, chỉ lần đầu mới bị chèn lỗi)
+static void sendFrame(Session &s, uint32_t k, bool fresh) {
+  std::vector<uint8_t> f = buildFrame(s, k);
+  if (fresh) g_st.frames++;
+  else g_st.resent++;
+  if (fresh && chance(g_opt.dropPm)) {
+    g_st.drops++;                // mất trước khi tới link (host biết) => không tốn credit
+    return;
+  }
+  s.sent++;
+  if (fresh && chance(g_opt.corruptPm)) {
+    size_t i = 4 + g_rng() % (f.size() - 4);
+    f[i] ^= (uint8_t)(1 << (g_rng() % 8));
+    g_st.corrupted++;
+  }
+  if (s.haveHeld) {
+    linkQueue(f);
+    linkQueue(s.held);
+    s.haveHeld = false;
+    return;
+  }
+  if (fresh && (k + 1 < s.frames) && chance(g_opt.reorderPm)) {
+    s.held = f;
+    s.haveHeld = true;
+    g_st.reorders++;
+    return;
+  }
+  linkQueue(f);
+}
+
+static void flushHeld(Session &s) {
+  if (s.haveHeld) linkQueue(s.held);
+  s.haveHeld = false;
+  linkFlush();
+}
+
+// Số gói 16-bit -> chỉ số đầy đủ gần ref nhất
+static uint32_t unwrap(uint32_t ref, uint16_t pkt) {
+  return ref + (uint32_t)(int16_t)(uint16_t)(pkt - (uint16_t)ref);
+}
+
+static uint32_t replyField(const std::string &r, const char *key, uint32_t def) {
+  size_t p = r.find(key);
+  return p == std::string::npos ? def : (uint32_t)strtoul(r.c_str() + p + strlen(key), nullptr, 10);
+}
+
+// STATS? sau phiên (GATT write, hoặc dòng text khi -U), giải mã bản nhị phân [0x04][ver]...
+static uint32_t get32(const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void queryStats() {
+  static const char cmd[] = "STATS?\n";
+  if (g_opt.uartBaud) Serial.injectRx((const uint8_t *)cmd, strlen(cmd));
+  else pOtaCharacteristic->hostWrite((const uint8_t *)cmd, strlen(cmd));
+  std::vector<uint8_t> m;
+  uint32_t w0 = millis();
+  while (!(popNotify(m) && !m.empty() && m[0] == IOT47_OTA_NTF_STATS) && millis() - w0 < 500) delay(1);
+  if (m.size() != 3 + 15 * 4 + 4 * IOT47_OTA_HIST_BUCKETS || m[0] != IOT47_OTA_NTF_STATS) {
+    printf("[sim] STATS? -> no reply\n");
+    return;
+  }
+  const uint8_t *v = &m[3];
+  printf("[sim] STATS?: %lu B/s | rx %lu writes, %lu fails, max %lu us, %lu resets | flash %lu sectors, avg %lu us, max %lu us\n",
+         (unsigned long)get32(v + 12), (unsigned long)get32(v + 16), (unsigned long)get32(v + 20),
+         (unsigned long)get32(v + 40), (unsigned long)get32(v + 36), (unsigned long)get32(v + 44),
+         (unsigned long)get32(v + 48), (unsigned long)get32(v + 52));
+}
+
+// FILES? + FILE_SHA=<tên> sau phiên asset: in các dòng trả lời, true nếu SHA-256 khớp sha
+static bool queryFiles(const uint8_t sha[32]) {
+  static const char cmd[] = "FILES?\n";
+  if (g_opt.uartBaud) Serial.injectRx((const uint8_t *)cmd, strlen(cmd));
+  else pOtaCharacteristic->hostWrite((const uint8_t *)cmd, strlen(cmd));
+  std::string shaCmd = std::string("FILE_SHA=") + g_opt.asset + "\n";
+  char hx[65];
+  for (int i = 0; i < 32; i++) snprintf(hx + 2 * i, 3, "%02x", sha[i]);
+  std::string want = std::string("FILE_SHA ") + g_opt.asset + " " + hx;
+  bool match = false;
+  bool sent = false;
+  std::vector<uint8_t> m;
+  uint32_t w0 = millis();
+  while (millis() - w0 < 500) {
+    if (!popNotify(m)) {
+      // FILES? xong (không còn dòng mới) => hỏi SHA
+      if (!sent && millis() - w0 > 50) {
+        if (g_opt.uartBaud) Serial.injectRx((const uint8_t *)shaCmd.data(), shaCmd.size());
+        else pOtaCharacteristic->hostWrite((const uint8_t *)shaCmd.data(), shaCmd.size());
+        sent = true;
+      }
+      delay(1);
+      continue;
+    }
+    if (!isText(m, "FILE")) continue;
+    std::string line(m.begin(), m.end());
+    while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) line.pop_back();
+    printf("[sim] %s: %s\n", isText(m, "FILE_SHA") ? "FILE_SHA=" : "FILES?", line.c_str());
+    if (isText(m, "FILE_SHA")) {
+      match = line.compare(0, want.size(), want) == 0;
+      break;
+    }
+  }
+  return match;
+}
+
+// SLOTS? sau phiên: in dòng của slot đích (metadata ghi khi tải xong)
+static void querySlots() {
+  static const char cmd[] = "SLOTS?\n";
+  if (g_opt.uartBaud) Serial.injectRx((const uint8_t *)cmd, strlen(cmd));
+  else pOtaCharacteristic->hostWrite((const uint8_t *)cmd, strlen(cmd));
+  std::string prefix = "SLOT " + std::to_string(g_opt.slot) + " ";
+  std::vector<uint8_t> m;
+  uint32_t w0 = millis();
+  while (millis() - w0 < 300) {
+    if (!popNotify(m)) { delay(1); continue; }
+    if (!isText(m, prefix.c_str())) continue;
+    std::string line(m.begin(), m.end());
+    while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) line.pop_back();
+    printf("[sim] SLOTS?: %s\n", line.c_str());
+    return;
+  }
+  printf("[sim] SLOTS? -> no reply\n");
+}
+
+enum SessionResult { SESSION_DONE, SESSION_FAIL, SESSION_TIMEOUT, SESSION_CUT };
+
+// 1 phiên: BEGIN -> frame -> "OTA DONE". cutAt > 0: dừng (mất kết nối) khi đã gửi tới byte cutAt.
+// H= là SHA-256 của ảnh cuối cùng trên board (finalImg = ảnh -E), không phải luồng gửi đi (khác khi Z=1 / D=)
+static SessionResult runSession(const std::vector<uint8_t> &img, const std::vector<uint8_t> &finalImg, uint32_t resumeId,
+                                uint32_t cutAt, uint32_t deadline) {
+  g_st.sessions++;
+  std::string hdr = "IOT47_BLE_OTA_BEGIN:" + std::to_string(img.size());
+  if (g_opt.ver >= 2) hdr += ";V=2";
+  if (g_opt.window > 0) hdr += ";W=" + std::to_string(g_opt.window);
+  if (resumeId) hdr += ";I=" + std::to_string(resumeId);
+  if (g_opt.crc) hdr += ";C=1";
+  if (g_opt.credit) hdr += ";FC=1";
+  if (g_opt.asset) hdr += std::string(";N=") + g_opt.asset;
+  if (g_opt.hash) {
+    uint8_t dg[32];
+    iot47_sha256_t sh;
+    iot47_sha256_init(&sh);
+    iot47_sha256_update(&sh, finalImg.data(), finalImg.size());
+    iot47_sha256_final(&sh, dg);
+    char hx[65];
+    for (int i = 0; i < 32; i++) snprintf(hx + 2 * i, 3, "%02x", dg[i]);
+    hdr += ";H=";
+    hdr += hx;
+  }
+  hdr += g_opt.extra;
+  hdr += "\r\n";
+  linkText(hdr.c_str());
+
+  // Chờ OK
+  std::string reply;
+  uint32_t t0 = millis();
+  while (reply.empty() && millis() - t0 < 3000) {
+    std::vector<uint8_t> m;
+    if (!popNotify(m)) { delay(1); continue; }
+    if (isText(m, "OK") || isText(m, "Fail") || isText(m, "FAIL")) reply.assign(m.begin(), m.end());
+  }
+  while (!reply.empty() && (reply.back() == '\n' || reply.back() == '\r')) reply.pop_back();
+  printf("[sim] BEGIN -> %s\n", reply.empty() ? "(no reply)" : reply.c_str());
+  if (!isText(std::vector<uint8_t>(reply.begin(), reply.end()), "OK")) return SESSION_FAIL;
+  if (reply == "OK SKIP") return SESSION_DONE;   // ảnh đã có trong slot (thiết bị boot luôn) / file đã có
+  if (g_opt.asset && reply.find(" N=1") == std::string::npos) return SESSION_FAIL;   // thiết bị cũ: coi là firmware
+
+  Session s;
+  s.img = &img;
+  s.start = replyField(reply, "R=", 0);
+  uint16_t frameMax = (uint16_t)replyField(reply, "F=", IOT47_OTA_FRAME_LEGACY);
+  uint32_t window = replyField(reply, "W=", 0);
+  s.payload = (uint16_t)(frameMax - IOT47_OTA_HDR_SIZE - (g_opt.crc ? IOT47_OTA_CRC_SIZE : 0));
+  s.frames = (uint32_t)((img.size() - s.start + s.payload - 1) / s.payload);
+  s.limit = replyField(reply, "FC=", 0);
+  s.fc = s.limit > 0;
+
+  uint32_t base = 0;         // gói đầu tiên thiết bị chưa nhận (theo ACK)
+  uint32_t next = 0;         // gói kế tiếp theo thứ tự
+  uint32_t high = 0;         // số gói đã từng gửi (next < high => gửi lại sau NACK)
+  uint32_t lastProgress = millis();
+  uint32_t stallStart = 0;
+  for (;;) {
+    if ((int32_t)(millis() - deadline) > 0) return SESSION_TIMEOUT;
+
+    std::vector<uint8_t> m;
+    while (popNotify(m)) {
+      if (m.size() >= 3 && m[0] == IOT47_OTA_NTF_ACK) {
+        g_st.acks++;
+        uint32_t b = unwrap(base, (uint16_t)((m[1] << 8) | m[2]));
+        if (b > base) { base = b; lastProgress = millis(); }
+        int hi = -1;
+        for (int i = 0; i < (int)(m.size() - 3) * 8; i++)
+          if ((m[3 + i / 8] >> (i % 8)) & 1) hi = i;
+        for (int i = 0; i < hi && hasCredit(s); i++)
+          if (!((m[3 + i / 8] >> (i % 8)) & 1) && base + i < next) sendFrame(s, base + i, false);
+      } else if (m.size() == 3 && m[0] == IOT47_OTA_NTF_NACK) {
+        g_st.nacks++;
+        uint32_t k = unwrap(next, (uint16_t)((m[1] << 8) | m[2]));
+        if (window > 0) {
+          if (k >= base && k < next && hasCredit(s)) sendFrame(s, k, false);
+        } else if (k < next) {
+          next = k;          // chế độ cũ: go-back-N từ gói hỏng
+        }
+      } else if (m.size() == 3 && m[0] == IOT47_OTA_NTF_CREDIT) {
+        g_st.credits++;
+        uint32_t lim = unwrap(s.limit, (uint16_t)((m[1] << 8) | m[2]));
+        if (lim > s.limit) s.limit = lim;
+      } else if (isText(m, "OTA DONE") || isText(m, "FILE DONE")) {
+        return SESSION_DONE;
+      } else if (isText(m, "FAIL:BUSY")) {
+        g_st.busy++;
+      } else if (isText(m, "FAIL")) {
+        printf("[sim] device: %.*s", (int)m.size(), (const char *)m.data());
+        return SESSION_FAIL;
+      } else if (isText(m, "Fail")) {
+        g_st.fails++;
+      }
+    }
+
+    if (cutAt && s.start + next * s.payload >= cutAt) {
+      flushHeld(s);
+      return SESSION_CUT;
+    }
+    bool canSend = (next < s.frames) && ((window == 0) || (next < base + window)) && hasCredit(s);
+    if (canSend) {
+      if (stallStart) { g_st.stallMs += millis() - stallStart; stallStart = 0; }
+      sendFrame(s, next, next >= high);
+      next++;
+      if (next > high) high = next;
+      if (window == 0) lastProgress = millis();
+      continue;
+    }
+
+    flushHeld(s);
+    if (next < s.frames && !stallStart) {
+      stallStart = millis();
+      g_st.stalls++;
+    }
+    // Không có tiến triển: gửi lại gói base (ACK bị mất / gói cuối bị drop)
+    if ((window > 0) && (base < s.frames) && (millis() - lastProgress > 50) && hasCredit(s)) {
+      sendFrame(s, base, false);
+      lastProgress = millis();
+    }
+    delayMicroseconds(200);
+  }
+}
+
+// Lệnh text ngoài OTA (GATT write, hoặc dòng UART), chờ trả lời bắt đầu bằng expect
+static bool deviceCommand(const char *cmd, const char *expect) {
+  if (g_opt.uartBaud) Serial.injectRx((const uint8_t *)cmd, strlen(cmd));
+  else pOtaCharacteristic->hostWrite((const uint8_t *)cmd, strlen(cmd));
+  std::vector<uint8_t> m;
+  uint32_t w0 = millis();
+  while (millis() - w0 < 500) {
+    if (!popNotify(m)) { delay(1); continue; }
+    if (isText(m, expect)) return true;
+  }
+  return false;
+}
+
+static void linkDisconnect() {
+#if MEBLOCK_OTA_L2CAP
+  if (g_opt.l2cap) NimBLEDevice::getL2CAPServer()->services.at(0)->hostClose();
+#endif
+  BLEDevice::getServer()->hostDisconnect();
+}
+
+static void linkConnect() {
+  BLEDevice::getServer()->hostPeerMtu = g_opt.mtu;
+  BLEDevice::getServer()->hostConnect();
+#if MEBLOCK_OTA_L2CAP
+  if (g_opt.l2cap) NimBLEDevice::getL2CAPServer()->services.at(0)->hostOpen(OTA_RX_MAX_WRITE);
+#endif
+}
+
+int main(int argc, char **argv) {
+  const char *imgArg = nullptr;
+  for (int i = 1; i < argc; i++) {
+    const char *a = argv[i];
+    bool more = i + 1 < argc;
+    if (!strcmp(a, "-m") && more) g_opt.mtu = (uint16_t)atoi(argv[++i]);
+    else if (!strcmp(a, "-g") && more) g_opt.gapUs = (uint32_t)atol(argv[++i]);
+    else if (!strcmp(a, "-t") && more) g_opt.trace = argv[++i];
+    else if (!strcmp(a, "-P")) g_opt.pack = true;
+#if MEBLOCK_OTA_L2CAP
+    else if (!strcmp(a, "-L")) g_opt.l2cap = true;
+#endif
+    else if (!strcmp(a, "-U") && more) g_opt.uartBaud = (uint32_t)atol(argv[++i]);
+    else if (!strcmp(a, "-v") && more) g_opt.ver = atoi(argv[++i]);
+    else if (!strcmp(a, "-w") && more) g_opt.window = atoi(argv[++i]);
+    else if (!strcmp(a, "-C")) g_opt.crc = true;
+    else if (!strcmp(a, "-H")) g_opt.hash = true;
+    else if (!strcmp(a, "-F")) g_opt.credit = true;
+    else if (!strcmp(a, "-x") && more) g_opt.extra = argv[++i];
+    else if (!strcmp(a, "-d") && more) g_opt.dropPm = atoi(argv[++i]);
+    else if (!strcmp(a, "-r") && more) g_opt.reorderPm = atoi(argv[++i]);
+    else if (!strcmp(a, "-e") && more) g_opt.corruptPm = atoi(argv[++i]);
+    else if (!strcmp(a, "-R") && more) g_opt.resumePct = atoi(argv[++i]);
+    else if (!strcmp(a, "-f") && more) {
+      unsigned long e = 0, w = 0, b = 0;
+      sscanf(argv[++i], "%lu,%lu,%lu", &e, &w, &b);
+      g_opt.eraseUs = (uint32_t)e;
+      g_opt.writeUsPerKB = (uint32_t)w;
+      g_opt.blockEraseUs = (uint32_t)b;
+    }
+    else if (!strcmp(a, "-S") && more) g_opt.slot = atoi(argv[++i]);
+    else if (!strcmp(a, "-K")) g_opt.slotHolds = true;
+    else if (!strcmp(a, "-k") && more) g_opt.otherSlot = atoi(argv[++i]);
+    else if (!strcmp(a, "-A") && more) g_opt.asset = argv[++i];
+    else if (!strcmp(a, "-b") && more) g_opt.base = argv[++i];
+    else if (!strcmp(a, "-E") && more) g_opt.expect = argv[++i];
+    else if (!strcmp(a, "-o") && more) g_opt.out = argv[++i];
+    else if (!strcmp(a, "-s") && more) g_opt.seed = (uint32_t)atol(argv[++i]);
+    else if (!strcmp(a, "-T") && more) g_opt.timeoutMs = (uint32_t)atol(argv[++i]);
+    else if (!strcmp(a, "-V")) g_opt.verbose = true;
+    else if (a[0] != '-' || a[1] == 0) imgArg = a;
+    else { usage(); return 2; }
+  }
+  if (!imgArg || g_opt.mtu < 23 || g_opt.mtu > 517) { usage(); return 2; }
+  if (g_opt.uartBaud && (g_opt.resumePct > 0 || g_opt.l2cap)) { usage(); return 2; }
+  if (g_opt.slot < 0 || g_opt.slot > 3 || (g_opt.slotHolds && (!(g_opt.slot || g_opt.asset) || !g_opt.hash)) ||
+      (g_opt.asset && (g_opt.slot || g_opt.base))) { usage(); return 2; }
+  if (g_opt.otherSlot && (g_opt.otherSlot < 1 || g_opt.otherSlot > 3 || g_opt.otherSlot == (g_opt.slot ? g_opt.slot : 1) ||
+                          g_opt.slotHolds || g_opt.asset || !g_opt.hash)) { usage(); return 2; }
+  if (g_opt.slot || g_opt.otherSlot) mock_flash_use_slots();
+  std::string target = "app" + std::to_string(g_opt.slot ? g_opt.slot : 1);
+  g_rng.seed(g_opt.seed);
+
+  std::vector<uint8_t> img;
+  if (imgArg[0] == '@') {
+    img.resize((size_t)atol(imgArg + 1));
+    for (auto &b : img) b = (uint8_t)g_rng();
+    if (!img.empty()) img[0] = 0xE9;        // magic ảnh app ESP32
+  } else if (!readFile(imgArg, img)) {
+    fprintf(stderr, "Cannot read %s\n", imgArg);
+    return 1;
+  }
+  if (img.empty()) { usage(); return 2; }
+
+  std::vector<uint8_t> expect = img;
+  if (g_opt.expect && !(expect.clear(), readFile(g_opt.expect, expect))) {
+    fprintf(stderr, "Cannot read %s\n", g_opt.expect);
+    return 1;
+  }
+  if (g_opt.base) {
+    std::vector<uint8_t> base;
+    if (!readFile(g_opt.base, base)) { fprintf(stderr, "Cannot read %s\n", g_opt.base); return 1; }
+    mock_flash_load(target.c_str(), base.data(), base.size());
+  }
+  if (g_opt.trace && !loadTrace(g_opt.trace)) {
+    fprintf(stderr, "Cannot read trace %s\n", g_opt.trace);
+    return 1;
+  }
+  g_mockFlashTiming.eraseUsPerSector = g_opt.eraseUs;
+  g_mockFlashTiming.writeUsPerKB = g_opt.writeUsPerKB;
+  g_mockFlashTiming.eraseUsPerBlock = g_opt.blockEraseUs;
+  if (!g_opt.verbose) Serial.setOutput(fopen("/dev/null", "w"));
+  std::string assetPath = g_opt.asset ? std::string("/") + g_opt.asset : std::string();
+  if (g_opt.slotHolds && g_opt.asset) {
+    LittleFS.hostPut(assetPath.c_str(), expect.data(), expect.size());   // lần tải trước đã có file này
+  } else if (g_opt.slotHolds || g_opt.otherSlot) {
+    // Lần tải trước đã ghi đúng ảnh này vào slot (metadata như ota_slot_record)
+    uint8_t held = (uint8_t)(g_opt.slotHolds ? g_opt.slot : g_opt.otherSlot);
+    mock_flash_load(("app" + std::to_string(held)).c_str(), expect.data(), expect.size());
+    MeblockSlotInfo info = {};
+    info.size = (uint32_t)expect.size();
+    iot47_sha256_t sh;
+    iot47_sha256_init(&sh);
+    iot47_sha256_update(&sh, expect.data(), expect.size());
+    iot47_sha256_final(&sh, info.sha);
+    strcpy(info.name, "sim");
+    meblock_slot_set(held, &info);
+  }
+
+  setup();
+  pOtaCharacteristic->hostOnNotify = [](const uint8_t *d, size_t l) {
+    std::lock_guard<std::mutex> lk(g_ntfMu);
+    g_ntf.emplace_back(d, d + l);
+  };
+  linkConnect();
+  if (g_opt.uartBaud) {
+    // loop() đọc UART trên luồng riêng (loopTask); vào chế độ OTA_UART ở 115200
+    Serial.setTxHook(uartTxHook);
+    std::thread([] { for (;;) loop(); }).detach();
+    std::string cmd = "OTA_UART=" + std::to_string(g_opt.uartBaud) + "\n";
+    Serial.injectRx((const uint8_t *)cmd.data(), cmd.size());
+    std::vector<uint8_t> m;
+    uint32_t w0 = millis();
+    while (!(popNotify(m) && isText(m, "UART OK")) && millis() - w0 < 1000) delay(1);
+    printf("[sim] OTA_UART -> %s, baud %lu\n", isText(m, "UART OK") ? "UART OK" : "(no reply)",
+           (unsigned long)Serial.baudRate());
+  }
+  if (g_opt.slot) {
+    std::string cmd = "SLOT=" + std::to_string(g_opt.slot) + ",sim\n";
+    printf("[sim] SLOT=%d -> %s\n", g_opt.slot, deviceCommand(cmd.c_str(), "SLOT OK") ? "SLOT OK" : "(no reply)");
+  }
+  s_otaRingHighWater = 0;
+  s_otaRingWaits = 0;
+
+  uint32_t t0 = millis();
+  uint32_t deadline = t0 + g_opt.timeoutMs;
+  uint32_t resumeId = 0;
+  uint32_t cutAt = 0;
+  if (g_opt.resumePct > 0) {
+    resumeId = iot47_crc32(0, img.data(), (uint32_t)img.size()) | 1;
+    cutAt = (uint32_t)((uint64_t)img.size() * g_opt.resumePct / 100);
+  }
+  SessionResult r = runSession(img, expect, resumeId, cutAt, deadline);
+  if (r == SESSION_CUT) {
+    delay(50);
+    linkDisconnect();
+    printf("[sim] link lost at %lu bytes\n", (unsigned long)cutAt);
+    delay(100);
+    linkConnect();
+    r = runSession(img, expect, resumeId, 0, deadline);
+  }
+  // Thiết bị restart sau khi chọn phân vùng boot (file asset: không restart)
+  for (int i = 0; i < 300 && r == SESSION_DONE && !g_opt.asset && !mock_restarted(); i++) delay(10);
+  uint32_t ms = millis() - t0;
+  queryStats();
+  if (g_opt.slot) querySlots();
+
+  std::vector<uint8_t> app = g_opt.asset ? LittleFS.hostGet(assetPath.c_str()) : mock_flash_dump(target.c_str(), expect.size());
+  bool match = app == expect;
+  const char *boot = mock_flash_boot_label();
+  bool ok = (r == SESSION_DONE) && match && (!g_opt.slotHolds || g_st.frames == 0) && (!g_opt.otherSlot || g_st.frames > 0);
+  if (g_opt.asset) {
+    uint8_t sha[32];
+    iot47_sha256_t sh;
+    iot47_sha256_init(&sh);
+    iot47_sha256_update(&sh, expect.data(), expect.size());
+    iot47_sha256_final(&sh, sha);
+    ok = ok && queryFiles(sha) && !boot && !mock_restarted();
+  } else {
+    ok = ok && boot && target == boot;
+  }
+  if (g_opt.out && !g_opt.asset && !mock_flash_save(target.c_str(), expect.size(), g_opt.out)) fprintf(stderr, "Cannot write %s\n", g_opt.out);
+
+  double secs = ms ? ms / 1000.0 : 1e-3;
+  printf("[sim] image %zu B, %lu frames (+%lu resent), %lu writes, %llu link B, %lu session(s)\n",
+         img.size(), (unsigned long)g_st.frames, (unsigned long)g_st.resent, (unsigned long)g_st.writes,
+         (unsigned long long)g_st.linkBytes, (unsigned long)g_st.sessions);
+  printf("[sim] time %lu ms, %.1f kB/s image, %.1f kB/s link\n",
+         (unsigned long)ms, img.size() / secs / 1000.0, g_st.linkBytes / secs / 1000.0);
+  printf("[sim] faults: drop %lu, reorder %lu, corrupt %lu | device: ACK %lu, NACK %lu, credit %lu, Fail %lu, FAIL:BUSY %lu\n",
+         (unsigned long)g_st.drops, (unsigned long)g_st.reorders, (unsigned long)g_st.corrupted,
+         (unsigned long)g_st.acks, (unsigned long)g_st.nacks, (unsigned long)g_st.credits, (unsigned long)g_st.fails,
+         (unsigned long)g_st.busy);
+  printf("[sim] host stalls %lu (%lu ms) | rx ring: high-water %lu/%lu B, producer waits %lu\n",
+         (unsigned long)g_st.stalls, (unsigned long)g_st.stallMs, (unsigned long)s_otaRingHighWater,
+         (unsigned long)s_otaRingSize, (unsigned long)s_otaRingWaits);
+#if MEBLOCK_USE_NIMBLE
+  const NimBLEServer *srv = BLEDevice::getServer();
+  printf("[sim] nimble: PHY %s, data len %u, interval %.2f-%.2f ms, ring %lu B\n",
+         (srv->hostPhyReq & BLE_GAP_LE_PHY_2M_MASK) ? "2M" : "1M", (unsigned)srv->hostDataLen,
+         srv->hostConnInfo().getConnInterval() * 1.25, srv->hostItvlMax * 1.25, (unsigned long)s_otaRingSize);
+#endif
+  if (g_opt.uartBaud)
+    printf("[sim] uart: %lu baud, driver RX overflow %lu B\n", (unsigned long)Serial.baudRate(),
+           (unsigned long)Serial.rxOverflow());
+  printf("[sim] flash: %lu erases, %lu writes, %lu bad writes\n",
+         (unsigned long)g_mockFlashStats.erases, (unsigned long)g_mockFlashStats.writes,
+         (unsigned long)g_mockFlashStats.badWrites);
+  if (ota_flash_stats.erase_checks > 0)
+    printf("[sim] erase-ahead: avg %lu B, min %lu B | writer waited %lu x (%lu ms)\n",
+           (unsigned long)(ota_flash_stats.erase_ahead_sum / ota_flash_stats.erase_checks),
+           (unsigned long)ota_flash_stats.erase_ahead_min, (unsigned long)ota_flash_stats.erase_waits,
+           (unsigned long)(ota_flash_stats.erase_wait_us / 1000));
+  static const char *names[] = { "done", "fail", "timeout", "cut" };
+  printf("[sim] result: %s, session %s, match=%d, boot=%s\n", ok ? "OK" : "FAILED", names[r], match ? 1 : 0,
+         boot ? boot : "-");
+  fflush(stdout);
+  _exit(ok ? 0 : 1);   // luồng worker / hash còn chạy (hoặc treo trong esp_restart)
+}
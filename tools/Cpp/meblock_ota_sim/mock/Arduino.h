@@ -0,0 +1,139 @@
+// Arduino.h (host mock) – chỉ đủ cho đường OTA của core_v1 chạy trên Linux
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <string>
+#include <algorithm>
+
+#include "freertos/FreeRTOS.h"
+
+// ===== Thời gian =====
+uint32_t millis();
+uint32_t micros();
+void     delay(uint32_t ms);
+void     delayMicroseconds(uint32_t us);
+static inline void yield() {}
+
+// ===== String (tập con API Arduino) =====
+class String {
+public:
+  String() {}
+  String(const char *s) : _s(s ? s : "") {}
+  String(const std::string &s) : _s(s) {}
+  String(char c) : _s(1, c) {}
+  String(int v)           : _s(std::to_string(v)) {}
+  String(unsigned int v)  : _s(std::to_string(v)) {}
+  String(long v)          : _s(std::to_string(v)) {}
+  String(unsigned long v) : _s(std::to_string(v)) {}
+
+  const char *c_str() const { return _s.c_str(); }
+  unsigned int length() const { return (unsigned int)_s.size(); }
+  bool reserve(unsigned int n) { _s.reserve(n); return true; }
+  char operator[](unsigned int i) const { return i < _s.size() ? _s[i] : 0; }
+  char charAt(unsigned int i) const { return (*this)[i]; }
+
+  String &operator+=(const String &o) { _s += o._s; return *this; }
+  String &operator+=(const char *o)   { _s += (o ? o : ""); return *this; }
+  String &operator+=(char c)          { _s += c; return *this; }
+  friend String operator+(const String &a, const String &b) { return String(a._s + b._s); }
+  friend String operator+(const String &a, const char *b)   { return String(a._s + b); }
+  friend String operator+(const char *a, const String &b)   { return String(a + b._s); }
+
+  bool operator==(const String &o) const { return _s == o._s; }
+  bool operator!=(const String &o) const { return _s != o._s; }
+  bool operator==(const char *o) const { return _s == o; }
+
+  bool equalsIgnoreCase(const String &o) const {
+    if (_s.size() != o._s.size()) return false;
+    for (size_t i = 0; i < _s.size(); i++)
+      if (tolower((unsigned char)_s[i]) != tolower((unsigned char)o._s[i])) return false;
+    return true;
+  }
+  bool startsWith(const String &p) const { return _s.compare(0, p._s.size(), p._s) == 0; }
+  bool endsWith(const String &p) const {
+    return _s.size() >= p._s.size() && _s.compare(_s.size() - p._s.size(), p._s.size(), p._s) == 0;
+  }
+  String substring(unsigned int from) const { return from < _s.size() ? String(_s.substr(from)) : String(); }
+  String substring(unsigned int from, unsigned int to) const {
+    if (from >= _s.size() || to <= from) return String();
+    return String(_s.substr(from, to - from));
+  }
+  int indexOf(char c) const { size_t p = _s.find(c); return p == std::string::npos ? -1 : (int)p; }
+  void remove(unsigned int idx) { if (idx < _s.size()) _s.erase(idx); }
+  void trim() {
+    size_t b = 0, e = _s.size();
+    while (b < e && isspace((unsigned char)_s[b])) b++;
+    while (e > b && isspace((unsigned char)_s[e - 1])) e--;
+    _s = _s.substr(b, e - b);
+  }
+  long toInt() const { return strtol(_s.c_str(), nullptr, 10); }
+
+private:
+  std::string _s;
+};
+
+// ===== Serial =====
+class HardwareSerial {
+public:
+  void begin(unsigned long baud) { _baud = baud; }
+  void end() {}
+  void updateBaudRate(unsigned long baud) { _baud = baud; }
+  unsigned long baudRate() const { return _baud; }
+  size_t setRxBufferSize(size_t n) { _rxCap = n; return n; }
+  size_t setTxBufferSize(size_t n) { return n; }
+  void flush() { fflush(_out); }
+
+  int available();
+  int read();
+  size_t readBytes(uint8_t *buf, size_t n);
+  size_t write(uint8_t c) { return write(&c, 1); }
+  size_t write(const uint8_t *buf, size_t n);
+
+  size_t print(const char *s)    { return fputs(s, _out) >= 0 ? strlen(s) : 0; }
+  size_t print(const String &s)  { return print(s.c_str()); }
+  size_t print(char c)           { return fputc(c, _out) != EOF; }
+  size_t print(int v)            { return fprintf(_out, "%d", v); }
+  size_t print(unsigned int v)   { return fprintf(_out, "%u", v); }
+  size_t print(long v)           { return fprintf(_out, "%ld", v); }
+  size_t print(unsigned long v)  { return fprintf(_out, "%lu", v); }
+  size_t println()               { return print("\n"); }
+  template <typename T> size_t println(const T &v) { size_t n = print(v); return n + println(); }
+  size_t printf(const char *fmt, ...) __attribute__((format(printf, 2, 3))) {
+    va_list ap; va_start(ap, fmt);
+    int n = vfprintf(_out, fmt, ap);
+    va_end(ap);
+    return n < 0 ? 0 : (size_t)n;
+  }
+  operator bool() const { return true; }
+
+  // Host: nơi ghi log (mặc định stdout, simulator có thể đổi sang /dev/null)
+  void setOutput(FILE *f) { _out = f; }
+  // Host: đẩy dữ liệu vào RX như thể đến từ UART (byte vượt buffer RX của driver bị mất)
+  void injectRx(const uint8_t *data, size_t n);
+  size_t rxOverflow() const { return _rxLost; }
+  // Host: nhận mọi byte firmware gửi bằng write() (đường trả lời OTA qua UART)
+  void setTxHook(void (*fn)(const uint8_t *data, size_t n)) { _txHook = fn; }
+
+private:
+  unsigned long _baud = 115200;
+  FILE *_out = stdout;
+  size_t _rxCap = 256;          // mặc định của driver UART Arduino-ESP32
+  size_t _rxLost = 0;
+  void (*_txHook)(const uint8_t *data, size_t n) = nullptr;
+};
+extern HardwareSerial Serial;
+
+// ===== ESP =====
+class EspClass {
+public:
+  [[noreturn]] void restart();
+  uint32_t getFreeHeap() { return 256 * 1024; }
+};
+extern EspClass ESP;
+
+static inline bool psramFound() { return false; }
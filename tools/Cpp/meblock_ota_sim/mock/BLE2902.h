@@ -0,0 +1,4 @@
+// BLE2902.h (host mock)
+#pragma once
+#include "BLEDevice.h"
+class BLE2902 {};
@@ -0,0 +1,129 @@
+// BLEDevice.h (host mock) – tập con API Bluedroid dùng trong core_v1
+#pragma once
+#include <Arduino.h>
+#include <functional>
+#include <vector>
+
+class BLECharacteristic;
+class BLEServer;
+
+class BLECharacteristicCallbacks {
+public:
+  virtual ~BLECharacteristicCallbacks() {}
+  virtual void onWrite(BLECharacteristic *c) { (void)c; }
+  virtual void onRead(BLECharacteristic *c) { (void)c; }
+};
+
+class BLECharacteristic {
+public:
+  static const uint32_t PROPERTY_READ     = 1 << 0;
+  static const uint32_t PROPERTY_WRITE    = 1 << 1;
+  static const uint32_t PROPERTY_NOTIFY   = 1 << 2;
+  static const uint32_t PROPERTY_BROADCAST= 1 << 3;
+  static const uint32_t PROPERTY_INDICATE = 1 << 4;
+  static const uint32_t PROPERTY_WRITE_NR = 1 << 5;
+
+  explicit BLECharacteristic(const char *uuid, uint32_t props = 0) : _uuid(uuid), _props(props) {}
+
+  void setCallbacks(BLECharacteristicCallbacks *cb) { _cb = cb; }
+  void setValue(const uint8_t *data, size_t len) { _value.assign(data, data + len); }
+  void setValue(const char *s) { setValue((const uint8_t *)s, strlen(s)); }
+  void setValue(const String &s) { setValue(s.c_str()); }
+  void notify(bool isNotification = true) {
+    (void)isNotification;
+    if (hostOnNotify) hostOnNotify(_value.data(), _value.size());
+  }
+  void indicate() { notify(false); }
+  uint8_t *getData() { return _value.empty() ? nullptr : _value.data(); }
+  size_t getLength() const { return _value.size(); }
+  String getValue() const { return String(std::string(_value.begin(), _value.end())); }
+
+  // Host: central ghi một giá trị (WRITE / WRITE_NR) – gọi onWrite như stack BLE thật
+  void hostWrite(const uint8_t *data, size_t len) {
+    setValue(data, len);
+    if (_cb) _cb->onWrite(this);
+  }
+  // Host: nhận mọi notify của thiết bị
+  std::function<void(const uint8_t *, size_t)> hostOnNotify;
+
+private:
+  const char *_uuid;
+  uint32_t _props;
+  BLECharacteristicCallbacks *_cb = nullptr;
+  std::vector<uint8_t> _value;
+};
+
+class BLEService {
+public:
+  BLECharacteristic *createCharacteristic(const char *uuid, uint32_t props) {
+    _chars.push_back(new BLECharacteristic(uuid, props));
+    return _chars.back();
+  }
+  void start() {}
+private:
+  std::vector<BLECharacteristic *> _chars;
+};
+
+// Tập con của union esp_ble_gatts_cb_param_t (Bluedroid)
+typedef union {
+  struct { uint16_t conn_id; uint16_t mtu; } mtu;
+} esp_ble_gatts_cb_param_t;
+
+class BLEServerCallbacks {
+public:
+  virtual ~BLEServerCallbacks() {}
+  virtual void onConnect(BLEServer *s) { (void)s; }
+  virtual void onDisconnect(BLEServer *s) { (void)s; }
+  virtual void onMtuChanged(BLEServer *s, esp_ble_gatts_cb_param_t *param) { (void)s; (void)param; }
+};
+
+class BLEServer {
+public:
+  BLEService *createService(const char *uuid) { (void)uuid; return new BLEService(); }
+  void setCallbacks(BLEServerCallbacks *cb) { _cb = cb; }
+  uint32_t getConnectedCount() { return _connected; }
+  uint16_t getPeerMTU(uint16_t connId) { (void)connId; return hostPeerMtu; }
+  uint16_t getConnId() { return 0; }
+  void startAdvertising();
+
+  // Host: mô phỏng kết nối / ngắt kết nối của central
+  void hostConnect() {
+    _connected = 1;
+    if (!_cb) return;
+    _cb->onConnect(this);
+    esp_ble_gatts_cb_param_t p;
+    p.mtu.conn_id = 0;
+    p.mtu.mtu = hostPeerMtu;
+    _cb->onMtuChanged(this, &p);
+  }
+  void hostDisconnect() { _connected = 0; if (_cb) _cb->onDisconnect(this); }
+  uint16_t hostPeerMtu = 517;
+
+private:
+  BLEServerCallbacks *_cb = nullptr;
+  uint32_t _connected = 0;
+};
+
+class BLEAdvertising {
+public:
+  void addServiceUUID(const char *uuid) { (void)uuid; }
+  void setScanResponse(bool v) { (void)v; }
+  void setMinPreferred(uint16_t v) { (void)v; }
+  void setMaxPreferred(uint16_t v) { (void)v; }
+  void start() {}
+  void stop() {}
+};
+
+class BLEDevice {
+public:
+  static void init(const char *name) { (void)name; }
+  static BLEServer *createServer() { return s_server = new BLEServer(); }
+  static BLEServer *getServer() { return s_server; }
+  static BLEAdvertising *getAdvertising() { static BLEAdvertising adv; return &adv; }
+  static void startAdvertising() {}
+  static uint16_t getMTU() { return 517; }
+private:
+  static inline BLEServer *s_server = nullptr;
+};
+
+inline void BLEServer::startAdvertising() { BLEDevice::startAdvertising(); }
@@ -0,0 +1,3 @@
+// BLEServer.h (host mock)
+#pragma once
+#include "BLEDevice.h"
@@ -0,0 +1,3 @@
+// BLEUtils.h (host mock)
+#pragma once
+#include "BLEDevice.h"
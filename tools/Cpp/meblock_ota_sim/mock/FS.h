@@ -0,0 +1,82 @@
+// FS.h (host mock) – tập con fs::FS / fs::File của arduino-esp32, file nằm trong RAM (dùng cho LittleFS.h)
+#pragma once
+#include <Arduino.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace fs {
+
+typedef std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> MockFiles;   // path ("/a.bin") -> nội dung
+
+class File {
+public:
+  File() {}
+  File(std::string path, std::shared_ptr<std::vector<uint8_t>> data) : _path(std::move(path)), _data(std::move(data)) {}
+  File(std::vector<std::pair<std::string, std::shared_ptr<std::vector<uint8_t>>>> dir) : _dir(true), _list(std::move(dir)) {}
+
+  explicit operator bool() const { return _data != nullptr || _dir; }
+  size_t write(const uint8_t *d, size_t n) {
+    if (!_data) return 0;
+    _data->insert(_data->end(), d, d + n);
+    return n;
+  }
+  int read(uint8_t *d, size_t n) {
+    if (!_data || _pos >= _data->size()) return _data ? 0 : -1;
+    size_t k = std::min(n, _data->size() - _pos);
+    memcpy(d, _data->data() + _pos, k);
+    _pos += k;
+    return (int)k;
+  }
+  size_t size() const { return _data ? _data->size() : 0; }
+  void close() { _data.reset(); _dir = false; _list.clear(); }
+  bool isDirectory() const { return _dir; }
+  const char *path() const { return _path.c_str(); }
+  const char *name() const { return _path.c_str() + (_path.empty() ? 0 : 1); }   // như esp32: không có '/' đầu
+  File openNextFile() {
+    if (!_dir || _next >= _list.size()) return File();
+    auto &e = _list[_next++];
+    return File(e.first, e.second);
+  }
+
+private:
+  std::string _path;
+  std::shared_ptr<std::vector<uint8_t>> _data;
+  size_t _pos = 0;
+  bool _dir = false;
+  std::vector<std::pair<std::string, std::shared_ptr<std::vector<uint8_t>>>> _list;
+  size_t _next = 0;
+};
+
+class FS {
+public:
+  File open(const char *path, const char *mode = "r") {
+    std::lock_guard<std::mutex> lk(_mu);
+    if (strcmp(path, "/") == 0) return File(std::vector<std::pair<std::string, std::shared_ptr<std::vector<uint8_t>>>>(_files.begin(), _files.end()));
+    if (mode[0] == 'w') return File(path, _files[path] = std::make_shared<std::vector<uint8_t>>());
+    auto it = _files.find(path);
+    return it == _files.end() ? File() : File(path, it->second);
+  }
+  bool exists(const char *path) { std::lock_guard<std::mutex> lk(_mu); return _files.count(path) > 0; }
+  bool remove(const char *path) { std::lock_guard<std::mutex> lk(_mu); return _files.erase(path) > 0; }
+  // Như lfs_rename: file đích đã có thì bị thay (nguyên tử)
+  bool rename(const char *from, const char *to) {
+    std::lock_guard<std::mutex> lk(_mu);
+    auto it = _files.find(from);
+    if (it == _files.end()) return false;
+    _files[to] = it->second;
+    _files.erase(from);
+    return true;
+  }
+
+protected:
+  MockFiles _files;
+  std::mutex _mu;
+};
+
+}  // namespace fs
+
+using fs::File;
+using fs::FS;
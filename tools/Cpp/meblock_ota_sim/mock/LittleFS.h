@@ -0,0 +1,60 @@
+// LittleFS.h (host mock) – LittleFS trên phân vùng data giả lập (mock_flash.cpp), file nằm trong RAM
+#pragma once
+#include "FS.h"
+#include "esp_partition.h"
+
+class LittleFSFS : public fs::FS {
+public:
+  // Mount được khi block 0 có superblock ("littlefs" ở offset 8, như LittleFS thật); không có => format nếu formatOnFail
+  bool begin(bool formatOnFail = false, const char *basePath = "/littlefs", uint8_t maxOpenFiles = 10,
+             const char *partitionLabel = "spiffs") {
+    (void)basePath; (void)maxOpenFiles;
+    _part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partitionLabel);
+    if (!_part) return false;
+    if (hasSuperblock()) return true;
+    return formatOnFail && format();
+  }
+  void end() {}
+  bool format() {
+    if (!_part) return false;
+    esp_partition_erase_range(_part, 0, _part->size);
+    esp_partition_write(_part, 8, "littlefs", 8);
+    std::lock_guard<std::mutex> lk(_mu);
+    _files.clear();
+    return true;
+  }
+  size_t totalBytes() const { return _part ? _part->size : 0; }
+  // Mỗi file chiếm tròn block 4KB, + 2 block metadata như LittleFS
+  size_t usedBytes() {
+    std::lock_guard<std::mutex> lk(_mu);
+    size_t n = 2 * 4096;
+    for (auto &f : _files) n += (f.second->size() + 4095) / 4096 * 4096;
+    return n;
+  }
+
+  // Host: nạp sẵn 1 file (vd asset đã tải lần trước)
+  void hostPut(const char *path, const uint8_t *d, size_t n) {
+    if (!_part || !hasSuperblock()) begin(true, "/littlefs", 10, hostLabel());
+    std::lock_guard<std::mutex> lk(_mu);
+    _files[path] = std::make_shared<std::vector<uint8_t>>(d, d + n);
+  }
+  // Host: nội dung file, rỗng nếu không có
+  std::vector<uint8_t> hostGet(const char *path) {
+    std::lock_guard<std::mutex> lk(_mu);
+    auto it = _files.find(path);
+    return it == _files.end() ? std::vector<uint8_t>() : *it->second;
+  }
+
+private:
+  bool hasSuperblock() {
+    char magic[8] = {};
+    esp_partition_read(_part, 8, magic, sizeof(magic));
+    return memcmp(magic, "littlefs", 8) == 0;
+  }
+  static const char *hostLabel() {
+    return esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "spiffs") ? "spiffs" : "ffat";
+  }
+  const esp_partition_t *_part = nullptr;
+};
+
+inline LittleFSFS LittleFS;
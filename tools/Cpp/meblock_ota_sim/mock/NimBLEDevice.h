@@ -0,0 +1,242 @@
+// NimBLEDevice.h (host mock) – tập con API NimBLE-Arduino 2.x dùng trong core_v1 (GATT server + L2CAP CoC)
+#pragma once
+#include <Arduino.h>
+#include <functional>
+#include <vector>
+
+// ===== Hằng số nimble host (host/ble_gap.h) =====
+#define BLE_GAP_LE_PHY_1M          1
+#define BLE_GAP_LE_PHY_2M          2
+#define BLE_GAP_LE_PHY_1M_MASK     0x01
+#define BLE_GAP_LE_PHY_2M_MASK     0x02
+#define BLE_GAP_LE_PHY_CODED_ANY   0
+
+class NimBLECharacteristic;
+class NimBLEServer;
+
+class NimBLEConnInfo {
+public:
+  uint16_t getConnHandle() const { return handle; }
+  uint16_t getConnInterval() const { return itvl; }
+  uint16_t getConnLatency() const { return latency; }
+  uint16_t getMTU() const { return mtu; }
+
+  uint16_t handle = 0;
+  uint16_t itvl = 24;     // 30 ms: mặc định của central trước khi cập nhật
+  uint16_t latency = 0;
+  uint16_t mtu = 23;
+};
+
+// Giá trị attribute: buffer liền mạch, data() trỏ thẳng vào byte đã ghi
+class NimBLEAttValue {
+public:
+  const uint8_t *data() const { return _v.empty() ? nullptr : _v.data(); }
+  uint16_t length() const { return (uint16_t)_v.size(); }
+  uint16_t size() const { return (uint16_t)_v.size(); }
+  void setValue(const uint8_t *d, size_t n) { _v.assign(d, d + n); }
+private:
+  std::vector<uint8_t> _v;
+};
+
+class NimBLEValueAttribute {
+public:
+  NimBLEAttValue getValue() const { return m_value; }   // bản sao, như thư viện thật
+  size_t getLength() const { return m_value.size(); }
+protected:
+  NimBLEAttValue m_value;
+};
+
+class NimBLECharacteristicCallbacks {
+public:
+  virtual ~NimBLECharacteristicCallbacks() {}
+  virtual void onWrite(NimBLECharacteristic *c, NimBLEConnInfo &ci) { (void)c; (void)ci; }
+  virtual void onRead(NimBLECharacteristic *c, NimBLEConnInfo &ci) { (void)c; (void)ci; }
+};
+
+namespace NIMBLE_PROPERTY {
+  enum {
+    READ     = 1 << 1,
+    WRITE_NR = 1 << 2,
+    WRITE    = 1 << 3,
+    NOTIFY   = 1 << 4,
+    INDICATE = 1 << 5,
+  };
+}
+
+class NimBLECharacteristic : public NimBLEValueAttribute {
+public:
+  NimBLECharacteristic(const char *uuid, uint32_t props) : _uuid(uuid), _props(props) {}
+
+  void setCallbacks(NimBLECharacteristicCallbacks *cb) { _cb = cb; }
+  void setValue(const uint8_t *data, size_t len) { m_value.setValue(data, len); }
+  void setValue(const char *s) { setValue((const uint8_t *)s, strlen(s)); }
+  bool notify() const {
+    if (hostOnNotify) hostOnNotify(m_value.data(), m_value.size());
+    return true;
+  }
+  bool indicate() const { return notify(); }
+
+  // Host: central ghi một giá trị (WRITE / WRITE_NR) – gọi onWrite như task host NimBLE
+  void hostWrite(const uint8_t *data, size_t len) {
+    setValue(data, len);
+    NimBLEConnInfo ci;
+    if (_cb) _cb->onWrite(this, ci);
+  }
+  // Host: nhận mọi notify của thiết bị
+  std::function<void(const uint8_t *, size_t)> hostOnNotify;
+
+private:
+  const char *_uuid;
+  uint32_t _props;
+  NimBLECharacteristicCallbacks *_cb = nullptr;
+};
+
+class NimBLEService {
+public:
+  NimBLECharacteristic *createCharacteristic(const char *uuid, uint32_t props = NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::WRITE,
+                                             uint16_t maxLen = 512) {
+    (void)maxLen;
+    _chars.push_back(new NimBLECharacteristic(uuid, props));
+    return _chars.back();
+  }
+  bool start() { return true; }
+private:
+  std::vector<NimBLECharacteristic *> _chars;
+};
+
+class NimBLEServerCallbacks {
+public:
+  virtual ~NimBLEServerCallbacks() {}
+  virtual void onConnect(NimBLEServer *s, NimBLEConnInfo &ci) { (void)s; (void)ci; }
+  virtual void onDisconnect(NimBLEServer *s, NimBLEConnInfo &ci, int reason) { (void)s; (void)ci; (void)reason; }
+  virtual void onMTUChange(uint16_t mtu, NimBLEConnInfo &ci) { (void)mtu; (void)ci; }
+  virtual void onConnParamsUpdate(NimBLEConnInfo &ci) { (void)ci; }
+  virtual void onPhyUpdate(NimBLEConnInfo &ci, uint8_t txPhy, uint8_t rxPhy) { (void)ci; (void)txPhy; (void)rxPhy; }
+};
+
+class NimBLEServer {
+public:
+  NimBLEService *createService(const char *uuid) { (void)uuid; return new NimBLEService(); }
+  void setCallbacks(NimBLEServerCallbacks *cb, bool deleteCallbacks = true) { (void)deleteCallbacks; _cb = cb; }
+  uint8_t getConnectedCount() const { return _connected; }
+  uint16_t getPeerMTU(uint16_t h) const { (void)h; return hostPeerMtu; }
+  void advertiseOnDisconnect(bool enable) { (void)enable; }
+
+  // Yêu cầu tối ưu link: central giả lập chấp nhận ngay (PHY chỉ khi hostPhy2M)
+  bool updatePhy(uint16_t h, uint8_t txMask, uint8_t rxMask, uint16_t opts) {
+    (void)h; (void)opts;
+    hostPhyReq = txMask & rxMask;
+    if (!hostPhy2M) return false;
+    if (_cb && (hostPhyReq & BLE_GAP_LE_PHY_2M_MASK)) _cb->onPhyUpdate(_ci, BLE_GAP_LE_PHY_2M, BLE_GAP_LE_PHY_2M);
+    return true;
+  }
+  void setDataLen(uint16_t h, uint16_t octets) const { (void)h; hostDataLen = octets; }
+  void updateConnParams(uint16_t h, uint16_t minItvl, uint16_t maxItvl, uint16_t latency, uint16_t timeout) {
+    (void)h; (void)timeout;
+    _ci.itvl = minItvl;
+    _ci.latency = latency;
+    hostItvlMax = maxItvl;
+    if (_cb) _cb->onConnParamsUpdate(_ci);
+  }
+
+  // Host: mô phỏng kết nối / ngắt kết nối của central
+  void hostConnect() {
+    _connected = 1;
+    _ci = NimBLEConnInfo();
+    _ci.mtu = hostPeerMtu;
+    if (!_cb) return;
+    _cb->onConnect(this, _ci);
+    _cb->onMTUChange(hostPeerMtu, _ci);
+  }
+  void hostDisconnect() { _connected = 0; if (_cb) _cb->onDisconnect(this, _ci, 0x13); }
+  uint16_t hostPeerMtu = 517;
+  bool hostPhy2M = true;               // controller + central hỗ trợ 2M (C3 / S3)
+  uint8_t hostPhyReq = 0;              // mask PHY thiết bị đã yêu cầu
+  mutable uint16_t hostDataLen = 27;   // LL data length thiết bị đã yêu cầu
+  uint16_t hostItvlMax = 0;
+  const NimBLEConnInfo &hostConnInfo() const { return _ci; }
+
+private:
+  NimBLEServerCallbacks *_cb = nullptr;
+  NimBLEConnInfo _ci;
+  uint8_t _connected = 0;
+};
+
+class NimBLEAdvertising {
+public:
+  bool addServiceUUID(const char *uuid) { (void)uuid; return true; }
+  void enableScanResponse(bool v) { (void)v; }
+  bool setName(const std::string &n) { (void)n; return true; }
+  bool setPreferredParams(uint16_t minItvl, uint16_t maxItvl) { (void)minItvl; (void)maxItvl; return true; }
+  bool start() { return true; }
+  bool stop() { return true; }
+};
+
+// ===== L2CAP CoC (server) =====
+class NimBLEL2CAPChannel;
+
+class NimBLEL2CAPChannelCallbacks {
+public:
+  virtual ~NimBLEL2CAPChannelCallbacks() {}
+  virtual bool shouldAcceptConnection(NimBLEL2CAPChannel *c) { (void)c; return true; }
+  virtual void onConnect(NimBLEL2CAPChannel *c, uint16_t mtu) { (void)c; (void)mtu; }
+  virtual void onRead(NimBLEL2CAPChannel *c, std::vector<uint8_t> &data) { (void)c; (void)data; }
+  virtual void onDisconnect(NimBLEL2CAPChannel *c) { (void)c; }
+};
+
+class NimBLEL2CAPChannel {
+public:
+  NimBLEL2CAPChannel(uint16_t psm, uint16_t mtu, NimBLEL2CAPChannelCallbacks *cb) : psm(psm), mtu(mtu), cb(cb) {}
+  bool isConnected() const { return _open; }
+
+  // Host: central mở / đóng kênh và gửi 1 SDU. onRead chạy trên luồng gọi (như task host NimBLE),
+  // credit chỉ được trả khi onRead xong => hostSend chặn khi thiết bị chưa nhận kịp
+  void hostOpen(uint16_t peerMtu) { _open = true; cb->onConnect(this, peerMtu < mtu ? peerMtu : mtu); }
+  void hostClose() { _open = false; cb->onDisconnect(this); }
+  void hostSend(const uint8_t *data, size_t len) {
+    std::vector<uint8_t> v(data, data + len);
+    cb->onRead(this, v);
+  }
+
+  const uint16_t psm;
+  const uint16_t mtu;
+  NimBLEL2CAPChannelCallbacks *const cb;
+
+private:
+  bool _open = false;
+};
+
+class NimBLEL2CAPServer {
+public:
+  NimBLEL2CAPChannel *createService(uint16_t psm, uint16_t mtu, NimBLEL2CAPChannelCallbacks *cb) {
+    services.push_back(new NimBLEL2CAPChannel(psm, mtu, cb));
+    return services.back();
+  }
+  std::vector<NimBLEL2CAPChannel *> services;
+};
+
+class NimBLEDevice {
+public:
+  static bool init(const std::string &name) { (void)name; return true; }
+  static bool setMTU(uint16_t mtu) { (void)mtu; return true; }
+  static bool setDefaultPhy(uint8_t txMask, uint8_t rxMask) { (void)txMask; (void)rxMask; return true; }
+  static bool setPower(int8_t dbm) { (void)dbm; return true; }
+  static NimBLEServer *createServer() { return s_server = new NimBLEServer(); }
+  static NimBLEServer *getServer() { return s_server; }
+  static NimBLEAdvertising *getAdvertising() { static NimBLEAdvertising adv; return &adv; }
+  static bool startAdvertising() { return true; }
+  static NimBLEL2CAPServer *createL2CAPServer() { static NimBLEL2CAPServer s; return &s; }
+  static NimBLEL2CAPServer *getL2CAPServer() { return createL2CAPServer(); }
+private:
+  static inline NimBLEServer *s_server = nullptr;
+};
+
+// Tên kiểu Bluedroid => NimBLE (như NimBLEDevice.h thật)
+#define BLEDevice                    NimBLEDevice
+#define BLEServer                    NimBLEServer
+#define BLEService                   NimBLEService
+#define BLECharacteristic            NimBLECharacteristic
+#define BLEAdvertising               NimBLEAdvertising
+#define BLEServerCallbacks           NimBLEServerCallbacks
+#define BLECharacteristicCallbacks   NimBLECharacteristicCallbacks
+#define BLEConnInfo                  NimBLEConnInfo
@@ -0,0 +1,51 @@
+// Preferences.h (host mock) – NVS giả lập trong RAM
+#pragma once
+#include <Arduino.h>
+#include <map>
+#include <vector>
+
+class Preferences {
+public:
+  bool begin(const char *ns, bool readOnly = false) { (void)readOnly; _ns = ns; return true; }
+  void end() {}
+  bool clear() { store()[_ns].clear(); return true; }
+  bool remove(const char *key) { return store()[_ns].erase(key) > 0; }
+  bool isKey(const char *key) { return store()[_ns].count(key) > 0; }
+
+  size_t putString(const char *key, const String &v) { return putBytes(key, v.c_str(), v.length()); }
+  String getString(const char *key, const String &def = String()) {
+    auto &m = store()[_ns];
+    auto it = m.find(key);
+    if (it == m.end()) return def;
+    return String(std::string(it->second.begin(), it->second.end()));
+  }
+  size_t putUInt(const char *key, uint32_t v) { return putBytes(key, &v, sizeof(v)); }
+  uint32_t getUInt(const char *key, uint32_t def = 0) { uint32_t v = def; getBytes(key, &v, sizeof(v)); return v; }
+  size_t putUChar(const char *key, uint8_t v) { return putBytes(key, &v, sizeof(v)); }
+  uint8_t getUChar(const char *key, uint8_t def = 0) { uint8_t v = def; getBytes(key, &v, sizeof(v)); return v; }
+  size_t putBool(const char *key, bool v) { return putUChar(key, v ? 1 : 0); }
+  bool getBool(const char *key, bool def = false) { return getUChar(key, def ? 1 : 0) != 0; }
+
+  size_t putBytes(const char *key, const void *v, size_t n) {
+    store()[_ns][key].assign((const uint8_t *)v, (const uint8_t *)v + n);
+    return n;
+  }
+  size_t getBytesLength(const char *key) {
+    auto &m = store()[_ns];
+    auto it = m.find(key);
+    return it == m.end() ? 0 : it->second.size();
+  }
+  size_t getBytes(const char *key, void *out, size_t maxLen) {
+    auto &m = store()[_ns];
+    auto it = m.find(key);
+    if (it == m.end()) return 0;
+    size_t n = std::min(maxLen, it->second.size());
+    memcpy(out, it->second.data(), n);
+    return n;
+  }
+
+private:
+  typedef std::map<std::string, std::map<std::string, std::vector<uint8_t>>> Store;
+  static Store &store() { static Store s; return s; }
+  std::string _ns;
+};
@@ -0,0 +1,24 @@
+// Update.h (host mock) – ghi vào phân vùng OTA kế tiếp của flash giả lập
+#pragma once
+#include <Arduino.h>
+#include "esp_ota_ops.h"
+
+#define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
+
+class UpdateClass {
+public:
+  bool begin(size_t size = UPDATE_SIZE_UNKNOWN);
+  size_t write(uint8_t *data, size_t len);
+  bool end(bool evenIfRemaining = false);
+  void abort();
+  bool isFinished() const { return _size != UPDATE_SIZE_UNKNOWN && _written == _size; }
+  uint8_t getError() const { return _error; }
+  size_t progress() const { return _written; }
+
+private:
+  esp_ota_handle_t _h = 0;
+  size_t _size = 0;
+  size_t _written = 0;
+  uint8_t _error = 0;
+};
+extern UpdateClass Update;
@@ -0,0 +1,14 @@
+// esp_err.h (host mock)
+#pragma once
+#include <stdint.h>
+typedef int esp_err_t;
+#define ESP_OK                    0
+#define ESP_FAIL                 -1
+#define ESP_ERR_NO_MEM           0x101
+#define ESP_ERR_INVALID_ARG      0x102
+#define ESP_ERR_INVALID_STATE    0x103
+#define ESP_ERR_INVALID_SIZE     0x104
+#define ESP_ERR_NOT_FOUND        0x105
+#define ESP_ERR_INVALID_CRC      0x109
+#define ESP_ERR_OTA_VALIDATE_FAILED 0x1503
+static inline const char *esp_err_to_name(esp_err_t e) { return e == ESP_OK ? "ESP_OK" : "ESP_ERR"; }
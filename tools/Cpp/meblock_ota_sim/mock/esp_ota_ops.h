@@ -0,0 +1,17 @@
+// esp_ota_ops.h (host mock)
+#pragma once
+#include "esp_partition.h"
+
+typedef uint32_t esp_ota_handle_t;
+#define OTA_SIZE_UNKNOWN            0xffffffff
+#define OTA_WITH_SEQUENTIAL_WRITES  0xfffffffe
+
+const esp_partition_t *esp_ota_get_running_partition();
+const esp_partition_t *esp_ota_get_boot_partition();
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from);
+esp_err_t esp_ota_begin(const esp_partition_t *p, size_t image_size, esp_ota_handle_t *out);
+esp_err_t esp_ota_write(esp_ota_handle_t h, const void *data, size_t size);
+esp_err_t esp_ota_write_with_offset(esp_ota_handle_t h, const void *data, size_t size, uint32_t offset);
+esp_err_t esp_ota_end(esp_ota_handle_t h);
+esp_err_t esp_ota_abort(esp_ota_handle_t h);
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *p);
@@ -0,0 +1,47 @@
+// esp_partition.h (host mock) – bảng phân vùng giống partitions.csv của board 4MB (hoặc 16MB có slot)
+#pragma once
+#include <stddef.h>
+#include "esp_err.h"
+
+typedef enum {
+  ESP_PARTITION_TYPE_APP  = 0x00,
+  ESP_PARTITION_TYPE_DATA = 0x01,
+  ESP_PARTITION_TYPE_ANY  = 0xff,
+} esp_partition_type_t;
+
+typedef enum {
+  ESP_PARTITION_SUBTYPE_APP_FACTORY    = 0x00,
+  ESP_PARTITION_SUBTYPE_APP_OTA_MIN    = 0x10,
+  ESP_PARTITION_SUBTYPE_APP_OTA_0      = 0x10,
+  ESP_PARTITION_SUBTYPE_APP_OTA_1      = 0x11,
+  ESP_PARTITION_SUBTYPE_APP_OTA_2      = 0x12,
+  ESP_PARTITION_SUBTYPE_APP_OTA_3      = 0x13,
+  ESP_PARTITION_SUBTYPE_APP_OTA_MAX    = 0x20,
+  ESP_PARTITION_SUBTYPE_DATA_OTA       = 0x00,
+  ESP_PARTITION_SUBTYPE_DATA_NVS       = 0x02,
+  ESP_PARTITION_SUBTYPE_DATA_FAT       = 0x81,
+  ESP_PARTITION_SUBTYPE_DATA_SPIFFS    = 0x82,
+  ESP_PARTITION_SUBTYPE_DATA_LITTLEFS  = 0x83,
+  ESP_PARTITION_SUBTYPE_ANY            = 0xff,
+} esp_partition_subtype_t;
+
+typedef struct {
+  void *flash_chip;
+  esp_partition_type_t type;
+  esp_partition_subtype_t subtype;
+  uint32_t address;
+  uint32_t size;
+  uint32_t erase_size;
+  char label[17];
+  bool encrypted;
+  bool readonly;
+} esp_partition_t;
+
+#define SPI_FLASH_SEC_SIZE 4096
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype,
+                                                const char *label);
+esp_err_t esp_partition_read(const esp_partition_t *p, size_t off, void *dst, size_t len);
+esp_err_t esp_partition_write(const esp_partition_t *p, size_t off, const void *src, size_t len);
+esp_err_t esp_partition_erase_range(const esp_partition_t *p, size_t off, size_t len);
@@ -0,0 +1,4 @@
+// esp_timer.h (host mock)
+#pragma once
+#include <stdint.h>
+int64_t esp_timer_get_time();
@@ -0,0 +1,32 @@
+// freertos/FreeRTOS.h (host mock) – shim FreeRTOS trên pthread/std::thread
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+typedef int32_t  BaseType_t;
+typedef uint32_t UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE   ((BaseType_t)1)
+#define pdFALSE  ((BaseType_t)0)
+#define pdPASS   pdTRUE
+#define pdFAIL   pdFALSE
+
+#define portMAX_DELAY       ((TickType_t)0xFFFFFFFFu)
+#define portTICK_PERIOD_MS  1
+#define portNUM_PROCESSORS  2
+#define pdMS_TO_TICKS(ms)   ((TickType_t)(ms))
+#define configMAX_PRIORITIES 25
+
+// Critical section: một mutex toàn cục (đủ cho host)
+typedef struct { int dummy; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0}
+void mock_rtos_enter_critical();
+void mock_rtos_exit_critical();
+#define portENTER_CRITICAL(m)     ((void)(m), mock_rtos_enter_critical())
+#define portEXIT_CRITICAL(m)      ((void)(m), mock_rtos_exit_critical())
+#define portENTER_CRITICAL_ISR(m) portENTER_CRITICAL(m)
+#define portEXIT_CRITICAL_ISR(m)  portEXIT_CRITICAL(m)
+#define portYIELD_FROM_ISR(x)     ((void)(x))
+#define IRAM_ATTR
+#define RTC_NOINIT_ATTR
@@ -0,0 +1,15 @@
+// freertos/queue.h (host mock)
+#pragma once
+#include "freertos/FreeRTOS.h"
+
+typedef struct MockQueue *QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize);
+void          vQueueDelete(QueueHandle_t q);
+BaseType_t    xQueueSend(QueueHandle_t q, const void *item, TickType_t wait);
+BaseType_t    xQueueReceive(QueueHandle_t q, void *item, TickType_t wait);
+UBaseType_t   uxQueueMessagesWaiting(QueueHandle_t q);
+UBaseType_t   uxQueueSpacesAvailable(QueueHandle_t q);
+BaseType_t    xQueueReset(QueueHandle_t q);
+#define xQueueSendToBack(q, i, w) xQueueSend(q, i, w)
+#define xQueueSendFromISR(q, i, woken) (((void)(woken)), xQueueSend(q, i, 0))
@@ -0,0 +1,21 @@
+// freertos/task.h (host mock)
+#pragma once
+#include "freertos/FreeRTOS.h"
+
+typedef struct MockTask *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+BaseType_t   xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack,
+                                     void *arg, UBaseType_t prio, TaskHandle_t *out, BaseType_t core);
+BaseType_t   xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack,
+                         void *arg, UBaseType_t prio, TaskHandle_t *out);
+void         vTaskDelete(TaskHandle_t t);
+void         vTaskDelay(TickType_t ticks);
+TickType_t   xTaskGetTickCount();
+TaskHandle_t xTaskGetCurrentTaskHandle();
+
+// Direct-to-task notification (chế độ đếm, giống ulTaskNotifyTake/xTaskNotifyGive)
+BaseType_t   xTaskNotifyGive(TaskHandle_t t);
+uint32_t     ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t wait);
+void         vTaskNotifyGiveFromISR(TaskHandle_t t, BaseType_t *woken);
+#define taskYIELD() ((void)0)
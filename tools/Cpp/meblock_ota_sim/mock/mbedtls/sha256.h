@@ -0,0 +1,14 @@
+// mbedtls/sha256.h (host mock) – API mbedtls trên bản SHA-256 C thuần của IOT47
+#pragma once
+#include "IOT47_OTA_Sha256.h"
+
+typedef iot47_sha256_t mbedtls_sha256_context;
+
+static inline void mbedtls_sha256_init(mbedtls_sha256_context *ctx) { (void)ctx; }
+static inline int mbedtls_sha256_starts(mbedtls_sha256_context *ctx, int is224) { (void)is224; iot47_sha256_init(ctx); return 0; }
+static inline int mbedtls_sha256_update(mbedtls_sha256_context *ctx, const unsigned char *d, size_t n) {
+  iot47_sha256_update(ctx, d, n);
+  return 0;
+}
+static inline int mbedtls_sha256_finish(mbedtls_sha256_context *ctx, unsigned char out[32]) { iot47_sha256_final(ctx, out); return 0; }
+static inline void mbedtls_sha256_free(mbedtls_sha256_context *ctx) { (void)ctx; }
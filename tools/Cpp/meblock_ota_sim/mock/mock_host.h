@@ -0,0 +1,37 @@
+// mock_host.h – các điều khiển phía host cho flash/RTOS giả lập (không có trên board)
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+struct MockFlashTiming {
+  uint32_t eraseUsPerSector = 0;   // ESP32 thật: ~30-50 ms / sector 4KB
+  uint32_t eraseUsPerBlock  = 0;   // erase 64KB thẳng hàng (block erase, ~150-200 ms); 0 => 16 x sector
+  uint32_t writeUsPerKB     = 0;   // ESP32 thật: ~2-3 ms / KB
+};
+
+struct MockFlashStats {
+  uint32_t erases  = 0;
+  uint32_t writes  = 0;
+  uint32_t badWrites = 0;          // ghi vào byte chưa erase (bit 0 -> 1)
+  uint64_t bytesWritten = 0;
+};
+
+extern MockFlashTiming g_mockFlashTiming;
+extern MockFlashStats  g_mockFlashStats;
+
+// Đọc lại nội dung một phân vùng app (để so với ảnh gốc)
+std::vector<uint8_t> mock_flash_dump(const char *label, size_t len);
+// Nạp sẵn dữ liệu vào một phân vùng (vd: ảnh cũ trong app1 cho delta OTA)
+void mock_flash_load(const char *label, const uint8_t *data, size_t len);
+// Dùng bảng phân vùng 16MB có slot app1..app3 (gọi trước setup())
+void mock_flash_use_slots();
+// Phân vùng boot được chọn gần nhất (nullptr nếu chưa đổi)
+const char *mock_flash_boot_label();
+
+// Lưu len byte đầu phân vùng ra file (ảnh mà Update / writer đã ghi)
+bool mock_flash_save(const char *label, size_t len, const char *path);
+
+// true sau khi firmware gọi ESP.restart()/esp_restart()
+bool mock_restarted();
+void mock_clear_restart();
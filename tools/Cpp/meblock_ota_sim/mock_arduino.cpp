@@ -0,0 +1,82 @@
+// mock_arduino.cpp – thời gian, Serial, ESP cho build host
+#include <Arduino.h>
+#include "esp_mac.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "mock_host.h"
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+static const auto s_t0 = std::chrono::steady_clock::now();
+
+int64_t esp_timer_get_time() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - s_t0).count();
+}
+uint32_t millis() { return (uint32_t)(esp_timer_get_time() / 1000); }
+uint32_t micros() { return (uint32_t)esp_timer_get_time(); }
+void delay(uint32_t ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+void delayMicroseconds(uint32_t us) { std::this_thread::sleep_for(std::chrono::microseconds(us)); }
+
+// ===== Serial =====
+HardwareSerial Serial;
+static std::mutex s_rxMu;
+static std::deque<uint8_t> s_rx;
+static std::mutex s_txMu;
+
+int HardwareSerial::available() {
+  std::lock_guard<std::mutex> lk(s_rxMu);
+  return (int)s_rx.size();
+}
+int HardwareSerial::read() {
+  std::lock_guard<std::mutex> lk(s_rxMu);
+  if (s_rx.empty()) return -1;
+  int c = s_rx.front();
+  s_rx.pop_front();
+  return c;
+}
+size_t HardwareSerial::readBytes(uint8_t *buf, size_t n) {
+  std::lock_guard<std::mutex> lk(s_rxMu);
+  size_t k = 0;
+  while (k < n && !s_rx.empty()) { buf[k++] = s_rx.front(); s_rx.pop_front(); }
+  return k;
+}
+size_t HardwareSerial::write(const uint8_t *buf, size_t n) {
+  std::lock_guard<std::mutex> lk(s_txMu);
+  if (_txHook) _txHook(buf, n);
+  return fwrite(buf, 1, n, _out);
+}
+void HardwareSerial::injectRx(const uint8_t *data, size_t n) {
+  std::lock_guard<std::mutex> lk(s_rxMu);
+  size_t room = (s_rx.size() < _rxCap) ? _rxCap - s_rx.size() : 0;
+  if (n > room) _rxLost += n - room;
+  s_rx.insert(s_rx.end(), data, data + std::min(n, room));
+}
+
+// ===== ESP / restart =====
+EspClass ESP;
+static std::atomic<bool> s_restarted{false};
+
+bool mock_restarted() { return s_restarted.load(); }
+void mock_clear_restart() { s_restarted = false; }
+
+void EspClass::restart() { esp_restart(); }
+
+void esp_restart() {
+  // Trên board: reset chip. Trên host: đánh dấu và "treo" luồng gọi
+  s_restarted = true;
+  for (;;) std::this_thread::sleep_for(std::chrono::seconds(1));
+}
+
+esp_reset_reason_t esp_reset_reason() { return ESP_RST_POWERON; }
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type) {
+  (void)type;
+  const uint8_t m[6] = {0x24, 0x6F, 0x28, 0xAB, 0xCD, 0xEF};
+  memcpy(mac, m, 6);
+  return ESP_OK;
+}
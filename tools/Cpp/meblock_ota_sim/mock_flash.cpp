@@ -0,0 +1,249 @@
+// mock_flash.cpp – flash 4MB (hoặc 16MB có slot) giả lập + esp_partition / esp_ota / Update
+#include <Arduino.h>
+#include <Update.h>
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "mock_host.h"
+
+#include <mutex>
+#include <thread>
+#include <vector>
+
+MockFlashTiming g_mockFlashTiming;
+MockFlashStats  g_mockFlashStats;
+
+static const uint32_t FLASH_SIZE = 0x1000000;
+static std::vector<uint8_t> s_flash(FLASH_SIZE, 0xFF);
+static std::mutex s_flashMu;
+static std::mutex s_chipMu;   // 1 chip SPI: erase và write không chạy song song (giống khoá flash của IDF)
+
+// Giống partitions.csv của ESP32-WROOM 32 / ESP32-C3 Super Mini
+static esp_partition_t s_parts[] = {
+  {nullptr, ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_NVS,    0x9000,   0x5000,   4096, "nvs",     false, false},
+  {nullptr, ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_OTA,    0xe000,   0x2000,   4096, "otadata", false, false},
+  {nullptr, ESP_PARTITION_TYPE_APP,  ESP_PARTITION_SUBTYPE_APP_OTA_0,   0x10000,  0x140000, 4096, "app0",    false, false},
+  {nullptr, ESP_PARTITION_TYPE_APP,  ESP_PARTITION_SUBTYPE_APP_OTA_1,   0x150000, 0x140000, 4096, "app1",    false, false},
+  {nullptr, ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, 0x290000, 0x160000, 4096, "spiffs",  false, false},
+};
+// Giống partitions_16MB_slots.csv (ESP32-S3 N16R8): app1..app3 = slot chương trình
+static esp_partition_t s_partsSlots[] = {
+  {nullptr, ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_NVS,    0x9000,   0x5000,   4096, "nvs",     false, false},
+  {nullptr, ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_OTA,    0xe000,   0x2000,   4096, "otadata", false, false},
+  {nullptr, ESP_PARTITION_TYPE_APP,  ESP_PARTITION_SUBTYPE_APP_OTA_0,   0x10000,  0x300000, 4096, "app0",    false, false},
+  {nullptr, ESP_PARTITION_TYPE_APP,  ESP_PARTITION_SUBTYPE_APP_OTA_1,   0x310000, 0x300000, 4096, "app1",    false, false},
+  {nullptr, ESP_PARTITION_TYPE_APP,  ESP_PARTITION_SUBTYPE_APP_OTA_2,   0x610000, 0x300000, 4096, "app2",    false, false},
+  {nullptr, ESP_PARTITION_TYPE_APP,  ESP_PARTITION_SUBTYPE_APP_OTA_3,   0x910000, 0x300000, 4096, "app3",    false, false},
+  {nullptr, ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_FAT,    0xC10000, 0x3E0000, 4096, "ffat",    false, false},
+};
+static esp_partition_t *s_table = s_parts;
+static size_t s_tableLen = sizeof(s_parts) / sizeof(s_parts[0]);
+static const esp_partition_t *s_boot = nullptr;
+
+static const esp_partition_t *find_label(const char *label) {
+  for (size_t i = 0; i < s_tableLen; i++) if (strcmp(s_table[i].label, label) == 0) return &s_table[i];
+  return nullptr;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype,
+                                                const char *label) {
+  for (size_t i = 0; i < s_tableLen; i++) {
+    const esp_partition_t &p = s_table[i];
+    if (type != ESP_PARTITION_TYPE_ANY && p.type != type) continue;
+    if (subtype != ESP_PARTITION_SUBTYPE_ANY && p.subtype != subtype) continue;
+    if (label && strcmp(label, p.label) != 0) continue;
+    return &p;
+  }
+  return nullptr;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *p, size_t off, void *dst, size_t len) {
+  if (!p || off + len > p->size) return ESP_ERR_INVALID_SIZE;
+  std::lock_guard<std::mutex> lk(s_flashMu);
+  memcpy(dst, &s_flash[p->address + off], len);
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *p, size_t off, const void *src, size_t len) {
+  if (!p || off + len > p->size) return ESP_ERR_INVALID_SIZE;
+  std::lock_guard<std::mutex> chip(s_chipMu);
+  if (g_mockFlashTiming.writeUsPerKB)
+    std::this_thread::sleep_for(std::chrono::microseconds((uint64_t)g_mockFlashTiming.writeUsPerKB * len / 1024));
+  std::lock_guard<std::mutex> lk(s_flashMu);
+  const uint8_t *s = (const uint8_t *)src;
+  uint8_t *d = &s_flash[p->address + off];
+  for (size_t i = 0; i < len; i++) {
+    // NOR flash chỉ kéo bit 1 -> 0; cần erase trước khi ghi
+    if ((d[i] & s[i]) != s[i]) g_mockFlashStats.badWrites++;
+    d[i] &= s[i];
+  }
+  g_mockFlashStats.writes++;
+  g_mockFlashStats.bytesWritten += len;
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *p, size_t off, size_t len) {
+  if (!p || off + len > p->size || (off % SPI_FLASH_SEC_SIZE) || (len % SPI_FLASH_SEC_SIZE))
+    return ESP_ERR_INVALID_ARG;
+  const size_t BLOCK = 0x10000;
+  for (size_t s = 0; s < len;) {
+    // như esp_flash_erase_region: dùng block erase 64KB khi địa chỉ và độ dài còn lại thẳng hàng
+    size_t a = p->address + off + s;
+    size_t n = (g_mockFlashTiming.eraseUsPerBlock && (a % BLOCK) == 0 && len - s >= BLOCK) ? BLOCK : SPI_FLASH_SEC_SIZE;
+    std::lock_guard<std::mutex> chip(s_chipMu);
+    uint32_t us = (n == BLOCK) ? g_mockFlashTiming.eraseUsPerBlock : g_mockFlashTiming.eraseUsPerSector;
+    if (us) std::this_thread::sleep_for(std::chrono::microseconds(us));
+    std::lock_guard<std::mutex> lk(s_flashMu);
+    memset(&s_flash[a], 0xFF, n);
+    g_mockFlashStats.erases++;
+    s += n;
+  }
+  return ESP_OK;
+}
+
+// ===== esp_ota =====
+struct OtaHandle {
+  const esp_partition_t *part = nullptr;
+  bool sequentialErase = false;
+  size_t wrote = 0;
+  bool open = false;
+};
+static OtaHandle s_ota;
+
+const esp_partition_t *esp_ota_get_running_partition() { return find_label("app0"); }
+const esp_partition_t *esp_ota_get_boot_partition() { return s_boot ? s_boot : find_label("app0"); }
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from) {
+  (void)start_from;
+  return find_label("app1");
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t *p, size_t image_size, esp_ota_handle_t *out) {
+  if (!p || p->type != ESP_PARTITION_TYPE_APP) return ESP_ERR_INVALID_ARG;
+  if (p == esp_ota_get_running_partition()) return ESP_ERR_OTA_VALIDATE_FAILED;
+  s_ota = OtaHandle();
+  s_ota.part = p;
+  s_ota.open = true;
+  if (image_size == OTA_WITH_SEQUENTIAL_WRITES) {
+    s_ota.sequentialErase = true;
+  } else {
+    size_t n = (image_size == OTA_SIZE_UNKNOWN) ? p->size
+                                                : (image_size + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE * SPI_FLASH_SEC_SIZE;
+    esp_err_t err = esp_partition_erase_range(p, 0, n);
+    if (err != ESP_OK) return err;
+  }
+  *out = 1;
+  return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t h, const void *data, size_t size) {
+  if (h != 1 || !s_ota.open) return ESP_ERR_INVALID_ARG;
+  if (s_ota.wrote == 0 && size > 0 && ((const uint8_t *)data)[0] != 0xE9) return ESP_ERR_OTA_VALIDATE_FAILED;
+  if (s_ota.sequentialErase) {
+    // Erase từng sector khi con trỏ ghi đi vào sector mới (giống IDF)
+    size_t first = (s_ota.wrote + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE;
+    size_t last  = (s_ota.wrote + size + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE;
+    if (s_ota.wrote % SPI_FLASH_SEC_SIZE == 0 && size) first = s_ota.wrote / SPI_FLASH_SEC_SIZE;
+    for (size_t s = first; s < last; s++) {
+      esp_err_t err = esp_partition_erase_range(s_ota.part, s * SPI_FLASH_SEC_SIZE, SPI_FLASH_SEC_SIZE);
+      if (err != ESP_OK) return err;
+    }
+  }
+  esp_err_t err = esp_partition_write(s_ota.part, s_ota.wrote, data, size);
+  if (err == ESP_OK) s_ota.wrote += size;
+  return err;
+}
+
+esp_err_t esp_ota_write_with_offset(esp_ota_handle_t h, const void *data, size_t size, uint32_t offset) {
+  if (h != 1 || !s_ota.open) return ESP_ERR_INVALID_ARG;
+  esp_err_t err = esp_partition_write(s_ota.part, offset, data, size);
+  if (err == ESP_OK) s_ota.wrote += size;
+  return err;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t h) {
+  if (h != 1 || !s_ota.open) return ESP_ERR_INVALID_ARG;
+  s_ota.open = false;
+  uint8_t magic = 0;
+  esp_partition_read(s_ota.part, 0, &magic, 1);
+  return (s_ota.wrote > 0 && magic == 0xE9) ? ESP_OK : ESP_ERR_OTA_VALIDATE_FAILED;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t h) {
+  if (h != 1) return ESP_ERR_INVALID_ARG;
+  s_ota.open = false;
+  return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *p) {
+  if (!p || p->type != ESP_PARTITION_TYPE_APP) return ESP_ERR_INVALID_ARG;
+  uint8_t magic = 0;
+  esp_partition_read(p, 0, &magic, 1);
+  if (magic != 0xE9) return ESP_ERR_OTA_VALIDATE_FAILED;
+  s_boot = p;
+  return ESP_OK;
+}
+
+// ===== Host helpers =====
+std::vector<uint8_t> mock_flash_dump(const char *label, size_t len) {
+  const esp_partition_t *p = find_label(label);
+  if (!p) return {};
+  if (len > p->size) len = p->size;
+  std::lock_guard<std::mutex> lk(s_flashMu);
+  return std::vector<uint8_t>(s_flash.begin() + p->address, s_flash.begin() + p->address + len);
+}
+
+void mock_flash_load(const char *label, const uint8_t *data, size_t len) {
+  const esp_partition_t *p = find_label(label);
+  if (!p || len > p->size) return;
+  std::lock_guard<std::mutex> lk(s_flashMu);
+  memset(&s_flash[p->address], 0xFF, p->size);
+  memcpy(&s_flash[p->address], data, len);
+}
+
+bool mock_flash_save(const char *label, size_t len, const char *path) {
+  std::vector<uint8_t> d = mock_flash_dump(label, len);
+  FILE *f = fopen(path, "wb");
+  if (!f) return false;
+  bool ok = fwrite(d.data(), 1, d.size(), f) == d.size();
+  fclose(f);
+  return ok;
+}
+
+void mock_flash_use_slots() {
+  s_table = s_partsSlots;
+  s_tableLen = sizeof(s_partsSlots) / sizeof(s_partsSlots[0]);
+  s_boot = nullptr;
+}
+
+const char *mock_flash_boot_label() { return s_boot ? s_boot->label : nullptr; }
+
+// ===== Update (Arduino) – bọc esp_ota như UpdateClass thật =====
+UpdateClass Update;
+
+bool UpdateClass::begin(size_t size) {
+  _size = size;
+  _written = 0;
+  _error = 0;
+  if (esp_ota_begin(esp_ota_get_next_update_partition(nullptr), size, &_h) != ESP_OK) {
+    _error = 1;
+    return false;
+  }
+  return true;
+}
+
+size_t UpdateClass::write(uint8_t *data, size_t len) {
+  if (_error) return 0;
+  if (esp_ota_write(_h, data, len) != ESP_OK) { _error = 2; return 0; }
+  _written += len;
+  return len;
+}
+
+bool UpdateClass::end(bool evenIfRemaining) {
+  if (_error) return false;
+  if (!evenIfRemaining && !isFinished()) { _error = 3; return false; }
+  if (esp_ota_end(_h) != ESP_OK) { _error = 4; return false; }
+  if (esp_ota_set_boot_partition(esp_ota_get_next_update_partition(nullptr)) != ESP_OK) { _error = 5; return false; }
+  return true;
+}
+
+void UpdateClass::abort() { esp_ota_abort(_h); _error = 6; }
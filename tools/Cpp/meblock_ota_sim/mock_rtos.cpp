@@ -0,0 +1,157 @@
+// mock_rtos.cpp – queue / task / notification của FreeRTOS trên std::thread
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "mock_host.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <vector>
+#include <string.h>
+
+static std::recursive_mutex s_critical;
+void mock_rtos_enter_critical() { s_critical.lock(); }
+void mock_rtos_exit_critical()  { s_critical.unlock(); }
+
+// ===== Queue =====
+struct MockQueue {
+  std::mutex mu;
+  std::condition_variable cv;
+  std::deque<std::vector<uint8_t>> items;
+  size_t length;
+  size_t itemSize;
+};
+
+static bool wait_until(std::unique_lock<std::mutex> &lk, std::condition_variable &cv,
+                       TickType_t wait, const std::function<bool()> &pred) {
+  if (pred()) return true;
+  if (wait == 0) return false;
+  if (wait == portMAX_DELAY) { cv.wait(lk, pred); return true; }
+  return cv.wait_for(lk, std::chrono::milliseconds(wait), pred);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+  MockQueue *q = new MockQueue();
+  q->length = length;
+  q->itemSize = itemSize;
+  return q;
+}
+void vQueueDelete(QueueHandle_t q) { delete q; }
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t wait) {
+  std::unique_lock<std::mutex> lk(q->mu);
+  if (!wait_until(lk, q->cv, wait, [q] { return q->items.size() < q->length; })) return pdFALSE;
+  const uint8_t *p = (const uint8_t *)item;
+  q->items.emplace_back(p, p + q->itemSize);
+  q->cv.notify_all();
+  return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t wait) {
+  std::unique_lock<std::mutex> lk(q->mu);
+  if (!wait_until(lk, q->cv, wait, [q] { return !q->items.empty(); })) return pdFALSE;
+  if (q->itemSize) memcpy(item, q->items.front().data(), q->itemSize);
+  q->items.pop_front();
+  q->cv.notify_all();
+  return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q) {
+  std::lock_guard<std::mutex> lk(q->mu);
+  return (UBaseType_t)q->items.size();
+}
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t q) {
+  std::lock_guard<std::mutex> lk(q->mu);
+  return (UBaseType_t)(q->length - q->items.size());
+}
+BaseType_t xQueueReset(QueueHandle_t q) {
+  std::lock_guard<std::mutex> lk(q->mu);
+  q->items.clear();
+  q->cv.notify_all();
+  return pdTRUE;
+}
+
+// ===== Semaphore =====
+SemaphoreHandle_t xSemaphoreCreateBinary() { return xQueueCreate(1, 0); }
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+  SemaphoreHandle_t s = xQueueCreate(1, 0);
+  xSemaphoreGive(s);
+  return s;
+}
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initial) {
+  SemaphoreHandle_t s = xQueueCreate(maxCount, 0);
+  for (UBaseType_t i = 0; i < initial; i++) xSemaphoreGive(s);
+  return s;
+}
+BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t wait) { return xQueueReceive(s, nullptr, wait); }
+BaseType_t xSemaphoreGive(SemaphoreHandle_t s) { return xQueueSend(s, nullptr, 0); }
+
+// ===== Task + notification =====
+struct MockTask {
+  std::mutex mu;
+  std::condition_variable cv;
+  uint32_t notify = 0;
+};
+
+static thread_local MockTask *t_self = nullptr;
+
+static MockTask *self_task() {
+  if (!t_self) t_self = new MockTask();   // luồng main / luồng host
+  return t_self;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack,
+                                   void *arg, UBaseType_t prio, TaskHandle_t *out, BaseType_t core) {
+  (void)name; (void)stack; (void)prio; (void)core;
+  MockTask *t = new MockTask();
+  if (out) *out = t;
+  std::thread([fn, arg, t] { t_self = t; fn(arg); }).detach();
+  return pdPASS;
+}
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack,
+                       void *arg, UBaseType_t prio, TaskHandle_t *out) {
+  return xTaskCreatePinnedToCore(fn, name, stack, arg, prio, out, 0);
+}
+void vTaskDelete(TaskHandle_t t) {
+  // Chỉ hỗ trợ tự xoá (vTaskDelete(nullptr)) – kết thúc luồng hiện tại
+  if (t == nullptr || t == t_self) {
+    for (;;) std::this_thread::sleep_for(std::chrono::hours(1));
+  }
+}
+void vTaskDelay(TickType_t ticks) { std::this_thread::sleep_for(std::chrono::milliseconds(ticks)); }
+TickType_t xTaskGetTickCount() {
+  static const auto t0 = std::chrono::steady_clock::now();
+  return (TickType_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - t0).count();
+}
+TaskHandle_t xTaskGetCurrentTaskHandle() { return self_task(); }
+
+BaseType_t xTaskNotifyGive(TaskHandle_t t) {
+  if (!t) return pdFAIL;
+  std::lock_guard<std::mutex> lk(t->mu);
+  t->notify++;
+  t->cv.notify_all();
+  return pdPASS;
+}
+void vTaskNotifyGiveFromISR(TaskHandle_t t, BaseType_t *woken) {
+  xTaskNotifyGive(t);
+  if (woken) *woken = pdFALSE;
+}
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t wait) {
+  MockTask *t = self_task();
+  std::unique_lock<std::mutex> lk(t->mu);
+  auto pred = [t] { return t->notify > 0; };
+  if (!pred()) {
+    if (wait == 0) return 0;
+    if (wait == portMAX_DELAY) t->cv.wait(lk, pred);
+    else if (!t->cv.wait_for(lk, std::chrono::milliseconds(wait), pred)) return 0;
+  }
+  uint32_t v = t->notify;
+  t->notify = clearOnExit ? 0 : v - 1;
+  return v;
+}
@@ -0,0 +1,129 @@
+// meblock_ota_delta.cpp
+// Tool máy tính: tạo / áp patch delta (D=) cho OTA BLE của core MEBLOCK.
+// Định dạng patch và bộ áp patch dùng chung với firmware: IOT47_OTA_Delta.h.
+//
+//   meblock_ota_delta diff  <old.bin> <new.bin> <out.patch>
+//   meblock_ota_delta apply [-p <size phân vùng>] <old.bin|app.img> <in.patch> <out.bin>
+//   meblock_ota_delta info  <in.patch>
+//
+// Board áp patch tại chỗ (ảnh cũ nằm ngay trong phân vùng đang ghi, writer giữ lại nội dung
+// cũ của sector vừa ghi đè), nên encoder chỉ cho byte mới ở vị trí p tham chiếu byte cũ ở
+// sector >= sector(p) - 1. "apply" mô phỏng đúng cách ghi đó trên một ảnh phân vùng
+// => patch qua được "apply" thì board cũng áp được.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "meblock_ota_delta.h"
+
+static bool readFile(const char *path, std::vector<uint8_t> &out) {
+  FILE *f = fopen(path, "rb");
+  if (!f) return false;
+  uint8_t buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out.insert(out.end(), buf, buf + n);
+  fclose(f);
+  return true;
+}
+
+static bool writeFile(const char *path, const std::vector<uint8_t> &data) {
+  FILE *f = fopen(path, "wb");
+  if (!f) return false;
+  bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+  fclose(f);
+  return ok;
+}
+
+static void printHash(const char *label, const uint8_t *h) {
+  printf("%s", label);
+  for (int i = 0; i < 32; i++) printf("%02x", h[i]);
+  printf("\n");
+}
+
+static void usage() {
+  fprintf(stderr,
+          "Usage:\n"
+          "  meblock_ota_delta diff  <old.bin> <new.bin> <out.patch>\n"
+          "  meblock_ota_delta apply [-p <partition size>] <old.bin|app.img> <in.patch> <out.bin>\n"
+          "  meblock_ota_delta info  <in.patch>\n");
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) { usage(); return 2; }
+  std::string cmd = argv[1];
+  long partSize = 0;
+  std::vector<const char *> files;
+  for (int i = 2; i < argc; i++) {
+    if (!strcmp(argv[i], "-p") && i + 1 < argc) partSize = strtol(argv[++i], 0, 0);
+    else files.push_back(argv[i]);
+  }
+
+  if (cmd == "info" && files.size() == 1) {
+    std::vector<uint8_t> patch;
+    uint32_t baseSize, newSize;
+    if (!readFile(files[0], patch)) { fprintf(stderr, "Cannot read %s\n", files[0]); return 1; }
+    if (!patchHeader(patch, baseSize, newSize)) { fprintf(stderr, "Not a delta patch\n"); return 1; }
+    printf("patch %zu bytes, base %u bytes, new %u bytes\n", patch.size(), baseSize, newSize);
+    printHash("base sha256 ", &patch[12]);
+    printHash("new  sha256 ", &patch[44]);
+    printf("IOT47_BLE_OTA_BEGIN:%zu;D=%u\n", patch.size(), newSize);
+    return 0;
+  }
+
+  if (files.size() != 3) { usage(); return 2; }
+
+  if (cmd == "diff") {
+    std::vector<uint8_t> oldImg, newImg;
+    if (!readFile(files[0], oldImg)) { fprintf(stderr, "Cannot read %s\n", files[0]); return 1; }
+    if (!readFile(files[1], newImg)) { fprintf(stderr, "Cannot read %s\n", files[1]); return 1; }
+    if (oldImg.empty() || newImg.empty()) { fprintf(stderr, "Empty image\n"); return 1; }
+
+    DeltaEncoder enc(oldImg, newImg);
+    std::vector<uint8_t> patch = enc.encode();
+
+    // tự kiểm tra: áp lại trên ảnh phân vùng chứa ảnh cũ (ghi đè tại chỗ)
+    s_part = oldImg;
+    s_part.resize(std::max(oldImg.size(), newImg.size()) + SECTOR, 0xFF);
+    std::vector<uint8_t> check;
+    uint8_t err;
+    if (!applyPatch(patch, check, err) || check != newImg) {
+      fprintf(stderr, "Self-check failed: %s\n", iot47_delta_strerror(err));
+      return 1;
+    }
+    if (!writeFile(files[2], patch)) { fprintf(stderr, "Cannot write %s\n", files[2]); return 1; }
+    printf("%zu -> %zu bytes (%.1f%% of new image)\n", newImg.size(), patch.size(),
+           100.0 * (double)patch.size() / (double)newImg.size());
+    printf("copy %zu, add %zu, literal %zu bytes\n", enc.copied, enc.added, enc.literal);
+    printf("IOT47_BLE_OTA_BEGIN:%zu;D=%zu\n", patch.size(), newImg.size());
+    return 0;
+  }
+
+  if (cmd == "apply") {
+    std::vector<uint8_t> patch, out;
+    uint32_t baseSize, newSize;
+    if (!readFile(files[0], s_part)) { fprintf(stderr, "Cannot read %s\n", files[0]); return 1; }
+    if (!readFile(files[1], patch)) { fprintf(stderr, "Cannot read %s\n", files[1]); return 1; }
+    if (!patchHeader(patch, baseSize, newSize)) { fprintf(stderr, "Not a delta patch\n"); return 1; }
+    // old.bin ngắn hơn phân vùng => phần còn lại coi như flash đã erase
+    size_t size = partSize > 0 ? (size_t)partSize : std::max<size_t>(s_part.size(), newSize);
+    if (size < newSize) { fprintf(stderr, "Partition too small for new image\n"); return 1; }
+    s_part.resize(size, 0xFF);
+    uint8_t err;
+    if (!applyPatch(patch, out, err)) { fprintf(stderr, "Apply failed: %s\n", iot47_delta_strerror(err)); return 1; }
+    uint8_t hash[32];
+    sha256(out, out.size(), hash);
+    if (memcmp(hash, &patch[44], 32) != 0) { fprintf(stderr, "New image hash mismatch\n"); return 1; }
+    if (!writeFile(files[2], out)) { fprintf(stderr, "Cannot write %s\n", files[2]); return 1; }
+    printf("%zu -> %zu bytes, sha256 ok\n", patch.size(), out.size());
+    return 0;
+  }
+
+  usage();
+  return 2;
+}
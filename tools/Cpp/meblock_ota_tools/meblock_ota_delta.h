@@ -0,0 +1,256 @@
+// meblock_ota_delta.h
+// Encoder patch delta (D=) và bộ áp patch trên ảnh phân vùng (ghi đè tại chỗ từng sector như writer trên board),
+// dùng chung cho meblock_ota_delta (CLI) và meblock_ota_delta_check (kiểm tra). Decoder: IOT47_OTA_Delta.h.
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "IOT47_OTA_Delta.h"
+
+static void sha256(const std::vector<uint8_t> &data, size_t len, uint8_t out[32]) {
+  iot47_sha256_t h;
+  iot47_sha256_init(&h);
+  iot47_sha256_update(&h, data.data(), len);
+  iot47_sha256_final(&h, out);
+}
+
+static void putU32(std::vector<uint8_t> &out, uint32_t v) {
+  for (int i = 0; i < 4; i++) out.push_back((uint8_t)(v >> (8 * i)));
+}
+
+static void putVarint(std::vector<uint8_t> &out, uint32_t v) {
+  while (v >= 0x80) { out.push_back((uint8_t)(v | 0x80)); v >>= 7; }
+  out.push_back((uint8_t)v);
+}
+
+// ===== Encoder: hạt giống khớp chính xác 8 byte (hash chain) rồi nới rộng kiểu bsdiff =====
+static const size_t SECTOR = IOT47_DELTA_SECTOR;
+static const size_t SEED = 8;          // độ dài khớp tối thiểu để mở 1 op
+static const size_t COPY_MIN = 24;     // đoạn khớp chính xác >= ngưỡng này => COPY, ngắn hơn gộp vào ADD
+static const int CHAIN = 48;
+static const size_t FUZZ = 64;         // dừng nới rộng khi điểm không tăng sau FUZZ byte
+
+class DeltaEncoder {
+public:
+  DeltaEncoder(const std::vector<uint8_t> &oldImg, const std::vector<uint8_t> &newImg)
+      : _old(oldImg), _new(newImg) {}
+
+  std::vector<uint8_t> encode() {
+    buildIndex();
+    uint8_t baseHash[32], newHash[32];
+    sha256(_old, _old.size(), baseHash);
+    sha256(_new, _new.size(), newHash);
+    _out.insert(_out.end(), IOT47_DELTA_MAGIC, IOT47_DELTA_MAGIC + 4);
+    putU32(_out, (uint32_t)_old.size());
+    putU32(_out, (uint32_t)_new.size());
+    _out.insert(_out.end(), baseHash, baseHash + 32);
+    _out.insert(_out.end(), newHash, newHash + 32);
+
+    size_t lit = 0, i = 0;
+    while (i + SEED <= _new.size()) {
+      size_t src, len;
+      if (!findSeed(i, src, len)) { i++; continue; }
+      // nới về phía sau (tới hết vùng khớp gần đúng) và về phía trước (ăn bớt literal)
+      len += extendForward(src + len, i + len);
+      size_t back = extendBackward(src, i, i - lit);
+      emitLiteral(lit, i - back);
+      emitRegion(src - back, i - back, len + back);
+      i += len;
+      lit = i;
+    }
+    emitLiteral(lit, _new.size());
+    return _out;
+  }
+
+  size_t copied = 0, added = 0, literal = 0;
+
+private:
+  // byte mới tại p đọc được byte cũ tại s <=> sector s còn trên flash hoặc là sector vừa ghi đè
+  static bool readable(size_t s, size_t p) { return s / SECTOR + 1 >= p / SECTOR; }
+  // số byte tối đa của op bắt đầu (s, p) mà không phạm điều kiện trên
+  static size_t limitFrom(size_t s, size_t p) {
+    if (s + SECTOR >= p) return SIZE_MAX;
+    if (!readable(s, p)) return 0;
+    return (p / SECTOR + 1) * SECTOR - p;     // p sang sector mới trước s
+  }
+
+  static uint32_t hash8(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return (uint32_t)((v * 0x9E3779B97F4A7C15ull) >> 44);   // 20 bit
+  }
+
+  void buildIndex() {
+    _head.assign((size_t)1 << 20, -1);
+    _next.assign(_old.size(), -1);
+    for (size_t s = 0; s + SEED <= _old.size(); s++) {
+      uint32_t h = hash8(&_old[s]);
+      _next[s] = _head[h];
+      _head[h] = (int32_t)s;
+    }
+  }
+
+  bool findSeed(size_t p, size_t &bestSrc, size_t &bestLen) {
+    bestLen = 0;
+    int chain = CHAIN;
+    for (int32_t c = _head[hash8(&_new[p])]; c >= 0 && chain-- > 0; c = _next[c]) {
+      size_t s = (size_t)c;
+      size_t cap = limitFrom(s, p);
+      if (cap < SEED) continue;
+      size_t maxLen = std::min(std::min(_old.size() - s, _new.size() - p), cap);
+      size_t m = 0;
+      while (m < maxLen && _old[s + m] == _new[p + m]) m++;
+      // cùng độ dài: ưu tiên giữ nguyên độ lệch của op trước (code chỉ bị dời)
+      if (m > bestLen || (m == bestLen && m > 0 && dist(s, p) < dist(bestSrc, p))) {
+        bestLen = m;
+        bestSrc = s;
+      }
+    }
+    if (bestLen >= SEED) _lastShift = (long)p - (long)bestSrc;
+    return bestLen >= SEED;
+  }
+
+  size_t dist(size_t s, size_t p) const {
+    long d = (long)p - (long)s - _lastShift;
+    return (size_t)(d < 0 ? -d : d);
+  }
+
+  // bsdiff: chọn độ dài làm 2*khớp - độ_dài lớn nhất
+  size_t extendForward(size_t s, size_t p) {
+    size_t cap = std::min(std::min(_old.size() - s, _new.size() - p), limitFrom(s, p));
+    long score = 0, best = 0;
+    size_t bestLen = 0;
+    for (size_t k = 0; k < cap && k - bestLen < FUZZ; k++) {
+      score += (_old[s + k] == _new[p + k]) ? 1 : -1;
+      if (score > best) { best = score; bestLen = k + 1; }
+    }
+    return bestLen;
+  }
+
+  size_t extendBackward(size_t s, size_t p, size_t maxBack) {
+    long score = 0, best = 0;
+    size_t bestLen = 0;
+    for (size_t k = 1; k <= maxBack && k <= s && k - bestLen < FUZZ; k++) {
+      if (!readable(s - k, p - k)) break;
+      score += (_old[s - k] == _new[p - k]) ? 1 : -1;
+      if (score > best) { best = score; bestLen = k; }
+    }
+    return bestLen;
+  }
+
+  void emitLiteral(size_t from, size_t to) {
+    if (to <= from) return;
+    _out.push_back(IOT47_DELTA_OP_LIT);
+    putVarint(_out, (uint32_t)(to - from));
+    _out.insert(_out.end(), _new.begin() + from, _new.begin() + to);
+    literal += to - from;
+  }
+
+  // Vùng [p, p+len) ứng với ảnh cũ [s, s+len): đoạn khớp dài => COPY, phần còn lại => ADD
+  void emitRegion(size_t s, size_t p, size_t len) {
+    size_t k = 0, addFrom = 0;
+    while (k < len) {
+      if (_old[s + k] != _new[p + k]) { k++; continue; }
+      size_t run = 0;
+      while (k + run < len && _old[s + k + run] == _new[p + k + run]) run++;
+      if (run >= COPY_MIN || (k == 0 && k + run == len)) {
+        emitAdd(s + addFrom, p + addFrom, k - addFrom);
+        emitCopy(s + k, run);
+        addFrom = k + run;
+      }
+      k += run;
+    }
+    emitAdd(s + addFrom, p + addFrom, len - addFrom);
+  }
+
+  void emitCopy(size_t s, size_t len) {
+    if (len == 0) return;
+    _out.push_back(IOT47_DELTA_OP_COPY);
+    putVarint(_out, (uint32_t)s);
+    putVarint(_out, (uint32_t)len);
+    copied += len;
+  }
+
+  void emitAdd(size_t s, size_t p, size_t len) {
+    if (len == 0) return;
+    _out.push_back(IOT47_DELTA_OP_ADD);
+    putVarint(_out, (uint32_t)s);
+    putVarint(_out, (uint32_t)len);
+    for (size_t k = 0; k < len; k++) _out.push_back((uint8_t)(_new[p + k] - _old[s + k]));
+    added += len;
+  }
+
+  const std::vector<uint8_t> &_old;
+  const std::vector<uint8_t> &_new;
+  std::vector<uint8_t> _out;
+  std::vector<int32_t> _head, _next;
+  long _lastShift = 0;
+};
+
+// ===== Áp patch trên ảnh phân vùng, ghi đè từng sector giống writer trên board =====
+static std::vector<uint8_t> s_part;         // "flash" của phân vùng đích
+static std::vector<uint8_t> s_stage;        // sector đang gom
+static std::vector<uint8_t> s_backup;       // nội dung cũ của sector vừa ghi đè
+static size_t s_flushed = 0;
+
+static bool partRead(uint32_t offset, uint8_t *dst, uint32_t len) {
+  if ((size_t)offset + len > s_part.size()) return false;
+  for (uint32_t i = 0; i < len; i++) {
+    size_t at = (size_t)offset + i;
+    if (at >= s_flushed) dst[i] = s_part[at];
+    else if (at + SECTOR >= s_flushed && !s_backup.empty()) dst[i] = s_backup[at + s_backup.size() - s_flushed];
+    else return false;                      // sector đã mất trên board
+  }
+  return true;
+}
+
+static void stageFlush() {
+  if (s_flushed + s_stage.size() > s_part.size()) s_part.resize(s_flushed + s_stage.size(), 0xFF);
+  s_backup.assign(s_part.begin() + s_flushed, s_part.begin() + s_flushed + s_stage.size());
+  memcpy(&s_part[s_flushed], s_stage.data(), s_stage.size());
+  s_flushed += s_stage.size();
+  s_stage.clear();
+}
+
+static bool partSink(const uint8_t *data, uint32_t len) {
+  for (uint32_t i = 0; i < len; i++) {
+    s_stage.push_back(data[i]);
+    if (s_stage.size() == SECTOR) stageFlush();
+  }
+  return true;
+}
+
+static bool applyPatch(const std::vector<uint8_t> &patch, std::vector<uint8_t> &out, uint8_t &err) {
+  s_stage.clear();
+  s_backup.clear();
+  s_flushed = 0;
+  iot47_delta_t *d = new iot47_delta_t;
+  iot47_delta_init(d, 0, partRead, partSink);
+  // đưa vào từng mẩu nhỏ lệch nhau như frame BLE
+  size_t off = 0, step = 1;
+  while (off < patch.size() && d->error == IOT47_DELTA_OK) {
+    size_t n = std::min(step, patch.size() - off);
+    iot47_delta_feed(d, &patch[off], (uint32_t)n);
+    off += n;
+    step = step % 509 + 97;
+  }
+  bool ok = (d->error == IOT47_DELTA_OK) && iot47_delta_done(d);
+  err = d->error;
+  if (ok) {
+    stageFlush();
+    out.assign(s_part.begin(), s_part.begin() + d->new_size);
+  }
+  delete d;
+  return ok;
+}
+
+static bool patchHeader(const std::vector<uint8_t> &patch, uint32_t &baseSize, uint32_t &newSize) {
+  if (patch.size() < IOT47_DELTA_HDR_SIZE || memcmp(patch.data(), IOT47_DELTA_MAGIC, 4) != 0) return false;
+  baseSize = iot47_delta_u32(&patch[4]);
+  newSize = iot47_delta_u32(&patch[8]);
+  return true;
+}
@@ -0,0 +1,146 @@
+// meblock_ota_delta_check.cpp
+// Kiểm tra trên máy tính cho delta OTA (D=): với từng cặp ảnh cũ / mới tạo bằng code, diff => áp patch tại chỗ trên
+// ảnh phân vùng chứa ảnh cũ (ghi đè từng sector 4KB như writer trên board, patch đưa vào theo mẩu lệch nhau như
+// frame BLE) => so từng byte với ảnh mới. Các cặp:
+//   - chèn 300 byte + sửa rải rác (bản build mới thường gặp), xoá 5000 byte, đổi chỗ 2 khối 20KB
+//   - ảnh mới dài / ngắn hơn 64KB, ảnh không liên quan, ảnh giống hệt, ảnh nhỏ hơn 1 sector
+// Thêm:
+//   - phân vùng không chứa đúng ảnh cũ (sai 1 byte) => IOT47_DELTA_ERR_BASE, chưa ghi sector nào
+//   - patch bị cắt giữa chừng (mất kết nối) => không xong, và ảnh cũ trong phân vùng đã bị ghi đè
+//     (lý do D= không resume được và board chỉ còn core factory, xem README của arduino_ble_ota)
+//
+//   meblock_ota_delta_check [-s <seed>]
+//
+// Exit code 0 khi mọi kiểm tra đạt => dùng được trong CI.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "meblock_ota_delta.h"
+
+static const size_t kImageSize = 600000;
+static int s_failed = 0;
+
+static void check(bool ok, const std::string &what) {
+  printf("%-4s %s\n", ok ? "OK" : "FAIL", what.c_str());
+  if (!ok) s_failed++;
+}
+
+// Ảnh giống firmware: các đoạn lặp lại (bảng, chuỗi) xen dữ liệu ngẫu nhiên
+static std::vector<uint8_t> makeImage(std::mt19937 &rng, size_t size) {
+  std::vector<uint8_t> img(size);
+  for (size_t i = 0; i < size;) {
+    size_t run = 16 + rng() % 512;
+    if (rng() % 3 == 0 && i > 4096) {
+      size_t from = rng() % (i - run / 2 - 1);
+      for (size_t k = 0; k < run && i < size; k++, i++) img[i] = img[from + k];
+    } else {
+      for (size_t k = 0; k < run && i < size; k++, i++) img[i] = (uint8_t)rng();
+    }
+  }
+  img[0] = 0xE9;   // magic ảnh app ESP32
+  return img;
+}
+
+// Phân vùng đủ chỗ cho cả 2 ảnh, phần sau ảnh cũ là flash đã erase
+static void loadPartition(const std::vector<uint8_t> &oldImg, size_t newSize) {
+  s_part = oldImg;
+  s_part.resize(std::max(oldImg.size(), newSize) + SECTOR, 0xFF);
+}
+
+static void roundTrip(const char *name, const std::vector<uint8_t> &oldImg, const std::vector<uint8_t> &newImg) {
+  DeltaEncoder enc(oldImg, newImg);
+  std::vector<uint8_t> patch = enc.encode();
+  loadPartition(oldImg, newImg.size());
+  std::vector<uint8_t> out;
+  uint8_t err = IOT47_DELTA_OK;
+  bool ok = applyPatch(patch, out, err);
+  char line[160];
+  snprintf(line, sizeof(line), "%-18s %7zu -> %7zu B, patch %7zu B: %s", name, oldImg.size(), newImg.size(),
+           patch.size(), ok ? (out == newImg ? "matches the new image" : "DIFFERS from the new image")
+                            : iot47_delta_strerror(err));
+  check(ok && out == newImg, line);
+}
+
+int main(int argc, char **argv) {
+  uint32_t seed = 1;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-s") && i + 1 < argc) seed = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    else {
+      fprintf(stderr, "usage: %s [-s seed]\n", argv[0]);
+      return 2;
+    }
+  }
+  std::mt19937 rng(seed);
+  std::vector<uint8_t> base = makeImage(rng, kImageSize);
+
+  {
+    std::vector<uint8_t> n = base;
+    std::vector<uint8_t> ins(300);
+    for (auto &b : ins) b = (uint8_t)rng();
+    n.insert(n.begin() + 200000, ins.begin(), ins.end());
+    for (int k = 0; k < 200; k++) {
+      size_t at = 4 + rng() % (n.size() - 8);
+      uint32_t v = rng();
+      memcpy(&n[at], &v, 4);   // địa chỉ / hằng số đổi sau khi code dời
+    }
+    roundTrip("insert + edits", base, n);
+  }
+  {
+    std::vector<uint8_t> n = base;
+    n.erase(n.begin() + 300000, n.begin() + 305000);
+    roundTrip("delete 5000", base, n);
+  }
+  {
+    std::vector<uint8_t> n = base;
+    std::swap_ranges(n.begin() + 100000, n.begin() + 120000, n.begin() + 400000);
+    roundTrip("swap 2 x 20KB", base, n);
+  }
+  {
+    std::vector<uint8_t> n = base, tail = makeImage(rng, 65536);
+    n.insert(n.end(), tail.begin(), tail.end());
+    roundTrip("grow 64KB", base, n);
+  }
+  roundTrip("shrink 64KB", base, std::vector<uint8_t>(base.begin(), base.end() - 65536));
+  roundTrip("unrelated", base, makeImage(rng, kImageSize));
+  roundTrip("identical", base, base);
+  {
+    std::vector<uint8_t> small(base.begin(), base.begin() + 1000), n = small;
+    n[500] ^= 0x5A;
+    roundTrip("< 1 sector", small, n);
+  }
+
+  // Phân vùng không chứa đúng ảnh cũ: board trả FAIL:BASE trước khi ghi
+  std::vector<uint8_t> next = base;
+  for (size_t i = 1000; i < next.size(); i += 7919) next[i] ^= 0xFF;
+  std::vector<uint8_t> patch = DeltaEncoder(base, next).encode();
+  {
+    std::vector<uint8_t> wrong = base;
+    wrong[kImageSize / 2] ^= 1;
+    loadPartition(wrong, next.size());
+    std::vector<uint8_t> before = s_part, out;
+    uint8_t err = IOT47_DELTA_OK;
+    bool ok = applyPatch(patch, out, err);
+    check(!ok && err == IOT47_DELTA_ERR_BASE && s_part == before,
+          "wrong base image: ERR_BASE, partition untouched");
+  }
+
+  // Mất kết nối giữa chừng: không resume được, ảnh cũ đã mất một phần
+  {
+    std::vector<uint8_t> half(patch.begin(), patch.begin() + patch.size() / 2);
+    loadPartition(base, next.size());
+    std::vector<uint8_t> out;
+    uint8_t err = IOT47_DELTA_OK;
+    bool ok = applyPatch(half, out, err);
+    bool oldGone = memcmp(s_part.data(), base.data(), SECTOR) != 0;
+    check(!ok && oldGone, "half a patch: not done, the old image is already overwritten");
+  }
+
+  return s_failed ? 1 : 0;
+}
@@ -0,0 +1,198 @@
+// meblock_ota_pack.cpp
+// Tool máy tính: nén ảnh firmware (.bin) cho chế độ OTA nén (Z=1) của core MEBLOCK.
+// Bitstream LZSS tương thích heatshrink (giải nén trên board bằng IOT47_OTA_Lzss.h).
+//
+//   meblock_ota_pack compress   [-w 11] [-l 5] <in.bin> <out.lz>
+//   meblock_ota_pack decompress [-w 11] [-l 5] -n <size gốc> <in.lz> <out.bin>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "IOT47_OTA_Lzss.h"
+
+static bool readFile(const char *path, std::vector<uint8_t> &out) {
+  FILE *f = fopen(path, "rb");
+  if (!f) return false;
+  uint8_t buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out.insert(out.end(), buf, buf + n);
+  fclose(f);
+  return true;
+}
+
+static bool writeFile(const char *path, const std::vector<uint8_t> &data) {
+  FILE *f = fopen(path, "wb");
+  if (!f) return false;
+  bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+  fclose(f);
+  return ok;
+}
+
+// ===== Bit writer (MSB trước, giống heatshrink) =====
+class BitWriter {
+public:
+  explicit BitWriter(std::vector<uint8_t> &out) : _out(out) {}
+  void put(uint32_t value, uint8_t bits) {
+    while (bits--) {
+      _cur = (uint8_t)((_cur << 1) | ((value >> bits) & 1));
+      if (++_n == 8) { _out.push_back(_cur); _cur = 0; _n = 0; }
+    }
+  }
+  void finish() {
+    if (_n) { _out.push_back((uint8_t)(_cur << (8 - _n))); _cur = 0; _n = 0; }
+  }
+private:
+  std::vector<uint8_t> &_out;
+  uint8_t _cur = 0;
+  uint8_t _n = 0;
+};
+
+// ===== Encoder: greedy + lazy 1 bước, hash chain 3 byte =====
+static std::vector<uint8_t> lzssCompress(const std::vector<uint8_t> &in, uint8_t wbits, uint8_t lbits) {
+  const size_t maxOff = (size_t)1 << wbits;
+  const size_t maxLen = (size_t)1 << lbits;
+  const size_t minLen = (1 + wbits + lbits) / 9 + 1;   // ngắn hơn thì literal rẻ hơn
+  const size_t HASH = 1 << 16;
+  const int maxChain = 256;
+
+  std::vector<int32_t> head(HASH, -1), prev(in.size(), -1);
+  auto hashAt = [&](size_t i) -> size_t {
+    return ((in[i] << 8) ^ (in[i + 1] << 4) ^ in[i + 2]) & (HASH - 1);
+  };
+  auto insert = [&](size_t i) {
+    if (i + 2 >= in.size()) return;
+    size_t h = hashAt(i);
+    prev[i] = head[h];
+    head[h] = (int32_t)i;
+  };
+  auto longest = [&](size_t i, size_t &bestOff) -> size_t {
+    size_t best = 0;
+    if (i + 2 >= in.size()) return 0;
+    size_t limit = std::min(maxLen, in.size() - i);
+    int32_t c = head[hashAt(i)];
+    for (int chain = 0; c >= 0 && chain < maxChain; chain++, c = prev[c]) {
+      size_t off = i - (size_t)c;
+      if (off > maxOff) break;
+      size_t l = 0;
+      while (l < limit && in[c + l] == in[i + l]) l++;
+      if (l > best) { best = l; bestOff = off; if (l == limit) break; }
+    }
+    return best;
+  };
+
+  std::vector<uint8_t> out;
+  BitWriter bw(out);
+  size_t i = 0;
+  while (i < in.size()) {
+    size_t off = 0;
+    size_t len = longest(i, off);
+    if (len >= minLen && i + 1 < in.size()) {
+      // lazy: nếu vị trí kế tiếp cho match dài hơn thì ghi literal trước
+      insert(i);
+      size_t off2 = 0;
+      size_t len2 = longest(i + 1, off2);
+      if (len2 > len) {
+        bw.put(1, 1);
+        bw.put(in[i], 8);
+        i++;
+        continue;
+      }
+      bw.put(0, 1);
+      bw.put((uint32_t)(off - 1), wbits);
+      bw.put((uint32_t)(len - 1), lbits);
+      for (size_t k = 1; k < len; k++) insert(i + k);
+      i += len;
+    } else {
+      insert(i);
+      bw.put(1, 1);
+      bw.put(in[i], 8);
+      i++;
+    }
+  }
+  bw.finish();
+  return out;
+}
+
+static std::vector<uint8_t> *s_decOut = nullptr;
+static bool decSink(const uint8_t *data, uint32_t len) {
+  s_decOut->insert(s_decOut->end(), data, data + len);
+  return true;
+}
+
+static bool lzssDecompress(const std::vector<uint8_t> &in, uint8_t wbits, uint8_t lbits,
+                           uint32_t outSize, std::vector<uint8_t> &out) {
+  iot47_lzss_t z;
+  out.clear();
+  s_decOut = &out;
+  if (!iot47_lzss_init(&z, wbits, lbits, outSize, decSink)) return false;
+  // đưa vào theo mẩu nhỏ như các frame BLE
+  for (size_t off = 0; off < in.size(); off += 244) {
+    size_t n = std::min<size_t>(244, in.size() - off);
+    if (!iot47_lzss_feed(&z, &in[off], (uint32_t)n)) break;
+  }
+  bool ok = iot47_lzss_done(&z) && out.size() == outSize;
+  iot47_lzss_free(&z);
+  return ok;
+}
+
+static void usage() {
+  fprintf(stderr,
+          "Usage:\n"
+          "  meblock_ota_pack compress   [-w 11] [-l 5] <in.bin> <out.lz>\n"
+          "  meblock_ota_pack decompress [-w 11] [-l 5] -n <size> <in.lz> <out.bin>\n");
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) { usage(); return 2; }
+  std::string cmd = argv[1];
+  int w = 11, l = 5;
+  long n = -1;
+  std::vector<const char *> files;
+  for (int i = 2; i < argc; i++) {
+    if (!strcmp(argv[i], "-w") && i + 1 < argc) w = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-l") && i + 1 < argc) l = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-n") && i + 1 < argc) n = atol(argv[++i]);
+    else files.push_back(argv[i]);
+  }
+  if (files.size() != 2 || w < IOT47_LZSS_W_MIN || w > IOT47_LZSS_W_MAX || l < IOT47_LZSS_L_MIN || l >= w) {
+    usage();
+    return 2;
+  }
+
+  std::vector<uint8_t> in;
+  if (!readFile(files[0], in)) { fprintf(stderr, "Cannot read %s\n", files[0]); return 1; }
+
+  if (cmd == "compress") {
+    std::vector<uint8_t> packed = lzssCompress(in, (uint8_t)w, (uint8_t)l);
+    std::vector<uint8_t> check;
+    if (!lzssDecompress(packed, (uint8_t)w, (uint8_t)l, (uint32_t)in.size(), check) || check != in) {
+      fprintf(stderr, "Self-check failed: decompressed image differs\n");
+      return 1;
+    }
+    if (!writeFile(files[1], packed)) { fprintf(stderr, "Cannot write %s\n", files[1]); return 1; }
+    printf("%zu -> %zu bytes (%.1f%%)\n", in.size(), packed.size(),
+           in.empty() ? 0.0 : 100.0 * (double)packed.size() / (double)in.size());
+    printf("IOT47_BLE_OTA_BEGIN:%zu;Z=1;U=%zu;ZW=%d;ZL=%d\n", packed.size(), in.size(), w, l);
+    return 0;
+  }
+
+  if (cmd == "decompress") {
+    if (n < 0) { usage(); return 2; }
+    std::vector<uint8_t> out;
+    if (!lzssDecompress(in, (uint8_t)w, (uint8_t)l, (uint32_t)n, out)) {
+      fprintf(stderr, "Decompress failed (truncated stream or wrong -w/-l/-n)\n");
+      return 1;
+    }
+    if (!writeFile(files[1], out)) { fprintf(stderr, "Cannot write %s\n", files[1]); return 1; }
+    printf("%zu -> %zu bytes\n", in.size(), out.size());
+    return 0;
+  }
+
+  usage();
+  return 2;
+}